@@ -0,0 +1,63 @@
+"""Creates /AerosimConnector/Materials/PostProcess/PP_SemanticStencil, the post
+process material of the segmentation camera (ASegmentationCameraSensor).
+
+It replaces the tonemapper and outputs CustomStencil / 255 in red, 0 in green
+and blue. The camera renders into a linear (non-sRGB) BGRA8 target, so the red
+byte of each pixel is the stencil value, i.e. the ObjectLabel of the actor.
+
+Run it once from the editor, e.g. the Output Log in Python mode:
+    py create_semantic_stencil_material.py
+then submit the saved asset with the plugin Content.
+"""
+
+import unreal
+
+PACKAGE_PATH = "/AerosimConnector/Materials/PostProcess"
+ASSET_NAME = "PP_SemanticStencil"
+
+
+def _blendable_location_replacing_tonemapper():
+    # The Python name of the enum value differs between engine versions.
+    for name in ("BL_REPLACING_TONEMAPPER", "REPLACING_TONEMAPPER", "BL_ReplacingTonemapper"):
+        if hasattr(unreal.BlendableLocation, name):
+            return getattr(unreal.BlendableLocation, name)
+    raise RuntimeError("No replacing tonemapper blendable location in this engine")
+
+
+def create_semantic_stencil_material():
+    asset_path = "{}/{}".format(PACKAGE_PATH, ASSET_NAME)
+    if unreal.EditorAssetLibrary.does_asset_exist(asset_path):
+        unreal.EditorAssetLibrary.delete_asset(asset_path)
+
+    asset_tools = unreal.AssetToolsHelpers.get_asset_tools()
+    material = asset_tools.create_asset(ASSET_NAME, PACKAGE_PATH, unreal.Material, unreal.MaterialFactoryNew())
+    material.set_editor_property("material_domain", unreal.MaterialDomain.MD_POST_PROCESS)
+    material.set_editor_property("blendable_location", _blendable_location_replacing_tonemapper())
+
+    editing = unreal.MaterialEditingLibrary
+    stencil = editing.create_material_expression(material, unreal.MaterialExpressionSceneTexture, -700, 0)
+    stencil.set_editor_property("scene_texture_id", unreal.SceneTextureId.PPI_CUSTOM_STENCIL)
+
+    red = editing.create_material_expression(material, unreal.MaterialExpressionComponentMask, -450, 0)
+    red.set_editor_property("r", True)
+    red.set_editor_property("g", False)
+    red.set_editor_property("b", False)
+    red.set_editor_property("a", False)
+    editing.connect_material_expressions(stencil, "Color", red, "")
+
+    # Stencil values are integers, scaled so the 8-bit target stores them as is.
+    to_red = editing.create_material_expression(material, unreal.MaterialExpressionConstant3Vector, -450, 200)
+    to_red.set_editor_property("constant", unreal.LinearColor(1.0 / 255.0, 0.0, 0.0, 0.0))
+
+    scaled = editing.create_material_expression(material, unreal.MaterialExpressionMultiply, -200, 0)
+    editing.connect_material_expressions(red, "", scaled, "A")
+    editing.connect_material_expressions(to_red, "", scaled, "B")
+    editing.connect_material_property(scaled, "", unreal.MaterialProperty.MP_EMISSIVE_COLOR)
+
+    editing.recompile_material(material)
+    unreal.EditorAssetLibrary.save_asset(asset_path)
+    unreal.log("Saved {}".format(asset_path))
+
+
+if __name__ == "__main__":
+    create_semantic_stencil_material()
@@ -50,6 +50,8 @@ public class AerosimConnector : ModuleRules
 				"USDUtilities",
 				"RenderCore",
 				"ImageWriteQueue",
+				"ImageWrapper",
+				"Projects",
 				// ... add private dependencies that you statically link with here ...
 			}
 			);
@@ -61,5 +63,8 @@ public class AerosimConnector : ModuleRules
 			}
 			);
 		bEnableExceptions = true;
+
+		// Local tileset streamed by aerosim.Tileset.CheckLocal without network access
+		RuntimeDependencies.Add(Path.Combine(PluginDirectory, "Resources", "SampleTileset", "*"));
 	}
 }
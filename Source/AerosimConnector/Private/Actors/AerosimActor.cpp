@@ -41,6 +41,21 @@ void AAerosimActor::Tick(float DeltaTime)
 	Super::Tick(DeltaTime);
 }
 
+void AAerosimActor::ApplySemanticStencil()
+{
+	const ObjectLabel Label = SemanticTags.IsEmpty() || SemanticTags[0] == ObjectLabel::Any ? ObjectLabel::None : SemanticTags[0];
+	const bool bRenderCustomDepth = Label != ObjectLabel::None;
+
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(this);
+	for (UPrimitiveComponent* Primitive : Primitives)
+	{
+		if (Primitive->bRenderCustomDepth != bRenderCustomDepth)
+			Primitive->SetRenderCustomDepth(bRenderCustomDepth);
+		if (Primitive->CustomDepthStencilValue != (int32)Label)
+			Primitive->SetCustomDepthStencilValue((int32)Label);
+	}
+}
+
 USceneComponent* AAerosimActor::GetChildrenActorByChildName(const FString& ChildNameToSearch)
 {
 	USceneComponent* Result = GetGeneratedComponent(ChildNameToSearch);
@@ -137,14 +152,22 @@ void AAerosimActor::UpdateTrajectoryVisualizerFutureTrajectory(const TArray<FVec
 	TrajectoryVisualizerComponent->UpdateFutureTrajectory(Waypoints);
 }
 
-void AAerosimActor::UpdateTrajectoryVisualizerSettings(bool bDisplayFutureTrajectory, bool bDisplayPastWaypoints, bool bHighlightUserDefinedWaypoints, uint32 NumberOfFutureWaypoints)
+void AAerosimActor::UpdateTrajectoryVisualizerSettings(const FTrajectoryVisualizationSettingsData& Settings)
 {
 	if (!IsValid(TrajectoryVisualizerComponent))
 	{
 		UE_LOG(LogAerosimConnector, Error, TEXT("TrajectoryVisualizerComponent is not valid"));
 		return;
 	}
-	TrajectoryVisualizerComponent->UpdateSettings(bDisplayFutureTrajectory, bDisplayPastWaypoints, bHighlightUserDefinedWaypoints, NumberOfFutureWaypoints);
+	TrajectoryVisualizerComponent->UpdateSettings(Settings);
+}
+
+void AAerosimActor::RebaseTrajectoryVisualizer(const FTransform& OldToNew)
+{
+	if (IsValid(TrajectoryVisualizerComponent))
+	{
+		TrajectoryVisualizerComponent->Rebase(OldToNew);
+	}
 }
 
 void AAerosimActor::SetWidgetID(int Id)
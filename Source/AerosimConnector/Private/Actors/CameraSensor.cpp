@@ -1,9 +1,12 @@
 #include "Actors/CameraSensor.h"
 #include "Render/ImageUtil.h"
+#include "Render/ImagePublisher.h"
+#include "Render/SensorRecorder.h"
 #include "Engine/SceneCapture2D.h"
 #include "Components/SceneCaptureComponent2D.h"
 #include "Serialization/BufferArchive.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "Game/Subsystems/RenderTargetPool.h"
 #include "Util/MessageHandler.h"
 
 ACameraSensor::ACameraSensor()
@@ -19,17 +22,36 @@ void ACameraSensor::BeginPlay()
 	SceneCaptureActor->AttachToComponent(RootComponent, FAttachmentTransformRules::SnapToTargetIncludingScale);
 	USceneCaptureComponent2D* SceneCaptureComponent = SceneCaptureActor->GetCaptureComponent2D();
 
-	RenderTarget = NewObject<UTextureRenderTarget2D>();
-	// TODO: Parametrize Pixelformat and LinearGamma
-	RenderTarget->InitCustomFormat(Resolution.X, Resolution.Y, EPixelFormat::PF_B8G8R8A8, true); // true=force Linear Gamma
-	RenderTarget->UpdateResourceImmediate();
+	// The render target is borrowed once the resolution is known, see InitRenderTarget.
+	RenderTargetPool = URenderTargetPool::Get(GetWorld());
 
 	// TODO: Decide when we want to get the frame
 	SceneCaptureComponent->CaptureSource = SCS_FinalColorLDR;
-	SceneCaptureComponent->TextureTarget = RenderTarget;
 	SceneCaptureComponent->bCaptureEveryFrame = false;
 	SceneCaptureComponent->bCaptureOnMovement = false;
 	SceneCaptureComponent->bAlwaysPersistRenderingState = true;
+
+	PublishStreamId = FImagePublisher::Get().RegisterStream(GetName(), TEXT("aerosim.renderer.responses"), FImageStreamSettings());
+}
+
+void ACameraSensor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	FImagePublisher::Get().UnregisterStream(PublishStreamId);
+	PublishStreamId = INDEX_NONE;
+	FSensorRecorder::Get().StopRecording(RecordingId);
+	RecordingId = INDEX_NONE;
+
+	if (IsValid(SceneCaptureActor))
+	{
+		SceneCaptureActor->GetCaptureComponent2D()->TextureTarget = nullptr;
+	}
+	if (IsValid(RenderTargetPool))
+	{
+		RenderTargetPool->Release(RenderTarget);
+	}
+	RenderTarget = nullptr;
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void ACameraSensor::SetCaptureEnabled(bool bCaptureEnabledIn)
@@ -37,6 +59,56 @@ void ACameraSensor::SetCaptureEnabled(bool bCaptureEnabledIn)
 	bCaptureEnabled = bCaptureEnabledIn;
 }
 
+void ACameraSensor::InitRenderTarget(FIntPoint Size)
+{
+	const EPixelFormat Format = RenderTargetFormat;
+	const bool bForceLinearGamma = true;
+	if (IsValid(RenderTarget) && RenderTarget->SizeX == Size.X && RenderTarget->SizeY == Size.Y && RenderTarget->OverrideFormat == Format)
+	{
+		return;
+	}
+
+	UTextureRenderTarget2D* PreviousRenderTarget = RenderTarget;
+	if (IsValid(RenderTargetPool))
+	{
+		RenderTarget = RenderTargetPool->Acquire(Size, Format, bForceLinearGamma);
+	}
+	else
+	{
+		// Outside of the Aerosim game mode there is no pool to share targets with.
+		RenderTarget = NewObject<UTextureRenderTarget2D>(this);
+		RenderTarget->InitCustomFormat(Size.X, Size.Y, Format, bForceLinearGamma);
+		RenderTarget->UpdateResourceImmediate();
+	}
+	Resolution = FVector2D(Size.X, Size.Y);
+	SceneCaptureActor->GetCaptureComponent2D()->TextureTarget = RenderTarget;
+
+	if (PreviousRenderTarget != nullptr && IsValid(RenderTargetPool))
+	{
+		RenderTargetPool->Release(PreviousRenderTarget);
+	}
+}
+
+void ACameraSensor::SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings)
+{
+	FImagePublisher::Get().UpdateStream(PublishStreamId, Label, Settings);
+}
+
+void ACameraSensor::SetRecording(bool bEnable, const FString& SensorId, const FSensorRecordingSettings& Settings)
+{
+	// A recording that failed to start is not retried until the settings change.
+	const bool bRecording = RecordingId != INDEX_NONE || bRecordingStartFailed;
+	if (bRecording == bEnable && (!bEnable || RecordingSettings == Settings))
+	{
+		return;
+	}
+
+	FSensorRecorder::Get().StopRecording(RecordingId);
+	RecordingId = bEnable ? FSensorRecorder::Get().StartRecording(SensorId, Settings) : INDEX_NONE;
+	bRecordingStartFailed = bEnable && RecordingId == INDEX_NONE;
+	RecordingSettings = Settings;
+}
+
 // Called every frame
 void ACameraSensor::Tick(float DeltaTime)
 {
@@ -44,6 +116,11 @@ void ACameraSensor::Tick(float DeltaTime)
 
 	if (bCaptureEnabled)
 	{
+		if (RenderTarget == nullptr)
+		{
+			// Not configured from the scene graph, e.g. placed in the level.
+			InitRenderTarget(FIntPoint(Resolution.X, Resolution.Y));
+		}
 		SceneCaptureActor->GetCaptureComponent2D()->CaptureScene();
 		GetCurrentFrame();
 	}
@@ -58,9 +135,35 @@ void ACameraSensor::GetCurrentFrame()
 	//             Done, from 2fps avg to 25fps avg
 	// 2. Use Multi-threading to get the image data
 	// 3. Split the image in chunks
-	ImageUtil::ReadSensorDataAsyncRaw(this, [this](const void* Mapping, FIntPoint Size) -> bool {
+	// 4. Publish straight from the mapped readback buffer, letting the transport
+	//    deal with the row pitch instead of repacking every frame.
+	// 5. Hand the frame over to the publisher thread, the readback stays locked
+	//    until the frame is published or dropped.
+	// The pose and sim time are taken now, the frame reaches the recorder a few
+	// frames later once it has been read back.
+	FRecordedFrameMetadata Metadata;
+	if (RecordingId != INDEX_NONE)
+	{
+		Metadata.SimTime = FSensorRecorder::Get().GetSimTime();
+		Metadata.Pose = GetActorTransform();
+	}
+	ImageUtil::ReadSensorDataAsyncLease(this, [StreamId = PublishStreamId, RecordingId = RecordingId, Metadata](const void* Mapping, int32 RowStride, FIntPoint Size, EPixelFormat Format, TUniqueFunction<void()>&& Release) {
 		TRACE_CPUPROFILER_EVENT_SCOPE(ACameraSensor::RetrieveDataAndPublish);
-		publish_image_to_topic("aerosim.renderer.responses", Size.X, Size.Y, 1, Mapping, Size.X * Size.Y * 4);
-		return true;
+		if (Mapping == nullptr)
+		{
+			return;
+		}
+		TUniquePtr<FImageFrame> Frame = MakeUnique<FImageFrame>();
+		Frame->View.Data = (const uint8*)Mapping;
+		Frame->View.RowStride = RowStride;
+		Frame->View.BytesPerPixel = GPixelFormats[Format].BlockBytes;
+		Frame->View.Size = Size;
+		Frame->Release = MoveTemp(Release);
+		if (RecordingId != INDEX_NONE)
+		{
+			// Copied before the publisher takes ownership of the mapping.
+			FSensorRecorder::Get().RecordFrame(RecordingId, Frame->View, Format, Metadata);
+		}
+		FImagePublisher::Get().Submit(StreamId, MoveTemp(Frame));
 	});
 }
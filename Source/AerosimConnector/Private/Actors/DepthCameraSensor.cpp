@@ -0,0 +1,148 @@
+#include "Actors/DepthCameraSensor.h"
+#include "AerosimConnector.h"
+#include "Render/ImageUtil.h"
+#include "Render/ImagePublisher.h"
+#include "Render/SensorRecorder.h"
+#include "Async/ParallelFor.h"
+#include "Engine/SceneCapture2D.h"
+#include "Components/SceneCaptureComponent2D.h"
+
+// Scene depth is rendered in centimeters.
+static constexpr float CentimetersPerMeter = 100.0f;
+
+// Far end of the 16-bit range when neither a depth range nor a far clip is set.
+static constexpr float DefaultQuantizedFarMeters = 1000.0f;
+
+static void DepthToMetersRow(const float* In, float* Out, int32 Width)
+{
+	for (int32 X = 0; X < Width; ++X)
+	{
+		Out[X] = In[X] * (1.0f / CentimetersPerMeter);
+	}
+}
+
+static void QuantizeDepthRow(const float* In, uint16* Out, int32 Width, float Offset, float Scale)
+{
+	for (int32 X = 0; X < Width; ++X)
+	{
+		Out[X] = (uint16)FMath::Clamp((In[X] - Offset) * Scale + 0.5f, 0.0f, 65535.0f);
+	}
+}
+
+ADepthCameraSensor::ADepthCameraSensor()
+{
+	RenderTargetFormat = PF_R32_FLOAT;
+}
+
+void ADepthCameraSensor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	USceneCaptureComponent2D* SceneCaptureComponent = SceneCaptureActor->GetCaptureComponent2D();
+	SceneCaptureComponent->CaptureSource = SCS_SceneDepth;
+	SetClipPlanes(NearClip, FarClip);
+}
+
+void ADepthCameraSensor::SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings)
+{
+	// Resizing, repacking and JPEG all assume 8-bit color. The frames carry
+	// their R32F or R16 layout, so they always get a header, even uncompressed.
+	FImageStreamSettings DepthSettings = Settings;
+	DepthSettings.Layout = EPixelLayout::BGRA8;
+	DepthSettings.OutputSize = FIntPoint::ZeroValue;
+	DepthSettings.Downscale = 1;
+	if (DepthSettings.Encode.Codec == EImageCodec::JPEG)
+	{
+		DepthSettings.Encode.Codec = EImageCodec::LZ4;
+	}
+	Super::SetPublishSettings(Label, DepthSettings);
+}
+
+void ADepthCameraSensor::SetClipPlanes(float NearClipIn, float FarClipIn)
+{
+	NearClip = NearClipIn;
+	FarClip = FarClipIn;
+	if (!IsValid(SceneCaptureActor))
+	{
+		return;
+	}
+
+	USceneCaptureComponent2D* SceneCaptureComponent = SceneCaptureActor->GetCaptureComponent2D();
+	SceneCaptureComponent->bOverride_CustomNearClippingPlane = NearClip > 0.0f;
+	SceneCaptureComponent->CustomNearClippingPlane = NearClip * CentimetersPerMeter;
+	SceneCaptureComponent->MaxViewDistanceOverride = FarClip > 0.0f ? FarClip * CentimetersPerMeter : -1.0f;
+}
+
+void ADepthCameraSensor::SetDepthEncoding(EDepthEncoding EncodingIn, FVector2D RangeIn)
+{
+	Encoding = EncodingIn;
+	Range = RangeIn;
+	if (Encoding == EDepthEncoding::UInt16 && Range.Y <= Range.X && FarClip <= 0.0f)
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Depth camera %s: uint16 depth without a depth range or far clip, quantizing up to %.0f m"),
+			*GetName(), DefaultQuantizedFarMeters);
+	}
+}
+
+FVector2D ADepthCameraSensor::GetQuantizedRange() const
+{
+	if (Range.Y > Range.X)
+	{
+		return Range;
+	}
+	const float Far = FarClip > 0.0f ? FarClip : DefaultQuantizedFarMeters;
+	return FVector2D(NearClip, FMath::Max(Far, NearClip + 1.0f));
+}
+
+void ADepthCameraSensor::GetCurrentFrame()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(ADepthCameraSensor::GetCurrentFrame);
+
+	FRecordedFrameMetadata Metadata;
+	if (RecordingId != INDEX_NONE)
+	{
+		Metadata.SimTime = FSensorRecorder::Get().GetSimTime();
+		Metadata.Pose = GetActorTransform();
+	}
+
+	const FVector2D QuantizedRange = GetQuantizedRange();
+	const float Offset = QuantizedRange.X * CentimetersPerMeter;
+	const float Scale = 65535.0f / FMath::Max((QuantizedRange.Y - QuantizedRange.X) * CentimetersPerMeter, UE_KINDA_SMALL_NUMBER);
+
+	// Depth is converted to meters (or quantized) on the readback worker, the
+	// readback is released right after and the publisher gets the converted copy.
+	ImageUtil::ReadSensorDataAsyncLease(this, [StreamId = PublishStreamId, RecordingId = RecordingId, Metadata, Encoding = Encoding, Offset, Scale](const void* Mapping, int32 RowStride, FIntPoint Size, EPixelFormat Format, TUniqueFunction<void()>&& Release) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(ADepthCameraSensor::RetrieveDataAndPublish);
+		if (Format != PF_R32_FLOAT)
+		{
+			Release();
+			return;
+		}
+
+		const int32 BytesPerPixel = Encoding == EDepthEncoding::UInt16 ? sizeof(uint16) : sizeof(float);
+		const int32 OutStride = Size.X * BytesPerPixel;
+		TArray64<uint8> Pixels;
+		Pixels.SetNumUninitialized((int64)OutStride * Size.Y);
+		ParallelFor(Size.Y, [&](int32 Y) {
+			const float* In = (const float*)((const uint8*)Mapping + (int64)Y * RowStride);
+			uint8* Out = Pixels.GetData() + (int64)Y * OutStride;
+			if (Encoding == EDepthEncoding::UInt16)
+			{
+				QuantizeDepthRow(In, (uint16*)Out, Size.X, Offset, Scale);
+			}
+			else
+			{
+				DepthToMetersRow(In, (float*)Out, Size.X);
+			}
+		});
+		Release();
+
+		TUniquePtr<FImageFrame> Frame = FImageFrame::MakeOwning(MoveTemp(Pixels), Size, BytesPerPixel,
+			Encoding == EDepthEncoding::UInt16 ? EPixelLayout::R16 : EPixelLayout::R32F);
+		if (RecordingId != INDEX_NONE)
+		{
+			FSensorRecorder::Get().RecordFrame(RecordingId, Frame->View, Encoding == EDepthEncoding::UInt16 ? PF_G16 : PF_R32_FLOAT, Metadata);
+		}
+		FImagePublisher::Get().Submit(StreamId, MoveTemp(Frame));
+	});
+}
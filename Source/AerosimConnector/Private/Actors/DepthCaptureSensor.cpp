@@ -1,8 +1,36 @@
 #include "Actors/DepthCaptureSensor.h"
+#include "AerosimConnector.h"
+#include "Render/ImageUtil.h"
+#include "Algo/Sort.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
 #include "Components/SceneCaptureComponent2D.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "Kismet/KismetRenderingLibrary.h"
 #include "Engine/World.h"
+#include "Math/VectorRegister.h"
+
+// Depths beyond this are not terrain (sky, far plane), in centimeters.
+static constexpr float MaxValidDepth = 500000.0f;
+
+// Sum of Count floats, four lanes at a time.
+static float SumSamples(const float* Values, int32 Count)
+{
+	VectorRegister4Float Sum = VectorZeroFloat();
+	int32 Index = 0;
+	for (; Index + 4 <= Count; Index += 4)
+	{
+		Sum = VectorAdd(Sum, VectorLoad(Values + Index));
+	}
+	alignas(16) float Lanes[4];
+	VectorStoreAligned(Sum, Lanes);
+	float Total = Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+	for (; Index < Count; ++Index)
+	{
+		Total += Values[Index];
+	}
+	return Total;
+}
 
 // Constructor
 ADepthCaptureSensor::ADepthCaptureSensor()
@@ -25,8 +53,9 @@ void ADepthCaptureSensor::BeginPlay()
 
 	DepthRenderTarget = NewObject<UTextureRenderTarget2D>();
 
-	// TODO: Parametrize Pixelformat and LinearGamma
-	DepthRenderTarget->InitCustomFormat(Resolution.X, Resolution.Y, EPixelFormat::PF_FloatRGBA, true);
+	// A single float channel: half floats lose centimeters past a few hundred meters
+	// and cannot hold more than 65504, and the readback is a quarter of RGBA16F.
+	DepthRenderTarget->InitCustomFormat(Resolution.X, Resolution.Y, EPixelFormat::PF_R32_FLOAT, true);
 	DepthRenderTarget->UpdateResourceImmediate();
 
 	// TODO: Decide when we want to get the frame
@@ -40,61 +69,220 @@ void ADepthCaptureSensor::Tick(float DeltaTime)
 	Super::Tick(DeltaTime);
 }
 
-float ADepthCaptureSensor::SampleHeight(int NumSamples)
+void ADepthCaptureSensor::SampleHeightAsync(int32 NumSamples, FOnHeightSampled&& OnSampled)
 {
-	float TotalDistance = 0.0f;
-	int ValidSamples = 0;
-
-	// Calculate the center of the image
-	int CenterX = Resolution.X / 2;
-	int CenterY = Resolution.Y / 2;
+	ReadDepthAsync([this, NumSamples, OnSampled = MoveTemp(OnSampled)]() {
+		OnSampled(ComputeHeightStats(NumSamples));
+	});
+}
 
-	for (int i = 0; i < NumSamples; i++)
+void ADepthCaptureSensor::ReadDepthAsync(TUniqueFunction<void()>&& OnRead)
+{
+	QueuedReads.Add(MoveTemp(OnRead));
+	if (!bReadbackInFlight)
 	{
-		// Generate random pixels weighted towards the center
-		int RandomX = CenterX + FMath::RandRange(-CenterX / 2, CenterX / 2);
-		int RandomY = CenterY + FMath::RandRange(-CenterY / 2, CenterY / 2);
-
-		// Clamp the values to ensure they stay within the resolution bounds
-		RandomX = FMath::Clamp(RandomX, 0, Resolution.X - 1);
-		RandomY = FMath::Clamp(RandomY, 0, Resolution.Y - 1);
+		IssueReadback();
+	}
+}
 
-		float DistanceValue = GetDistanceAtPixel(RandomX, RandomY);
+void ADepthCaptureSensor::IssueReadback()
+{
+	if (!DepthRenderTarget || QueuedReads.IsEmpty())
+	{
+		return;
+	}
+	bReadbackInFlight = true;
+	InFlightReads = MoveTemp(QueuedReads);
 
-		if (DistanceValue >= 0.0f && DistanceValue <= 500000) // Check if the distance value is valid (The depth sensor cannot measure distances greater than 65536 so 50000 is a safe round value	that ensures the value is valid)
+	// The depth is extracted on the readback worker, the game thread only gets the float array.
+	ImageUtil::ReadImageDataAsyncLease(*DepthRenderTarget, [WeakThis = TWeakObjectPtr<ADepthCaptureSensor>(this)](const void* Mapping, int32 RowStride, FIntPoint Size, EPixelFormat Format, TUniqueFunction<void()>&& Release) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(ADepthCaptureSensor::ReadDepth);
+		TArray<float> Depth;
+		if (Format == PF_R32_FLOAT || Format == PF_FloatRGBA)
 		{
-			TotalDistance += DistanceValue;
-			ValidSamples++;
+			Depth.SetNumUninitialized(Size.X * Size.Y);
+			ParallelFor(Size.Y, [&](int32 Y) {
+				const uint8* In = (const uint8*)Mapping + (int64)Y * RowStride;
+				float* Out = Depth.GetData() + (int64)Y * Size.X;
+				if (Format == PF_R32_FLOAT)
+				{
+					FMemory::Memcpy(Out, In, Size.X * sizeof(float));
+				}
+				else
+				{
+					for (int32 X = 0; X < Size.X; ++X)
+					{
+						Out[X] = ((const FFloat16Color*)In)[X].R.GetFloat();
+					}
+				}
+			});
 		}
+		Release();
 
-		// Optionally print the value of each sampled pixel
-		// UE_LOG(LogTemp, Log, TEXT("Distance at weighted pixel (%d, %d): %f"), RandomX, RandomY, DistanceValue);
-	}
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Depth = MoveTemp(Depth), Size]() mutable {
+			if (ADepthCaptureSensor* This = WeakThis.Get())
+			{
+				This->OnDepthReadback(MoveTemp(Depth), Size);
+			}
+		});
+	});
+}
 
-	if (ValidSamples > NumSamples / 2) // If more than half of the samples are valid, return the average
+void ADepthCaptureSensor::OnDepthReadback(TArray<float>&& Depth, FIntPoint Size)
+{
+	bReadbackInFlight = false;
+	if (Depth.IsEmpty())
 	{
-		UE_LOG(LogTemp, Log, TEXT("Distance: %f"), TotalDistance / ValidSamples);
-		return TotalDistance / ValidSamples;
+		UE_LOG(LogAerosimConnector, Error, TEXT("Depth capture %s: the readback failed or the depth format is unsupported"), *GetName());
+		CachedDepth.Reset();
+		CachedDepthSize = FIntPoint::ZeroValue;
 	}
 	else
 	{
-		return -1.0f; // Indicate that not enough valid samples were found
+		CachedDepth = MoveTemp(Depth);
+		CachedDepthSize = Size;
+	}
+	CachedDepthFrame = GFrameCounter;
+
+	TArray<TUniqueFunction<void()>> Reads = MoveTemp(InFlightReads);
+	for (TUniqueFunction<void()>& OnRead : Reads)
+	{
+		OnRead();
 	}
+	IssueReadback();
 }
 
-float ADepthCaptureSensor::GetDistanceAtPixel(int X, int Y)
+bool ADepthCaptureSensor::ReadDepthSync()
 {
+	if (CachedDepthFrame == GFrameCounter)
+		return !CachedDepth.IsEmpty();
 	if (!DepthRenderTarget)
-		return -1.0f;
+		return false;
 
+	TRACE_CPUPROFILER_EVENT_SCOPE(ADepthCaptureSensor::ReadDepthSync);
 	FTextureRenderTargetResource* RenderTargetResource = DepthRenderTarget->GameThread_GetRenderTargetResource();
 	TArray<FLinearColor> PixelData;
 	RenderTargetResource->ReadLinearColorPixels(PixelData);
 
-	int32 Index = Y * DepthRenderTarget->SizeX + X;
-	if (PixelData.IsValidIndex(Index))
+	CachedDepth.SetNumUninitialized(PixelData.Num());
+	for (int32 Index = 0; Index < PixelData.Num(); ++Index)
+	{
+		CachedDepth[Index] = PixelData[Index].R;
+	}
+	CachedDepthSize = FIntPoint(DepthRenderTarget->SizeX, DepthRenderTarget->SizeY);
+	CachedDepthFrame = GFrameCounter;
+	return !CachedDepth.IsEmpty();
+}
+
+FDepthSampleStats ADepthCaptureSensor::ComputeHeightStats(int32 NumSamples) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(ADepthCaptureSensor::ComputeHeightStats);
+	FDepthSampleStats Stats;
+	if (CachedDepth.IsEmpty() || NumSamples <= 0)
+	{
+		return Stats;
+	}
+	Stats.NumSamples = NumSamples;
+
+	// Random pixels in the central half of the image, the valid ones are
+	// compacted to the front without branching.
+	const int32 CenterX = CachedDepthSize.X / 2;
+	const int32 CenterY = CachedDepthSize.Y / 2;
+	TArray<float> Samples;
+	Samples.SetNumUninitialized(NumSamples);
+	int32 NumValid = 0;
+	for (int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		const int32 X = FMath::Clamp(CenterX + FMath::RandRange(-CenterX / 2, CenterX / 2), 0, CachedDepthSize.X - 1);
+		const int32 Y = FMath::Clamp(CenterY + FMath::RandRange(-CenterY / 2, CenterY / 2), 0, CachedDepthSize.Y - 1);
+		const float Depth = CachedDepth[Y * CachedDepthSize.X + X];
+		Samples[NumValid] = Depth;
+		NumValid += (Depth >= 0.0f) & (Depth <= MaxValidDepth);
+	}
+	Stats.ValidRatio = (float)NumValid / NumSamples;
+	if (NumValid == 0)
+	{
+		return Stats;
+	}
+
+	TArrayView<float> Valid(Samples.GetData(), NumValid);
+	Algo::Sort(Valid);
+	Stats.Median = NumValid % 2 ? Valid[NumValid / 2] : 0.5f * (Valid[NumValid / 2 - 1] + Valid[NumValid / 2]);
+
+	const int32 Trim = FMath::Min(FMath::FloorToInt32(NumValid * FMath::Clamp(TrimFraction, 0.0f, 0.5f)), (NumValid - 1) / 2);
+	const int32 NumKept = NumValid - 2 * Trim;
+	Stats.TrimmedMean = SumSamples(Valid.GetData() + Trim, NumKept) / NumKept;
+	return Stats;
+}
+
+float ADepthCaptureSensor::GetDepthAt(FVector2D UV, int32 Radius) const
+{
+	if (CachedDepth.IsEmpty())
+		return -1.0f;
+
+	const int32 CenterX = FMath::FloorToInt32(UV.X * CachedDepthSize.X);
+	const int32 CenterY = FMath::FloorToInt32(UV.Y * CachedDepthSize.Y);
+	TArray<float, TInlineAllocator<25>> Window;
+	for (int32 Y = FMath::Max(CenterY - Radius, 0); Y <= FMath::Min(CenterY + Radius, CachedDepthSize.Y - 1); ++Y)
+	{
+		for (int32 X = FMath::Max(CenterX - Radius, 0); X <= FMath::Min(CenterX + Radius, CachedDepthSize.X - 1); ++X)
+		{
+			const float Depth = CachedDepth[Y * CachedDepthSize.X + X];
+			if (Depth >= 0.0f && Depth <= MaxValidDepth)
+				Window.Add(Depth);
+		}
+	}
+	if (Window.IsEmpty())
+		return -1.0f;
+
+	Algo::Sort(Window);
+	return Window[Window.Num() / 2];
+}
+
+bool ADepthCaptureSensor::ProjectToUV(const FVector& Location, FVector2D& OutUV) const
+{
+	// Orthographic: image axes are the right and up vectors of the capture, the
+	// height of the view follows the aspect ratio of the target.
+	const FVector Offset = Location - SceneCaptureComponent->GetComponentLocation();
+	const double Width = SceneCaptureComponent->OrthoWidth;
+	const double Height = Width * Resolution.Y / Resolution.X;
+	OutUV.X = 0.5 + FVector::DotProduct(Offset, SceneCaptureComponent->GetRightVector()) / Width;
+	OutUV.Y = 0.5 - FVector::DotProduct(Offset, SceneCaptureComponent->GetUpVector()) / Height;
+	return OutUV.X >= 0.0 && OutUV.X < 1.0 && OutUV.Y >= 0.0 && OutUV.Y < 1.0;
+}
+
+void ADepthCaptureSensor::SetOrthoWidth(float OrthoWidth)
+{
+	SceneCaptureComponent->OrthoWidth = OrthoWidth;
+}
+
+float ADepthCaptureSensor::GetOrthoWidth() const
+{
+	return SceneCaptureComponent->OrthoWidth;
+}
+
+float ADepthCaptureSensor::SampleHeight(int NumSamples)
+{
+	if (!ReadDepthSync())
+		return -1.0f;
+
+	const FDepthSampleStats Stats = ComputeHeightStats(NumSamples);
+	if (!Stats.IsValid())
+	{
+		return -1.0f; // Indicate that not enough valid samples were found
+	}
+	UE_LOG(LogAerosimConnector, Log, TEXT("Distance: %f (median %f, %.0f%% valid)"), Stats.TrimmedMean, Stats.Median, Stats.ValidRatio * 100.0f);
+	return Stats.TrimmedMean;
+}
+
+float ADepthCaptureSensor::GetDistanceAtPixel(int X, int Y)
+{
+	if (!ReadDepthSync())
+		return -1.0f;
+
+	if (X >= 0 && X < CachedDepthSize.X && Y >= 0 && Y < CachedDepthSize.Y)
 	{
-		return PixelData[Index].R; // Normalized depth value
+		return CachedDepth[Y * CachedDepthSize.X + X]; // Scene depth in centimeters
 	}
 
 	return -1.0f;
@@ -0,0 +1,323 @@
+#include "Actors/LidarSensor.h"
+#include "Actors/AerosimActor.h"
+#include "AerosimConnector.h"
+#include "Render/ImagePublisher.h"
+#include "Containers/Ticker.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Lidar Rays Issued"), STAT_AerosimLidarRaysIssued, STATGROUP_AerosimConnector);
+
+// Trace user data: scan buffer (1 bit), scan generation (7 bits), ray index (24 bits).
+static constexpr int32 MaxRaysPerScan = 1 << 24;
+
+static constexpr float CentimetersPerMeter = 100.0f;
+
+FString ALidarSensor::GetPointCloudTopic(const FString& SensorName)
+{
+	return FString::Printf(TEXT("aerosim.renderer.lidar.%s"), *SensorName);
+}
+
+static float GetIntensity(const FHitResult& Hit)
+{
+	const AAerosimActor* Actor = Cast<AAerosimActor>(Hit.GetActor());
+	const ObjectLabel Label = Actor != nullptr && !Actor->GetSemanticTags().IsEmpty() ? Actor->GetSemanticTags()[0] : ObjectLabel::None;
+	// Rough near-infrared reflectivity of each class.
+	switch (Label)
+	{
+		case ObjectLabel::Terrain:
+			return 0.35f;
+		case ObjectLabel::Building:
+			return 0.6f;
+		case ObjectLabel::Road:
+			return 0.2f;
+		case ObjectLabel::Water:
+			return 0.05f;
+		default:
+			return 0.5f;
+	}
+}
+
+ALidarSensor::ALidarSensor()
+{
+}
+
+void ALidarSensor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	TraceDelegate.BindUObject(this, &ALidarSensor::OnTraceCompleted);
+	QueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(LidarTrace), false, this);
+	UpdatePattern();
+
+	PublishTopic = GetPointCloudTopic(GetName());
+	PublishStreamId = FImagePublisher::Get().RegisterStream(GetName(), PublishTopic, FImageStreamSettings());
+}
+
+void ALidarSensor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	FImagePublisher::Get().UnregisterStream(PublishStreamId);
+	PublishStreamId = INDEX_NONE;
+	// Traces still in flight hold a weak binding and are ignored.
+	TraceDelegate.Unbind();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ALidarSensor::SetLidarSettings(const FLidarSettings& Settings)
+{
+	if (LidarSettings == Settings && !ColumnSinCos.IsEmpty())
+	{
+		return;
+	}
+	LidarSettings = Settings;
+	UpdatePattern();
+}
+
+void ALidarSensor::SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings)
+{
+	// Point clouds are published as one row of 16-byte points, only the queue and LZ4 apply.
+	FImageStreamSettings PointSettings;
+	PointSettings.QueueDepth = Settings.QueueDepth;
+	PointSettings.Policy = Settings.Policy;
+	PointSettings.Encode.Codec = Settings.Encode.Codec == EImageCodec::LZ4 ? EImageCodec::LZ4 : EImageCodec::None;
+
+	// The topic names the sensor, a stream is registered again when it is renamed.
+	const FString Topic = GetPointCloudTopic(Label);
+	if (Topic != PublishTopic && PublishStreamId != INDEX_NONE)
+	{
+		FImagePublisher::Get().UnregisterStream(PublishStreamId);
+		PublishTopic = Topic;
+		PublishStreamId = FImagePublisher::Get().RegisterStream(Label, PublishTopic, PointSettings);
+		return;
+	}
+	FImagePublisher::Get().UpdateStream(PublishStreamId, Label, PointSettings);
+}
+
+void ALidarSensor::UpdatePattern()
+{
+	LidarSettings.Channels = FMath::Max(1, LidarSettings.Channels);
+	const int32 Columns = FMath::Min(LidarSettings.GetColumns(), MaxRaysPerScan / LidarSettings.Channels);
+
+	ChannelSinCos.SetNum(LidarSettings.Channels);
+	for (int32 Channel = 0; Channel < LidarSettings.Channels; ++Channel)
+	{
+		const float Alpha = LidarSettings.Channels > 1 ? (float)Channel / (LidarSettings.Channels - 1) : 0.5f;
+		const float Elevation = FMath::DegreesToRadians(FMath::Lerp(LidarSettings.UpperFov, LidarSettings.LowerFov, Alpha));
+		ChannelSinCos[Channel] = FVector2f(FMath::Sin(Elevation), FMath::Cos(Elevation));
+	}
+	ColumnSinCos.SetNum(Columns);
+	for (int32 Column = 0; Column < Columns; ++Column)
+	{
+		const float Azimuth = 2.0f * PI * Column / Columns;
+		ColumnSinCos[Column] = FVector2f(FMath::Sin(Azimuth), FMath::Cos(Azimuth));
+	}
+
+	// Start over, traces of the previous pattern are told apart by the generation.
+	ResetScan(Scans[0]);
+	ResetScan(Scans[1]);
+	CurrentScan = 0;
+	NextColumn = 0;
+	ColumnBudget = 0.0;
+}
+
+void ALidarSensor::ResetScan(FScan& Scan)
+{
+	Scan.Points.Init(FVector4f(0.0f, 0.0f, 0.0f, -1.0f), LidarSettings.Channels * ColumnSinCos.Num());
+	Scan.PendingTraces = 0;
+	Scan.bSwept = false;
+	++Scan.Generation;
+}
+
+void ALidarSensor::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!bCaptureEnabled || ColumnSinCos.IsEmpty())
+	{
+		return;
+	}
+	TRACE_CPUPROFILER_EVENT_SCOPE(ALidarSensor::Tick);
+
+	// The sensor is usually attached to the vehicle carrying it.
+	QueryParams.ClearIgnoredActors();
+	QueryParams.AddIgnoredActor(this);
+	if (AActor* Parent = GetAttachParentActor())
+	{
+		QueryParams.AddIgnoredActor(Parent);
+	}
+
+	// Columns the beam went past since the last tick, at most one revolution
+	// behind when frames are slow or the ray budget is exceeded.
+	const int32 Columns = ColumnSinCos.Num();
+	ColumnBudget = FMath::Min(ColumnBudget + DeltaTime * LidarSettings.RotationRate * Columns, (double)Columns);
+	int32 NumColumns = (int32)ColumnBudget;
+	if (LidarSettings.MaxRaysPerFrame > 0)
+	{
+		NumColumns = FMath::Min(NumColumns, FMath::Max(1, LidarSettings.MaxRaysPerFrame / LidarSettings.Channels));
+	}
+	ColumnBudget -= NumColumns;
+
+	while (NumColumns > 0)
+	{
+		const int32 Batch = FMath::Min(NumColumns, Columns - NextColumn);
+		IssueColumns(NextColumn, Batch);
+		NextColumn += Batch;
+		NumColumns -= Batch;
+		if (NextColumn < Columns)
+		{
+			break;
+		}
+
+		// Revolution complete, it is published once its last traces are back.
+		FScan& Swept = Scans[CurrentScan];
+		Swept.bSwept = true;
+		if (Swept.PendingTraces == 0)
+		{
+			PublishScan(Swept);
+		}
+		CurrentScan ^= 1;
+		NextColumn = 0;
+		// Traces still missing from the revolution before are abandoned.
+		ResetScan(Scans[CurrentScan]);
+	}
+}
+
+void ALidarSensor::IssueColumns(int32 FirstColumn, int32 NumColumns)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(ALidarSensor::IssueColumns);
+
+	UWorld* World = GetWorld();
+	FScan& Scan = Scans[CurrentScan];
+	const FTransform& Transform = GetActorTransform();
+	const FVector Start = Transform.GetLocation();
+	const double RangeCm = LidarSettings.Range * CentimetersPerMeter;
+	const uint32 ScanBits = ((uint32)CurrentScan << 31) | ((uint32)(Scan.Generation & 0x7F) << 24);
+	const int32 Channels = LidarSettings.Channels;
+
+	for (int32 Column = FirstColumn; Column < FirstColumn + NumColumns; ++Column)
+	{
+		for (int32 Channel = 0; Channel < Channels; ++Channel)
+		{
+			const FVector2f& Elevation = ChannelSinCos[Channel];
+			const FVector2f& Azimuth = ColumnSinCos[Column];
+			const FVector Direction(Elevation.Y * Azimuth.Y, Elevation.Y * Azimuth.X, Elevation.X);
+			const FVector End = Start + Transform.TransformVectorNoScale(Direction) * RangeCm;
+			const uint32 UserData = ScanBits | (uint32)(Column * Channels + Channel);
+			World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Start, End, ECC_Visibility, QueryParams, FCollisionResponseParams::DefaultResponseParam, &TraceDelegate, UserData);
+		}
+	}
+
+	const int32 Rays = NumColumns * Channels;
+	Scan.PendingTraces += Rays;
+	RaysIssued += Rays;
+	INC_DWORD_STAT_BY(STAT_AerosimLidarRaysIssued, Rays);
+}
+
+void ALidarSensor::OnTraceCompleted(const FTraceHandle& Handle, FTraceDatum& Datum)
+{
+	FScan& Scan = Scans[Datum.UserData >> 31];
+	const int32 RayIndex = Datum.UserData & (MaxRaysPerScan - 1);
+	if (((Datum.UserData >> 24) & 0x7F) != (uint32)(Scan.Generation & 0x7F) || !Scan.Points.IsValidIndex(RayIndex))
+	{
+		return;
+	}
+	++RaysCompleted;
+
+	if (!Datum.OutHits.IsEmpty() && Datum.OutHits[0].bBlockingHit)
+	{
+		// Rebuilt from the pattern, the sensor may have moved since the ray was issued.
+		const FVector2f& Elevation = ChannelSinCos[RayIndex % LidarSettings.Channels];
+		const FVector2f& Azimuth = ColumnSinCos[RayIndex / LidarSettings.Channels];
+		const float Distance = Datum.OutHits[0].Distance / CentimetersPerMeter;
+		Scan.Points[RayIndex] = FVector4f(
+			Elevation.Y * Azimuth.Y * Distance,
+			Elevation.Y * Azimuth.X * Distance,
+			Elevation.X * Distance,
+			GetIntensity(Datum.OutHits[0]));
+	}
+
+	if (--Scan.PendingTraces == 0 && Scan.bSwept)
+	{
+		PublishScan(Scan);
+	}
+}
+
+void ALidarSensor::PublishScan(FScan& Scan)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(ALidarSensor::PublishScan);
+	Scan.bSwept = false;
+
+	int32 NumHits = 0;
+	for (const FVector4f& Point : Scan.Points)
+	{
+		NumHits += Point.W >= 0.0f;
+	}
+	if (NumHits == 0)
+	{
+		return;
+	}
+
+	TArray64<uint8> Packed;
+	Packed.SetNumUninitialized((int64)NumHits * sizeof(FVector4f));
+	FVector4f* Out = (FVector4f*)Packed.GetData();
+	for (const FVector4f& Point : Scan.Points)
+	{
+		if (Point.W >= 0.0f)
+			*Out++ = Point;
+	}
+
+	FImagePublisher::Get().Submit(PublishStreamId, FImageFrame::MakeOwning(MoveTemp(Packed), FIntPoint(NumHits, 1), sizeof(FVector4f), EPixelLayout::XYZI32F));
+	++ScansPublished;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs LidarBenchmarkCommand(
+	TEXT("aerosim.Benchmark.Lidar"),
+	TEXT("Spins a lidar at the player view point and logs the rays traced per second. Run on a test map, -nullrhi works. ")
+		TEXT("Arguments: [Seconds=5] [Channels=64] [HorizontalResolution=0.1] [RotationRate=20]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World) {
+		if (World == nullptr)
+		{
+			return;
+		}
+		const double Seconds = Args.Num() > 0 ? FCString::Atod(*Args[0]) : 5.0;
+		FLidarSettings Settings;
+		Settings.Channels = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 64;
+		Settings.HorizontalResolution = Args.Num() > 2 ? FCString::Atof(*Args[2]) : 0.1f;
+		Settings.RotationRate = Args.Num() > 3 ? FCString::Atof(*Args[3]) : 20.0f;
+
+		FVector Location = FVector::ZeroVector;
+		FRotator Rotation = FRotator::ZeroRotator;
+		if (APlayerController* PlayerController = World->GetFirstPlayerController())
+		{
+			PlayerController->GetPlayerViewPoint(Location, Rotation);
+		}
+		ALidarSensor* Lidar = World->SpawnActor<ALidarSensor>(Location, FRotator::ZeroRotator);
+		if (Lidar == nullptr)
+		{
+			return;
+		}
+		Lidar->SetLidarSettings(Settings);
+
+		const double StartTime = FPlatformTime::Seconds();
+		FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([WeakLidar = TWeakObjectPtr<ALidarSensor>(Lidar), StartTime, Seconds, Frames = 0](float) mutable {
+			ALidarSensor* Lidar = WeakLidar.Get();
+			if (Lidar == nullptr)
+			{
+				return false;
+			}
+			++Frames;
+			const double Elapsed = FPlatformTime::Seconds() - StartTime;
+			if (Elapsed < Seconds)
+			{
+				return true;
+			}
+			const FLidarSettings& Settings = Lidar->GetLidarSettings();
+			UE_LOG(LogAerosimConnector, Display, TEXT("Lidar benchmark: %d channels x %d columns at %.1f Hz, %llu of %llu rays traced in %.2f s (%.0f rays/s, %.1f fps), %llu scans published"),
+				Settings.Channels, Settings.GetColumns(), Settings.RotationRate, Lidar->GetRaysCompleted(), Lidar->GetRaysIssued(), Elapsed,
+				Lidar->GetRaysCompleted() / Elapsed, Frames / Elapsed, Lidar->GetScansPublished());
+			Lidar->Destroy();
+			return false;
+		}));
+	}));
@@ -0,0 +1,125 @@
+#include "Actors/SegmentationCameraSensor.h"
+#include "Actors/AerosimActor.h"
+#include "AerosimConnector.h"
+#include "Render/ImageUtil.h"
+#include "Render/ImagePublisher.h"
+#include "Render/SensorRecorder.h"
+#include "Async/ParallelFor.h"
+#include "Engine/SceneCapture2D.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "Materials/MaterialInterface.h"
+
+static TAutoConsoleVariable<float> CVarSegmentationStencilRefreshSeconds(
+	TEXT("aerosim.Segmentation.StencilRefreshSeconds"),
+	1.0f,
+	TEXT("Seconds between updates of the semantic stencil values by segmentation cameras."),
+	ECVF_Default);
+
+ASegmentationCameraSensor::ASegmentationCameraSensor()
+{
+	StencilMaterial = TSoftObjectPtr<UMaterialInterface>(FSoftObjectPath(TEXT("/AerosimConnector/Materials/PostProcess/PP_SemanticStencil.PP_SemanticStencil")));
+}
+
+void ASegmentationCameraSensor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Anything blending neighbouring pixels would invent labels along the edges.
+	USceneCaptureComponent2D* SceneCaptureComponent = SceneCaptureActor->GetCaptureComponent2D();
+	SceneCaptureComponent->ShowFlags.SetAntiAliasing(false);
+	SceneCaptureComponent->ShowFlags.SetTemporalAA(false);
+	SceneCaptureComponent->ShowFlags.SetMotionBlur(false);
+	SceneCaptureComponent->ShowFlags.SetBloom(false);
+	SceneCaptureComponent->ShowFlags.SetEyeAdaptation(false);
+
+	UMaterialInterface* Material = StencilMaterial.LoadSynchronous();
+	if (Material == nullptr)
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Segmentation camera %s: stencil material %s not found, capture disabled. Content/Python/create_semantic_stencil_material.py of the plugin creates it"), *GetName(), *StencilMaterial.ToString());
+		SetCaptureEnabled(false);
+		return;
+	}
+	SceneCaptureComponent->PostProcessSettings.AddBlendable(Material, 1.0f);
+	SceneCaptureComponent->PostProcessBlendWeight = 1.0f;
+
+	ApplySemanticStencils();
+}
+
+void ASegmentationCameraSensor::Tick(float DeltaTime)
+{
+	const double Now = FPlatformTime::Seconds();
+	if (bCaptureEnabled && Now - LastStencilUpdateTime >= CVarSegmentationStencilRefreshSeconds.GetValueOnGameThread())
+	{
+		ApplySemanticStencils();
+	}
+
+	Super::Tick(DeltaTime);
+}
+
+void ASegmentationCameraSensor::SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings)
+{
+	// Resizing would blend labels and JPEG would alter them.
+	FImageStreamSettings LabelSettings = Settings;
+	LabelSettings.Layout = EPixelLayout::Y8;
+	LabelSettings.OutputSize = FIntPoint::ZeroValue;
+	LabelSettings.Downscale = 1;
+	if (LabelSettings.Encode.Codec != EImageCodec::LZ4)
+	{
+		LabelSettings.Encode.Codec = EImageCodec::RLE;
+	}
+	Super::SetPublishSettings(Label, LabelSettings);
+}
+
+void ASegmentationCameraSensor::ApplySemanticStencils()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(ASegmentationCameraSensor::ApplySemanticStencils);
+	LastStencilUpdateTime = FPlatformTime::Seconds();
+	for (TActorIterator<AAerosimActor> It(GetWorld()); It; ++It)
+	{
+		It->ApplySemanticStencil();
+	}
+}
+
+void ASegmentationCameraSensor::GetCurrentFrame()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(ASegmentationCameraSensor::GetCurrentFrame);
+
+	FRecordedFrameMetadata Metadata;
+	if (RecordingId != INDEX_NONE)
+	{
+		Metadata.SimTime = FSensorRecorder::Get().GetSimTime();
+		Metadata.Pose = GetActorTransform();
+	}
+
+	// The labels are pulled out of the red channel on the readback worker, the
+	// readback is released right after and the publisher gets the label image.
+	ImageUtil::ReadSensorDataAsyncLease(this, [StreamId = PublishStreamId, RecordingId = RecordingId, Metadata](const void* Mapping, int32 RowStride, FIntPoint Size, EPixelFormat Format, TUniqueFunction<void()>&& Release) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(ASegmentationCameraSensor::RetrieveDataAndPublish);
+		if (Format != PF_B8G8R8A8)
+		{
+			Release();
+			return;
+		}
+
+		TArray64<uint8> Labels;
+		Labels.SetNumUninitialized((int64)Size.X * Size.Y);
+		ParallelFor(Size.Y, [&](int32 Y) {
+			const uint8* In = (const uint8*)Mapping + (int64)Y * RowStride;
+			uint8* Out = Labels.GetData() + (int64)Y * Size.X;
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				Out[X] = In[4 * X + 2];
+			}
+		});
+		Release();
+
+		TUniquePtr<FImageFrame> Frame = FImageFrame::MakeOwning(MoveTemp(Labels), Size, 1, EPixelLayout::Y8);
+		if (RecordingId != INDEX_NONE)
+		{
+			FSensorRecorder::Get().RecordFrame(RecordingId, Frame->View, PF_G8, Metadata);
+		}
+		FImagePublisher::Get().Submit(StreamId, MoveTemp(Frame));
+	});
+}
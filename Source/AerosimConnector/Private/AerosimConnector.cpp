@@ -8,6 +8,10 @@
 #include "UObject/SavePackage.h"
 #include "HAL/FileManager.h"
 #include "CesiumIonServer.h"
+#include "Render/ImageEncoder.h"
+#include "Render/ImagePublisher.h"
+#include "Render/ReadbackPoller.h"
+#include "Render/SensorRecorder.h"
 
 #define LOCTEXT_NAMESPACE "FAerosimConnectorModule"
 
@@ -16,12 +20,16 @@ DEFINE_LOG_CATEGORY(LogAerosimConnector);
 void FAerosimConnectorModule::StartupModule()
 {
 	ModifyCesiumTokenDataAsset();
+	ImageEncoder::Startup();
 }
 
 void FAerosimConnectorModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	FReadbackPoller::Get().Shutdown();
+	FImagePublisher::Get().Shutdown();
+	FSensorRecorder::Get().Shutdown();
 }
 
 void FAerosimConnectorModule::ModifyCesiumTokenDataAsset()
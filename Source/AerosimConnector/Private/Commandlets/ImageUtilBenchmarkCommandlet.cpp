@@ -0,0 +1,39 @@
+#include "Commandlets/ImageUtilBenchmarkCommandlet.h"
+
+#include "AerosimConnector.h"
+#include "Render/ImageBenchmark.h"
+
+UImageUtilBenchmarkCommandlet::UImageUtilBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UImageUtilBenchmarkCommandlet::Main(const FString& Params)
+{
+	ImageBenchmark::FBenchmarkOptions Options;
+	FParse::Value(*Params, TEXT("filter="), Options.Filter);
+	FParse::Value(*Params, TEXT("minseconds="), Options.MinSeconds);
+
+	FString Path = ImageBenchmark::GetDefaultResultsPath();
+	FParse::Value(*Params, TEXT("output="), Path);
+
+	TArray<ImageBenchmark::FBenchmarkResult> Results;
+	ImageBenchmark::RunSuite(Options, Results);
+	if (Results.IsEmpty())
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("No benchmark matched the filter '%s'"), *Options.Filter);
+		return 1;
+	}
+	if (!ImageBenchmark::WriteResults(Results, Path))
+		return 1;
+	// Cases whose output is wrong fail the run, whatever their speed.
+	if (const int32 Failed = ImageBenchmark::CountFailedChecks(Results))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("%d benchmark cases failed their check"), Failed);
+		return 1;
+	}
+	return 0;
+}
@@ -1,6 +1,27 @@
 #include "Components/TrajectoryVisualizerComponent.h"
+#include "Game/Subsystems/SceneGraph.h"
+#include "HAL/IConsoleManager.h"
 #include "Materials/MaterialInstanceDynamic.h"
 
+static TAutoConsoleVariable<int32> CVarTrajectoryMaxPastSegments(
+	TEXT("aerosim.Trajectory.MaxPastSegments"),
+	4096,
+	TEXT("Segments of past trajectory drawn per actor, the oldest ones are reused beyond. Read when the trajectory starts."),
+	ECVF_Default);
+
+// Edge length of the engine cube mesh and cross-section scale of the trajectory.
+static constexpr double CubeMeshSize = 100.0;
+static constexpr double TrajectoryThickness = 0.1;
+
+// Points closer than this (cm) to the previous one do not start a segment.
+static constexpr double MinSegmentLength = 1.0;
+
+// Points a simplified segment may stand for, bounds the cost of a point.
+static constexpr int32 MaxSimplifiedPoints = 64;
+
+// Future waypoints that moved less than this (cm) keep their segments.
+static constexpr double FutureWaypointTolerance = 0.1;
+
 UStaticMesh* UTrajectoryVisualizerComponent::CubeMesh = nullptr;
 UStaticMesh* UTrajectoryVisualizerComponent::SphereMesh = nullptr;
 
@@ -51,17 +72,68 @@ void UTrajectoryVisualizerComponent::Update(FVector Position)
 		UE_LOG(LogAerosimConnector, VeryVerbose, TEXT("Actor: %s -> Has not enabled the Trajectory Visualizer Component"), *GetName());
 		return;
 	}
-	if (!SplineComponent)
+	if (!CreatePastTrajectoryMesh())
 	{
-		SplineComponent = NewObject<USplineComponent>(this, TEXT("SplineComponent"));
-		SplineComponent->SetMobility(EComponentMobility::Movable);
-		SplineComponent->RegisterComponentWithWorld(GetWorld());
-		SplineComponent->SetVisibility(false);
-		SplineComponent->bDrawDebug = false;
+		return;
 	}
-	SplineComponent->AddSplinePoint(Position, ESplineCoordinateSpace::World, true);
-	SplineComponent->UpdateSpline();
-	DrawSpline();
+
+	const FVector Point = PastTrajectoryMesh->GetComponentTransform().InverseTransformPosition(Position);
+	const double Now = GetWorld()->GetTimeSeconds();
+	if (bHasPastPoint)
+	{
+		if (Now - LastPastPointSeconds < UpdateInterval)
+		{
+			return;
+		}
+		const FVector Offset = Point - LastPastPoint;
+		const double Distance = Offset.Size();
+		if (Distance < MinSegmentLength)
+		{
+			return;
+		}
+		// Keep the point once far enough, or once the heading turned enough
+		const bool bTurned = !LastPastDirection.IsZero()
+			&& FVector::DotProduct(Offset / Distance, LastPastDirection) < FMath::Cos(FMath::DegreesToRadians(MaxHeadingChange));
+		if (Distance < MinPointDistance && !bTurned)
+		{
+			return;
+		}
+		LastPastDirection = Offset / Distance;
+	}
+	LastPastPointSeconds = Now;
+	AddPastPoint(Point);
+}
+
+void UTrajectoryVisualizerComponent::AddPastPoint(const FVector& Point)
+{
+	if (!bHasPastPoint)
+	{
+		LastPastPoint = Point;
+		bHasPastPoint = true;
+		return;
+	}
+
+	// Online simplification: stretch the newest segment over Point while the
+	// points it stands for stay within the tolerance of the straight line.
+	bool bFits = SimplifyTolerance > 0.0f && LastPastSegment != INDEX_NONE
+		&& SimplifiedPoints.Num() >= 2 && SimplifiedPoints.Num() < MaxSimplifiedPoints;
+	for (int32 Index = 1; bFits && Index < SimplifiedPoints.Num(); ++Index)
+	{
+		bFits = FMath::PointDistToSegment(SimplifiedPoints[Index], SimplifiedPoints[0], Point) <= SimplifyTolerance;
+	}
+
+	if (bFits)
+	{
+		PastTrajectoryMesh->UpdateInstanceTransform(LastPastSegment, GetSegmentTransform(SimplifiedPoints[0], Point), false, true, true);
+	}
+	else
+	{
+		LastPastSegment = DrawPastSegment(LastPastPoint, Point);
+		SimplifiedPoints.Reset();
+		SimplifiedPoints.Add(LastPastPoint);
+	}
+	SimplifiedPoints.Add(Point);
+	LastPastPoint = Point;
 }
 
 void UTrajectoryVisualizerComponent::UpdateUserDefinedWaypoints(const TArray<FVector>& Waypoints)
@@ -75,15 +147,6 @@ void UTrajectoryVisualizerComponent::UpdateUserDefinedWaypoints(const TArray<FVe
 	{
 		return;
 	}
-	SplineMeshes.Empty();
-	if (!SplineComponent)
-	{
-		SplineComponent = NewObject<USplineComponent>(this, TEXT("SplineComponent"));
-		SplineComponent->SetMobility(EComponentMobility::Movable);
-		SplineComponent->RegisterComponentWithWorld(GetWorld());
-		SplineComponent->SetVisibility(false);
-		SplineComponent->bDrawDebug = false;
-	}
 	DrawUserDefinedWaypoints(Waypoints);
 }
 
@@ -100,143 +163,177 @@ void UTrajectoryVisualizerComponent::UpdateFutureTrajectory(const TArray<FVector
 		return;
 	}
 
-	for (USplineMeshComponent* SplineMesh : FutureSplineMeshes)
+	if (!IsValid(FutureTrajectoryMesh))
 	{
-		if (IsValid(SplineMesh))
+		FutureTrajectoryMesh = CreateTrajectoryMesh(TEXT("FutureTrajectoryMesh"));
+		if (FutureTrajectoryMesh == nullptr)
 		{
-			SplineMesh->DestroyComponent();
+			return;
 		}
+		FutureWaypoints.Reset();
+		NumFutureSegments = 0;
 	}
 
-	if (!FutureSplineComponent)
+	// Keep the waypoints that did not move, relative to the mesh like its instances
+	const FTransform& ToWorld = FutureTrajectoryMesh->GetComponentTransform();
+	const int32 NumDrawnWaypoints = FutureWaypoints.Num();
+	ChangedFutureWaypoints.Init(false, Waypoints.Num());
+	FutureWaypoints.SetNum(Waypoints.Num(), EAllowShrinking::No);
+	for (int32 Index = 0; Index < Waypoints.Num(); ++Index)
 	{
-		FutureSplineComponent = NewObject<USplineComponent>(this, TEXT("FutureSplineComponent"));
-		FutureSplineComponent->SetMobility(EComponentMobility::Movable);
-		FutureSplineComponent->RegisterComponentWithWorld(GetWorld());
-		FutureSplineComponent->SetVisibility(false);
-		FutureSplineComponent->bDrawDebug = false;
+		const FVector Waypoint = ToWorld.InverseTransformPosition(Waypoints[Index]);
+		if (Index >= NumDrawnWaypoints || !FutureWaypoints[Index].Equals(Waypoint, FutureWaypointTolerance))
+		{
+			FutureWaypoints[Index] = Waypoint;
+			ChangedFutureWaypoints[Index] = true;
+		}
 	}
+	DrawFutureSegments();
+}
 
-	FutureSplineComponent->ClearSplinePoints();
-	FutureSplineComponent->SetSplinePoints(Waypoints, ESplineCoordinateSpace::World, false);
-	FutureSplineComponent->UpdateSpline();
-	DrawFutureSpline();
+void UTrajectoryVisualizerComponent::Rebase(const FTransform& OldToNew)
+{
+	// The drawn components are not attached, each one is moved on its own.
+	auto RebaseComponent = [&OldToNew](USceneComponent* Component) {
+		if (IsValid(Component))
+		{
+			Component->SetWorldTransform(Component->GetComponentTransform() * OldToNew);
+		}
+	};
+	RebaseComponent(PastTrajectoryMesh);
+	RebaseComponent(FutureTrajectoryMesh);
+	for (UStaticMeshComponent* Waypoint : UserDefinedWaypoints)
+	{
+		RebaseComponent(Waypoint);
+	}
 }
 
-void UTrajectoryVisualizerComponent::UpdateSettings(bool ShowFutureWaypoints, bool ShowBehindWaypoints, bool ShowUserDefinedWaypoints, uint32 FutureWaypoints)
+void UTrajectoryVisualizerComponent::UpdateSettings(const FTrajectoryVisualizationSettingsData& Settings)
 {
-	bDisplayFutureTrajectory = ShowFutureWaypoints;
-	bDisplayPastWaypoints = ShowBehindWaypoints;
-	bHighlightUserDefinedWaypoints = ShowUserDefinedWaypoints;
-	NumberOfFutureWaypoints = FutureWaypoints;
+	bDisplayFutureTrajectory = Settings.DisplayFutureTrajectory;
+	bDisplayPastWaypoints = Settings.DisplayPastTrajectory;
+	bHighlightUserDefinedWaypoints = Settings.HighlightUserDefinedWaypoints;
+	NumberOfFutureWaypoints = FMath::Max(Settings.NumberOfFutureWaypoints, 0);
+	// Settings are in meters, the points in centimeters
+	UpdateInterval = FMath::Max(Settings.UpdateInterval, 0.0f);
+	MinPointDistance = FMath::Max(Settings.MinPointDistance, 0.0f) * 100.0f;
+	MaxHeadingChange = FMath::Clamp(Settings.MaxHeadingChange, 0.0f, 180.0f);
+	SimplifyTolerance = FMath::Max(Settings.SimplifyTolerance, 0.0f) * 100.0f;
 	bEnabled = (bDisplayFutureTrajectory || bDisplayPastWaypoints);
 }
 
-void UTrajectoryVisualizerComponent::DrawSpline()
+UStaticMesh* UTrajectoryVisualizerComponent::GetCubeMesh()
 {
-	if (!bEnabled)
-	{
-		UE_LOG(LogAerosimConnector, VeryVerbose, TEXT("Actor: %s -> Has not enabled the Trajectory Visualizer Component"), *GetName());
-		return;
-	}
-	const int32 NumPoints = SplineComponent->GetNumberOfSplinePoints();
-
-	if (NumPoints < 2 || LastSplinePointIndex >= NumPoints - 1)
-	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("Not enough points to draw Spline"));
-		return;
-	}
-
-	USplineMeshComponent* SplineMesh = NewObject<USplineMeshComponent>(this);
-	if (!IsValid(SplineMesh))
-	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("Failed to create SplineMesh"));
-		return;
-	}
-	SplineMesh->SetMobility(EComponentMobility::Movable);
-	SplineMesh->RegisterComponentWithWorld(GetWorld());
-
-	FVector StartPos, StartTangent, EndPos, EndTangent;
-	SplineComponent->GetLocationAndTangentAtSplinePoint(LastSplinePointIndex, StartPos, StartTangent, ESplineCoordinateSpace::World);
-	SplineComponent->GetLocationAndTangentAtSplinePoint(LastSplinePointIndex + 1, EndPos, EndTangent, ESplineCoordinateSpace::World);
-	SplineMesh->SetStartAndEnd(StartPos, StartTangent, EndPos, EndTangent);
-
 	if (!IsValid(CubeMesh))
 	{
 		CubeMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
 		if (!IsValid(CubeMesh))
 		{
 			UE_LOG(LogAerosimConnector, Error, TEXT("Failed to load Cube Mesh"));
-			return;
+			return nullptr;
 		}
 	}
+	return CubeMesh;
+}
 
-	SplineMesh->SetStaticMesh(CubeMesh);
-	if (IsValid(SplineMaterial))
+FTransform UTrajectoryVisualizerComponent::GetSegmentTransform(const FVector& Start, const FVector& End)
+{
+	const FVector Segment = End - Start;
+	return FTransform(Segment.Rotation(), (Start + End) * 0.5,
+		FVector(Segment.Size() / CubeMeshSize, TrajectoryThickness, TrajectoryThickness));
+}
+
+UInstancedStaticMeshComponent* UTrajectoryVisualizerComponent::CreateTrajectoryMesh(const TCHAR* Name)
+{
+	UStaticMesh* Mesh = GetCubeMesh();
+	if (Mesh == nullptr)
 	{
-		SplineMesh->SetMaterial(0, SplineMaterial);
+		return nullptr;
 	}
 
-	SplineMesh->SetStartScale(FVector2D(0.1f, 0.1f));
-	SplineMesh->SetEndScale(FVector2D(0.1f, 0.1f));
-	SplineMesh->SetVisibility(true);
-	SplineMesh->SetHiddenInGame(false);
-	SplineMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
-	SplineMesh->SetMobility(EComponentMobility::Movable);
-
-	SplineMeshes.Add(SplineMesh);
-	LastSplinePointIndex++;
+	UInstancedStaticMeshComponent* TrajectoryMesh = NewObject<UInstancedStaticMeshComponent>(this, Name);
+	if (!IsValid(TrajectoryMesh))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Failed to create %s"), Name);
+		return nullptr;
+	}
+	TrajectoryMesh->SetMobility(EComponentMobility::Movable);
+	TrajectoryMesh->SetStaticMesh(Mesh);
+	if (IsValid(SplineMaterial))
+	{
+		TrajectoryMesh->SetMaterial(0, SplineMaterial);
+	}
+	TrajectoryMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	TrajectoryMesh->RegisterComponentWithWorld(GetWorld());
+	return TrajectoryMesh;
 }
 
-void UTrajectoryVisualizerComponent::DrawFutureSpline()
+bool UTrajectoryVisualizerComponent::CreatePastTrajectoryMesh()
 {
-	if (!bEnabled)
+	if (IsValid(PastTrajectoryMesh))
 	{
-		UE_LOG(LogAerosimConnector, VeryVerbose, TEXT("Actor: %s -> Has not enabled the Trajectory Visualizer Component"), *GetName());
-		return;
+		return true;
+	}
+	PastTrajectoryMesh = CreateTrajectoryMesh(TEXT("PastTrajectoryMesh"));
+	if (PastTrajectoryMesh == nullptr)
+	{
+		return false;
 	}
 
-	if (!IsValid(CubeMesh))
+	PastSegmentCapacity = FMath::Max(CVarTrajectoryMaxPastSegments.GetValueOnGameThread(), 1);
+	NextPastSegment = 0;
+	LastPastSegment = INDEX_NONE;
+	bHasPastPoint = false;
+	return true;
+}
+
+int32 UTrajectoryVisualizerComponent::DrawPastSegment(const FVector& Start, const FVector& End)
+{
+	// Fill the ring, then overwrite its oldest segment
+	const FTransform Segment = GetSegmentTransform(Start, End);
+	if (PastTrajectoryMesh->GetInstanceCount() < PastSegmentCapacity)
 	{
-		CubeMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
-		if (!IsValid(CubeMesh))
-		{
-			UE_LOG(LogAerosimConnector, Error, TEXT("Failed to load Cube Mesh"));
-			return;
-		}
+		return PastTrajectoryMesh->AddInstance(Segment, false);
 	}
+	const int32 Instance = NextPastSegment;
+	PastTrajectoryMesh->UpdateInstanceTransform(Instance, Segment, false, true, true);
+	NextPastSegment = (NextPastSegment + 1) % PastSegmentCapacity;
+	return Instance;
+}
 
-	const int32 NumPoints = FutureSplineComponent->GetNumberOfSplinePoints();
-	for (int32 PointIndex = 0; PointIndex < NumPoints - 1; ++PointIndex)
+void UTrajectoryVisualizerComponent::DrawFutureSegments()
+{
+	// Only segments with a moved end are touched, instances of segments the
+	// path no longer has are collapsed and kept for the next longer path
+	const int32 NumSegments = FutureWaypoints.Num() - 1;
+	bool bChanged = false;
+	for (int32 Segment = 0; Segment < NumSegments; ++Segment)
 	{
-		USplineMeshComponent* SplineMesh = NewObject<USplineMeshComponent>(this);
-		if (!IsValid(SplineMesh))
+		if (Segment < NumFutureSegments && !ChangedFutureWaypoints[Segment] && !ChangedFutureWaypoints[Segment + 1])
 		{
-			UE_LOG(LogAerosimConnector, Error, TEXT("Failed to create SplineMesh at index %d"), PointIndex);
 			continue;
 		}
-
-		SplineMesh->SetMobility(EComponentMobility::Movable);
-		SplineMesh->RegisterComponentWithWorld(GetWorld());
-
-		FVector StartPos, StartTangent, EndPos, EndTangent;
-		FutureSplineComponent->GetLocationAndTangentAtSplinePoint(PointIndex, StartPos, StartTangent, ESplineCoordinateSpace::World);
-		FutureSplineComponent->GetLocationAndTangentAtSplinePoint(PointIndex + 1, EndPos, EndTangent, ESplineCoordinateSpace::World);
-		SplineMesh->SetStartAndEnd(StartPos, StartTangent, EndPos, EndTangent);
-
-		SplineMesh->SetStaticMesh(CubeMesh);
-		if (IsValid(SplineMaterial))
+		const FTransform Transform = GetSegmentTransform(FutureWaypoints[Segment], FutureWaypoints[Segment + 1]);
+		if (Segment < FutureTrajectoryMesh->GetInstanceCount())
 		{
-			SplineMesh->SetMaterial(0, SplineMaterial);
+			FutureTrajectoryMesh->UpdateInstanceTransform(Segment, Transform, false, false, true);
 		}
+		else
+		{
+			FutureTrajectoryMesh->AddInstance(Transform, false);
+		}
+		bChanged = true;
+	}
+	for (int32 Segment = NumSegments; Segment < NumFutureSegments; ++Segment)
+	{
+		FutureTrajectoryMesh->UpdateInstanceTransform(Segment, FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), false, false, true);
+		bChanged = true;
+	}
+	NumFutureSegments = NumSegments;
 
-		SplineMesh->SetStartScale(FVector2D(0.1f, 0.1f));
-		SplineMesh->SetEndScale(FVector2D(0.1f, 0.1f));
-		SplineMesh->SetVisibility(true);
-		SplineMesh->SetHiddenInGame(false);
-		SplineMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
-		SplineMesh->SetMobility(EComponentMobility::Movable);
-		FutureSplineMeshes.Add(SplineMesh);
+	if (bChanged)
+	{
+		FutureTrajectoryMesh->MarkRenderStateDirty();
 	}
 }
 
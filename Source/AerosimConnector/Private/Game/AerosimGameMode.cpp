@@ -5,9 +5,13 @@
 #include "Game/Subsystems/ActorRegistry.h"
 #include "Game/Subsystems/CommandConsumer.h"
 #include "Game/Subsystems/CesiumTileManager.h"
+#include "Game/Subsystems/AltitudeMeasurementService.h"
+#include "Game/Subsystems/RenderTargetPool.h"
+#include "Render/ReadbackPoller.h"
 
 #include "Util/MessageHandler.h"
 #include "Misc/Paths.h"
+#include "HAL/IConsoleManager.h"
 #include <cstring>
 
 #include "Kismet/GameplayStatics.h"
@@ -28,6 +32,18 @@ void AAerosimGameMode::BeginPlay()
 		UE_LOG(LogAerosimConnector, Error, TEXT("Data Tracker is not valid"));
 	}
 
+	// Segmentation cameras read the semantic labels from the custom depth stencil,
+	// which is only rendered in stencil mode. Set before any sensor is spawned.
+	IConsoleVariable* CVarCustomDepth = IConsoleManager::Get().FindConsoleVariable(TEXT("r.CustomDepth"));
+	if (CVarCustomDepth != nullptr && CVarCustomDepth->GetInt() != 3)
+	{
+		UE_LOG(LogAerosimConnector, Log, TEXT("Setting r.CustomDepth to 3 for the semantic stencil"));
+		CVarCustomDepth->Set(3, ECVF_SetByCode);
+	}
+
+	// Created before any sensor is spawned, sensors borrow their render targets from it
+	RenderTargetPool = NewObject<URenderTargetPool>(this, URenderTargetPool::StaticClass());
+
 	if (IsValid(RegistryClass))
 	{
 		ActorRegistry = NewObject<UActorRegistry>(this, RegistryClass);
@@ -45,11 +61,16 @@ void AAerosimGameMode::BeginPlay()
 		CesiumTileManager->LoadTileSet(InitialLat, InitialLon, InitialHeight);
 	}
 
+	AltitudeMeasurementService = NewObject<UAltitudeMeasurementService>(this, UAltitudeMeasurementService::StaticClass());
+	AltitudeMeasurementService->SetCesiumTileManager(CesiumTileManager);
+	AltitudeMeasurementService->SetSpectatorPawn(SpectatorPawn);
+
 	CommandConsumer = NewObject<UCommandConsumer>(this, UCommandConsumer::StaticClass());
 	if (IsValid(CommandConsumer))
 	{
 		CommandConsumer->SetActorRegistry(ActorRegistry);
 		CommandConsumer->SetCesiumTileManager(CesiumTileManager);
+		CommandConsumer->SetAltitudeMeasurementService(AltitudeMeasurementService);
 		CommandConsumer->GameMode = this;
 	}
 
@@ -96,16 +117,27 @@ void AAerosimGameMode::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
 	CommandConsumer->ProcessCommandsFromQueue(DeltaSeconds);
+	AltitudeMeasurementService->Tick(DeltaSeconds);
+	CesiumTileManager->Tick(DeltaSeconds);
+	RenderTargetPool->Tick();
 }
 
 void AAerosimGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
 
+	if (IsValid(AltitudeMeasurementService))
+	{
+		AltitudeMeasurementService->Shutdown();
+	}
+
 	if (IsValid(CesiumTileManager))
 	{
 		CesiumTileManager->EndPlay();
 	}
 
+	// Sensors are going away, don't deliver their in-flight frames
+	FReadbackPoller::Get().Flush();
+
 	end_message_handler();
 }
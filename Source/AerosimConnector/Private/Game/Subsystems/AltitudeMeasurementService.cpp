@@ -0,0 +1,680 @@
+#include "Game/Subsystems/AltitudeMeasurementService.h"
+#include "Game/Subsystems/CesiumTileManager.h"
+#include "Actors/DepthCaptureSensor.h"
+#include "AerosimConnector.h"
+#include "Util/MessageHandler.h"
+#include "Cesium3DTileset.h"
+#include "CesiumGeoreference.h"
+#include "GameFramework/Pawn.h"
+#include "Components/SceneComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/Paths.h"
+
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+static TAutoConsoleVariable<int32> CVarAltitudeMeasurementSettleFrames(
+	TEXT("aerosim.AltitudeMeasurement.SettleFrames"),
+	5,
+	TEXT("Consecutive frames the tileset must report a complete load before the altitude probe measures."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarAltitudeMeasurementTimeoutSeconds(
+	TEXT("aerosim.AltitudeMeasurement.TimeoutSeconds"),
+	30.0f,
+	TEXT("Seconds an altitude offset measurement may take when the command sets no timeout."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTerrainHeightsClusterMeters(
+	TEXT("aerosim.TerrainHeights.ClusterMeters"),
+	250.0f,
+	TEXT("Size of the areas whose missing terrain heights are measured from a single tileset load and readback."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTerrainHeightsInterpolationMeters(
+	TEXT("aerosim.TerrainHeights.InterpolationMeters"),
+	30.0f,
+	TEXT("Distance to the measured terrain heights within which a queried height is interpolated instead of measured."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarTerrainHeightsPersist(
+	TEXT("aerosim.TerrainHeights.Persist"),
+	true,
+	TEXT("Keep the measured terrain heights in a file per tileset source, reused by the next runs."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTerrainHeightsPrecisionDegrees(
+	TEXT("aerosim.TerrainHeights.PrecisionDegrees"),
+	1e-6f,
+	TEXT("Grid the positions of the persisted terrain heights are stored on, in degrees. Changing it discards the files written with another grid."),
+	ECVF_Default);
+
+// Detail levels of the heights in the cache: measured from the raised probe
+// only, or from the probe moved close above the terrain.
+static constexpr uint8 CoarseLod = 0;
+static constexpr uint8 FineLod = 1;
+
+// An offset measurement is answered from a fine height this close to its point.
+static constexpr double CachedOffsetMeters = 0.5;
+
+// Meters the origin is first raised by, to avoid measuring negative altitudes if
+// the terrain is higher than the expected altitude.
+static constexpr double InitialDepthSensorOffset = 500.0;
+
+// Meters kept above the terrain for the final measurement. Close enough for the
+// finest LODs, far enough to smooth out irregularities of the terrain.
+static constexpr double FineDepthSensorOffset = 20.0;
+
+// When no terrain is seen under a cluster the probe is likely under ground, it
+// is raised by this much, up to the highest terrain on Earth.
+static constexpr double ClusterRaiseStep = 1000.0;
+static constexpr double MaxClusterProbeAltitude = 9000.0;
+
+// Search radius of the first guess of the terrain altitude of a cluster.
+static constexpr double AltitudeGuessMeters = 2000.0;
+
+// Margin around the points of a cluster in the probe view, in meters.
+static constexpr double ClusterMarginMeters = 10.0;
+
+void UAltitudeMeasurementService::Enqueue(const FMeasureAltitudeOffsetCommandParams& Params)
+{
+	UpdateHeightCacheFile();
+	double CachedHeight = 0.0;
+	if (HeightCache.FindNearest(Params.Lat, Params.Lon, CachedOffsetMeters, CachedHeight, FineLod))
+	{
+		PublishOffset(Params, TEXT("cached"), Params.ExpectedAltitude - CachedHeight);
+		return;
+	}
+
+	if (Stage != EAltitudeMeasurementStage::Idle && !Active.bCluster && Active.Params.UUID == Params.UUID)
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Altitude offset measurement %s already in progress, request ignored"), *Params.UUID);
+		return;
+	}
+	FAltitudeMeasurementJob* Pending = PendingJobs.FindByPredicate([&Params](const FAltitudeMeasurementJob& Job) {
+		return !Job.bCluster && Job.Params.UUID == Params.UUID;
+	});
+	if (Pending != nullptr)
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Altitude offset measurement %s already queued, replacing its parameters"), *Params.UUID);
+		Pending->Params = Params;
+		return;
+	}
+	FAltitudeMeasurementJob& Job = PendingJobs.AddDefaulted_GetRef();
+	Job.Params = Params;
+	UE_LOG(LogAerosimConnector, Log, TEXT("Altitude offset measurement %s queued (%d pending)"), *Params.UUID, GetNumPending());
+}
+
+void UAltitudeMeasurementService::EnqueueTerrainQuery(const FString& UUID, TArray<FVector2D>&& Points, double MaxDistance, double Timeout)
+{
+	if (Queries.Contains(UUID))
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Terrain height query %s already in progress, request ignored"), *UUID);
+		return;
+	}
+	UpdateHeightCacheFile();
+	if (MaxDistance <= 0.0)
+	{
+		MaxDistance = CVarTerrainHeightsInterpolationMeters.GetValueOnGameThread();
+	}
+
+	FTerrainHeightQuery Query;
+	Query.UUID = UUID;
+	Query.Points = MoveTemp(Points);
+	Query.Heights.SetNumZeroed(Query.Points.Num());
+	Query.Sources.Init(ETerrainHeightSource::Missing, Query.Points.Num());
+
+	// Group the points the cache cannot answer into cells of the cluster size.
+	const double ClusterMeters = FMath::Max(CVarTerrainHeightsClusterMeters.GetValueOnGameThread(), 1.0f);
+	TMap<FIntPoint, TArray<int32>> Misses;
+	int32 NumMisses = 0;
+	for (int32 Index = 0; Index < Query.Points.Num(); ++Index)
+	{
+		const FVector2D& Point = Query.Points[Index];
+		if (!FMath::IsFinite(Point.X) || !FMath::IsFinite(Point.Y) || FMath::Abs(Point.X) > 90.0)
+		{
+			continue; // Malformed, answered as missing.
+		}
+		if (HeightCache.Query(Point.X, Point.Y, MaxDistance, Query.Heights[Index]))
+		{
+			Query.Sources[Index] = ETerrainHeightSource::Cache;
+			continue;
+		}
+		// Meters east of the prime meridian at this latitude and north of the equator.
+		const double East = FTerrainHeightCache::GetOffsetMeters(Point.X, 0.0, Point.X, Point.Y).X;
+		const double North = FTerrainHeightCache::GetOffsetMeters(0.0, Point.Y, Point.X, Point.Y).Y;
+		Misses.FindOrAdd(FIntPoint(FMath::FloorToInt32(East / ClusterMeters), FMath::FloorToInt32(North / ClusterMeters))).Add(Index);
+		++NumMisses;
+	}
+
+	UE_LOG(LogAerosimConnector, Log, TEXT("Terrain height query %s: %d points, %d from the cache, %d to measure in %d clusters"),
+		*UUID, Query.Points.Num(), Query.Points.Num() - NumMisses, NumMisses, Misses.Num());
+
+	for (TPair<FIntPoint, TArray<int32>>& Cluster : Misses)
+	{
+		FAltitudeMeasurementJob& Job = PendingJobs.AddDefaulted_GetRef();
+		Job.bCluster = true;
+		Job.Params.UUID = UUID;
+		Job.Params.Timeout = Timeout;
+		for (int32 Index : Cluster.Value)
+		{
+			Job.Params.Lat += Query.Points[Index].X / Cluster.Value.Num();
+			Job.Params.Lon += Query.Points[Index].Y / Cluster.Value.Num();
+		}
+		Job.PointIndices = MoveTemp(Cluster.Value);
+	}
+	Query.PendingClusters = Misses.Num();
+
+	if (Query.PendingClusters == 0)
+	{
+		PublishQuery(Query);
+		return;
+	}
+	Queries.Add(UUID, MoveTemp(Query));
+}
+
+void UAltitudeMeasurementService::Tick(float DeltaSeconds)
+{
+	if (Stage == EAltitudeMeasurementStage::Idle)
+	{
+		StartNext();
+		if (Stage == EAltitudeMeasurementStage::Idle)
+			return;
+	}
+
+	if (FPlatformTime::Seconds() - ActiveStartTime > ActiveTimeout)
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Altitude measurement %s timed out after %.1f s"), *Active.Params.UUID, ActiveTimeout);
+		if (Active.bCluster)
+		{
+			Queries.FindChecked(Active.Params.UUID).bTimedOut = true;
+			FinishCluster();
+		}
+		else
+		{
+			Finish(TEXT("timeout"), 0.0);
+		}
+		return;
+	}
+
+	switch (Stage)
+	{
+		case EAltitudeMeasurementStage::SettleCoarse:
+			UpdateSettling(EAltitudeMeasurementStage::MeasureCoarse);
+			break;
+		case EAltitudeMeasurementStage::SettleFine:
+			UpdateSettling(EAltitudeMeasurementStage::MeasureFine);
+			break;
+		default:
+			// Waiting for the readback.
+			break;
+	}
+}
+
+void UAltitudeMeasurementService::Shutdown()
+{
+	if (HeightCache.IsOpen() && HeightCache.IsDirty())
+	{
+		HeightCache.Save();
+	}
+}
+
+void UAltitudeMeasurementService::UpdateHeightCacheFile()
+{
+	if (!CVarTerrainHeightsPersist.GetValueOnGameThread() || !IsValid(CesiumTileManager))
+	{
+		return;
+	}
+	const FString SourceKey = CesiumTileManager->GetTilesetSourceKey();
+	const double Precision = FMath::Max(CVarTerrainHeightsPrecisionDegrees.GetValueOnGameThread(), 1e-7f);
+	if (SourceKey.IsEmpty() || (SourceKey == HeightCacheSourceKey && HeightCache.IsOpen()))
+	{
+		return;
+	}
+
+	Shutdown();
+	HeightCacheSourceKey = SourceKey;
+	const FTCHARToUTF8 SourceUtf8(*SourceKey);
+	const uint64 SourceHash = CityHash64(SourceUtf8.Get(), SourceUtf8.Length());
+	const FString Path = FPaths::ProjectSavedDir() / TEXT("Aerosim") / TEXT("TerrainHeights") / FString::Printf(TEXT("%016llx.bin"), SourceHash);
+	HeightCache.Open(Path, SourceHash, Precision);
+}
+
+void UAltitudeMeasurementService::StartNext()
+{
+	if (PendingJobs.IsEmpty())
+	{
+		if (bSensorSpawned)
+		{
+			CesiumTileManager->DeleteAltitudeOffsetSensor();
+			bSensorSpawned = false;
+		}
+		RestoreView();
+		// Nothing left to measure, a good time to write the new heights.
+		Shutdown();
+		return;
+	}
+	if (!IsValid(CesiumTileManager))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("TileManager is not valid"));
+		return;
+	}
+
+	SaveView();
+	Active = MoveTemp(PendingJobs[0]);
+	PendingJobs.RemoveAt(0);
+	ActiveStartTime = FPlatformTime::Seconds();
+	ActiveTimeout = Active.Params.Timeout > 0.0 ? Active.Params.Timeout : CVarAltitudeMeasurementTimeoutSeconds.GetValueOnGameThread();
+	CoarseHeights.Reset();
+	FinePoints.Reset();
+
+	if (!bSensorSpawned)
+	{
+		bSensorSpawned = CesiumTileManager->SpawnAltitudeOffsetSensor();
+		if (bSensorSpawned)
+		{
+			DefaultOrthoWidth = CesiumTileManager->GetAltitudeOffsetSensor()->GetOrthoWidth();
+		}
+	}
+	ADepthCaptureSensor* Probe = CesiumTileManager->GetAltitudeOffsetSensor();
+
+	if (!Active.bCluster)
+	{
+		UE_LOG(LogAerosimConnector, Log, TEXT("Altitude offset measurement %s started at %f %f"), *Active.Params.UUID, Active.Params.Lat, Active.Params.Lon);
+		if (IsValid(Probe))
+		{
+			Probe->SetOrthoWidth(DefaultOrthoWidth);
+		}
+		StartProbe(Active.Params.ExpectedAltitude);
+		return;
+	}
+
+	// Widen the probe to see every point of the cluster.
+	double HalfExtent = 0.0;
+	const FTerrainHeightQuery& Query = Queries.FindChecked(Active.Params.UUID);
+	for (int32 Index : Active.PointIndices)
+	{
+		const FVector2D Offset = FTerrainHeightCache::GetOffsetMeters(Active.Params.Lat, Active.Params.Lon, Query.Points[Index].X, Query.Points[Index].Y);
+		HalfExtent = FMath::Max(HalfExtent, FMath::Max(FMath::Abs(Offset.X), FMath::Abs(Offset.Y)));
+	}
+	if (IsValid(Probe))
+	{
+		Probe->SetOrthoWidth(FMath::Max<float>(DefaultOrthoWidth, (2.0 * HalfExtent + ClusterMarginMeters) * 100.0));
+	}
+
+	// Start from the closest height measured so far, or the ellipsoid.
+	double AltitudeGuess = 0.0;
+	HeightCache.FindNearest(Active.Params.Lat, Active.Params.Lon, AltitudeGuessMeters, AltitudeGuess);
+	Active.Params.ExpectedAltitude = AltitudeGuess;
+
+	UE_LOG(LogAerosimConnector, Verbose, TEXT("Terrain height query %s: measuring %d points around %f %f"), *Active.Params.UUID, Active.PointIndices.Num(), Active.Params.Lat, Active.Params.Lon);
+	StartProbe(AltitudeGuess);
+}
+
+void UAltitudeMeasurementService::SaveView()
+{
+	ACesiumGeoreference* GeoReference = CesiumTileManager->GetGeoReference();
+	if (bViewSaved || !IsValid(GeoReference))
+	{
+		return;
+	}
+	bViewSaved = true;
+	SavedOrigin = GeoReference->GetOriginLongitudeLatitudeHeight();
+	SavedSpectatorParent = nullptr;
+	SavedSpectatorSocket = NAME_None;
+	if (IsValid(SpectatorPawn) && SpectatorPawn->GetRootComponent() != nullptr)
+	{
+		// Attached, e.g. following a vehicle: keep the offset to the parent.
+		USceneComponent* Root = SpectatorPawn->GetRootComponent();
+		SavedSpectatorParent = Root->GetAttachParent();
+		SavedSpectatorSocket = Root->GetAttachSocketName();
+		SavedSpectatorTransform = SavedSpectatorParent.IsValid() ? Root->GetRelativeTransform() : SpectatorPawn->GetActorTransform();
+	}
+}
+
+void UAltitudeMeasurementService::RestoreView()
+{
+	if (!bViewSaved)
+	{
+		return;
+	}
+	bViewSaved = false;
+	if (!IsValid(CesiumTileManager))
+	{
+		return;
+	}
+	UE_LOG(LogAerosimConnector, Log, TEXT("Altitude measurements done, origin back to %f %f %f"), SavedOrigin.Y, SavedOrigin.X, SavedOrigin.Z);
+	CesiumTileManager->MoveOrigin(SavedOrigin.Y, SavedOrigin.X, SavedOrigin.Z);
+
+	// Unreal coordinates are those of the saved origin again.
+	if (IsValid(SpectatorPawn))
+	{
+		if (USceneComponent* Parent = SavedSpectatorParent.Get())
+		{
+			SpectatorPawn->GetRootComponent()->AttachToComponent(Parent, FAttachmentTransformRules::KeepRelativeTransform, SavedSpectatorSocket);
+			SpectatorPawn->SetActorRelativeTransform(SavedSpectatorTransform);
+		}
+		else
+		{
+			SpectatorPawn->SetActorTransform(SavedSpectatorTransform);
+		}
+	}
+}
+
+void UAltitudeMeasurementService::StartProbe(double ExpectedAltitude)
+{
+	// Move the origin to the given coordinates, raised by the known offset
+	DepthSensorOffset = InitialDepthSensorOffset;
+	MoveProbe(ExpectedAltitude + DepthSensorOffset);
+
+	Stage = EAltitudeMeasurementStage::SettleCoarse;
+	SettledFrames = 0;
+}
+
+void UAltitudeMeasurementService::MoveProbe(double ProbeAltitude)
+{
+	// A rebase keeps the other actors in place, the probe stays at the origin
+	CesiumTileManager->MoveOrigin(Active.Params.Lat, Active.Params.Lon, ProbeAltitude);
+
+	// The tiles are selected for the spectator view, keep it over the probe looking down
+	if (IsValid(SpectatorPawn))
+	{
+		SpectatorPawn->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
+		SpectatorPawn->SetActorLocation(FVector(0, 0, 0));
+		SpectatorPawn->SetActorRotation(FVector(0, 0, -90).Rotation());
+	}
+	else
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("No SpectatorPawn Found"));
+	}
+}
+
+void UAltitudeMeasurementService::UpdateSettling(EAltitudeMeasurementStage NextStage)
+{
+	// Moving the origin drops the progress below 100 on the next tileset update,
+	// so it must stay complete over several frames, not just be complete once.
+	ACesium3DTileset* Tileset = CesiumTileManager->GetCesiumTileset();
+	const bool bLoaded = !IsValid(Tileset) || Tileset->GetLoadProgress() >= 100.0f;
+	SettledFrames = bLoaded ? SettledFrames + 1 : 0;
+	if (SettledFrames < CVarAltitudeMeasurementSettleFrames.GetValueOnGameThread())
+	{
+		return;
+	}
+
+	Stage = NextStage;
+	Measure();
+}
+
+void UAltitudeMeasurementService::Measure()
+{
+	const uint32 Serial = ++MeasurementSerial;
+	if (!Active.bCluster)
+	{
+		CesiumTileManager->MeasureAltitudeOffsetAsync([WeakThis = TWeakObjectPtr<UAltitudeMeasurementService>(this), Serial](double MeasuredDistance) {
+			if (UAltitudeMeasurementService* This = WeakThis.Get())
+			{
+				This->OnMeasured(Serial, MeasuredDistance);
+			}
+		});
+		return;
+	}
+
+	ADepthCaptureSensor* Probe = CesiumTileManager->GetAltitudeOffsetSensor();
+	if (!IsValid(Probe))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("DepthCaptureActor not in Scene"));
+		FinishCluster();
+		return;
+	}
+	Probe->ReadDepthAsync([WeakThis = TWeakObjectPtr<UAltitudeMeasurementService>(this), Serial]() {
+		if (UAltitudeMeasurementService* This = WeakThis.Get())
+		{
+			This->OnClusterRead(Serial);
+		}
+	});
+}
+
+void UAltitudeMeasurementService::OnMeasured(uint32 Serial, double MeasuredDistance)
+{
+	if (Serial != MeasurementSerial || (Stage != EAltitudeMeasurementStage::MeasureCoarse && Stage != EAltitudeMeasurementStage::MeasureFine))
+	{
+		return;
+	}
+
+	if (MeasuredDistance < 0.0)
+	{
+		// Too few valid depths, e.g. tiles still missing under the probe. Try
+		// again once settled, the timeout bounds the retries.
+		Stage = Stage == EAltitudeMeasurementStage::MeasureCoarse ? EAltitudeMeasurementStage::SettleCoarse : EAltitudeMeasurementStage::SettleFine;
+		SettledFrames = 0;
+		return;
+	}
+
+	double AltitudeOffset = MeasuredDistance / 100.0; // Convert from cm to m
+	AltitudeOffset -= DepthSensorOffset;
+
+	if (Stage == EAltitudeMeasurementStage::MeasureFine)
+	{
+		// Terrain queries around this point can use it too.
+		HeightCache.Add(Active.Params.Lat, Active.Params.Lon, Active.Params.ExpectedAltitude - AltitudeOffset, FineLod);
+		Finish(TEXT("ok"), AltitudeOffset);
+		return;
+	}
+
+	// Move the probe close above the terrain so it switches to the closest LOD
+	if (AltitudeOffset < 0.0)
+	{
+		DepthSensorOffset = FMath::Abs(AltitudeOffset) + FineDepthSensorOffset;
+	}
+	else if (AltitudeOffset < FineDepthSensorOffset)
+	{
+		DepthSensorOffset = FineDepthSensorOffset;
+	}
+	else
+	{
+		DepthSensorOffset = 0.0;
+	}
+	MoveProbe(Active.Params.ExpectedAltitude + DepthSensorOffset);
+
+	Stage = EAltitudeMeasurementStage::SettleFine;
+	SettledFrames = 0;
+}
+
+int32 UAltitudeMeasurementService::ReadClusterHeights(TArray<TOptional<double>>& OutHeights) const
+{
+	const FTerrainHeightQuery& Query = Queries.FindChecked(Active.Params.UUID);
+	ADepthCaptureSensor* Probe = CesiumTileManager->GetAltitudeOffsetSensor();
+	ACesiumGeoreference* GeoReference = CesiumTileManager->GetGeoReference();
+	OutHeights.Init(TOptional<double>(), Active.PointIndices.Num());
+	if (!IsValid(Probe) || !IsValid(GeoReference))
+	{
+		return 0;
+	}
+
+	// The probe sits at the origin, raised by DepthSensorOffset above the guess.
+	const double ProbeAltitude = Active.Params.ExpectedAltitude + DepthSensorOffset;
+	int32 NumMeasured = 0;
+	for (int32 Point = 0; Point < Active.PointIndices.Num(); ++Point)
+	{
+		const FVector2D& LatLon = Query.Points[Active.PointIndices[Point]];
+		const FVector Location = GeoReference->TransformLongitudeLatitudeHeightPositionToUnreal(FVector(LatLon.Y, LatLon.X, ProbeAltitude));
+		FVector2D UV;
+		if (!Probe->ProjectToUV(Location, UV))
+			continue;
+		const float Depth = Probe->GetDepthAt(UV);
+		if (Depth < 0.0f)
+			continue;
+		OutHeights[Point] = ProbeAltitude - Depth / 100.0; // Convert from cm to m
+		++NumMeasured;
+	}
+	return NumMeasured;
+}
+
+void UAltitudeMeasurementService::OnClusterRead(uint32 Serial)
+{
+	if (Serial != MeasurementSerial || !Active.bCluster)
+	{
+		return;
+	}
+
+	TArray<TOptional<double>> Heights;
+	const int32 NumMeasured = ReadClusterHeights(Heights);
+
+	if (Stage == EAltitudeMeasurementStage::MeasureCoarse)
+	{
+		if (NumMeasured == 0)
+		{
+			// Nothing under the probe, likely under ground: raise it and try again.
+			if (Active.Params.ExpectedAltitude + DepthSensorOffset + ClusterRaiseStep > MaxClusterProbeAltitude)
+			{
+				FinishCluster();
+				return;
+			}
+			DepthSensorOffset += ClusterRaiseStep;
+			MoveProbe(Active.Params.ExpectedAltitude + DepthSensorOffset);
+			Stage = EAltitudeMeasurementStage::SettleCoarse;
+			SettledFrames = 0;
+			return;
+		}
+
+		CoarseHeights = Heights;
+		double Highest = TNumericLimits<double>::Lowest();
+		for (const TOptional<double>& Height : Heights)
+		{
+			if (Height.IsSet())
+				Highest = FMath::Max(Highest, Height.GetValue());
+		}
+
+		// Close above the highest point for the finer LODs, far enough for the
+		// spectator view to cover the whole cluster.
+		ADepthCaptureSensor* Probe = CesiumTileManager->GetAltitudeOffsetSensor();
+		const double Clearance = FMath::Max(FineDepthSensorOffset, 0.5 * Probe->GetOrthoWidth() / 100.0);
+		DepthSensorOffset = Highest + Clearance - Active.Params.ExpectedAltitude;
+		MoveProbe(Active.Params.ExpectedAltitude + DepthSensorOffset);
+		Stage = EAltitudeMeasurementStage::SettleFine;
+		SettledFrames = 0;
+		return;
+	}
+
+	// Points missed by the fine readback keep their coarse height.
+	FinePoints.Init(false, Heights.Num());
+	for (int32 Point = 0; Point < Heights.Num(); ++Point)
+	{
+		if (Heights[Point].IsSet())
+		{
+			CoarseHeights[Point] = Heights[Point];
+			FinePoints[Point] = true;
+		}
+	}
+	FinishCluster();
+}
+
+void UAltitudeMeasurementService::FinishCluster()
+{
+	FTerrainHeightQuery& Query = Queries.FindChecked(Active.Params.UUID);
+	int32 NumMeasured = 0;
+	for (int32 Point = 0; Point < CoarseHeights.Num(); ++Point)
+	{
+		if (!CoarseHeights[Point].IsSet())
+			continue;
+		const int32 Index = Active.PointIndices[Point];
+		Query.Heights[Index] = CoarseHeights[Point].GetValue();
+		Query.Sources[Index] = ETerrainHeightSource::Measured;
+		const bool bFine = FinePoints.IsValidIndex(Point) && FinePoints[Point];
+		HeightCache.Add(Query.Points[Index].X, Query.Points[Index].Y, Query.Heights[Index], bFine ? FineLod : CoarseLod);
+		++NumMeasured;
+	}
+	UE_LOG(LogAerosimConnector, Verbose, TEXT("Terrain height query %s: measured %d of %d points in %.2f s"),
+		*Query.UUID, NumMeasured, Active.PointIndices.Num(), FPlatformTime::Seconds() - ActiveStartTime);
+
+	++MeasurementSerial;
+	Stage = EAltitudeMeasurementStage::Idle;
+	if (--Query.PendingClusters == 0)
+	{
+		PublishQuery(Query);
+		Queries.Remove(Active.Params.UUID);
+	}
+}
+
+void UAltitudeMeasurementService::PublishQuery(FTerrainHeightQuery& Query)
+{
+	int32 NumCached = 0;
+	int32 NumMeasured = 0;
+	TArray<TSharedPtr<FJsonValue>> Heights;
+	TArray<TSharedPtr<FJsonValue>> Sources;
+	for (int32 Index = 0; Index < Query.Points.Num(); ++Index)
+	{
+		switch (Query.Sources[Index])
+		{
+			case ETerrainHeightSource::Cache:
+				++NumCached;
+				Heights.Add(MakeShared<FJsonValueNumber>(Query.Heights[Index]));
+				Sources.Add(MakeShared<FJsonValueString>(TEXT("cache")));
+				break;
+			case ETerrainHeightSource::Measured:
+				++NumMeasured;
+				Heights.Add(MakeShared<FJsonValueNumber>(Query.Heights[Index]));
+				Sources.Add(MakeShared<FJsonValueString>(TEXT("measured")));
+				break;
+			default:
+				Heights.Add(MakeShared<FJsonValueNull>());
+				Sources.Add(MakeShared<FJsonValueString>(TEXT("missing")));
+				break;
+		}
+	}
+	const int32 NumMissing = Query.Points.Num() - NumCached - NumMeasured;
+	UE_LOG(LogAerosimConnector, Log, TEXT("Terrain height query %s answered: %d from the cache, %d measured, %d missing"), *Query.UUID, NumCached, NumMeasured, NumMissing);
+
+	TSharedPtr<FJsonObject> ResponsePayload = MakeShareable(new FJsonObject);
+	ResponsePayload->SetStringField(TEXT("uuid"), Query.UUID);
+	ResponsePayload->SetStringField(TEXT("response_type"), TEXT("query_terrain_heights_response"));
+
+	TSharedPtr<FJsonObject> ResponseParameters = MakeShareable(new FJsonObject);
+	ResponseParameters->SetArrayField(TEXT("heights"), Heights);
+	ResponseParameters->SetArrayField(TEXT("sources"), Sources);
+	ResponseParameters->SetNumberField(TEXT("cache_hits"), NumCached);
+	ResponseParameters->SetNumberField(TEXT("measured"), NumMeasured);
+	ResponseParameters->SetNumberField(TEXT("missing"), NumMissing);
+	ResponseParameters->SetStringField(TEXT("status"), Query.bTimedOut ? TEXT("timeout") : TEXT("ok"));
+	ResponsePayload->SetObjectField(TEXT("parameters"), ResponseParameters);
+
+	FString ResponseString;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ResponseString);
+	FJsonSerializer::Serialize(ResponsePayload.ToSharedRef(), Writer);
+
+	publish_to_topic("aerosim.renderer.responses", TCHAR_TO_UTF8(*ResponseString));
+}
+
+void UAltitudeMeasurementService::Finish(const TCHAR* Status, double AltitudeOffset)
+{
+	UE_LOG(LogAerosimConnector, Log, TEXT("Altitude offset measurement %s: %s, offset %f m in %.2f s"), *Active.Params.UUID, Status, AltitudeOffset, FPlatformTime::Seconds() - ActiveStartTime);
+	PublishOffset(Active.Params, Status, AltitudeOffset);
+
+	++MeasurementSerial;
+	Stage = EAltitudeMeasurementStage::Idle;
+}
+
+void UAltitudeMeasurementService::PublishOffset(const FMeasureAltitudeOffsetCommandParams& Params, const TCHAR* Status, double AltitudeOffset)
+{
+	// Create the response payload
+	TSharedPtr<FJsonObject> ResponsePayload = MakeShareable(new FJsonObject);
+	ResponsePayload->SetStringField(TEXT("uuid"), Params.UUID);
+	ResponsePayload->SetStringField(TEXT("response_type"), TEXT("measure_altitude_offset_response"));
+
+	TSharedPtr<FJsonObject> ResponseParameters = MakeShareable(new FJsonObject);
+	ResponseParameters->SetNumberField(TEXT("lat"), Params.Lat);
+	ResponseParameters->SetNumberField(TEXT("lon"), Params.Lon);
+	ResponseParameters->SetNumberField(TEXT("altitude_offset"), AltitudeOffset);
+	ResponseParameters->SetStringField(TEXT("status"), Status);
+
+	ResponsePayload->SetObjectField(TEXT("parameters"), ResponseParameters);
+
+	// Serialize the response payload to a string
+	FString ResponseString;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ResponseString);
+	FJsonSerializer::Serialize(ResponsePayload.ToSharedRef(), Writer);
+
+	publish_to_topic("aerosim.renderer.responses", TCHAR_TO_UTF8(*ResponseString));
+}
@@ -1,6 +1,7 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "Game/Subsystems/CesiumTileManager.h"
+#include "Game/AerosimGameMode.h"
 #include "CesiumGeoreference.h"
 #ifdef _WIN32
 	#include "windows/WindowsWindow.h"
@@ -11,6 +12,22 @@
 #include "CesiumSunSky.h"
 #include "Actors/DepthCaptureSensor.h"
 #include "Components/ChildActorComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "CesiumRuntimeSettings.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
+#include "Cesium3DTilesSelection/Tile.h"
+#include "Cesium3DTilesSelection/TileLoadState.h"
+#include "Cesium3DTilesSelection/Tileset.h"
+#include "Cesium3DTilesetLoadFailureDetails.h"
+#include "Containers/Ticker.h"
+#include "Interfaces/IPluginManager.h"
+
+static TAutoConsoleVariable<float> CVarOriginRebaseMeters(
+	TEXT("aerosim.Origin.RebaseMeters"),
+	20000.0f,
+	TEXT("Origin changes up to this distance rebase the world in place instead of reloading the tileset around the new origin."),
+	ECVF_Default);
 
 void UCesiumTileManager::BeginPlay()
 {
@@ -31,8 +48,18 @@ void UCesiumTileManager::BeginPlay()
 	}
 
 	CesiumTileset->AttachToActor(GeoReference, FAttachmentTransformRules::KeepWorldTransform);
-	CesiumTileset->SetTilesetSource(ETilesetSource::FromCesiumIon);
-	CesiumTileset->SetIonAssetID(2275207);
+
+	// -AerosimTileset=<ion asset id | tileset directory, json or url> picks the
+	// source before anything is requested, e.g. on nodes without network access
+	FString SourceOverride;
+	if (FParse::Value(FCommandLine::Get(), TEXT("AerosimTileset="), SourceOverride))
+	{
+		SetTilesetSourceFromString(SourceOverride);
+	}
+	else
+	{
+		ApplyTilesetSource();
+	}
 
 	// Patch to prevent flickering tiles from Unreal occlusion culling issue
 	// https://github.com/CesiumGS/cesium-unreal/issues/914
@@ -43,12 +70,64 @@ void UCesiumTileManager::BeginPlay()
 
 void UCesiumTileManager::EndPlay()
 {
+	Prefetcher.Reset(CesiumTileset);
+	Metrics.Reset(CesiumTileset);
+
 	// Delete default georeference created dynamically
 	if (GeoReference != nullptr)
 	{
 		GeoReference->Destroy();
 	}
 }
+void UCesiumTileManager::Tick(float DeltaSeconds)
+{
+	Prefetcher.Tick(CesiumTileset, DeltaSeconds);
+	Governor.Tick(CesiumTileset, DeltaSeconds);
+	Metrics.Tick(CesiumTileset, DeltaSeconds);
+}
+
+void UCesiumTileManager::SetTileBudget(TOptional<double> MaximumScreenSpaceError, TOptional<int64> MaximumCachedBytes,
+	TOptional<int32> MaximumSimultaneousTileLoads, TOptional<bool> bGovernorEnabled)
+{
+	if (bGovernorEnabled.IsSet())
+	{
+		FTileGovernor::SetEnabled(bGovernorEnabled.GetValue());
+	}
+	if (!IsValid(CesiumTileset))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("CesiumTileset is not valid"));
+		return;
+	}
+	FTileBudget Budget = FTileGovernor::GetBudget(CesiumTileset);
+	Budget.MaximumScreenSpaceError = MaximumScreenSpaceError.Get(Budget.MaximumScreenSpaceError);
+	Budget.MaximumCachedBytes = MaximumCachedBytes.Get(Budget.MaximumCachedBytes);
+	Budget.MaximumSimultaneousTileLoads = MaximumSimultaneousTileLoads.Get(Budget.MaximumSimultaneousTileLoads);
+	Governor.SetUserBudget(CesiumTileset, Budget);
+	UE_LOG(LogAerosimConnector, Log, TEXT("Tileset budget set: screen-space error %.1f, cache %.0f MB, %d loads"),
+		Budget.MaximumScreenSpaceError, Budget.MaximumCachedBytes / (1024.0 * 1024.0), Budget.MaximumSimultaneousTileLoads);
+}
+
+UCesiumTileManager* UCesiumTileManager::Get(const UWorld* World)
+{
+	if (World == nullptr)
+		return nullptr;
+	AAerosimGameMode* GameMode = World->GetAuthGameMode<AAerosimGameMode>();
+	return IsValid(GameMode) ? GameMode->GetCesiumTileManager() : nullptr;
+}
+
+FString UCesiumTileManager::GetTilesetSourceKey() const
+{
+	if (!IsValid(CesiumTileset))
+	{
+		return FString();
+	}
+	if (CesiumTileset->GetTilesetSource() == ETilesetSource::FromUrl)
+	{
+		return TEXT("url:") + CesiumTileset->GetUrl();
+	}
+	return FString::Printf(TEXT("ion:%lld"), CesiumTileset->GetIonAssetID());
+}
+
 bool UCesiumTileManager::LoadTileSet(double Lat, double Lon, double Height)
 {
 	UE_LOG(LogAerosimConnector, Warning, TEXT("Tile set to be loaded at %f %f"), Lat, Lon);
@@ -77,6 +156,39 @@ bool UCesiumTileManager::LoadTileSet(double Lat, double Lon, double Height)
 	return true;
 }
 
+bool UCesiumTileManager::MoveOrigin(double Lat, double Lon, double Height)
+{
+	if (!IsValid(GeoReference))
+	{
+		LoadTileSet(Lat, Lon, Height);
+		return false;
+	}
+
+	// The Unreal origin is the current georeference origin.
+	const double Distance = GeoReference->TransformLongitudeLatitudeHeightPositionToUnreal(FVector(Lon, Lat, Height)).Size() / 100.0;
+	if (Distance > CVarOriginRebaseMeters.GetValueOnGameThread())
+	{
+		UE_LOG(LogAerosimConnector, Log, TEXT("Origin moves %.0f m to %f %f, reloading the tileset"), Distance, Lat, Lon);
+		LoadTileSet(Lat, Lon, Height);
+		return false;
+	}
+
+	// Through Earth-centered coordinates, which the move does not change.
+	const FMatrix UnrealToEcef = GeoReference->ComputeUnrealToEarthCenteredEarthFixedTransformation();
+	GeoReference->SetOriginLongitudeLatitudeHeight(FVector(Lon, Lat, Height));
+	const FTransform Rebase(UnrealToEcef * GeoReference->ComputeEarthCenteredEarthFixedToUnrealTransformation());
+
+	if (IsValid(SpectatorPawn) && SpectatorPawn->GetAttachParentActor() == nullptr)
+	{
+		SpectatorPawn->SetActorTransform(SpectatorPawn->GetActorTransform() * Rebase);
+	}
+	Prefetcher.Rebase(Rebase);
+	OriginRebased.Broadcast(Rebase);
+
+	UE_LOG(LogAerosimConnector, Verbose, TEXT("Origin rebased by %.1f m to %f %f %f"), Distance, Lat, Lon, Height);
+	return true;
+}
+
 bool UCesiumTileManager::SpawnAltitudeOffsetSensor()
 {
 	// Spawn a DepthCaptureActor pointing straight down
@@ -98,6 +210,7 @@ void UCesiumTileManager::DeleteAltitudeOffsetSensor()
 	// Destroy the DepthCaptureActor
 	if (DepthCaptureActor)
 		DepthCaptureActor->Destroy();
+	DepthCaptureActor = nullptr;
 }
 
 double UCesiumTileManager::MeasureAltitudeOffset()
@@ -112,6 +225,243 @@ double UCesiumTileManager::MeasureAltitudeOffset()
 	return AltitudeOffset;
 }
 
+void UCesiumTileManager::MeasureAltitudeOffsetAsync(TFunction<void(double)>&& OnMeasured)
+{
+	if (!IsValid(DepthCaptureActor))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("DepthCaptureActor not in Scene"));
+		OnMeasured(-1.0);
+		return;
+	}
+
+	DepthCaptureActor->SampleHeightAsync(1000, [OnMeasured = MoveTemp(OnMeasured)](const FDepthSampleStats& Stats) {
+		UE_LOG(LogAerosimConnector, Log, TEXT("Altitude offset sensor: trimmed mean %f, median %f, %.0f%% valid"), Stats.TrimmedMean, Stats.Median, Stats.ValidRatio * 100.0f);
+		OnMeasured(Stats.IsValid() ? Stats.TrimmedMean : -1.0);
+	});
+}
+
+void UCesiumTileManager::SetTilesetSource(const FString& JsonPath, int32 IonId)
+{
+	CesiumJsonPath = JsonPath;
+	CesiumIonID = IonId;
+	ApplyTilesetSource();
+}
+
+void UCesiumTileManager::SetTilesetSourceFromString(const FString& Source)
+{
+	if (Source.IsNumeric())
+	{
+		SetTilesetSource(FString(), FCString::Atoi(*Source));
+	}
+	else
+	{
+		SetTilesetSource(Source, CesiumIonID);
+	}
+}
+
+FString UCesiumTileManager::ResolveTilesetUrl(const FString& JsonPath)
+{
+	if (JsonPath.Contains(TEXT("://")))
+	{
+		return JsonPath;
+	}
+	// A directory holds a tileset.json, relative paths are from the project
+	FString Path = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), JsonPath);
+	if (FPaths::DirectoryExists(Path))
+	{
+		Path /= TEXT("tileset.json");
+	}
+	if (!FPaths::FileExists(Path))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Local tileset %s not found"), *Path);
+	}
+	return RefactorPath(Path);
+}
+
+FString UCesiumTileManager::GetSampleTilesetPath()
+{
+	const TSharedPtr<IPlugin> Plugin = IPluginManager::Get().FindPlugin(TEXT("AerosimConnector"));
+	return Plugin.IsValid() ? FPaths::ConvertRelativePathToFull(Plugin->GetBaseDir() / TEXT("Resources/SampleTileset")) : FString();
+}
+
+void UCesiumTileManager::CheckLocalTileset(const FString& JsonPath, double TimeoutSeconds)
+{
+	using namespace Cesium3DTilesSelection;
+
+	if (!IsValid(CesiumTileset))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Tileset check: no tileset in this world"));
+		return;
+	}
+	const bool bSample = JsonPath.IsEmpty();
+	const FString Path = bSample ? GetSampleTilesetPath() : JsonPath;
+	if (Path.IsEmpty() || Path.Contains(TEXT("://")))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Tileset check: '%s' is not a local tileset"), *Path);
+		return;
+	}
+	if (bCheckingTileset)
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Tileset check: a check is already running"));
+		return;
+	}
+
+	struct FCheck
+	{
+		TWeakObjectPtr<UCesiumTileManager> Manager;
+		TWeakObjectPtr<ACesium3DTileset> Tileset;
+		FString Url;
+		double StartSeconds = 0.0;
+		double TimeoutSeconds = 0.0;
+		FString Failure;
+		FDelegateHandle FailureHandle;
+		// Source, origin (Lon, Lat, Height) and spectator put back once done.
+		FString PreviousJsonPath;
+		int32 PreviousIonId = 0;
+		bool bMovedOrigin = false;
+		FVector PreviousOrigin = FVector::ZeroVector;
+		FTransform PreviousSpectatorTransform;
+	};
+	const TSharedRef<FCheck> Check = MakeShared<FCheck>();
+	Check->Manager = this;
+	Check->PreviousJsonPath = CesiumJsonPath;
+	Check->PreviousIonId = CesiumIonID;
+	if (bSample && IsValid(GeoReference))
+	{
+		Check->bMovedOrigin = true;
+		Check->PreviousOrigin = GeoReference->GetOriginLongitudeLatitudeHeight();
+		if (IsValid(SpectatorPawn))
+		{
+			Check->PreviousSpectatorTransform = SpectatorPawn->GetActorTransform();
+		}
+		LoadTileSet(0.0, 0.0, 0.0);
+	}
+	SetTilesetSource(Path, CesiumIonID);
+	bCheckingTileset = true;
+
+	Check->Tileset = CesiumTileset;
+	Check->Url = CesiumTileset->GetUrl();
+	Check->StartSeconds = FPlatformTime::Seconds();
+	Check->TimeoutSeconds = TimeoutSeconds;
+	Check->FailureHandle = OnCesium3DTilesetLoadFailure.AddLambda([Check](const FCesium3DTilesetLoadFailureDetails& Details) {
+		if (Details.Tileset == Check->Tileset)
+		{
+			Check->Failure = FString::Printf(TEXT("%s (HTTP status %lld)"), *Details.Message, Details.HttpStatusCode);
+		}
+	});
+
+	FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Check](float) {
+		const ACesium3DTileset* TilesetActor = Check->Tileset.Get();
+		const double Elapsed = FPlatformTime::Seconds() - Check->StartSeconds;
+
+		// Tiles with renderable content, the root alone may be an empty parent
+		int32 LoadedTiles = 0;
+		const Tileset* NativeTileset = IsValid(TilesetActor) ? TilesetActor->GetTileset() : nullptr;
+		const Tile* Root = NativeTileset != nullptr ? NativeTileset->getRootTile() : nullptr;
+		TArray<const Tile*, TInlineAllocator<64>> Stack;
+		if (Root != nullptr)
+		{
+			Stack.Add(Root);
+		}
+		while (Stack.Num() > 0)
+		{
+			const Tile* Current = Stack.Pop(EAllowShrinking::No);
+			for (const Tile& Child : Current->getChildren())
+			{
+				Stack.Add(&Child);
+			}
+			if (Current->getState() == TileLoadState::Done && Current->getContent().isRenderContent())
+			{
+				++LoadedTiles;
+			}
+		}
+
+		bool bFinished = true;
+		if (!IsValid(TilesetActor))
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("Tileset check: the tileset was destroyed while loading %s"), *Check->Url);
+		}
+		else if (!Check->Failure.IsEmpty())
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("Tileset check: %s failed to load after %.2f s: %s"), *Check->Url, Elapsed, *Check->Failure);
+		}
+		else if (LoadedTiles > 0 && TilesetActor->GetLoadProgress() >= 100.0f)
+		{
+			UE_LOG(LogAerosimConnector, Display, TEXT("Tileset check: %s loaded %d tiles with content in %.2f s"), *Check->Url, LoadedTiles, Elapsed);
+		}
+		else if (Elapsed > Check->TimeoutSeconds)
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("Tileset check: %s not loaded after %.0f s, %s, %.0f%% progress"),
+				*Check->Url, Elapsed, Root != nullptr ? TEXT("root tile loaded") : TEXT("no root tile"), TilesetActor->GetLoadProgress());
+		}
+		else
+		{
+			bFinished = false;
+		}
+		if (!bFinished)
+		{
+			return true;
+		}
+		OnCesium3DTilesetLoadFailure.Remove(Check->FailureHandle);
+
+		UCesiumTileManager* Manager = Check->Manager.Get();
+		if (IsValid(Manager))
+		{
+			Manager->bCheckingTileset = false;
+			Manager->SetTilesetSource(Check->PreviousJsonPath, Check->PreviousIonId);
+			if (Check->bMovedOrigin)
+			{
+				Manager->LoadTileSet(Check->PreviousOrigin.Y, Check->PreviousOrigin.X, Check->PreviousOrigin.Z);
+				if (IsValid(Manager->SpectatorPawn))
+				{
+					Manager->SpectatorPawn->SetActorTransform(Check->PreviousSpectatorTransform);
+				}
+			}
+			UE_LOG(LogAerosimConnector, Display, TEXT("Tileset check: streaming %s again"), *Manager->GetTilesetSourceKey());
+		}
+		return false;
+	}));
+}
+
+void UCesiumTileManager::ApplyTilesetSource()
+{
+	if (!IsValid(CesiumTileset))
+	{
+		return;
+	}
+	if (!CesiumJsonPath.IsEmpty())
+	{
+		const FString Url = ResolveTilesetUrl(CesiumJsonPath);
+		CesiumTileset->SetTilesetSource(ETilesetSource::FromUrl);
+		CesiumTileset->SetUrl(Url);
+		UE_LOG(LogAerosimConnector, Log, TEXT("Tileset streaming from %s"), *Url);
+	}
+	else
+	{
+		CesiumTileset->SetTilesetSource(ETilesetSource::FromCesiumIon);
+		CesiumTileset->SetIonAssetID(CesiumIonID);
+		UE_LOG(LogAerosimConnector, Log, TEXT("Tileset streaming from Cesium ion asset %d"), CesiumIonID);
+	}
+}
+
+void UCesiumTileManager::ConfigureRequestCache(int32 MaxItems, int32 RequestsPerPrune)
+{
+	// Cesium opens its cache with these on the first tile request of the
+	// process, they are saved to the user config for the next start
+	UCesiumRuntimeSettings* Settings = GetMutableDefault<UCesiumRuntimeSettings>();
+	if (MaxItems > 0)
+	{
+		Settings->MaxCacheItems = MaxItems;
+	}
+	if (RequestsPerPrune > 0)
+	{
+		Settings->RequestsPerCachePrune = RequestsPerPrune;
+	}
+	Settings->SaveConfig();
+	UE_LOG(LogAerosimConnector, Log, TEXT("Tile request cache: %d items, pruned every %d requests, effective from the next start"),
+		Settings->MaxCacheItems, Settings->RequestsPerCachePrune);
+}
+
 FString UCesiumTileManager::RefactorPath(FString Path)
 {
 	// we make sure the file is formatted correctly, this let us just copy and past the route.
@@ -119,6 +469,8 @@ FString UCesiumTileManager::RefactorPath(FString Path)
 	// Prefix of the route in case it does not have it
 	if (!Path.Contains("file:///"))
 	{
+		// Absolute Unix paths already start with the third slash
+		Path.RemoveFromStart(TEXT("/"));
 		FString PrefixPathString = "file:///";
 		Path.InsertAt(0, PrefixPathString);
 	}
@@ -272,3 +624,52 @@ void UCesiumTileManager::SetCesiumWeatherEnabled(bool bEnable)
 	CesiumSunSky->SetActorHiddenInGame(!bEnable);
 	CesiumSunSky->SetActorEnableCollision(bEnable);
 }
+
+static FAutoConsoleCommandWithWorldAndArgs TilePrefetchStatsCommand(
+	TEXT("aerosim.TilePrefetch.Stats"),
+	TEXT("Logs how often the cameras saw tiles not loaded yet and the prefetch views in use. Pass reset to restart the counts."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World) {
+		UCesiumTileManager* TileManager = UCesiumTileManager::Get(World);
+		if (TileManager == nullptr)
+		{
+			UE_LOG(LogAerosimConnector, Display, TEXT("TilePrefetch: no tile manager in this world"));
+			return;
+		}
+		FTilePrefetcher& Prefetcher = TileManager->GetPrefetcher();
+		const FTilePrefetchStats& Stats = Prefetcher.GetStats();
+		UE_LOG(LogAerosimConnector, Display, TEXT("TilePrefetch: %d views for %d actors, tiles missing in %llu of %llu sampled frames (%.1f%%), %llu frames over the memory budget"),
+			Stats.Views, Stats.Targets, Stats.MissedFrames, Stats.SampledFrames, 100.0 * Stats.GetMissRatio(), Stats.OverBudgetFrames);
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Prefetcher.ResetStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs TilesetSourceCommand(
+	TEXT("aerosim.Tileset.Source"),
+	TEXT("Streams the tileset from a Cesium ion asset id, or from a tileset directory, tileset.json or url."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World) {
+		UCesiumTileManager* TileManager = UCesiumTileManager::Get(World);
+		if (TileManager == nullptr || Args.Num() < 1)
+		{
+			UE_LOG(LogAerosimConnector, Display, TEXT("Usage: aerosim.Tileset.Source <ion asset id | path | url>"));
+			return;
+		}
+		TileManager->SetTilesetSourceFromString(Args[0]);
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs TilesetCheckLocalCommand(
+	TEXT("aerosim.Tileset.CheckLocal"),
+	TEXT("Streams a local tileset directory or tileset.json, by default the sample one of the plugin, and logs whether and how fast it loaded. Needs no network access. ")
+		TEXT("The previous tileset, origin and spectator are restored once done."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World) {
+		UCesiumTileManager* TileManager = UCesiumTileManager::Get(World);
+		if (TileManager == nullptr)
+		{
+			UE_LOG(LogAerosimConnector, Display, TEXT("Usage: aerosim.Tileset.CheckLocal [path] [timeout seconds]"));
+			return;
+		}
+		const FString Path = Args.Num() > 0 ? Args[0] : FString();
+		const double TimeoutSeconds = Args.Num() > 1 ? FCString::Atod(*Args[1]) : 30.0;
+		TileManager->CheckLocalTileset(Path, TimeoutSeconds);
+	}));
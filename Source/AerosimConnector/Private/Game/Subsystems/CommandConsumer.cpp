@@ -24,6 +24,8 @@
 #include "Game/Subsystems/PayloadProcessor.h"
 #include "Game/Subsystems/AerosimDataTracker.h"
 #include "Actors/CameraSensor.h"
+#include "Actors/DepthCameraSensor.h"
+#include "Actors/LidarSensor.h"
 #include "Weather/AerosimWeather.h"
 
 static void PrintJsonObject(const TSharedPtr<FJsonObject>& JsonObject)
@@ -47,6 +49,30 @@ static void PrintJsonObject(const TSharedPtr<FJsonObject>& JsonObject)
 	}
 }
 
+static FImageStreamSettings MakePublishSettings(const FSensorData& Sensor)
+{
+	FImageStreamSettings PublishSettings;
+	PublishSettings.QueueDepth = Sensor.PublishQueueDepth;
+	PublishSettings.Policy = Sensor.PublishQueuePolicy;
+	PublishSettings.Layout = Sensor.OutputLayout;
+	PublishSettings.Encode.Codec = Sensor.Codec;
+	PublishSettings.Encode.Quality = Sensor.CodecQuality;
+	PublishSettings.Roi = FIntRect(Sensor.RoiOffset, Sensor.RoiOffset + Sensor.RoiSize);
+	PublishSettings.OutputSize = Sensor.OutputResolution;
+	PublishSettings.Downscale = Sensor.Downscale;
+	return PublishSettings;
+}
+
+static FSensorRecordingSettings MakeRecordingSettings(const FSensorData& Sensor)
+{
+	FSensorRecordingSettings RecordingSettings;
+	RecordingSettings.Directory = Sensor.RecordDirectory;
+	RecordingSettings.Format = Sensor.RecordFormat;
+	RecordingSettings.MaxInFlight = Sensor.RecordQueueDepth;
+	RecordingSettings.bDropWhenFull = Sensor.bRecordDropWhenFull;
+	return RecordingSettings;
+}
+
 void UCommandConsumer::SetActorRegistry(UActorRegistry* ActorRegistry)
 {
 	Registry = ActorRegistry;
@@ -55,6 +81,15 @@ void UCommandConsumer::SetActorRegistry(UActorRegistry* ActorRegistry)
 void UCommandConsumer::SetCesiumTileManager(UCesiumTileManager* NewCesiumTileManager)
 {
 	CesiumTileManager = NewCesiumTileManager;
+	if (IsValid(CesiumTileManager))
+	{
+		CesiumTileManager->OnOriginRebased().AddUObject(this, &UCommandConsumer::OnOriginRebased);
+	}
+}
+
+void UCommandConsumer::SetAltitudeMeasurementService(UAltitudeMeasurementService* NewAltitudeMeasurementService)
+{
+	AltitudeMeasurementService = NewAltitudeMeasurementService;
 }
 
 void UCommandConsumer::UpdateSceneFromSceneGraph(const FString& SceneGraphJson)
@@ -72,6 +107,7 @@ void UCommandConsumer::UpdateSceneFromSceneGraph(const FString& SceneGraphJson)
 
 	SpawnActorsIfNeeded(CurrentSceneGraph);
 	UpdateResourcesFromSceneGraph(CurrentSceneGraph);
+	UpdateSensorsFromSceneGraph(CurrentSceneGraph);
 	UpdateActorTransformsFromSceneGraph(CurrentSceneGraph);
 	UpdateEffectorsFromSceneGraph(CurrentSceneGraph);
 	UpdatePFDsFromSceneGraph(CurrentSceneGraph);
@@ -104,14 +140,15 @@ void UCommandConsumer::SpawnActorsIfNeeded(FSceneGraph& SceneGraph)
 
 			// Process sensor actors
 			bool bIsSensor = false;
-			if (ActorType == "sensors/cameras/rgb_camera")
+			if (ActorType == "sensors/cameras/rgb_camera" || ActorType == "sensors/cameras/segmentation_camera")
 			{
+				// Segmentation cameras are configured like RGB cameras, see ASegmentationCameraSensor.
 				bIsSensor = true;
 				ACameraSensor* CameraSensor = Cast<ACameraSensor>(SpawnedActor);
 				bool bCaptureEnabled = SceneGraph.Components.Sensors[Entity.Key].bCaptureEnabled;
 				CameraSensor->SetCaptureEnabled(bCaptureEnabled);
 				FVector2D Resolution = SceneGraph.Components.Sensors[Entity.Key].Resolution;
-				CameraSensor->GetRenderTarget()->InitCustomFormat(Resolution.X, Resolution.Y, EPixelFormat::PF_B8G8R8A8, true);
+				CameraSensor->InitRenderTarget(FIntPoint(Resolution.X, Resolution.Y));
 				ECameraProjectionMode::Type ProjectionMode = SceneGraph.Components.Sensors[Entity.Key].ProjectionMode;
 				CameraSensor->GetSceneCaptureActor()->GetCaptureComponent2D()->ProjectionType = ProjectionMode;
 				float OrthoWidth = SceneGraph.Components.Sensors[Entity.Key].OrthoWidth;
@@ -120,11 +157,47 @@ void UCommandConsumer::SpawnActorsIfNeeded(FSceneGraph& SceneGraph)
 				CameraSensor->GetSceneCaptureActor()->GetCaptureComponent2D()->FOVAngle = FOV;
 				float TickRate = SceneGraph.Components.Sensors[Entity.Key].TickRate;
 				CameraSensor->SetActorTickInterval(TickRate);
+				CameraSensor->SetPublishSettings(Entity.Key, MakePublishSettings(SceneGraph.Components.Sensors[Entity.Key]));
 			}
 			else if (ActorType == "sensors/depth_sensor")
 			{
 				bIsSensor = true;
-				// TODO
+				ADepthCameraSensor* DepthSensor = Cast<ADepthCameraSensor>(SpawnedActor);
+				if (IsValid(DepthSensor))
+				{
+					const FSensorData& Sensor = SceneGraph.Components.Sensors[Entity.Key];
+					DepthSensor->SetCaptureEnabled(Sensor.bCaptureEnabled);
+					DepthSensor->InitRenderTarget(FIntPoint(Sensor.Resolution.X, Sensor.Resolution.Y));
+					DepthSensor->GetSceneCaptureActor()->GetCaptureComponent2D()->ProjectionType = Sensor.ProjectionMode;
+					DepthSensor->GetSceneCaptureActor()->GetCaptureComponent2D()->OrthoWidth = Sensor.OrthoWidth;
+					DepthSensor->GetSceneCaptureActor()->GetCaptureComponent2D()->FOVAngle = Sensor.FOV;
+					DepthSensor->SetActorTickInterval(Sensor.TickRate);
+					DepthSensor->SetClipPlanes(Sensor.NearClip, Sensor.FarClip);
+					DepthSensor->SetDepthEncoding(Sensor.DepthEncoding, Sensor.DepthRange);
+					DepthSensor->SetPublishSettings(Entity.Key, MakePublishSettings(Sensor));
+				}
+				else
+				{
+					UE_LOG(LogAerosimConnector, Error, TEXT("Actor '%s' of type %s is not a depth camera sensor, the actor registry must map %s to ADepthCameraSensor or a Blueprint of it"), *Entity.Key, *ActorType, *ActorType);
+				}
+			}
+			else if (ActorType == "sensors/lidar")
+			{
+				bIsSensor = true;
+				ALidarSensor* LidarSensor = Cast<ALidarSensor>(SpawnedActor);
+				if (IsValid(LidarSensor))
+				{
+					const FSensorData& Sensor = SceneGraph.Components.Sensors[Entity.Key];
+					LidarSensor->SetCaptureEnabled(Sensor.bCaptureEnabled);
+					// The sweep follows the elapsed time, the tick rate only sets the size of the batches.
+					LidarSensor->SetActorTickInterval(Sensor.TickRate);
+					LidarSensor->SetLidarSettings(Sensor.Lidar);
+					LidarSensor->SetPublishSettings(Entity.Key, MakePublishSettings(Sensor));
+				}
+				else
+				{
+					UE_LOG(LogAerosimConnector, Error, TEXT("Actor '%s' of type %s is not a lidar sensor"), *Entity.Key, *ActorType);
+				}
 			}
 
 			AAerosimActor* AerosimActor = Cast<AAerosimActor>(SpawnedActor);
@@ -164,14 +237,58 @@ void UCommandConsumer::SpawnActorsIfNeeded(FSceneGraph& SceneGraph)
 	}
 }
 
+void UCommandConsumer::UpdateSensorsFromSceneGraph(const FSceneGraph& SceneGraph)
+{
+	// Publish settings can change at runtime, cropping and downscaling happen on
+	// the CPU copy of the frame. A resolution change swaps the render target for
+	// one from the pool.
+	for (const auto& Sensor : SceneGraph.Components.Sensors)
+	{
+		const uint32* ActorId = ActorNameIdMap.Find(Sensor.Key);
+		if (ActorId == nullptr)
+			continue;
+
+		if (ALidarSensor* LidarSensor = Cast<ALidarSensor>(Registry->GetActor(*ActorId)))
+		{
+			LidarSensor->SetLidarSettings(Sensor.Value.Lidar);
+			LidarSensor->SetPublishSettings(Sensor.Key, MakePublishSettings(Sensor.Value));
+			continue;
+		}
+
+		ACameraSensor* CameraSensor = Cast<ACameraSensor>(Registry->GetActor(*ActorId));
+		if (IsValid(CameraSensor))
+		{
+			if (Sensor.Value.Resolution.X > 0 && Sensor.Value.Resolution.Y > 0)
+			{
+				CameraSensor->InitRenderTarget(FIntPoint(Sensor.Value.Resolution.X, Sensor.Value.Resolution.Y));
+			}
+			if (ADepthCameraSensor* DepthSensor = Cast<ADepthCameraSensor>(CameraSensor))
+			{
+				DepthSensor->SetClipPlanes(Sensor.Value.NearClip, Sensor.Value.FarClip);
+				DepthSensor->SetDepthEncoding(Sensor.Value.DepthEncoding, Sensor.Value.DepthRange);
+			}
+			CameraSensor->SetPublishSettings(Sensor.Key, MakePublishSettings(Sensor.Value));
+			if (Sensor.Value.bRecordSet)
+			{
+				CameraSensor->SetRecording(Sensor.Value.bRecord, Sensor.Key, MakeRecordingSettings(Sensor.Value));
+			}
+		}
+	}
+}
+
 void UCommandConsumer::UpdateResourcesFromSceneGraph(const FSceneGraph& SceneGraph)
 {
 	if (SceneGraph.Resources.bResourcesSet)
 	{
+		if (SceneGraph.Resources.SimTime >= 0.0)
+		{
+			FSensorRecorder::Get().SetSimTime(SceneGraph.Resources.SimTime);
+		}
+
 		if (CachedOrigin != SceneGraph.Resources.Origin)
 		{
 			CachedOrigin = SceneGraph.Resources.Origin;
-			CesiumTileManager->LoadTileSet(CachedOrigin.X, CachedOrigin.Y, CachedOrigin.Z);
+			CesiumTileManager->MoveOrigin(CachedOrigin.X, CachedOrigin.Y, CachedOrigin.Z);
 		}
 
 		if (SceneGraph.Resources.Weather.Preset.Len() > 0)
@@ -251,6 +368,12 @@ void UCommandConsumer::UpdateActorTransformsFromSceneGraph(const FSceneGraph& Sc
 				// Convert global pose from NED to Unreal ESU
 				ned_to_unreal_esu(&Transform.Position.X, &Transform.Position.Y, &Transform.Position.Z);
 				rpy_ned_to_unreal_esu(&Transform.Rotation.Roll, &Transform.Rotation.Pitch, &Transform.Rotation.Yaw);
+
+				// Only actors moving in the world frame pull tiles of their own
+				if (IsValid(CesiumTileManager))
+				{
+					CesiumTileManager->TrackPrefetchActor(Registry->GetActor(ActorNameIdMap[States.Key]));
+				}
 			}
 
 			Registry->GetActor(ActorNameIdMap[States.Key])->SetActorRelativeTransform(FTransform(Transform.Rotation, Transform.Position, Transform.Scale));
@@ -261,18 +384,8 @@ void UCommandConsumer::UpdateActorTransformsFromSceneGraph(const FSceneGraph& Sc
 				AAerosimActor* AerosimActor = Cast<AAerosimActor>(Actor);
 				if (IsValid(AerosimActor))
 				{
-					// TODO: handle skipping updates in the actor's trajectory visualizer and expose this as an update interval parameter in the trajectory settings instead of throwing away command messages
-					static constexpr unsigned int SKIP_MESSAGES = 10;
-					static unsigned int counter = SKIP_MESSAGES;
-					if (counter == SKIP_MESSAGES)
-					{
-						AerosimActor->UpdateTrajectoryVisualizer(Transform.Position);
-						counter = 0;
-					}
-					else
-					{
-						counter++;
-					}
+					// The visualizer decimates the points of each actor itself
+					AerosimActor->UpdateTrajectoryVisualizer(Transform.Position);
 				}
 			}
 		}
@@ -398,7 +511,7 @@ void UCommandConsumer::UpdateTrajectoryVisualizationSettingsFromSceneGraph(const
 			AAerosimActor* Actor = Cast<AAerosimActor>(Registry->GetActor(ActorNameIdMap[TrajectorySettings.Key]));
 			if (IsValid(Actor))
 			{
-				Actor->UpdateTrajectoryVisualizerSettings(TrajectorySettings.Value.DisplayFutureTrajectory, TrajectorySettings.Value.DisplayPastTrajectory, TrajectorySettings.Value.HighlightUserDefinedWaypoints, TrajectorySettings.Value.HighlightUserDefinedWaypoints);
+				Actor->UpdateTrajectoryVisualizerSettings(TrajectorySettings.Value);
 			}
 			else
 			{
@@ -445,6 +558,10 @@ void UCommandConsumer::UpdateTrajectoryVisualizationFutureTrajectoryWaypointsFro
 			if (IsValid(Actor))
 			{
 				Actor->UpdateTrajectoryVisualizerFutureTrajectory(TrajectoryFutureWaypoints.Value.Waypoints);
+				if (IsValid(CesiumTileManager))
+				{
+					CesiumTileManager->SetPrefetchWaypoints(Actor, TrajectoryFutureWaypoints.Value.Waypoints);
+				}
 			}
 			else
 			{
@@ -458,6 +575,25 @@ void UCommandConsumer::UpdateTrajectoryVisualizationFutureTrajectoryWaypointsFro
 	}
 }
 
+void UCommandConsumer::OnOriginRebased(const FTransform& OldToNew)
+{
+	for (const TPair<FString, uint32>& ActorNameId : ActorNameIdMap)
+	{
+		AActor* Actor = Registry->GetActor(ActorNameId.Value);
+		if (!IsValid(Actor))
+			continue;
+		// Attached actors follow their parent
+		if (Actor->GetAttachParentActor() == nullptr)
+		{
+			Actor->SetActorTransform(Actor->GetActorTransform() * OldToNew);
+		}
+		if (AAerosimActor* AerosimActor = Cast<AAerosimActor>(Actor))
+		{
+			AerosimActor->RebaseTrajectoryVisualizer(OldToNew);
+		}
+	}
+}
+
 void UCommandConsumer::ProcessCommandsFromQueue(float DeltaSeconds)
 {
 	if (!IsValid(Registry))
@@ -585,6 +721,10 @@ void UCommandConsumer::ProcessCommandsFromQueue(float DeltaSeconds)
 				{
 					MeasureAltitudeOffsetCommand(CurJsonObject);
 				}
+				else if (CommandType == TEXT("query_terrain_heights"))
+				{
+					QueryTerrainHeightsCommand(CurJsonObject);
+				}
 				else if (CommandType == TEXT("visualize_trajectory"))
 				{
 					VisualizeTrajectoryCommand(CurJsonObject);
@@ -609,10 +749,18 @@ void UCommandConsumer::ProcessCommandsFromQueue(float DeltaSeconds)
 				{
 					SetCesiumEnabled(CurJsonObject);
 				}
+				else if (CommandType == TEXT("set_tileset_budget"))
+				{
+					SetTilesetBudgetCommand(CurJsonObject);
+				}
 				else if (CommandType == TEXT("set_cesium_weather_enabled"))
 				{
 					SetCesiumWeatherEnabled(CurJsonObject);
 				}
+				else if (CommandType == TEXT("set_sensor_recording"))
+				{
+					SetSensorRecordingCommand(CurJsonObject);
+				}
 				else
 				{
 					UE_LOG(LogAerosimConnector, Warning, TEXT("Unknown command_type: %s"), *CommandType);
@@ -646,6 +794,33 @@ void UCommandConsumer::ConfigureSceneCommand(TSharedPtr<FJsonObject> JsonObject)
 {
 	TSharedPtr<FJsonObject> ParametersObject = JsonObject->GetObjectField(TEXT("parameters"));
 	bRealTimePacingMode = ParametersObject->GetBoolField(TEXT("enable_realtime_pacing"));
+
+	// "tileset": { "ion_asset_id": 2275207 } or { "path": "<directory, tileset.json or url>" },
+	// with an optional "cache": { "max_items": N, "requests_per_prune": N }
+	const TSharedPtr<FJsonObject>* TilesetObject;
+	if (ParametersObject->TryGetObjectField(TEXT("tileset"), TilesetObject) && IsValid(CesiumTileManager))
+	{
+		FString Path;
+		int32 IonId = 0;
+		if ((*TilesetObject)->TryGetStringField(TEXT("path"), Path) && !Path.IsEmpty())
+		{
+			CesiumTileManager->SetTilesetSource(Path, CesiumTileManager->GetCesiumIonId());
+		}
+		else if ((*TilesetObject)->TryGetNumberField(TEXT("ion_asset_id"), IonId))
+		{
+			CesiumTileManager->SetTilesetSource(FString(), IonId);
+		}
+
+		const TSharedPtr<FJsonObject>* CacheObject;
+		if ((*TilesetObject)->TryGetObjectField(TEXT("cache"), CacheObject))
+		{
+			int32 MaxItems = 0;
+			int32 RequestsPerPrune = 0;
+			(*CacheObject)->TryGetNumberField(TEXT("max_items"), MaxItems);
+			(*CacheObject)->TryGetNumberField(TEXT("requests_per_prune"), RequestsPerPrune);
+			UCesiumTileManager::ConfigureRequestCache(MaxItems, RequestsPerPrune);
+		}
+	}
 	// TODO Should this take an entire sim config JSON to set up everything for the scene
 	// like enabling/disabling Cesium stuff for GIS vs synthetic scenes, spawning objects, etc?
 }
@@ -960,6 +1135,37 @@ void UCommandConsumer::AttachSensorCommand(TSharedPtr<FJsonObject> JsonObject)
 	}
 }
 
+void UCommandConsumer::SetSensorRecordingCommand(TSharedPtr<FJsonObject> JsonObject)
+{
+	TSharedPtr<FJsonObject> ParametersObject = JsonObject->GetObjectField(TEXT("parameters"));
+	uint32 InstanceId = ParametersObject->GetIntegerField(TEXT("instance_id"));
+	FString SensorName = ParametersObject->GetStringField(TEXT("sensor_name"));
+	bool bEnabled = ParametersObject->GetBoolField(TEXT("enabled"));
+
+	FSensorRecordingSettings RecordingSettings;
+	ParametersObject->TryGetStringField(TEXT("directory"), RecordingSettings.Directory);
+	ParametersObject->TryGetNumberField(TEXT("queue_depth"), RecordingSettings.MaxInFlight);
+	FString Format;
+	if (ParametersObject->TryGetStringField(TEXT("format"), Format))
+	{
+		RecordingSettings.Format = FSensorRecorder::ParseFormat(Format);
+	}
+	FString Policy;
+	if (ParametersObject->TryGetStringField(TEXT("policy"), Policy))
+	{
+		RecordingSettings.bDropWhenFull = Policy.Equals(TEXT("drop"));
+	}
+
+	ACameraSensor* CameraSensor = Cast<ACameraSensor>(Registry->GetActor(InstanceId));
+	if (!IsValid(CameraSensor))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Camera sensor not found for recording request: ActorID: %d"), InstanceId);
+		return;
+	}
+	CameraSensor->SetRecording(bEnabled, SensorName, RecordingSettings);
+	UE_LOG(LogAerosimConnector, Log, TEXT("Set sensor recording command processed: SensorName: %s, Enabled: %d"), *SensorName, bEnabled);
+}
+
 void UCommandConsumer::PossessSensorCommand(TSharedPtr<FJsonObject> JsonObject)
 {
 	// TODO Implement this
@@ -974,7 +1180,7 @@ void UCommandConsumer::LoadCoordinatesCommand(TSharedPtr<FJsonObject> JsonObject
 	float Alt = ParametersObject->GetNumberField(TEXT("alt"));
 
 	// Directly passing parameters from JSON to the function
-	CesiumTileManager->LoadTileSet(Lat, Lon, Alt);
+	CesiumTileManager->MoveOrigin(Lat, Lon, Alt);
 	UE_LOG(LogAerosimConnector, Warning, TEXT("Load coordinates command processed: Lat: %f, Lon: %f, Alt: %f"), Lat, Lon, Alt);
 }
 
@@ -1065,157 +1271,72 @@ void UCommandConsumer::AttachActorToActorWithSocketCommand(TSharedPtr<FJsonObjec
 
 void UCommandConsumer::MeasureAltitudeOffsetCommand(TSharedPtr<FJsonObject> JsonObject)
 {
-	FString UUID = JsonObject->GetStringField(TEXT("uuid"));
 	TSharedPtr<FJsonObject> ParametersObject = JsonObject->GetObjectField(TEXT("parameters"));
 
-	double Lat = ParametersObject->GetNumberField(TEXT("lat"));
-	double Lon = ParametersObject->GetNumberField(TEXT("lon"));
-	double ExpectedAltitude = ParametersObject->GetNumberField(TEXT("expected_hae_in_meters"));
+	FMeasureAltitudeOffsetCommandParams Params;
+	Params.UUID = JsonObject->GetStringField(TEXT("uuid"));
+	Params.Lat = ParametersObject->GetNumberField(TEXT("lat"));
+	Params.Lon = ParametersObject->GetNumberField(TEXT("lon"));
+	Params.ExpectedAltitude = ParametersObject->GetNumberField(TEXT("expected_hae_in_meters"));
+	ParametersObject->TryGetNumberField(TEXT("timeout"), Params.Timeout);
 
 	UE_LOG(LogAerosimConnector, Log, TEXT("Measure Altitude Offset Command Received"));
 
-	if (!CesiumTileManager)
-	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("TileManager is not valid"));
-		return;
-	}
-
-	// Load Cesium Tileset at the given coordinates
-	CurrentDepthSensorOffset = InitialDepthSensorOffset;
-	CesiumTileManager->LoadTileSet(Lat, Lon, ExpectedAltitude + CurrentDepthSensorOffset); // Add a known altitude offset of 500m to prevent measuring negative altitudes if the terrain is lower than the expected altitude
-
-	AAerosimGameMode* AerosimGameMode = Cast<AAerosimGameMode>(UGameplayStatics::GetGameMode(GetWorld()));
-	if (!IsValid(AerosimGameMode))
-	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("No AerosimGameMode Found"));
-		return;
-	}
-
-	APawn* SpectatorPawn = AerosimGameMode->GetSpectatorPawn();
-	if (!IsValid(SpectatorPawn))
-	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("No SpectatorPawn Found"));
-		return;
-	}
-
-	USceneComponent* RootComponent = SpectatorPawn->GetRootComponent();
-	if (!IsValid(RootComponent))
+	if (!AltitudeMeasurementService)
 	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("No RootComponent Found"));
+		UE_LOG(LogAerosimConnector, Error, TEXT("AltitudeMeasurementService is not valid"));
 		return;
 	}
 
-	// Cache the params for later use
-	CachedMeasureAltitudeOffsetCommandParams.UUID = UUID;
-	CachedMeasureAltitudeOffsetCommandParams.Lat = Lat;
-	CachedMeasureAltitudeOffsetCommandParams.Lon = Lon;
-	CachedMeasureAltitudeOffsetCommandParams.ExpectedAltitude = ExpectedAltitude;
-
-	// Detach the spectator pawn from any parent
-	SpectatorPawn->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
-	SpectatorPawn->SetActorLocation(FVector(0, 0, 0));
-	SpectatorPawn->SetActorRotation(FVector(0, 0, -90).Rotation());
-	CesiumTileManager->SpawnAltitudeOffsetSensor();
-
-	// Bind a function to the OnTilesetLoaded delegate
-	if (CesiumTileManager->GetCesiumTileset())
-	{
-		CesiumTileManager->GetCesiumTileset()->OnTilesetLoaded.AddDynamic(this, &UCommandConsumer::OnTilesetLoaded);
-		UE_LOG(LogAerosimConnector, Log, TEXT("OnTilesetLoaded delegate bound"));
-	}
+	// Measured over the next frames, the response is published when done.
+	AltitudeMeasurementService->Enqueue(Params);
 }
 
-void UCommandConsumer::OnTilesetLoaded()
+void UCommandConsumer::QueryTerrainHeightsCommand(TSharedPtr<FJsonObject> JsonObject)
 {
-	UE_LOG(LogAerosimConnector, Log, TEXT("Tileset loaded"));
-	if (!CesiumTileManager)
-	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("CesiumTileManager is not valid"));
-		return;
-	}
+	FString UUID = JsonObject->GetStringField(TEXT("uuid"));
+	TSharedPtr<FJsonObject> ParametersObject = JsonObject->GetObjectField(TEXT("parameters"));
 
-	// Unbind the delegate
-	if (CesiumTileManager->GetCesiumTileset())
+	// Points as [lat, lon] pairs or {"lat", "lon"} objects.
+	TArray<FVector2D> Points;
+	const TArray<TSharedPtr<FJsonValue>>* PointsArray;
+	if (ParametersObject->TryGetArrayField(TEXT("points"), PointsArray))
 	{
-		CesiumTileManager->GetCesiumTileset()->OnTilesetLoaded.RemoveDynamic(this, &UCommandConsumer::OnTilesetLoaded);
-		UE_LOG(LogAerosimConnector, Log, TEXT("OnTilesetLoaded delegate unbound"));
+		Points.Reserve(PointsArray->Num());
+		for (const TSharedPtr<FJsonValue>& PointValue : *PointsArray)
+		{
+			const TArray<TSharedPtr<FJsonValue>>* Pair;
+			const TSharedPtr<FJsonObject>* PointObject;
+			if (PointValue->TryGetArray(Pair) && Pair->Num() >= 2)
+			{
+				Points.Add(FVector2D((*Pair)[0]->AsNumber(), (*Pair)[1]->AsNumber()));
+			}
+			else if (PointValue->TryGetObject(PointObject))
+			{
+				Points.Add(FVector2D((*PointObject)->GetNumberField(TEXT("lat")), (*PointObject)->GetNumberField(TEXT("lon"))));
+			}
+			else
+			{
+				UE_LOG(LogAerosimConnector, Warning, TEXT("Query terrain heights %s: malformed point %d"), *UUID, Points.Num());
+				Points.Add(FVector2D(NAN, NAN));
+			}
+		}
 	}
 
-	if (!GetWorld())
-	{
-		UE_LOG(LogAerosimConnector, Error, TEXT("World context is invalid. Timer cannot be set."));
-		return;
-	}
+	double MaxDistance = 0.0;
+	double Timeout = 0.0;
+	ParametersObject->TryGetNumberField(TEXT("max_distance"), MaxDistance);
+	ParametersObject->TryGetNumberField(TEXT("timeout"), Timeout);
 
-	UE_LOG(LogAerosimConnector, Log, TEXT("Tileset loaded. Waiting for 5 seconds before adjusting offset"));
-	// Delay for 5 seconds before measuring altitude to give the tileset time to load properly
-	GetWorld()->GetTimerManager().SetTimer(DepthSensorDelayTimerHandle, this, &UCommandConsumer::AdjustDepthSensorOffset, 5.0f, false);
-}
+	UE_LOG(LogAerosimConnector, Log, TEXT("Query Terrain Heights Command Received: %d points"), Points.Num());
 
-void UCommandConsumer::AdjustDepthSensorOffset()
-{
-	// Clear the timer handle
-	if (GetWorld() && GetWorld()->GetTimerManager().IsTimerActive(DepthSensorDelayTimerHandle))
-	{
-		GetWorld()->GetTimerManager().ClearTimer(DepthSensorDelayTimerHandle);
-		DepthSensorDelayTimerHandle.Invalidate(); // Reset the handle to ensure it's reusable
-		UE_LOG(LogAerosimConnector, Log, TEXT("Timer handle cleared and invalidated"));
-	}
-
-	// Query the values from the DepthCaptureActor
-	double AltitudeOffset = CesiumTileManager->MeasureAltitudeOffset() / 100.0; // Convert from cm to m
-	AltitudeOffset -= CurrentDepthSensorOffset;									// Remove added known altitude offset of 500m to prevent measuring negative altitudes if the terrain is lower than the expected altitude
-
-	// The offset of 20m is an arbitrary value that allows the terrain to switch to the closest LOD to get a more accurate altitude measurement while being far enough to smooth
-	// out irregularities in the terrain when average sampling
-	if (AltitudeOffset < 0.0f)
+	if (!AltitudeMeasurementService)
 	{
-		CurrentDepthSensorOffset = abs(AltitudeOffset) + 20.0f;
-		CesiumTileManager->SetOriginHeight(CachedMeasureAltitudeOffsetCommandParams.ExpectedAltitude + CurrentDepthSensorOffset);
-	}
-	else if (AltitudeOffset < 20.0f)
-	{
-		CurrentDepthSensorOffset = 20.0f;
-		CesiumTileManager->SetOriginHeight(CachedMeasureAltitudeOffsetCommandParams.ExpectedAltitude + CurrentDepthSensorOffset);
-	}
-	else
-	{
-		CurrentDepthSensorOffset = 0.0f;
-		CesiumTileManager->SetOriginHeight(CachedMeasureAltitudeOffsetCommandParams.ExpectedAltitude);
+		UE_LOG(LogAerosimConnector, Error, TEXT("AltitudeMeasurementService is not valid"));
+		return;
 	}
 
-	UE_LOG(LogAerosimConnector, Log, TEXT("Tileset loaded. Waiting for 5 seconds before taking final offset"));
-	// Delay for 5 seconds before measuring altitude to give the tileset time to switch to the LOD level we need.
-	GetWorld()->GetTimerManager().SetTimer(DepthSensorDelayTimerHandle, this, &UCommandConsumer::MeasureAltitudeOffsetResponse, 5.0f, false);
-}
-
-void UCommandConsumer::MeasureAltitudeOffsetResponse()
-{
-	// Query the values from the DepthCaptureActor
-	double AltitudeOffset = CesiumTileManager->MeasureAltitudeOffset() / 100.0; // Convert from cm to m
-	AltitudeOffset -= CurrentDepthSensorOffset;
-	CesiumTileManager->DeleteAltitudeOffsetSensor();
-
-	// Create the response payload
-	TSharedPtr<FJsonObject> ResponsePayload = MakeShareable(new FJsonObject);
-	ResponsePayload->SetStringField(TEXT("uuid"), CachedMeasureAltitudeOffsetCommandParams.UUID);
-
-	TSharedPtr<FJsonObject> ResponseType = MakeShareable(new FJsonObject);
-	ResponseType->SetStringField(TEXT("response_type"), TEXT("measure_altitude_offset_response"));
-
-	TSharedPtr<FJsonObject> ResponseParameters = MakeShareable(new FJsonObject);
-	ResponseParameters->SetNumberField(TEXT("lat"), CachedMeasureAltitudeOffsetCommandParams.Lat);
-	ResponseParameters->SetNumberField(TEXT("lon"), CachedMeasureAltitudeOffsetCommandParams.Lon);
-	ResponseParameters->SetNumberField(TEXT("altitude_offset"), AltitudeOffset);
-
-	ResponsePayload->SetObjectField(TEXT("parameters"), ResponseParameters);
-
-	// Serialize the response payload to a string
-	FString ResponseString;
-	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ResponseString);
-	FJsonSerializer::Serialize(ResponsePayload.ToSharedRef(), Writer);
-
-	publish_to_topic("aerosim.renderer.responses", TCHAR_TO_UTF8(*ResponseString));
+	AltitudeMeasurementService->EnqueueTerrainQuery(UUID, MoveTemp(Points), MaxDistance, Timeout);
 }
 
 void UCommandConsumer::VisualizeTrajectoryCommand(TSharedPtr<FJsonObject> JsonObject)
@@ -1233,18 +1354,7 @@ void UCommandConsumer::VisualizeTrajectoryCommand(TSharedPtr<FJsonObject> JsonOb
 	AAerosimActor* AerosimActor = Cast<AAerosimActor>(Registry->GetActor(InstanceId));
 	if (IsValid(AerosimActor))
 	{
-		// TODO: handle skipping updates in the actor's trajectory visualizer and expose this as an update interval parameter in the trajectory settings instead of throwing away command messages
-		static constexpr unsigned int SKIP_MESSAGES = 10;
-		static unsigned int counter = SKIP_MESSAGES;
-		if (counter == SKIP_MESSAGES)
-		{
-			AerosimActor->UpdateTrajectoryVisualizer(Position);
-			counter = 0;
-		}
-		else
-		{
-			counter++;
-		}
+		AerosimActor->UpdateTrajectoryVisualizer(Position);
 	}
 	else
 	{
@@ -1256,15 +1366,20 @@ void UCommandConsumer::VisualizeTrajectorySettingsCommand(TSharedPtr<FJsonObject
 {
 	TSharedPtr<FJsonObject> ParametersObject = JsonObject->GetObjectField(TEXT("parameters"));
 	uint32 InstanceId = ParametersObject->GetIntegerField(TEXT("instance_id"));
-	bool bDisplayFutureTrajectory = ParametersObject->GetBoolField(TEXT("show_ahead_waypoints"));
-	bool bDisplayPastWaypoints = ParametersObject->GetBoolField(TEXT("show_behind_waypoints"));
-	bool bHighlightUserDefinedWaypoints = ParametersObject->GetBoolField(TEXT("show_user_defined_waypoints"));
-	uint32 NumberOfFutureWaypoints = ParametersObject->GetIntegerField(TEXT("number_of_waypoints_ahead"));
+	FTrajectoryVisualizationSettingsData Settings;
+	Settings.DisplayFutureTrajectory = ParametersObject->GetBoolField(TEXT("show_ahead_waypoints"));
+	Settings.DisplayPastTrajectory = ParametersObject->GetBoolField(TEXT("show_behind_waypoints"));
+	Settings.HighlightUserDefinedWaypoints = ParametersObject->GetBoolField(TEXT("show_user_defined_waypoints"));
+	Settings.NumberOfFutureWaypoints = ParametersObject->GetIntegerField(TEXT("number_of_waypoints_ahead"));
+	ParametersObject->TryGetNumberField(TEXT("update_interval"), Settings.UpdateInterval);
+	ParametersObject->TryGetNumberField(TEXT("min_point_distance"), Settings.MinPointDistance);
+	ParametersObject->TryGetNumberField(TEXT("max_heading_change"), Settings.MaxHeadingChange);
+	ParametersObject->TryGetNumberField(TEXT("simplify_tolerance"), Settings.SimplifyTolerance);
 
 	AAerosimActor* AerosimActor = Cast<AAerosimActor>(Registry->GetActor(InstanceId));
 	if (IsValid(AerosimActor))
 	{
-		AerosimActor->UpdateTrajectoryVisualizerSettings(bDisplayFutureTrajectory, bDisplayPastWaypoints, bHighlightUserDefinedWaypoints, NumberOfFutureWaypoints);
+		AerosimActor->UpdateTrajectoryVisualizerSettings(Settings);
 	}
 	else
 	{
@@ -1299,6 +1414,10 @@ void UCommandConsumer::VisualizeTrajectoryAddAheadTrajectory(TSharedPtr<FJsonObj
 			}
 		}
 		AerosimActor->UpdateTrajectoryVisualizerFutureTrajectory(ParsedTrajectory);
+		if (IsValid(CesiumTileManager))
+		{
+			CesiumTileManager->SetPrefetchWaypoints(AerosimActor, ParsedTrajectory);
+		}
 	}
 	else
 	{
@@ -1373,3 +1492,38 @@ void UCommandConsumer::SetCesiumWeatherEnabled(TSharedPtr<FJsonObject> JsonObjec
 		CesiumTileManager->SetCesiumEnabled(IsEnabled);
 	}
 }
+
+void UCommandConsumer::SetTilesetBudgetCommand(TSharedPtr<FJsonObject> JsonObject)
+{
+	TSharedPtr<FJsonObject> ParametersObject = JsonObject->GetObjectField(TEXT("parameters"));
+	if (!IsValid(CesiumTileManager))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("TileManager is not valid"));
+		return;
+	}
+
+	// Every field is optional, the ones left out keep their value
+	TOptional<double> MaximumScreenSpaceError;
+	TOptional<int64> MaximumCachedBytes;
+	TOptional<int32> MaximumSimultaneousTileLoads;
+	TOptional<bool> bGovernorEnabled;
+	double Number = 0.0;
+	bool bValue = false;
+	if (ParametersObject->TryGetNumberField(TEXT("maximum_screen_space_error"), Number))
+	{
+		MaximumScreenSpaceError = Number;
+	}
+	if (ParametersObject->TryGetNumberField(TEXT("maximum_cached_megabytes"), Number))
+	{
+		MaximumCachedBytes = (int64)(Number * 1024.0 * 1024.0);
+	}
+	if (ParametersObject->TryGetNumberField(TEXT("maximum_simultaneous_tile_loads"), Number))
+	{
+		MaximumSimultaneousTileLoads = (int32)Number;
+	}
+	if (ParametersObject->TryGetBoolField(TEXT("governor_enabled"), bValue))
+	{
+		bGovernorEnabled = bValue;
+	}
+	CesiumTileManager->SetTileBudget(MaximumScreenSpaceError, MaximumCachedBytes, MaximumSimultaneousTileLoads, bGovernorEnabled);
+}
@@ -201,6 +201,11 @@ bool UPayloadProcessor::ParseJson(const FString& JsonString, FSceneGraph& OutSce
 					Resources.ViewportConfig.ActiveViewport = ViewportConfig->GetStringField("active_camera");
 					Resources.ViewportConfig.RendererInstanceID = ViewportConfig->GetStringField("renderer_instance");
 				}
+				const TSharedPtr<FJsonObject>* SimTime;
+				if (ResourcesObject->TryGetObjectField(TEXT("sim_time"), SimTime))
+				{
+					Resources.SimTime = (*SimTime)->GetNumberField("sec") + (*SimTime)->GetNumberField("nsec") * 1e-9;
+				}
 				Resources.bResourcesSet = true;
 
 				OutSceneGraph.Resources = Resources;
@@ -289,7 +294,31 @@ bool UPayloadProcessor::ParseJson(const FString& JsonString, FSceneGraph& OutSce
 					Sensor.SensorType = SensorInfo->GetStringField("sensor_type");
 
 					TSharedPtr<FJsonObject> SensorParameters = SensorInfo->GetObjectField("sensor_parameters");
-					TSharedPtr<FJsonObject> RGBAParams = SensorParameters->GetObjectField("RGBCamera");
+					if (SensorParameters->HasField("Lidar"))
+					{
+						TSharedPtr<FJsonObject> LidarParams = SensorParameters->GetObjectField("Lidar");
+						Sensor.TickRate = LidarParams->GetNumberField("tick_rate");
+						Sensor.bCaptureEnabled = LidarParams->GetBoolField("capture_enabled");
+						LidarParams->TryGetNumberField(TEXT("channels"), Sensor.Lidar.Channels);
+						LidarParams->TryGetNumberField(TEXT("upper_fov"), Sensor.Lidar.UpperFov);
+						LidarParams->TryGetNumberField(TEXT("lower_fov"), Sensor.Lidar.LowerFov);
+						LidarParams->TryGetNumberField(TEXT("horizontal_resolution"), Sensor.Lidar.HorizontalResolution);
+						LidarParams->TryGetNumberField(TEXT("rotation_rate"), Sensor.Lidar.RotationRate);
+						LidarParams->TryGetNumberField(TEXT("range"), Sensor.Lidar.Range);
+						LidarParams->TryGetNumberField(TEXT("max_rays_per_frame"), Sensor.Lidar.MaxRaysPerFrame);
+						LidarParams->TryGetNumberField(TEXT("publish_queue_depth"), Sensor.PublishQueueDepth);
+						if (LidarParams->HasField("codec") && LidarParams->GetStringField("codec").Equals("lz4"))
+						{
+							Sensor.Codec = EImageCodec::LZ4;
+						}
+						OutSceneGraph.Components.Sensors.Add(SensorPair.Key, Sensor);
+						continue;
+					}
+
+					// Depth cameras take the same parameters as RGB cameras, plus the depth encoding.
+					TSharedPtr<FJsonObject> RGBAParams = SensorParameters->HasField("DepthCamera")
+						? SensorParameters->GetObjectField("DepthCamera")
+						: SensorParameters->GetObjectField("RGBCamera");
 
 					Sensor.TickRate = RGBAParams->GetNumberField("tick_rate");
 					Sensor.FOV = RGBAParams->GetNumberField("fov");
@@ -319,6 +348,123 @@ bool UPayloadProcessor::ParseJson(const FString& JsonString, FSceneGraph& OutSce
 						Sensor.Resolution.X = (*ResolutionArray)[0]->AsNumber();
 						Sensor.Resolution.Y = (*ResolutionArray)[1]->AsNumber();
 					}
+					if (RGBAParams->HasField("publish_queue_depth"))
+					{
+						Sensor.PublishQueueDepth = RGBAParams->GetIntegerField("publish_queue_depth");
+					}
+					if (RGBAParams->HasField("publish_queue_policy"))
+					{
+						FString Policy = RGBAParams->GetStringField("publish_queue_policy");
+						if (Policy.Equals("drop_newest"))
+						{
+							Sensor.PublishQueuePolicy = EImageQueuePolicy::DropNewest;
+						}
+						else if (Policy.Equals("block"))
+						{
+							Sensor.PublishQueuePolicy = EImageQueuePolicy::Block;
+						}
+						else
+						{
+							Sensor.PublishQueuePolicy = EImageQueuePolicy::DropOldest;
+						}
+					}
+					if (RGBAParams->HasField("output_layout"))
+					{
+						FString Layout = RGBAParams->GetStringField("output_layout");
+						if (Layout.Equals("rgb8"))
+						{
+							Sensor.OutputLayout = EPixelLayout::RGB8;
+						}
+						else if (Layout.Equals("nv12"))
+						{
+							Sensor.OutputLayout = EPixelLayout::NV12;
+						}
+						else if (Layout.Equals("i420"))
+						{
+							Sensor.OutputLayout = EPixelLayout::I420;
+						}
+						else if (Layout.Equals("y8"))
+						{
+							Sensor.OutputLayout = EPixelLayout::Y8;
+						}
+						else
+						{
+							Sensor.OutputLayout = EPixelLayout::BGRA8;
+						}
+					}
+					if (RGBAParams->HasField("codec"))
+					{
+						FString Codec = RGBAParams->GetStringField("codec");
+						if (Codec.Equals("lz4"))
+						{
+							Sensor.Codec = EImageCodec::LZ4;
+						}
+						else if (Codec.Equals("jpeg"))
+						{
+							Sensor.Codec = EImageCodec::JPEG;
+						}
+						else if (Codec.Equals("rle"))
+						{
+							Sensor.Codec = EImageCodec::RLE;
+						}
+						else
+						{
+							Sensor.Codec = EImageCodec::None;
+						}
+					}
+					if (RGBAParams->HasField("codec_quality"))
+					{
+						Sensor.CodecQuality = RGBAParams->GetIntegerField("codec_quality");
+					}
+					const TArray<TSharedPtr<FJsonValue>>* RoiArray;
+					if (RGBAParams->TryGetArrayField(TEXT("roi"), RoiArray) && RoiArray->Num() == 4)
+					{
+						Sensor.RoiOffset.X = (*RoiArray)[0]->AsNumber();
+						Sensor.RoiOffset.Y = (*RoiArray)[1]->AsNumber();
+						Sensor.RoiSize.X = (*RoiArray)[2]->AsNumber();
+						Sensor.RoiSize.Y = (*RoiArray)[3]->AsNumber();
+					}
+					const TArray<TSharedPtr<FJsonValue>>* OutputResolutionArray;
+					if (RGBAParams->TryGetArrayField(TEXT("output_resolution"), OutputResolutionArray) && OutputResolutionArray->Num() == 2)
+					{
+						Sensor.OutputResolution.X = (*OutputResolutionArray)[0]->AsNumber();
+						Sensor.OutputResolution.Y = (*OutputResolutionArray)[1]->AsNumber();
+					}
+					if (RGBAParams->HasField("downscale"))
+					{
+						Sensor.Downscale = RGBAParams->GetIntegerField("downscale");
+					}
+					if (RGBAParams->HasField("depth_encoding"))
+					{
+						Sensor.DepthEncoding = RGBAParams->GetStringField("depth_encoding").Equals("uint16") ? EDepthEncoding::UInt16 : EDepthEncoding::Float32;
+					}
+					const TArray<TSharedPtr<FJsonValue>>* DepthRangeArray;
+					if (RGBAParams->TryGetArrayField(TEXT("depth_range"), DepthRangeArray) && DepthRangeArray->Num() == 2)
+					{
+						Sensor.DepthRange.X = (*DepthRangeArray)[0]->AsNumber();
+						Sensor.DepthRange.Y = (*DepthRangeArray)[1]->AsNumber();
+					}
+					if (RGBAParams->HasField("record"))
+					{
+						Sensor.bRecordSet = true;
+						Sensor.bRecord = RGBAParams->GetBoolField("record");
+					}
+					if (RGBAParams->HasField("record_format"))
+					{
+						Sensor.RecordFormat = FSensorRecorder::ParseFormat(RGBAParams->GetStringField("record_format"));
+					}
+					if (RGBAParams->HasField("record_directory"))
+					{
+						Sensor.RecordDirectory = RGBAParams->GetStringField("record_directory");
+					}
+					if (RGBAParams->HasField("record_queue_depth"))
+					{
+						Sensor.RecordQueueDepth = RGBAParams->GetIntegerField("record_queue_depth");
+					}
+					if (RGBAParams->HasField("record_policy"))
+					{
+						Sensor.bRecordDropWhenFull = RGBAParams->GetStringField("record_policy").Equals("drop");
+					}
 
 					OutSceneGraph.Components.Sensors.Add(SensorPair.Key, Sensor);
 				}
@@ -422,6 +568,10 @@ bool UPayloadProcessor::ParseJson(const FString& JsonString, FSceneGraph& OutSce
 						Settings.DisplayPastTrajectory = SettingsInfo->GetBoolField("display_past_trajectory");
 						Settings.HighlightUserDefinedWaypoints = SettingsInfo->GetBoolField("highlight_user_defined_waypoints");
 						Settings.NumberOfFutureWaypoints = SettingsInfo->GetIntegerField("number_of_future_waypoints");
+						SettingsInfo->TryGetNumberField(TEXT("update_interval"), Settings.UpdateInterval);
+						SettingsInfo->TryGetNumberField(TEXT("min_point_distance"), Settings.MinPointDistance);
+						SettingsInfo->TryGetNumberField(TEXT("max_heading_change"), Settings.MaxHeadingChange);
+						SettingsInfo->TryGetNumberField(TEXT("simplify_tolerance"), Settings.SimplifyTolerance);
 						if (!OutSceneGraph.Components.TrajectoryVisualizationSettings.Contains(TrajectoryPair.Key))
 						{
 							OutSceneGraph.Components.TrajectoryVisualizationSettings.Add(TrajectoryPair.Key, FTrajectoryVisualizationSettingsData());
@@ -0,0 +1,185 @@
+#include "Game/Subsystems/RenderTargetPool.h"
+
+#include "AerosimConnector.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/World.h"
+#include "Game/AerosimGameMode.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Render Targets In Use"), STAT_AerosimRenderTargetsInUse, STATGROUP_AerosimConnector);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Render Targets Idle"), STAT_AerosimRenderTargetsIdle, STATGROUP_AerosimConnector);
+DECLARE_MEMORY_STAT(TEXT("Render Target Memory In Use"), STAT_AerosimRenderTargetMemoryInUse, STATGROUP_AerosimConnector);
+DECLARE_MEMORY_STAT(TEXT("Render Target Memory Idle"), STAT_AerosimRenderTargetMemoryIdle, STATGROUP_AerosimConnector);
+
+static TAutoConsoleVariable<float> CVarRenderTargetPoolIdleSeconds(
+	TEXT("aerosim.RenderTargetPool.IdleSeconds"),
+	30.0f,
+	TEXT("Seconds an unused sensor render target is kept for reuse before it is released. Negative keeps them forever."));
+
+int64 FRenderTargetKey::GetSizeBytes() const
+{
+	const FPixelFormatInfo& Info = GPixelFormats[Format];
+	const int64 BlocksX = FMath::DivideAndRoundUp(Size.X, FMath::Max(1, Info.BlockSizeX));
+	const int64 BlocksY = FMath::DivideAndRoundUp(Size.Y, FMath::Max(1, Info.BlockSizeY));
+	return BlocksX * BlocksY * Info.BlockBytes;
+}
+
+URenderTargetPool* URenderTargetPool::Get(const UWorld* World)
+{
+	if (World == nullptr)
+		return nullptr;
+	AAerosimGameMode* GameMode = World->GetAuthGameMode<AAerosimGameMode>();
+	return IsValid(GameMode) ? GameMode->GetRenderTargetPool() : nullptr;
+}
+
+UTextureRenderTarget2D* URenderTargetPool::Acquire(FIntPoint Size, EPixelFormat Format, bool bForceLinearGamma)
+{
+	FRenderTargetKey Key;
+	Key.Size = FIntPoint::ComponentMax(Size, FIntPoint(1, 1));
+	Key.Format = Format;
+	Key.bForceLinearGamma = bForceLinearGamma;
+
+	FPooledRenderTarget Entry;
+	// The most recently returned target is the most likely to still be resident.
+	const int32 IdleIndex = Idle.FindLastByPredicate([&Key](const FPooledRenderTarget& Pooled) {
+		return Pooled.Key == Key && IsValid(Pooled.Target);
+	});
+	if (IdleIndex != INDEX_NONE)
+	{
+		Entry = Idle[IdleIndex];
+		Idle.RemoveAtSwap(IdleIndex);
+		++Reused;
+	}
+	else
+	{
+		Entry.Key = Key;
+		Entry.Target = NewObject<UTextureRenderTarget2D>(this);
+		Entry.Target->InitCustomFormat(Key.Size.X, Key.Size.Y, Key.Format, Key.bForceLinearGamma);
+		Entry.Target->UpdateResourceImmediate();
+		++Allocated;
+		UE_LOG(LogAerosimConnector, Verbose, TEXT("RenderTargetPool: allocated %dx%d %s (%lld bytes)"),
+			Key.Size.X, Key.Size.Y, GPixelFormats[Key.Format].Name, Key.GetSizeBytes());
+	}
+
+	InUse.Add(Entry);
+	UpdateStats();
+	return Entry.Target;
+}
+
+void URenderTargetPool::Release(UTextureRenderTarget2D* Target)
+{
+	if (Target == nullptr)
+		return;
+
+	const int32 Index = InUse.IndexOfByPredicate([Target](const FPooledRenderTarget& Pooled) {
+		return Pooled.Target == Target;
+	});
+	if (Index == INDEX_NONE)
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("RenderTargetPool: %s was not acquired from the pool"), *Target->GetName());
+		return;
+	}
+
+	FPooledRenderTarget Entry = InUse[Index];
+	InUse.RemoveAtSwap(Index);
+	Entry.IdleSince = FPlatformTime::Seconds();
+	Idle.Add(Entry);
+	UpdateStats();
+}
+
+void URenderTargetPool::Tick()
+{
+	const double IdleSeconds = CVarRenderTargetPoolIdleSeconds.GetValueOnGameThread();
+	if (IdleSeconds < 0.0 || Idle.IsEmpty())
+		return;
+
+	const double Now = FPlatformTime::Seconds();
+	bool bTrimmed = false;
+	for (int32 Index = Idle.Num() - 1; Index >= 0; --Index)
+	{
+		if (Now - Idle[Index].IdleSince >= IdleSeconds)
+		{
+			ReleaseIdle(Index);
+			bTrimmed = true;
+		}
+	}
+	if (bTrimmed)
+	{
+		UpdateStats();
+	}
+}
+
+void URenderTargetPool::Trim()
+{
+	for (int32 Index = Idle.Num() - 1; Index >= 0; --Index)
+	{
+		ReleaseIdle(Index);
+	}
+	UpdateStats();
+}
+
+void URenderTargetPool::ReleaseIdle(int32 Index)
+{
+	FPooledRenderTarget& Entry = Idle[Index];
+	if (IsValid(Entry.Target))
+	{
+		// Frees the GPU memory now, the object itself goes away with the next GC.
+		Entry.Target->ReleaseResource();
+	}
+	Idle.RemoveAtSwap(Index);
+	++Trimmed;
+}
+
+FRenderTargetPoolStats URenderTargetPool::GetStats() const
+{
+	FRenderTargetPoolStats Stats;
+	Stats.InUse = InUse.Num();
+	Stats.Idle = Idle.Num();
+	for (const FPooledRenderTarget& Entry : InUse)
+	{
+		Stats.InUseBytes += Entry.Key.GetSizeBytes();
+	}
+	for (const FPooledRenderTarget& Entry : Idle)
+	{
+		Stats.IdleBytes += Entry.Key.GetSizeBytes();
+	}
+	Stats.Allocated = Allocated;
+	Stats.Reused = Reused;
+	Stats.Trimmed = Trimmed;
+	return Stats;
+}
+
+void URenderTargetPool::UpdateStats() const
+{
+	const FRenderTargetPoolStats Stats = GetStats();
+	SET_DWORD_STAT(STAT_AerosimRenderTargetsInUse, Stats.InUse);
+	SET_DWORD_STAT(STAT_AerosimRenderTargetsIdle, Stats.Idle);
+	SET_MEMORY_STAT(STAT_AerosimRenderTargetMemoryInUse, Stats.InUseBytes);
+	SET_MEMORY_STAT(STAT_AerosimRenderTargetMemoryIdle, Stats.IdleBytes);
+}
+
+static FAutoConsoleCommandWithWorld RenderTargetPoolStatsCommand(
+	TEXT("aerosim.RenderTargetPool.Stats"),
+	TEXT("Logs the occupancy and memory of the sensor render target pool."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World) {
+		URenderTargetPool* Pool = URenderTargetPool::Get(World);
+		if (Pool == nullptr)
+		{
+			UE_LOG(LogAerosimConnector, Display, TEXT("RenderTargetPool: no pool in this world"));
+			return;
+		}
+		const FRenderTargetPoolStats Stats = Pool->GetStats();
+		UE_LOG(LogAerosimConnector, Display, TEXT("RenderTargetPool: %d in use (%.1f MB), %d idle (%.1f MB), %llu allocated, %llu reused, %llu trimmed"),
+			Stats.InUse, Stats.InUseBytes / (1024.0 * 1024.0), Stats.Idle, Stats.IdleBytes / (1024.0 * 1024.0),
+			Stats.Allocated, Stats.Reused, Stats.Trimmed);
+	}));
+
+static FAutoConsoleCommandWithWorld RenderTargetPoolTrimCommand(
+	TEXT("aerosim.RenderTargetPool.Trim"),
+	TEXT("Releases every idle sensor render target."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World) {
+		if (URenderTargetPool* Pool = URenderTargetPool::Get(World))
+		{
+			Pool->Trim();
+		}
+	}));
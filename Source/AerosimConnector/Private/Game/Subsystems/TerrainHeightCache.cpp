@@ -0,0 +1,482 @@
+#include "Game/Subsystems/TerrainHeightCache.h"
+#include "AerosimConnector.h"
+#include "Algo/BinarySearch.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+// Meters per degree of latitude, the local equirectangular approximation is
+// good to a few millimeters over the distances involved.
+static constexpr double MetersPerDegree = 111320.0;
+
+// Samples closer than this are taken as the height of the point itself.
+static constexpr double ExactDistance = 0.5;
+
+static constexpr uint32 FileMagic = 0x43485441; // "ATHC"
+static constexpr uint32 FileVersion = 1;
+
+FTerrainHeightCache::FTerrainHeightCache(double CellDegreesIn)
+	: CellDegrees(CellDegreesIn)
+{
+}
+
+FTerrainHeightCache::~FTerrainHeightCache()
+{
+	CloseFile();
+}
+
+FVector2D FTerrainHeightCache::GetOffsetMeters(double FromLat, double FromLon, double ToLat, double ToLon)
+{
+	// The shorter way around, points on either side of the antimeridian are close.
+	const double DeltaLon = FMath::UnwindDegrees(ToLon - FromLon);
+	const double CosLat = FMath::Cos(FMath::DegreesToRadians(0.5 * (FromLat + ToLat)));
+	return FVector2D(DeltaLon * MetersPerDegree * CosLat, (ToLat - FromLat) * MetersPerDegree);
+}
+
+FIntPoint FTerrainHeightCache::GetCell(double Lat, double Lon) const
+{
+	return FIntPoint(WrapCellX(FMath::FloorToInt32(Lon / CellDegrees)), FMath::FloorToInt32(Lat / CellDegrees));
+}
+
+int32 FTerrainHeightCache::GetNumLonCells() const
+{
+	return FMath::Max(1, FMath::RoundToInt32(360.0 / CellDegrees));
+}
+
+int32 FTerrainHeightCache::WrapCellX(int32 CellX) const
+{
+	// Cells from -180 degrees east, so both ends of a longitude map to one cell.
+	const int32 NumLonCells = GetNumLonCells();
+	const int32 HalfLonCells = NumLonCells / 2;
+	return (int32)(((int64)CellX + HalfLonCells) % NumLonCells + NumLonCells) % NumLonCells - HalfLonCells;
+}
+
+void FTerrainHeightCache::ForEachCellInRange(double Lat, double Lon, double MaxDistance, TFunctionRef<void(uint64)> Visitor) const
+{
+	// Longitude cells shrink towards the poles, widen the search accordingly.
+	const double CosLat = FMath::Max(FMath::Cos(FMath::DegreesToRadians(Lat)), 0.01);
+	const double LatRange = MaxDistance / MetersPerDegree;
+	const double LonRange = LatRange / CosLat;
+	const int32 MinY = FMath::FloorToInt32((Lat - LatRange) / CellDegrees);
+	const int32 MaxY = FMath::FloorToInt32((Lat + LatRange) / CellDegrees);
+	// The range may cross the antimeridian, its cells are wrapped one by one.
+	const int32 MinX = FMath::FloorToInt32((Lon - LonRange) / CellDegrees);
+	const int32 NumX = FMath::Min(FMath::FloorToInt32((Lon + LonRange) / CellDegrees) - MinX + 1, GetNumLonCells());
+
+	for (int32 CellY = MinY; CellY <= MaxY; ++CellY)
+	{
+		for (int32 OffsetX = 0; OffsetX < NumX; ++OffsetX)
+		{
+			Visitor(MakeKey(FIntPoint(WrapCellX(MinX + OffsetX), CellY)));
+		}
+	}
+}
+
+// Whether a sample of the file is superseded by a sample in memory of the same
+// cell, the same rule Save applies when merging them.
+static bool IsReplaced(const FTerrainHeightSample& Sample, TConstArrayView<FTerrainHeightSample> Newer)
+{
+	for (const FTerrainHeightSample& NewerSample : Newer)
+	{
+		if (NewerSample.Lod >= Sample.Lod && FTerrainHeightCache::GetOffsetMeters(Sample.Lat, Sample.Lon, NewerSample.Lat, NewerSample.Lon).Size() < ExactDistance)
+			return true;
+	}
+	return false;
+}
+
+void FTerrainHeightCache::ForEachSampleInRange(double Lat, double Lon, double MaxDistance, TFunctionRef<void(const FTerrainHeightSample&, double)> Visitor) const
+{
+	ForEachCellInRange(Lat, Lon, MaxDistance, [&](uint64 Key) {
+		const FCell* Cell = Cells.Find(Key);
+		if (Cell != nullptr)
+		{
+			for (const FTerrainHeightSample& Sample : *Cell)
+			{
+				const double Distance = GetOffsetMeters(Lat, Lon, Sample.Lat, Sample.Lon).Size();
+				if (Distance <= MaxDistance)
+					Visitor(Sample, Distance);
+			}
+		}
+
+		const FFileCell* FileCell = FindFileCell(Key);
+		if (FileCell == nullptr)
+			return;
+		for (const FFileSample& FileSample : FileSamples.Slice(FileCell->First, FileCell->Count))
+		{
+			const FTerrainHeightSample Sample = ToSample(FileSample);
+			const double Distance = GetOffsetMeters(Lat, Lon, Sample.Lat, Sample.Lon).Size();
+			if (Distance <= MaxDistance && (Cell == nullptr || !IsReplaced(Sample, *Cell)))
+				Visitor(Sample, Distance);
+		}
+	});
+}
+
+void FTerrainHeightCache::Add(double Lat, double Lon, double Height, uint8 Lod, double MergeDistance)
+{
+	// The closest sample within MergeDistance, which may lie in a neighbouring cell.
+	uint64 NearestKey = 0;
+	int32 NearestIndex = INDEX_NONE;
+	double NearestDistance = MergeDistance;
+	ForEachCellInRange(Lat, Lon, MergeDistance, [&](uint64 Key) {
+		const FCell* Cell = Cells.Find(Key);
+		if (Cell == nullptr)
+			return;
+		for (int32 Index = 0; Index < Cell->Num(); ++Index)
+		{
+			const double Distance = GetOffsetMeters(Lat, Lon, (*Cell)[Index].Lat, (*Cell)[Index].Lon).Size();
+			if (Distance < NearestDistance)
+			{
+				NearestKey = Key;
+				NearestIndex = Index;
+				NearestDistance = Distance;
+			}
+		}
+	});
+
+	if (NearestIndex != INDEX_NONE)
+	{
+		FCell& NearestCell = Cells.FindChecked(NearestKey);
+		if (Lod < NearestCell[NearestIndex].Lod)
+		{
+			return;
+		}
+		// Replaced, the new sample goes to the cell of its own position.
+		NearestCell.RemoveAtSwap(NearestIndex);
+		--NumSamples;
+	}
+	Cells.FindOrAdd(MakeKey(GetCell(Lat, Lon))).Add({ Lat, Lon, Height, Lod });
+	++NumSamples;
+}
+
+bool FTerrainHeightCache::Query(double Lat, double Lon, double MaxDistance, double& OutHeight) const
+{
+	double WeightSum = 0.0;
+	double HeightSum = 0.0;
+	double ClosestDistance = MaxDistance;
+	double ClosestHeight = 0.0;
+	ForEachSampleInRange(Lat, Lon, MaxDistance, [&](const FTerrainHeightSample& Sample, double Distance) {
+		const double Weight = 1.0 / FMath::Square(FMath::Max(Distance, ExactDistance));
+		WeightSum += Weight;
+		HeightSum += Weight * Sample.Height;
+		if (Distance <= ClosestDistance)
+		{
+			ClosestDistance = Distance;
+			ClosestHeight = Sample.Height;
+		}
+	});
+	if (WeightSum == 0.0)
+	{
+		return false;
+	}
+	OutHeight = ClosestDistance < ExactDistance ? ClosestHeight : HeightSum / WeightSum;
+	return true;
+}
+
+bool FTerrainHeightCache::FindNearest(double Lat, double Lon, double MaxDistance, double& OutHeight, uint8 MinLod) const
+{
+	double ClosestDistance = TNumericLimits<double>::Max();
+	ForEachSampleInRange(Lat, Lon, MaxDistance, [&](const FTerrainHeightSample& Sample, double Distance) {
+		if (Distance < ClosestDistance && Sample.Lod >= MinLod)
+		{
+			ClosestDistance = Distance;
+			OutHeight = Sample.Height;
+		}
+	});
+	return ClosestDistance <= MaxDistance;
+}
+
+void FTerrainHeightCache::Reset()
+{
+	Cells.Reset();
+	NumSamples = 0;
+	CloseFile();
+	FilePath.Reset();
+}
+
+void FTerrainHeightCache::ForEachSample(TFunctionRef<void(const FTerrainHeightSample&)> Visitor) const
+{
+	for (const TPair<uint64, FCell>& Cell : Cells)
+	{
+		for (const FTerrainHeightSample& Sample : Cell.Value)
+		{
+			Visitor(Sample);
+		}
+	}
+	for (const FFileSample& FileSample : FileSamples)
+	{
+		Visitor(ToSample(FileSample));
+	}
+}
+
+const FTerrainHeightCache::FFileCell* FTerrainHeightCache::FindFileCell(uint64 Key) const
+{
+	const int32 Index = Algo::LowerBoundBy(FileCells, Key, &FFileCell::Key);
+	return FileCells.IsValidIndex(Index) && FileCells[Index].Key == Key ? &FileCells[Index] : nullptr;
+}
+
+FTerrainHeightSample FTerrainHeightCache::ToSample(const FFileSample& Sample) const
+{
+	return { Sample.Lat * Precision, Sample.Lon * Precision, Sample.Height, Sample.Lod };
+}
+
+void FTerrainHeightCache::CloseFile()
+{
+	FileCells = TArrayView<const FFileCell>();
+	FileSamples = TArrayView<const FFileSample>();
+	// The region must go before the file it maps.
+	MappedRegion.Reset();
+	MappedFile.Reset();
+}
+
+bool FTerrainHeightCache::Open(const FString& Path, uint64 SourceHash, double PrecisionIn)
+{
+	Reset();
+	FilePath = Path;
+	FileSourceHash = SourceHash;
+	Precision = PrecisionIn;
+	return MapFile();
+}
+
+bool FTerrainHeightCache::MapFile()
+{
+	const FString& Path = FilePath;
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (!PlatformFile.FileExists(*Path))
+	{
+		return false;
+	}
+	MappedFile.Reset(PlatformFile.OpenMapped(*Path));
+	if (!MappedFile.IsValid() || MappedFile->GetFileSize() < (int64)sizeof(FFileHeader))
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Terrain height cache %s cannot be mapped, it will be rewritten"), *Path);
+		CloseFile();
+		return false;
+	}
+	MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+	if (!MappedRegion.IsValid())
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Terrain height cache %s cannot be mapped, it will be rewritten"), *Path);
+		CloseFile();
+		return false;
+	}
+
+	const uint8* Data = MappedRegion->GetMappedPtr();
+	const FFileHeader& Header = *reinterpret_cast<const FFileHeader*>(Data);
+	const int64 ExpectedSize = sizeof(FFileHeader) + (int64)Header.NumCells * sizeof(FFileCell) + (int64)Header.NumSamples * sizeof(FFileSample);
+	if (Header.Magic != FileMagic || Header.Version != FileVersion || Header.SourceHash != FileSourceHash
+		|| Header.CellDegrees != CellDegrees || Header.Precision != Precision || ExpectedSize != MappedRegion->GetMappedSize())
+	{
+		UE_LOG(LogAerosimConnector, Log, TEXT("Terrain height cache %s is for another tileset, grid or version, it will be rewritten"), *Path);
+		CloseFile();
+		return false;
+	}
+
+	// Lookups slice the samples of a cell and binary search the keys, a file
+	// truncated or corrupted past its header must not get that far.
+	const FFileCell* MappedCells = reinterpret_cast<const FFileCell*>(Data + sizeof(FFileHeader));
+	bool bValid = Header.NumCells <= (uint32)MAX_int32 && Header.NumSamples <= (uint32)MAX_int32;
+	for (uint32 Index = 0; bValid && Index < Header.NumCells; ++Index)
+	{
+		bValid = (uint64)MappedCells[Index].First + MappedCells[Index].Count <= Header.NumSamples
+			&& (Index == 0 || MappedCells[Index - 1].Key < MappedCells[Index].Key);
+	}
+	if (!bValid)
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Terrain height cache %s is corrupted, it will be rewritten"), *Path);
+		CloseFile();
+		return false;
+	}
+
+	FileCells = MakeArrayView(MappedCells, Header.NumCells);
+	FileSamples = MakeArrayView(reinterpret_cast<const FFileSample*>(Data + sizeof(FFileHeader) + Header.NumCells * sizeof(FFileCell)), Header.NumSamples);
+	UE_LOG(LogAerosimConnector, Log, TEXT("Terrain height cache %s mapped: %d samples in %d cells"), *Path, FileSamples.Num(), FileCells.Num());
+	return true;
+}
+
+bool FTerrainHeightCache::Save()
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+
+	// Samples of the file not replaced by a newer one in memory.
+	TMap<uint64, FCell> Merged = Cells;
+	for (const FFileCell& FileCell : FileCells)
+	{
+		FCell& Cell = Merged.FindOrAdd(FileCell.Key);
+		const int32 NumNewer = Cell.Num();
+		for (const FFileSample& FileSample : FileSamples.Slice(FileCell.First, FileCell.Count))
+		{
+			const FTerrainHeightSample Sample = ToSample(FileSample);
+			if (!IsReplaced(Sample, MakeArrayView(Cell.GetData(), NumNewer)))
+			{
+				Cell.Add(Sample);
+			}
+		}
+	}
+	Merged.KeySort(TLess<uint64>());
+
+	TArray<FFileCell> OutCells;
+	TArray<FFileSample> OutSamples;
+	OutCells.Reserve(Merged.Num());
+	for (const TPair<uint64, FCell>& Cell : Merged)
+	{
+		OutCells.Add({ Cell.Key, (uint32)OutSamples.Num(), (uint32)Cell.Value.Num() });
+		for (const FTerrainHeightSample& Sample : Cell.Value)
+		{
+			FFileSample& OutSample = OutSamples.AddZeroed_GetRef();
+			OutSample.Lat = FMath::RoundToInt32(Sample.Lat / Precision);
+			OutSample.Lon = FMath::RoundToInt32(Sample.Lon / Precision);
+			OutSample.Height = (float)Sample.Height;
+			OutSample.Lod = Sample.Lod;
+		}
+	}
+
+	FFileHeader Header;
+	FMemory::Memzero(Header);
+	Header.Magic = FileMagic;
+	Header.Version = FileVersion;
+	Header.SourceHash = FileSourceHash;
+	Header.CellDegrees = CellDegrees;
+	Header.Precision = Precision;
+	Header.NumCells = OutCells.Num();
+	Header.NumSamples = OutSamples.Num();
+
+	TArray<uint8> Bytes;
+	Bytes.Reserve(sizeof(FFileHeader) + OutCells.Num() * sizeof(FFileCell) + OutSamples.Num() * sizeof(FFileSample));
+	Bytes.Append(reinterpret_cast<const uint8*>(&Header), sizeof(FFileHeader));
+	Bytes.Append(reinterpret_cast<const uint8*>(OutCells.GetData()), OutCells.Num() * sizeof(FFileCell));
+	Bytes.Append(reinterpret_cast<const uint8*>(OutSamples.GetData()), OutSamples.Num() * sizeof(FFileSample));
+
+	// Written aside and moved over the old file, which must be unmapped first.
+	const FString TempPath = FilePath + TEXT(".tmp");
+	if (!FFileHelper::SaveArrayToFile(Bytes, *TempPath))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Failed to write terrain height cache %s"), *TempPath);
+		return false;
+	}
+	CloseFile();
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.DeleteFile(*FilePath);
+	if (!PlatformFile.MoveFile(*FilePath, *TempPath))
+	{
+		// The samples in memory are kept, the next Save tries again.
+		UE_LOG(LogAerosimConnector, Error, TEXT("Failed to replace terrain height cache %s"), *FilePath);
+		return false;
+	}
+
+	UE_LOG(LogAerosimConnector, Log, TEXT("Terrain height cache %s saved: %d samples in %d cells"), *FilePath, OutSamples.Num(), OutCells.Num());
+	// The samples written are served from the new file from now on, they only
+	// leave memory once it is mapped.
+	if (!MapFile())
+	{
+		return false;
+	}
+	Cells.Reset();
+	NumSamples = 0;
+	return true;
+}
+
+// Checks that every sample is queried back with its height from memory, from
+// the file right after Save, after a second Save merging new samples into it
+// and from a fresh cache opening the file. The samples straddle the
+// antimeridian. Also logs the query time in memory and from the mapped file.
+static void RunTerrainHeightCacheBenchmark(const TArray<FString>& Args)
+{
+	const int32 NumSamples = Args.Num() > 0 ? FMath::Max(2, FCString::Atoi(*Args[0])) : 100000;
+	const FString Path = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("TerrainHeightCache.bin");
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(Path), true);
+	IFileManager::Get().Delete(*Path);
+	constexpr uint64 SourceHash = 0x5EED;
+	constexpr double Precision = 1e-7;
+	// Heights are stored as floats.
+	constexpr double Tolerance = 1e-3;
+
+	// A jittered grid of 2 m spacing, so no two samples are close enough for
+	// Save to take one as a replacement of the other.
+	constexpr double Lat0 = 10.0;
+	const double Step = 2.0 / MetersPerDegree;
+	const double LonStep = Step / FMath::Cos(FMath::DegreesToRadians(Lat0));
+	const int32 Side = FMath::CeilToInt32(FMath::Sqrt((double)NumSamples));
+	FRandomStream Random(NumSamples);
+	TArray<FTerrainHeightSample> Samples;
+	Samples.SetNum(NumSamples);
+	for (int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		FTerrainHeightSample& Sample = Samples[Index];
+		Sample.Lat = Lat0 + (Index / Side - Side / 2 + Random.FRandRange(-0.25f, 0.25f)) * Step;
+		Sample.Lon = FMath::UnwindDegrees(180.0 + (Index % Side - Side / 2 + Random.FRandRange(-0.25f, 0.25f)) * LonStep);
+		Sample.Height = Random.FRandRange(0.0f, 3000.0f);
+	}
+
+	int32 Mismatches = 0;
+	auto Check = [&](const FTerrainHeightCache& Cache, int32 First, int32 Count, const TCHAR* Stage) {
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Index = First; Index < First + Count; ++Index)
+		{
+			const FTerrainHeightSample& Sample = Samples[Index];
+			double Height = 0.0;
+			if (!Cache.Query(Sample.Lat, Sample.Lon, 0.1, Height) || FMath::Abs(Height - Sample.Height) > Tolerance)
+			{
+				if (Mismatches++ == 0)
+				{
+					UE_LOG(LogAerosimConnector, Error, TEXT("Terrain height cache %s: sample %d at (%.7f, %.7f) lost its height %.3f"), Stage, Index, Sample.Lat, Sample.Lon, Sample.Height);
+				}
+			}
+		}
+		UE_LOG(LogAerosimConnector, Display, TEXT("Terrain height cache %-22s %7d queries, %.0f ns/query"),
+			Stage, Count, (FPlatformTime::Seconds() - StartTime) * 1e9 / FMath::Max(1, Count));
+	};
+
+	const int32 Half = NumSamples / 2;
+	{
+		// MergeDistance 0 keeps every sample.
+		FTerrainHeightCache Cache;
+		Cache.Open(Path, SourceHash, Precision);
+		for (int32 Index = 0; Index < Half; ++Index)
+		{
+			Cache.Add(Samples[Index].Lat, Samples[Index].Lon, Samples[Index].Height, 0, 0.0);
+		}
+		Check(Cache, 0, Half, TEXT("in memory"));
+		Cache.Save();
+		Check(Cache, 0, Half, TEXT("mapped after save"));
+
+		for (int32 Index = Half; Index < NumSamples; ++Index)
+		{
+			Cache.Add(Samples[Index].Lat, Samples[Index].Lon, Samples[Index].Height, 0, 0.0);
+		}
+		Check(Cache, 0, NumSamples, TEXT("mapped and in memory"));
+		Cache.Save();
+		Check(Cache, 0, NumSamples, TEXT("mapped after merge"));
+	}
+	{
+		FTerrainHeightCache Cache;
+		Cache.Open(Path, SourceHash, Precision);
+		if (Cache.Num() != NumSamples)
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("Terrain height cache reopened with %d samples, %d were saved"), Cache.Num(), NumSamples);
+			++Mismatches;
+		}
+		Check(Cache, 0, NumSamples, TEXT("reopened"));
+	}
+	IFileManager::Get().Delete(*Path);
+
+	if (Mismatches > 0)
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("Terrain height cache round trip failed: %d mismatches"), Mismatches);
+	}
+	else
+	{
+		UE_LOG(LogAerosimConnector, Display, TEXT("Terrain height cache round trip passed for %d samples"), NumSamples);
+	}
+}
+
+static FAutoConsoleCommand TerrainHeightCacheBenchmarkCommand(
+	TEXT("aerosim.Benchmark.TerrainHeightCache"),
+	TEXT("Checks that terrain height samples round-trip through Save and Open and logs the query time. Args: [NumSamples]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&RunTerrainHeightCacheBenchmark));
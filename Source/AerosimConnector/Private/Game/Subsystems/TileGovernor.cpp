@@ -0,0 +1,170 @@
+#include "Game/Subsystems/TileGovernor.h"
+#include "AerosimConnector.h"
+#include "Cesium3DTileset.h"
+#include "Cesium3DTilesSelection/Tileset.h"
+#include "HAL/IConsoleManager.h"
+#include "RHI.h"
+#include "RenderCore.h"
+
+static TAutoConsoleVariable<bool> CVarTileGovernorEnabled(
+	TEXT("aerosim.TileGovernor.Enabled"),
+	true,
+	TEXT("Adjust the tileset screen-space error, cache size and concurrent loads to the frame time and memory targets."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTileGovernorTargetFrameMs(
+	TEXT("aerosim.TileGovernor.TargetFrameMs"),
+	33.3f,
+	TEXT("Frame time the governor aims for, in milliseconds."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTileGovernorMaxMemoryMB(
+	TEXT("aerosim.TileGovernor.MaxMemoryMB"),
+	1024.0f,
+	TEXT("Tile data the tileset may keep resident, in megabytes."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTileGovernorMinScreenSpaceError(
+	TEXT("aerosim.TileGovernor.MinScreenSpaceError"),
+	16.0f,
+	TEXT("Finest screen-space error the governor gives back, the Cesium default. A finer one set on the tileset is given back too."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTileGovernorMaxScreenSpaceError(
+	TEXT("aerosim.TileGovernor.MaxScreenSpaceError"),
+	64.0f,
+	TEXT("Coarsest screen-space error the governor goes to."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTileGovernorIntervalSeconds(
+	TEXT("aerosim.TileGovernor.IntervalSeconds"),
+	1.0f,
+	TEXT("Seconds between two adjustments, long enough for the previous one to show in the frame time."),
+	ECVF_Default);
+
+// Over Target * OverBudgetRatio detail is reduced, under Target * UnderBudgetRatio
+// it is given back. The band in between avoids oscillating.
+static constexpr double OverBudgetRatio = 1.1;
+static constexpr double UnderBudgetRatio = 0.8;
+
+// Screen-space error factor of one adjustment.
+static constexpr double ScreenSpaceErrorStep = 1.25;
+
+static constexpr int32 MinSimultaneousTileLoads = 4;
+// Loads given back at most, unless more were set on the tileset.
+static constexpr int32 MaxSimultaneousTileLoads = 40;
+
+// The cache is shrunk to this share of the ceiling when the ceiling is exceeded.
+static constexpr double CacheShrinkRatio = 0.75;
+
+FTileBudget FTileGovernor::GetBudget(const ACesium3DTileset* Tileset)
+{
+	FTileBudget Budget;
+	Budget.MaximumScreenSpaceError = Tileset->GetMaximumScreenSpaceError();
+	Budget.MaximumCachedBytes = Tileset->MaximumCachedBytes;
+	Budget.MaximumSimultaneousTileLoads = Tileset->MaximumSimultaneousTileLoads;
+	return Budget;
+}
+
+void FTileGovernor::ApplyBudget(ACesium3DTileset* Tileset, const FTileBudget& Budget)
+{
+	// The tileset copies these into its loading options every tick, no reload needed
+	Tileset->SetMaximumScreenSpaceError(Budget.MaximumScreenSpaceError);
+	Tileset->MaximumCachedBytes = Budget.MaximumCachedBytes;
+	Tileset->MaximumSimultaneousTileLoads = Budget.MaximumSimultaneousTileLoads;
+}
+
+void FTileGovernor::SetUserBudget(ACesium3DTileset* Tileset, const FTileBudget& Budget)
+{
+	ApplyBudget(Tileset, Budget);
+	UserBudget = Budget;
+}
+
+void FTileGovernor::SetEnabled(bool bEnabled)
+{
+	CVarTileGovernorEnabled->Set(bEnabled, ECVF_SetByCode);
+}
+
+void FTileGovernor::Tick(ACesium3DTileset* Tileset, float DeltaSeconds)
+{
+	if (!CVarTileGovernorEnabled.GetValueOnGameThread() || !IsValid(Tileset))
+	{
+		SmoothedFrameMs = 0.0;
+		return;
+	}
+
+	const double FrameMs = FMath::Max3(
+		FPlatformTime::ToMilliseconds(GGameThreadTime),
+		FPlatformTime::ToMilliseconds(GRenderThreadTime),
+		FPlatformTime::ToMilliseconds(RHIGetGPUFrameCycles()));
+	const double Alpha = 1.0 - FMath::Exp(-DeltaSeconds);
+	SmoothedFrameMs = SmoothedFrameMs > 0.0 ? FMath::Lerp(SmoothedFrameMs, FrameMs, Alpha) : FrameMs;
+
+	SecondsSinceAdjustment += DeltaSeconds;
+	if (SecondsSinceAdjustment < CVarTileGovernorIntervalSeconds.GetValueOnGameThread())
+	{
+		return;
+	}
+	SecondsSinceAdjustment = 0.0;
+
+	const double TargetMs = CVarTileGovernorTargetFrameMs.GetValueOnGameThread();
+	const int64 CeilingBytes = (int64)(CVarTileGovernorMaxMemoryMB.GetValueOnGameThread() * 1024.0 * 1024.0);
+	const double MinError = CVarTileGovernorMinScreenSpaceError.GetValueOnGameThread();
+	const double MaxError = FMath::Max<double>(CVarTileGovernorMaxScreenSpaceError.GetValueOnGameThread(), MinError);
+	const Cesium3DTilesSelection::Tileset* NativeTileset = Tileset->GetTileset();
+	const int64 ResidentBytes = NativeTileset != nullptr ? NativeTileset->getTotalDataBytes() : 0;
+
+	// Each step only moves the budget the way it adjusts, so a user setting
+	// beyond the limits is never pulled back to them
+	const FTileBudget Budget = GetBudget(Tileset);
+	if (!UserBudget.IsSet())
+	{
+		UserBudget = Budget;
+	}
+	FTileBudget Next = Budget;
+	if (ResidentBytes > CeilingBytes)
+	{
+		Next.MaximumScreenSpaceError = FMath::Max(Budget.MaximumScreenSpaceError, FMath::Min(Budget.MaximumScreenSpaceError * ScreenSpaceErrorStep, MaxError));
+		Next.MaximumCachedBytes = FMath::Min(Budget.MaximumCachedBytes, (int64)(CeilingBytes * CacheShrinkRatio));
+		if (Next != Budget)
+		{
+			UE_LOG(LogAerosimConnector, Log, TEXT("TileGovernor: %.0f MB resident over the %.0f MB ceiling, screen-space error %.1f -> %.1f, cache %.0f -> %.0f MB"),
+				ResidentBytes / (1024.0 * 1024.0), CeilingBytes / (1024.0 * 1024.0), Budget.MaximumScreenSpaceError, Next.MaximumScreenSpaceError,
+				Budget.MaximumCachedBytes / (1024.0 * 1024.0), Next.MaximumCachedBytes / (1024.0 * 1024.0));
+		}
+	}
+	else if (SmoothedFrameMs > TargetMs * OverBudgetRatio)
+	{
+		Next.MaximumScreenSpaceError = FMath::Max(Budget.MaximumScreenSpaceError, FMath::Min(Budget.MaximumScreenSpaceError * ScreenSpaceErrorStep, MaxError));
+		Next.MaximumSimultaneousTileLoads = FMath::Min(Budget.MaximumSimultaneousTileLoads, FMath::Max(Budget.MaximumSimultaneousTileLoads - 2, MinSimultaneousTileLoads));
+		if (Next != Budget)
+		{
+			UE_LOG(LogAerosimConnector, Log, TEXT("TileGovernor: frame %.1f ms over the %.1f ms target, screen-space error %.1f -> %.1f, loads %d -> %d"),
+				SmoothedFrameMs, TargetMs, Budget.MaximumScreenSpaceError, Next.MaximumScreenSpaceError,
+				Budget.MaximumSimultaneousTileLoads, Next.MaximumSimultaneousTileLoads);
+		}
+	}
+	else if (SmoothedFrameMs < TargetMs * UnderBudgetRatio)
+	{
+		// Detail first, then the loads, then room in the cache up to the ceiling.
+		// The limits take in what the user set.
+		const double FinestError = FMath::Min(MinError, UserBudget->MaximumScreenSpaceError);
+		const int32 MostLoads = FMath::Max(MaxSimultaneousTileLoads, UserBudget->MaximumSimultaneousTileLoads);
+		const int64 MostCachedBytes = FMath::Max(CeilingBytes, UserBudget->MaximumCachedBytes);
+		Next.MaximumScreenSpaceError = FMath::Min(Budget.MaximumScreenSpaceError, FMath::Max(Budget.MaximumScreenSpaceError / ScreenSpaceErrorStep, FinestError));
+		Next.MaximumSimultaneousTileLoads = FMath::Max(Budget.MaximumSimultaneousTileLoads, FMath::Min(Budget.MaximumSimultaneousTileLoads + 1, MostLoads));
+		Next.MaximumCachedBytes = FMath::Max(Budget.MaximumCachedBytes, FMath::Min<int64>(ResidentBytes * 5 / 4, MostCachedBytes));
+		if (Next != Budget)
+		{
+			UE_LOG(LogAerosimConnector, Log, TEXT("TileGovernor: frame %.1f ms under the %.1f ms target, screen-space error %.1f -> %.1f, loads %d -> %d, cache %.0f -> %.0f MB"),
+				SmoothedFrameMs, TargetMs, Budget.MaximumScreenSpaceError, Next.MaximumScreenSpaceError,
+				Budget.MaximumSimultaneousTileLoads, Next.MaximumSimultaneousTileLoads,
+				Budget.MaximumCachedBytes / (1024.0 * 1024.0), Next.MaximumCachedBytes / (1024.0 * 1024.0));
+		}
+	}
+
+	if (Next != Budget)
+	{
+		ApplyBudget(Tileset, Next);
+	}
+}
@@ -0,0 +1,319 @@
+#include "Game/Subsystems/TileMetrics.h"
+#include "AerosimConnector.h"
+#include "Util/MessageHandler.h"
+#include "Cesium3DTileset.h"
+#include "Cesium3DTilesSelection/Tile.h"
+#include "Cesium3DTilesSelection/TileLoadState.h"
+#include "Cesium3DTilesSelection/Tileset.h"
+#include "HAL/IConsoleManager.h"
+
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+DECLARE_CYCLE_STAT(TEXT("Cesium Tileset Tick"), STAT_AerosimTilesetTick, STATGROUP_AerosimConnector);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tiles Resident"), STAT_AerosimTilesResident, STATGROUP_AerosimConnector);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tile Requests Pending"), STAT_AerosimTileRequestsPending, STATGROUP_AerosimConnector);
+DECLARE_MEMORY_STAT(TEXT("Tile Data Resident"), STAT_AerosimTileDataResident, STATGROUP_AerosimConnector);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Tile Loads"), STAT_AerosimTileLoads, STATGROUP_AerosimConnector);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Tile Evictions"), STAT_AerosimTileEvictions, STATGROUP_AerosimConnector);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Tile Load Latency p90 (ms)"), STAT_AerosimTileLoadLatencyP90, STATGROUP_AerosimConnector);
+
+static TAutoConsoleVariable<int32> CVarTileMetricsLevel(
+	TEXT("aerosim.TileMetrics.Level"),
+	1,
+	TEXT("Tile streaming metrics: 0 off, 1 resident tiles, pending requests and tileset tick time, 2 also each load and eviction with the load latencies."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTileMetricsPublishSeconds(
+	TEXT("aerosim.TileMetrics.PublishSeconds"),
+	5.0f,
+	TEXT("Seconds between two tile_metrics messages on the renderer responses topic, 0 only updates the stat counters."),
+	ECVF_Default);
+
+// Load latencies kept per window, a uniform sample beyond.
+static constexpr int32 MaxLoadLatencySamples = 4096;
+
+// Tiles still to load for the current views, derived from the load progress
+// of the last tileset tick: the loaded share of loaded and pending tiles.
+static int32 EstimatePendingTiles(int32 ResidentTiles, float LoadProgress)
+{
+	if (LoadProgress >= 100.0f || ResidentTiles <= 0)
+	{
+		return 0;
+	}
+	const double Progress = FMath::Max(LoadProgress, 1.0f);
+	return FMath::RoundToInt(ResidentTiles * (100.0 - Progress) / Progress);
+}
+
+// Nearest-rank percentile of sorted values.
+static float Percentile(const TArray<float>& Sorted, double Fraction)
+{
+	const int32 Rank = FMath::CeilToInt(Fraction * Sorted.Num());
+	return Sorted[FMath::Clamp(Rank - 1, 0, Sorted.Num() - 1)];
+}
+
+FTileMetrics::FTileMetrics()
+{
+	for (FTilesetTickBracket* Bracket : { &TilesetTickStart, &TilesetTickEnd })
+	{
+		Bracket->Metrics = this;
+		Bracket->bCanEverTick = true;
+		Bracket->bStartWithTickEnabled = true;
+		Bracket->bHighPriority = true;
+	}
+	TilesetTickEnd.bEnd = true;
+}
+
+void FTileMetrics::FTilesetTickBracket::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (!bEnd)
+	{
+		Metrics->TilesetTickStartFrame = GFrameCounter;
+		Metrics->TilesetTickStartCycles = FPlatformTime::Cycles64();
+		return;
+	}
+
+	// Same conditions as the actor tick, nothing ran between the two otherwise
+	const ACesium3DTileset* Timed = Metrics->TimedTileset.Get();
+	if (Metrics->TilesetTickStartFrame != GFrameCounter || !IsValid(Timed) || !Timed->IsActorTickEnabled()
+		|| (TickType == LEVELTICK_ViewportsOnly && !Timed->ShouldTickIfViewportsOnly()))
+	{
+		return;
+	}
+	const uint64 Cycles = FPlatformTime::Cycles64() - Metrics->TilesetTickStartCycles;
+	SET_CYCLE_COUNTER(STAT_AerosimTilesetTick, (uint32)Cycles);
+	const double Seconds = FPlatformTime::ToSeconds64(Cycles);
+
+	FTileMetricsWindow& Window = Metrics->Window;
+	++Window.Ticks;
+	Window.TickSeconds += Seconds;
+	Window.MaxTickSeconds = FMath::Max(Window.MaxTickSeconds, Seconds);
+}
+
+void FTileMetrics::TimeTilesetTick(bool bEnabled, ACesium3DTileset* Tileset)
+{
+	ACesium3DTileset* Timed = TimedTileset.Get();
+	if (bTimingTilesetTick && (!bEnabled || !IsValid(Tileset) || Timed != Tileset))
+	{
+		if (IsValid(Timed))
+		{
+			Timed->PrimaryActorTick.RemovePrerequisite(Timed, TilesetTickStart);
+			Timed->PrimaryActorTick.bHighPriority = bTimedTickHighPriority;
+			TilesetTickEnd.RemovePrerequisite(Timed, Timed->PrimaryActorTick);
+		}
+		TilesetTickStart.UnRegisterTickFunction();
+		TilesetTickEnd.UnRegisterTickFunction();
+		TimedTileset.Reset();
+		TilesetTickStartFrame = MAX_uint64;
+		bTimingTilesetTick = false;
+	}
+
+	if (!bTimingTilesetTick && bEnabled && IsValid(Tileset) && Tileset->GetLevel() != nullptr)
+	{
+		// In the group of the actor tick, and like the brackets dispatched ahead
+		// of the other ticks of the group so none runs in between
+		FTickFunction& ActorTick = Tileset->PrimaryActorTick;
+		for (FTilesetTickBracket* Bracket : { &TilesetTickStart, &TilesetTickEnd })
+		{
+			Bracket->TickGroup = ActorTick.TickGroup;
+			Bracket->EndTickGroup = ActorTick.EndTickGroup;
+			Bracket->bTickEvenWhenPaused = ActorTick.bTickEvenWhenPaused;
+			Bracket->RegisterTickFunction(Tileset->GetLevel());
+		}
+		ActorTick.AddPrerequisite(Tileset, TilesetTickStart);
+		TilesetTickEnd.AddPrerequisite(Tileset, ActorTick);
+		bTimedTickHighPriority = ActorTick.bHighPriority;
+		ActorTick.bHighPriority = true;
+		TimedTileset = Tileset;
+		bTimingTilesetTick = true;
+	}
+}
+
+void FTileMetrics::Tick(ACesium3DTileset* Tileset, float DeltaSeconds)
+{
+	const int32 Level = CVarTileMetricsLevel.GetValueOnGameThread();
+	TimeTilesetTick(Level > 0, Tileset);
+
+	const Cesium3DTilesSelection::Tileset* NativeTileset = IsValid(Tileset) ? Tileset->GetTileset() : nullptr;
+	if (Level <= 0 || NativeTileset == nullptr)
+	{
+		TrackedTiles.Reset();
+		WalkSerial = 0;
+		LastResidentTiles = -1;
+		Window = FTileMetricsWindow();
+		return;
+	}
+
+	const int32 ResidentTiles = NativeTileset->getNumberOfTilesLoaded();
+	if (Level >= 2)
+	{
+		WalkTiles(Tileset);
+	}
+	else
+	{
+		TrackedTiles.Reset();
+		WalkSerial = 0;
+		if (LastResidentTiles >= 0)
+		{
+			const int32 Loaded = FMath::Max(ResidentTiles - LastResidentTiles, 0);
+			const int32 Evicted = FMath::Max(LastResidentTiles - ResidentTiles, 0);
+			Window.TilesLoaded += Loaded;
+			Window.TilesEvicted += Evicted;
+			INC_DWORD_STAT_BY(STAT_AerosimTileLoads, Loaded);
+			INC_DWORD_STAT_BY(STAT_AerosimTileEvictions, Evicted);
+		}
+	}
+	LastResidentTiles = ResidentTiles;
+
+	SET_DWORD_STAT(STAT_AerosimTilesResident, ResidentTiles);
+	SET_DWORD_STAT(STAT_AerosimTileRequestsPending, EstimatePendingTiles(ResidentTiles, Tileset->GetLoadProgress()));
+	SET_MEMORY_STAT(STAT_AerosimTileDataResident, NativeTileset->getTotalDataBytes());
+
+	Window.Seconds += DeltaSeconds;
+	const float PublishSeconds = CVarTileMetricsPublishSeconds.GetValueOnGameThread();
+	if (PublishSeconds > 0.0f && Window.Seconds >= PublishSeconds)
+	{
+		Publish(Tileset, Level);
+		Window = FTileMetricsWindow();
+	}
+}
+
+void FTileMetrics::WalkTiles(const ACesium3DTileset* Tileset)
+{
+	using namespace Cesium3DTilesSelection;
+
+	const Tile* Root = Tileset->GetTileset()->getRootTile();
+	const double Now = FPlatformTime::Seconds();
+	// Tiles found on the first walk were loaded before it started
+	const bool bFirstWalk = WalkSerial == 0;
+	++WalkSerial;
+
+	TArray<const Tile*, TInlineAllocator<64>> Stack;
+	if (Root != nullptr)
+	{
+		Stack.Add(Root);
+	}
+	while (Stack.Num() > 0)
+	{
+		const Tile* Current = Stack.Pop(EAllowShrinking::No);
+		for (const Tile& Child : Current->getChildren())
+		{
+			Stack.Add(&Child);
+		}
+
+		const TileLoadState State = Current->getState();
+		const bool bLoading = State == TileLoadState::ContentLoading || State == TileLoadState::ContentLoaded;
+		if (!bLoading && State != TileLoadState::Done)
+		{
+			continue;
+		}
+		FTrackedTile* Tracked = TrackedTiles.Find(Current);
+		if (Tracked == nullptr)
+		{
+			Tracked = &TrackedTiles.Add(Current);
+			Tracked->LoadStartSeconds = bLoading ? Now : -1.0;
+			Tracked->bLoaded = !bLoading;
+			if (Tracked->bLoaded && !bFirstWalk)
+			{
+				++Window.TilesLoaded;
+				INC_DWORD_STAT(STAT_AerosimTileLoads);
+			}
+		}
+		else if (!Tracked->bLoaded && !bLoading)
+		{
+			Tracked->bLoaded = true;
+			++Window.TilesLoaded;
+			INC_DWORD_STAT(STAT_AerosimTileLoads);
+			if (Tracked->LoadStartSeconds >= 0.0)
+			{
+				AddLoadLatency((Now - Tracked->LoadStartSeconds) * 1000.0);
+			}
+		}
+		Tracked->Walk = WalkSerial;
+	}
+
+	// Tiles gone from the tree or unloading were evicted
+	for (auto It = TrackedTiles.CreateIterator(); It; ++It)
+	{
+		if (It.Value().Walk != WalkSerial)
+		{
+			if (It.Value().bLoaded)
+			{
+				++Window.TilesEvicted;
+				INC_DWORD_STAT(STAT_AerosimTileEvictions);
+			}
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FTileMetrics::AddLoadLatency(double Milliseconds)
+{
+	++Window.LoadsSeen;
+	if (Window.LoadLatenciesMs.Num() < MaxLoadLatencySamples)
+	{
+		Window.LoadLatenciesMs.Add((float)Milliseconds);
+		return;
+	}
+	const int32 Slot = FMath::RandRange(0, Window.LoadsSeen - 1);
+	if (Slot < MaxLoadLatencySamples)
+	{
+		Window.LoadLatenciesMs[Slot] = (float)Milliseconds;
+	}
+}
+
+void FTileMetrics::Publish(const ACesium3DTileset* Tileset, int32 Level)
+{
+	const Cesium3DTilesSelection::Tileset* NativeTileset = Tileset->GetTileset();
+	const int32 ResidentTiles = NativeTileset->getNumberOfTilesLoaded();
+
+	// Not a reply to a request, so no uuid
+	TSharedPtr<FJsonObject> ResponsePayload = MakeShareable(new FJsonObject);
+	ResponsePayload->SetStringField(TEXT("uuid"), TEXT(""));
+	ResponsePayload->SetStringField(TEXT("response_type"), TEXT("tile_metrics"));
+
+	TSharedPtr<FJsonObject> ResponseParameters = MakeShareable(new FJsonObject);
+	ResponseParameters->SetNumberField(TEXT("level"), Level);
+	ResponseParameters->SetNumberField(TEXT("window_seconds"), Window.Seconds);
+	ResponseParameters->SetNumberField(TEXT("tiles_resident"), ResidentTiles);
+	ResponseParameters->SetNumberField(TEXT("tiles_loaded"), Window.TilesLoaded);
+	ResponseParameters->SetNumberField(TEXT("tiles_evicted"), Window.TilesEvicted);
+	ResponseParameters->SetNumberField(TEXT("bytes_resident"), NativeTileset->getTotalDataBytes());
+	ResponseParameters->SetNumberField(TEXT("pending_requests"), EstimatePendingTiles(ResidentTiles, Tileset->GetLoadProgress()));
+	ResponseParameters->SetNumberField(TEXT("load_progress"), Tileset->GetLoadProgress());
+	ResponseParameters->SetNumberField(TEXT("tileset_tick_ms_mean"), Window.Ticks > 0 ? 1000.0 * Window.TickSeconds / Window.Ticks : 0.0);
+	ResponseParameters->SetNumberField(TEXT("tileset_tick_ms_max"), 1000.0 * Window.MaxTickSeconds);
+
+	if (Level >= 2)
+	{
+		TSharedPtr<FJsonObject> Latency = MakeShareable(new FJsonObject);
+		Latency->SetNumberField(TEXT("count"), Window.LoadsSeen);
+		if (Window.LoadLatenciesMs.Num() > 0)
+		{
+			Window.LoadLatenciesMs.Sort();
+			Latency->SetNumberField(TEXT("p50"), Percentile(Window.LoadLatenciesMs, 0.5));
+			Latency->SetNumberField(TEXT("p90"), Percentile(Window.LoadLatenciesMs, 0.9));
+			Latency->SetNumberField(TEXT("p99"), Percentile(Window.LoadLatenciesMs, 0.99));
+			SET_FLOAT_STAT(STAT_AerosimTileLoadLatencyP90, Percentile(Window.LoadLatenciesMs, 0.9));
+		}
+		ResponseParameters->SetObjectField(TEXT("load_latency_ms"), Latency);
+	}
+
+	ResponsePayload->SetObjectField(TEXT("parameters"), ResponseParameters);
+
+	FString ResponseString;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ResponseString);
+	FJsonSerializer::Serialize(ResponsePayload.ToSharedRef(), Writer);
+
+	publish_to_topic("aerosim.renderer.responses", TCHAR_TO_UTF8(*ResponseString));
+}
+
+void FTileMetrics::Reset(ACesium3DTileset* Tileset)
+{
+	TimeTilesetTick(false, Tileset);
+	TrackedTiles.Reset();
+	WalkSerial = 0;
+	LastResidentTiles = -1;
+	Window = FTileMetricsWindow();
+}
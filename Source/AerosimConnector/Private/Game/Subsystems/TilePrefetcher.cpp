@@ -0,0 +1,290 @@
+#include "Game/Subsystems/TilePrefetcher.h"
+#include "AerosimConnector.h"
+#include "Cesium3DTileset.h"
+#include "Cesium3DTilesSelection/Tileset.h"
+#include "CesiumCamera.h"
+#include "CesiumCameraManager.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tile Prefetch Views"), STAT_AerosimTilePrefetchViews, STATGROUP_AerosimConnector);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Tile Prefetch Missed Frames"), STAT_AerosimTilePrefetchMissedFrames, STATGROUP_AerosimConnector);
+
+static TAutoConsoleVariable<bool> CVarTilePrefetchEnabled(
+	TEXT("aerosim.TilePrefetch.Enabled"),
+	true,
+	TEXT("Load the tiles ahead of moving actors through virtual cameras along their predicted path."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTilePrefetchLookaheadSeconds(
+	TEXT("aerosim.TilePrefetch.LookaheadSeconds"),
+	10.0f,
+	TEXT("How far ahead of the actors tiles are prefetched, in seconds at their current speed."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarTilePrefetchMaxViews(
+	TEXT("aerosim.TilePrefetch.MaxViews"),
+	4,
+	TEXT("Virtual cameras shared by all the tracked actors. Limits the views, not the tile requests each view causes."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarTilePrefetchViewportSize(
+	TEXT("aerosim.TilePrefetch.ViewportSize"),
+	512,
+	TEXT("Viewport size of the virtual cameras in pixels, smaller selects coarser and fewer tiles."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTilePrefetchMaxMegabytes(
+	TEXT("aerosim.TilePrefetch.MaxMegabytes"),
+	512.0f,
+	TEXT("Tile data resident in memory above which prefetching is suspended."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarTilePrefetchSampleFrames(
+	TEXT("aerosim.TilePrefetch.SampleFrames"),
+	30,
+	TEXT("Frames between two checks of whether the cameras see tiles not loaded yet, 0 disables the checks."),
+	ECVF_Default);
+
+// Horizontal field of view of the virtual cameras, in degrees.
+static constexpr double PrefetchFieldOfView = 90.0;
+
+// Degrees the virtual cameras look below the direction of travel.
+static constexpr double PrefetchPitchDown = 15.0;
+
+// Time constant of the velocity smoothing, in seconds.
+static constexpr float VelocitySmoothingSeconds = 0.5f;
+
+// Location changes faster than this are teleports or origin changes, not motion (cm/s).
+static constexpr double MaxPlausibleSpeed = 100000.0;
+
+// Below this speed (cm/s) the actor is taken as stationary and nothing is prefetched.
+static constexpr double MinPrefetchSpeed = 100.0;
+
+void FTilePrefetcher::Track(AActor* Actor)
+{
+	if (!IsValid(Actor) || Targets.ContainsByPredicate([Actor](const FTarget& Target) { return Target.Actor == Actor; }))
+	{
+		return;
+	}
+	FTarget& Target = Targets.AddDefaulted_GetRef();
+	Target.Actor = Actor;
+}
+
+void FTilePrefetcher::SetWaypoints(AActor* Actor, const TArray<FVector>& Waypoints)
+{
+	Track(Actor);
+	for (FTarget& Target : Targets)
+	{
+		if (Target.Actor == Actor)
+		{
+			Target.Waypoints = Waypoints;
+		}
+	}
+}
+
+void FTilePrefetcher::UpdateVelocity(FTarget& Target, float DeltaSeconds) const
+{
+	const FVector Location = Target.Actor->GetActorLocation();
+	if (Target.bHasLocation && DeltaSeconds > 0.0f)
+	{
+		const FVector Velocity = (Location - Target.LastLocation) / DeltaSeconds;
+		if (Velocity.SizeSquared() < FMath::Square(MaxPlausibleSpeed))
+		{
+			const float Alpha = 1.0f - FMath::Exp(-DeltaSeconds / VelocitySmoothingSeconds);
+			Target.Velocity = FMath::Lerp(Target.Velocity, Velocity, Alpha);
+		}
+	}
+	Target.LastLocation = Location;
+	Target.bHasLocation = true;
+}
+
+void FTilePrefetcher::PredictViews(const FTarget& Target, int32 NumViews, TArray<TPair<FVector, FVector>>& OutViews) const
+{
+	OutViews.Reset();
+	const double Speed = Target.Velocity.Size();
+	if (NumViews <= 0 || Speed < MinPrefetchSpeed)
+	{
+		return;
+	}
+	const double Reach = Speed * CVarTilePrefetchLookaheadSeconds.GetValueOnGameThread();
+
+	// The corridor starts at the actor and follows the waypoints still ahead of it.
+	TArray<FVector, TInlineAllocator<16>> Path;
+	Path.Add(Target.LastLocation);
+	if (Target.Waypoints.Num() > 0)
+	{
+		int32 Closest = 0;
+		for (int32 Index = 1; Index < Target.Waypoints.Num(); ++Index)
+		{
+			if (FVector::DistSquared(Target.Waypoints[Index], Target.LastLocation) < FVector::DistSquared(Target.Waypoints[Closest], Target.LastLocation))
+				Closest = Index;
+		}
+		// Skip the closest waypoint once the actor is past it.
+		const FVector Heading = Target.Waypoints.IsValidIndex(Closest + 1) ? Target.Waypoints[Closest + 1] - Target.Waypoints[Closest] : Target.Velocity;
+		const int32 First = FVector::DotProduct(Target.Waypoints[Closest] - Target.LastLocation, Heading) > 0.0 ? Closest : Closest + 1;
+		for (int32 Index = First; Index < Target.Waypoints.Num(); ++Index)
+		{
+			Path.Add(Target.Waypoints[Index]);
+		}
+	}
+	if (Path.Num() == 1)
+	{
+		Path.Add(Target.LastLocation + Target.Velocity.GetSafeNormal() * Reach);
+	}
+
+	// Views evenly spaced along the first Reach of the corridor, clamped to its end.
+	int32 Segment = 0;
+	double SegmentStart = 0.0;
+	for (int32 View = 0; View < NumViews; ++View)
+	{
+		const double Distance = Reach * (View + 1) / NumViews;
+		while (Segment + 2 < Path.Num() && SegmentStart + FVector::Dist(Path[Segment], Path[Segment + 1]) < Distance)
+		{
+			SegmentStart += FVector::Dist(Path[Segment], Path[Segment + 1]);
+			++Segment;
+		}
+		const FVector Direction = (Path[Segment + 1] - Path[Segment]).GetSafeNormal();
+		const double SegmentLength = FVector::Dist(Path[Segment], Path[Segment + 1]);
+		const FVector Location = Path[Segment] + Direction * FMath::Min(Distance - SegmentStart, SegmentLength);
+		OutViews.Emplace(Location, Direction.IsNearlyZero() ? Target.Velocity.GetSafeNormal() : Direction);
+	}
+}
+
+void FTilePrefetcher::RemoveViews(ACesium3DTileset* Tileset, FTarget& Target) const
+{
+	ACesiumCameraManager* CameraManager = IsValid(Tileset) ? Tileset->ResolveCameraManager() : nullptr;
+	if (IsValid(CameraManager))
+	{
+		for (int32 ViewId : Target.ViewIds)
+		{
+			CameraManager->RemoveCamera(ViewId);
+		}
+	}
+	Target.ViewIds.Reset();
+}
+
+void FTilePrefetcher::Tick(ACesium3DTileset* Tileset, float DeltaSeconds)
+{
+	Targets.RemoveAll([this, Tileset](FTarget& Target) {
+		if (Target.Actor.IsValid())
+			return false;
+		RemoveViews(Tileset, Target);
+		return true;
+	});
+	for (FTarget& Target : Targets)
+	{
+		UpdateVelocity(Target, DeltaSeconds);
+	}
+	if (!IsValid(Tileset))
+	{
+		return;
+	}
+
+	// The tileset updated its load progress with the real cameras only.
+	++FrameCounter;
+	if (bSampling)
+	{
+		bSampling = false;
+		++Stats.SampledFrames;
+		if (Tileset->GetLoadProgress() < 100.0f)
+		{
+			++Stats.MissedFrames;
+			INC_DWORD_STAT(STAT_AerosimTilePrefetchMissedFrames);
+		}
+	}
+	else
+	{
+		const int32 SampleFrames = CVarTilePrefetchSampleFrames.GetValueOnGameThread();
+		bSampling = SampleFrames > 0 && FrameCounter % SampleFrames == 0;
+	}
+
+	const Cesium3DTilesSelection::Tileset* NativeTileset = Tileset->GetTileset();
+	const int64 ResidentBytes = NativeTileset != nullptr ? NativeTileset->getTotalDataBytes() : 0;
+	const bool bOverBudget = ResidentBytes > (int64)(CVarTilePrefetchMaxMegabytes.GetValueOnGameThread() * 1024.0 * 1024.0);
+	Stats.OverBudgetFrames += bOverBudget ? 1 : 0;
+
+	const int32 MaxViews = CVarTilePrefetchMaxViews.GetValueOnGameThread();
+	const bool bPrefetch = CVarTilePrefetchEnabled.GetValueOnGameThread() && !bSampling && !bOverBudget && MaxViews > 0;
+	ACesiumCameraManager* CameraManager = Tileset->ResolveCameraManager();
+	if (!bPrefetch || !IsValid(CameraManager))
+	{
+		for (FTarget& Target : Targets)
+		{
+			RemoveViews(Tileset, Target);
+		}
+		Stats.Views = 0;
+		Stats.Targets = Targets.Num();
+		SET_DWORD_STAT(STAT_AerosimTilePrefetchViews, 0);
+		return;
+	}
+
+	// Share the views between the actors. The remainder goes to different
+	// actors every frame, so none is left without views when they are scarce.
+	const double ViewportPixels = FMath::Max(CVarTilePrefetchViewportSize.GetValueOnGameThread(), 16);
+	const FVector2D ViewportSize(ViewportPixels, ViewportPixels);
+	TArray<TPair<FVector, FVector>> Views;
+	int32 NumViews = 0;
+	for (int32 Index = 0; Index < Targets.Num(); ++Index)
+	{
+		FTarget& Target = Targets[Index];
+		const int32 Turn = (int32)((Index + FrameCounter) % Targets.Num());
+		const int32 Share = MaxViews / Targets.Num() + (Turn < MaxViews % Targets.Num() ? 1 : 0);
+		PredictViews(Target, Share, Views);
+
+		while (Target.ViewIds.Num() > Views.Num())
+		{
+			CameraManager->RemoveCamera(Target.ViewIds.Pop(EAllowShrinking::No));
+		}
+		for (int32 View = 0; View < Views.Num(); ++View)
+		{
+			FRotator Rotation = Views[View].Value.Rotation();
+			Rotation.Pitch = FMath::Clamp(Rotation.Pitch - PrefetchPitchDown, -89.0, 89.0);
+			const FCesiumCamera Camera(ViewportSize, Views[View].Key, Rotation, PrefetchFieldOfView);
+			if (Target.ViewIds.IsValidIndex(View))
+			{
+				CameraManager->UpdateCamera(Target.ViewIds[View], Camera);
+			}
+			else
+			{
+				Target.ViewIds.Add(CameraManager->AddCamera(Camera));
+			}
+		}
+		NumViews += Views.Num();
+	}
+	Stats.Views = NumViews;
+	Stats.Targets = Targets.Num();
+	SET_DWORD_STAT(STAT_AerosimTilePrefetchViews, NumViews);
+}
+
+void FTilePrefetcher::Rebase(const FTransform& OldToNew)
+{
+	for (FTarget& Target : Targets)
+	{
+		Target.LastLocation = OldToNew.TransformPosition(Target.LastLocation);
+		Target.Velocity = OldToNew.TransformVector(Target.Velocity);
+		for (FVector& Waypoint : Target.Waypoints)
+		{
+			Waypoint = OldToNew.TransformPosition(Waypoint);
+		}
+	}
+}
+
+void FTilePrefetcher::Reset(ACesium3DTileset* Tileset)
+{
+	for (FTarget& Target : Targets)
+	{
+		RemoveViews(Tileset, Target);
+	}
+	Targets.Reset();
+	bSampling = false;
+}
+
+void FTilePrefetcher::ResetStats()
+{
+	const int32 Views = Stats.Views;
+	const int32 NumTargets = Stats.Targets;
+	Stats = FTilePrefetchStats();
+	Stats.Views = Views;
+	Stats.Targets = NumTargets;
+}
@@ -0,0 +1,728 @@
+#include "Render/ImageBenchmark.h"
+#include "Render/ImageEncoder.h"
+#include "Render/ImagePublisher.h"
+#include "Render/ImageResize.h"
+#include "Render/ImageUtil.h"
+#include "Render/LabelRLE.h"
+#include "Render/PixelRepack.h"
+#include "AerosimConnector.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Dom/JsonObject.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Math/RandomStream.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+namespace ImageBenchmark
+{
+	// BGRA8 frame stored with padded rows, like a mapped readback buffer.
+	struct FSampleFrame
+	{
+		FString Name;
+		TArray64<uint8> Pixels;
+		FImageView View;
+	};
+
+	static constexpr int32 RowAlignment = 256;
+
+	static void InitSampleFrame(FSampleFrame& Frame, FIntPoint Size)
+	{
+		Frame.View.Size = Size;
+		Frame.View.BytesPerPixel = 4;
+		Frame.View.RowStride = Align(Size.X * 4, RowAlignment);
+		Frame.Pixels.SetNumZeroed((int64)Frame.View.RowStride * Size.Y);
+		Frame.View.Data = Frame.Pixels.GetData();
+	}
+
+	// Loads the PNG/JPEG frames found in Directory (e.g. frames saved with
+	// ImageUtil::SaveImageData).
+	static void LoadSampleFrames(const FString& Directory, TArray<FSampleFrame>& OutFrames)
+	{
+		IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+		TArray<FString> Files;
+		IFileManager::Get().FindFiles(Files, *(Directory / TEXT("*.png")), true, false);
+		IFileManager::Get().FindFiles(Files, *(Directory / TEXT("*.jpg")), true, false);
+		for (const FString& File : Files)
+		{
+			TArray64<uint8> Compressed;
+			if (!FFileHelper::LoadFileToArray(Compressed, *(Directory / File)))
+				continue;
+			EImageFormat Format = ImageWrapperModule.DetectImageFormat(Compressed.GetData(), Compressed.Num());
+			TSharedPtr<IImageWrapper> Wrapper = ImageWrapperModule.CreateImageWrapper(Format);
+			TArray64<uint8> Raw;
+			if (!Wrapper.IsValid() || !Wrapper->SetCompressed(Compressed.GetData(), Compressed.Num()) || !Wrapper->GetRaw(ERGBFormat::BGRA, 8, Raw))
+			{
+				UE_LOG(LogAerosimConnector, Warning, TEXT("Skipping sample frame %s, could not decode it"), *File);
+				continue;
+			}
+
+			FSampleFrame& Frame = OutFrames.AddDefaulted_GetRef();
+			Frame.Name = File;
+			InitSampleFrame(Frame, FIntPoint(Wrapper->GetWidth(), Wrapper->GetHeight()));
+			for (int32 Y = 0; Y < Frame.View.Size.Y; ++Y)
+			{
+				FMemory::Memcpy((uint8*)Frame.View.GetRow(Y), Raw.GetData() + (int64)Y * Frame.View.GetRowBytes(), Frame.View.GetRowBytes());
+			}
+		}
+	}
+
+	// Smooth gradients with some sensor-like noise, a rough stand-in for a
+	// rendered frame when no captured sample is available.
+	static void MakeSyntheticFrame(FIntPoint Size, FSampleFrame& Frame)
+	{
+		Frame.Name = FString::Printf(TEXT("synthetic_%dx%d"), Size.X, Size.Y);
+		InitSampleFrame(Frame, Size);
+		FRandomStream Random(Size.X * 31 + Size.Y);
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			FColor* Row = (FColor*)Frame.View.GetRow(Y);
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				const int32 Noise = Random.RandRange(-4, 4);
+				Row[X].B = (uint8)FMath::Clamp(X * 255 / Size.X + Noise, 0, 255);
+				Row[X].G = (uint8)FMath::Clamp(Y * 255 / Size.Y + Noise, 0, 255);
+				Row[X].R = (uint8)FMath::Clamp(((X / 64) ^ (Y / 64)) * 16 + Noise, 0, 255);
+				Row[X].A = 255;
+			}
+		}
+	}
+
+	static void RunEncodeBenchmark(const TArray<FString>& Args)
+	{
+		const FString Directory = Args.Num() > 0 ? Args[0] : FPaths::ProjectSavedDir() / TEXT("Captures");
+		const int32 Iterations = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 30;
+
+		TArray<FSampleFrame> Frames;
+		LoadSampleFrames(Directory, Frames);
+		if (Frames.IsEmpty())
+		{
+			UE_LOG(LogAerosimConnector, Log, TEXT("No sample frames in %s, using synthetic 1920x1080 frames"), *Directory);
+			MakeSyntheticFrame(FIntPoint(1920, 1080), Frames.AddDefaulted_GetRef());
+		}
+
+		struct FCase
+		{
+			const TCHAR* Name;
+			FImageEncodeSettings Settings;
+		};
+		TArray<FCase> Cases;
+		Cases.Add({ TEXT("lz4"), { EImageCodec::LZ4, 0, 0 } });
+		Cases.Add({ TEXT("lz4 single band"), { EImageCodec::LZ4, 0, MAX_int32 } });
+		Cases.Add({ TEXT("jpeg q75"), { EImageCodec::JPEG, 75, 0 } });
+		Cases.Add({ TEXT("jpeg q90"), { EImageCodec::JPEG, 90, 0 } });
+		Cases.Add({ TEXT("jpeg q90 single band"), { EImageCodec::JPEG, 90, MAX_int32 } });
+
+		TArray64<uint8> Encoded;
+		for (const FSampleFrame& Frame : Frames)
+		{
+			const double RawBytes = (double)Frame.View.GetPackedBytes();
+			for (const FCase& Case : Cases)
+			{
+				// Warm up, so the band buffers are allocated outside the measurement.
+				if (!ImageEncoder::Encode(Frame.View, EPixelLayout::BGRA8, Case.Settings, Encoded))
+					continue;
+
+				const double StartTime = FPlatformTime::Seconds();
+				for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+				{
+					ImageEncoder::Encode(Frame.View, EPixelLayout::BGRA8, Case.Settings, Encoded);
+				}
+				const double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+				const double MsPerFrame = Elapsed * 1000.0 / Iterations;
+				const double MBps = RawBytes * Iterations / Elapsed / (1024.0 * 1024.0);
+				const double Ratio = RawBytes / Encoded.Num();
+				UE_LOG(LogAerosimConnector, Display, TEXT("ImageEncode %s [%s]: %.2f ms/frame, %.1f MB/s, ratio %.2f:1, %s"),
+					*Frame.Name, Case.Name, MsPerFrame, MBps, Ratio,
+					MsPerFrame <= 1000.0 / 30.0 ? TEXT("keeps up at 30 Hz") : TEXT("too slow for 30 Hz"));
+			}
+		}
+	}
+
+	// Runs every layout through the vector and the scalar kernels, checks that
+	// they produce the same bytes and reports their throughput.
+	static void RunRepackBenchmark(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 30;
+		UE_LOG(LogAerosimConnector, Display, TEXT("PixelRepack vector kernels: %s"), PixelRepack::GetVectorKernelName());
+
+		// Widths that are not a multiple of the vector width exercise the scalar tails.
+		const FIntPoint Sizes[] = { FIntPoint(1920, 1080), FIntPoint(642, 482), FIntPoint(30, 6) };
+		const EPixelLayout Layouts[] = { EPixelLayout::RGB8, EPixelLayout::NV12, EPixelLayout::I420, EPixelLayout::Y8 };
+		for (const FIntPoint& Size : Sizes)
+		{
+			FSampleFrame Frame;
+			MakeSyntheticFrame(Size, Frame);
+			for (EPixelLayout Layout : Layouts)
+			{
+				const int64 PackedBytes = PixelRepack::GetPackedView(Layout, Size, nullptr).GetPackedBytes();
+				TArray64<uint8> Reference;
+				TArray64<uint8> Vectorized;
+				Reference.SetNumZeroed(PackedBytes);
+				Vectorized.SetNumZeroed(PackedBytes);
+				PixelRepack::RepackRows(Frame.View, Layout, 0, Size.Y, Reference.GetData(), false);
+				PixelRepack::RepackRows(Frame.View, Layout, 0, Size.Y, Vectorized.GetData(), true);
+				if (FMemory::Memcmp(Reference.GetData(), Vectorized.GetData(), PackedBytes) != 0)
+				{
+					int64 FirstMismatch = 0;
+					while (Reference[FirstMismatch] == Vectorized[FirstMismatch])
+						++FirstMismatch;
+					UE_LOG(LogAerosimConnector, Error, TEXT("PixelRepack %s %dx%d: %s kernels differ from the scalar reference at byte %lld"),
+						PixelRepack::GetLayoutName(Layout), Size.X, Size.Y, PixelRepack::GetVectorKernelName(), FirstMismatch);
+					continue;
+				}
+
+				double Seconds[2] = {};
+				for (int32 Kernel = 0; Kernel < 2; ++Kernel)
+				{
+					const double StartTime = FPlatformTime::Seconds();
+					for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+					{
+						PixelRepack::RepackRows(Frame.View, Layout, 0, Size.Y, Vectorized.GetData(), Kernel == 1);
+					}
+					Seconds[Kernel] = (FPlatformTime::Seconds() - StartTime) / Iterations;
+				}
+
+				const double SourceBytes = (double)Frame.View.GetPackedBytes();
+				UE_LOG(LogAerosimConnector, Display, TEXT("PixelRepack %s %dx%d (single thread): scalar %.2f GB/s, vector %.2f GB/s, %.1fx, output %.0f%% of BGRA8"),
+					PixelRepack::GetLayoutName(Layout), Size.X, Size.Y,
+					SourceBytes / Seconds[0] / 1e9, SourceBytes / Seconds[1] / 1e9, Seconds[0] / Seconds[1],
+					100.0 * PackedBytes / SourceBytes);
+			}
+		}
+	}
+
+	// Same as RunRepackBenchmark for the downscaling kernels: halving (mip)
+	// and bilinear resizes of a 1080p frame and of a cropped region.
+	static void RunResizeBenchmark(const TArray<FString>& Args)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 30;
+
+		FSampleFrame Frame;
+		MakeSyntheticFrame(FIntPoint(1920, 1080), Frame);
+		const FImageView Cropped = ImageResize::Crop(Frame.View, FIntRect(FIntPoint(101, 37), FIntPoint(1701, 937)));
+
+		struct FCase
+		{
+			const TCHAR* Name;
+			const FImageView* Source;
+			FIntPoint OutputSize;
+		};
+		const FCase Cases[] = {
+			{ TEXT("halve"), &Frame.View, FIntPoint(960, 540) },
+			{ TEXT("bilinear"), &Frame.View, FIntPoint(1280, 720) },
+			{ TEXT("bilinear"), &Frame.View, FIntPoint(333, 187) },
+			{ TEXT("bilinear crop"), &Cropped, FIntPoint(641, 361) },
+		};
+		for (const FCase& Case : Cases)
+		{
+			const FImageView& Source = *Case.Source;
+			const bool bHalve = Case.OutputSize * 2 == Source.Size;
+			const int64 OutBytes = (int64)Case.OutputSize.X * Case.OutputSize.Y * 4;
+			TArray64<uint8> Reference;
+			TArray64<uint8> Vectorized;
+			Reference.SetNumZeroed(OutBytes);
+			Vectorized.SetNumZeroed(OutBytes);
+			for (int32 Kernel = 0; Kernel < 2; ++Kernel)
+			{
+				uint8* Out = Kernel == 0 ? Reference.GetData() : Vectorized.GetData();
+				if (bHalve)
+					ImageResize::HalveRows(Source, 0, Case.OutputSize.Y, Out, Kernel == 1);
+				else
+					ImageResize::BilinearRows(Source, Case.OutputSize, 0, Case.OutputSize.Y, Out, Kernel == 1);
+			}
+			if (FMemory::Memcmp(Reference.GetData(), Vectorized.GetData(), OutBytes) != 0)
+			{
+				UE_LOG(LogAerosimConnector, Error, TEXT("ImageResize %s %dx%d -> %dx%d: vector kernels differ from the scalar reference"),
+					Case.Name, Source.Size.X, Source.Size.Y, Case.OutputSize.X, Case.OutputSize.Y);
+				continue;
+			}
+
+			TArray64<uint8> Resized;
+			FImageView ResizedView;
+			const double StartTime = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				ImageResize::Resize(Source, Case.OutputSize, Resized, ResizedView);
+			}
+			const double MsPerFrame = (FPlatformTime::Seconds() - StartTime) * 1000.0 / Iterations;
+			UE_LOG(LogAerosimConnector, Display, TEXT("ImageResize %s %dx%d -> %dx%d: %.2f ms/frame"),
+				Case.Name, Source.Size.X, Source.Size.Y, Case.OutputSize.X, Case.OutputSize.Y, MsPerFrame);
+		}
+	}
+
+	// Pixel formats DecodePixelsByFormat supports for either output type.
+	static const EPixelFormat DecodeFormats[] = {
+		PF_B8G8R8A8, PF_R8G8B8A8, PF_R32_FLOAT, PF_FloatRGBA, PF_FloatR11G11B10, PF_A32B32G32R32F,
+		PF_A2B10G10R10, PF_A16B16G16R16, PF_G16R16, PF_G16, PF_R16G16B16A16_UINT, PF_X24_G8
+	};
+
+	// Bits of the float and half values mixed into the synthetic pixels, the
+	// ones where vector code tends to part from the scalar conversions: NaNs
+	// (quiet, signaling, negative), infinities, values out of the int32 range
+	// once scaled, denormals and negative zero.
+	static const uint32 SpecialFloatBits[] = {
+		0x7FC00000, 0xFFC00123, 0x7F800001, 0x7F800000, 0xFF800000,
+		0x60AD78EC /* 1e20 */, 0xE0AD78EC /* -1e20 */, 0x4F800000 /* 2^32 */, 0x00000001, 0x807FFFFF, 0x80000000
+	};
+	static const uint16 SpecialHalfBits[] = {
+		0x7E00, 0xFE01, 0x7C01, 0x7C00, 0xFC00, 0x7BFF, 0x0001, 0x03FF, 0x8001, 0x8000
+	};
+
+	// Fills a GPU-pitched buffer with plausible pixels: float formats get
+	// values around [0, 1], the others random bytes. One float or half in 16
+	// is a special value, and one R11G11B10 pixel in 8 keeps its random
+	// exponents, so infinities, NaNs and denormals reach every decode path.
+	static void MakeSyntheticPixels(EPixelFormat Format, FIntPoint Size, int32 PitchPixels, TArray64<uint8>& Out)
+	{
+		const int32 BlockBytes = GPixelFormats[Format].BlockBytes;
+		Out.SetNumUninitialized((int64)PitchPixels * BlockBytes * Size.Y);
+		FRandomStream Random(Format * 7919 + Size.X);
+		switch (Format)
+		{
+			case PF_R32_FLOAT:
+			case PF_A32B32G32R32F:
+				for (uint32& Value : TArrayView<uint32>((uint32*)Out.GetData(), Out.Num() / sizeof(uint32)))
+				{
+					if (Random.RandHelper(16) == 0)
+						Value = SpecialFloatBits[Random.RandHelper(UE_ARRAY_COUNT(SpecialFloatBits))];
+					else
+					{
+						const float Finite = Random.FRandRange(-0.25f, 1.25f);
+						FMemory::Memcpy(&Value, &Finite, sizeof(Value));
+					}
+				}
+				break;
+			case PF_FloatRGBA:
+				for (FFloat16& Value : TArrayView<FFloat16>((FFloat16*)Out.GetData(), Out.Num() / sizeof(FFloat16)))
+				{
+					if (Random.RandHelper(16) == 0)
+						Value.Encoded = SpecialHalfBits[Random.RandHelper(UE_ARRAY_COUNT(SpecialHalfBits))];
+					else
+						Value = FFloat16(Random.FRandRange(-0.25f, 1.25f));
+				}
+				break;
+			case PF_FloatR11G11B10:
+				// Clearing the top exponent bit of every channel keeps them finite.
+				for (uint32& Value : TArrayView<uint32>((uint32*)Out.GetData(), Out.Num() / sizeof(uint32)))
+				{
+					Value = (uint32)Random.GetUnsignedInt();
+					if (Random.RandHelper(8) != 0)
+						Value &= ~(0x400u | 0x200000u | 0x80000000u);
+				}
+				break;
+			default:
+				for (uint8& Value : Out)
+					Value = (uint8)Random.RandHelper(256);
+				break;
+		}
+	}
+
+	// Label image resembling an aerial view: terrain crossed by roads, with
+	// blocks of buildings and a lake.
+	static void MakeSyntheticLabels(FIntPoint Size, TArray64<uint8>& Out)
+	{
+		Out.SetNumUninitialized((int64)Size.X * Size.Y);
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				uint8 Label = 1; // Terrain
+				if (X % 160 < 8 || Y % 120 < 6)
+					Label = 3; // Road
+				else if ((X / 40 + Y / 30) % 3 == 0 && X % 40 > 12 && Y % 30 > 10)
+					Label = 2; // Building
+				if (FMath::Square(X - Size.X / 4) + FMath::Square(Y - Size.Y / 3) < FMath::Square(Size.Y / 6))
+					Label = 4; // Water
+				Out[(int64)Y * Size.X + X] = Label;
+			}
+		}
+	}
+
+	// Runs Body until both the minimum time and iteration count are reached,
+	// after one warm-up call.
+	template <typename FBody>
+	static void Measure(
+		const FBenchmarkOptions& Options,
+		const TCHAR* Stage,
+		const FString& Variant,
+		FIntPoint Size,
+		int64 InputBytes,
+		TArray<FBenchmarkResult>& OutResults,
+		FBody&& Body)
+	{
+		if (!Options.Filter.IsEmpty() && !FString(Stage).Contains(Options.Filter) && !Variant.Contains(Options.Filter))
+			return;
+
+		Body();
+		int32 Iterations = 0;
+		double Elapsed = 0.0;
+		const double StartTime = FPlatformTime::Seconds();
+		do
+		{
+			Body();
+			++Iterations;
+			Elapsed = FPlatformTime::Seconds() - StartTime;
+		} while (Iterations < Options.MinIterations || Elapsed < Options.MinSeconds);
+
+		FBenchmarkResult& Result = OutResults.AddDefaulted_GetRef();
+		Result.Stage = Stage;
+		Result.Variant = Variant;
+		Result.Size = Size;
+		Result.Iterations = Iterations;
+		Result.SecondsPerIteration = Elapsed / Iterations;
+		Result.InputBytes = InputBytes;
+		UE_LOG(LogAerosimConnector, Display, TEXT("ImageUtil benchmark %-11s %-36s %4dx%-4d %8.3f ms %7.2f GB/s %7.2f ns/pixel"),
+			Stage, *Variant, Size.X, Size.Y, Result.SecondsPerIteration * 1000.0,
+			Result.GetGigabytesPerSecond(), Result.GetNanosecondsPerPixel());
+	}
+
+	// Records the outcome of a check on the results measured since FirstResult.
+	static void SetCheck(TArray<FBenchmarkResult>& Results, int32 FirstResult, bool bPassed)
+	{
+		for (int32 Index = FirstResult; Index < Results.Num(); ++Index)
+		{
+			Results[Index].bChecked = true;
+			Results[Index].bCheckPassed = bPassed;
+		}
+	}
+
+	// Decodes every format into both output types, through the reference
+	// converters and the banded/vector path, checked to be bit identical.
+	static void RunDecodeCases(const FBenchmarkOptions& Options, FIntPoint Size, TArray<FBenchmarkResult>& OutResults)
+	{
+		const int64 NumPixels = (int64)Size.X * Size.Y;
+		// Raw float values, as the recorder reads them, the case the fast path covers.
+		const FReadSurfaceDataFlags Flags(RCM_MinMax);
+		TArray<FColor> ReferenceColors, FastColors;
+		TArray<FLinearColor> ReferenceLinear, FastLinear;
+		ReferenceColors.SetNumZeroed(NumPixels);
+		FastColors.SetNumZeroed(NumPixels);
+		ReferenceLinear.SetNumZeroed(NumPixels);
+		FastLinear.SetNumZeroed(NumPixels);
+		for (EPixelFormat Format : DecodeFormats)
+		{
+			const int32 PitchPixels = Align(Size.X, 64);
+			TArray64<uint8> Pixels;
+			MakeSyntheticPixels(Format, Size, PitchPixels, Pixels);
+			const int64 InputBytes = NumPixels * GPixelFormats[Format].BlockBytes;
+
+			auto MeasureDecode = [&](auto& Reference, auto& Fast, const TCHAR* OutputName) {
+				const int32 FirstResult = OutResults.Num();
+				bool bSupported = false;
+				Measure(Options, TEXT("decode"), FString::Printf(TEXT("%s %s reference"), GPixelFormats[Format].Name, OutputName), Size, InputBytes, OutResults, [&] {
+					bSupported = ImageUtil::DecodePixelsByFormat(Pixels.GetData(), PitchPixels, Size, Format, Flags, Reference, false);
+				});
+				Measure(Options, TEXT("decode"), FString::Printf(TEXT("%s %s fast"), GPixelFormats[Format].Name, OutputName), Size, InputBytes, OutResults, [&] {
+					ImageUtil::DecodePixelsByFormat(Pixels.GetData(), PitchPixels, Size, Format, Flags, Fast, true);
+				});
+				// Both outputs hold the last decode, compare them when both paths ran.
+				if (!bSupported || OutResults.Num() - FirstResult != 2)
+					return;
+				const bool bEqual = FMemory::Memcmp(Reference.GetData(), Fast.GetData(), Reference.Num() * Reference.GetTypeSize()) == 0;
+				SetCheck(OutResults, FirstResult, bEqual);
+				if (!bEqual)
+				{
+					UE_LOG(LogAerosimConnector, Error, TEXT("ImageUtil benchmark decode %s %s %dx%d: fast path differs from the reference converters"),
+						GPixelFormats[Format].Name, OutputName, Size.X, Size.Y);
+				}
+			};
+			MeasureDecode(ReferenceColors, FastColors, TEXT("FColor"));
+			MeasureDecode(ReferenceLinear, FastLinear, TEXT("FLinearColor"));
+		}
+	}
+
+	// The decode cases of the suite at a few resolutions, for a quick check
+	// from the console.
+	static void RunDecodeBenchmark(const TArray<FString>& Args)
+	{
+		FBenchmarkOptions Options;
+		Options.MinSeconds = 0.0;
+		Options.MinIterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10;
+		const FIntPoint Sizes[] = { FIntPoint(640, 480), FIntPoint(1920, 1080), FIntPoint(3840, 2160) };
+		TArray<FBenchmarkResult> Results;
+		for (const FIntPoint& Size : Sizes)
+		{
+			RunDecodeCases(Options, Size, Results);
+		}
+		if (const int32 Failed = CountFailedChecks(Results))
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("%d decode cases differ from the reference converters"), Failed);
+		}
+	}
+
+	void RunSuite(const FBenchmarkOptions& Options, TArray<FBenchmarkResult>& OutResults)
+	{
+		const FIntPoint Sizes[] = { FIntPoint(320, 240), FIntPoint(640, 480), FIntPoint(1280, 720), FIntPoint(1920, 1080), FIntPoint(3840, 2160) };
+		for (const FIntPoint& Size : Sizes)
+		{
+			const int64 NumPixels = (int64)Size.X * Size.Y;
+
+			RunDecodeCases(Options, Size, OutResults);
+
+			// The remaining stages start from a BGRA8 readback with padded rows.
+			FSampleFrame Frame;
+			MakeSyntheticFrame(Size, Frame);
+			const int64 FrameBytes = Frame.View.GetPackedBytes();
+			TArray64<uint8> Out;
+			Out.SetNumUninitialized(FrameBytes);
+
+			Measure(Options, TEXT("pitch_strip"), TEXT("PF_B8G8R8A8"), Size, FrameBytes, OutResults, [&] {
+				ImageUtil::StripRowPitch(Frame.View.Data, Frame.View.RowStride, Size, 4, Out.GetData());
+			});
+
+			const EPixelLayout Layouts[] = { EPixelLayout::RGB8, EPixelLayout::NV12, EPixelLayout::I420, EPixelLayout::Y8 };
+			for (EPixelLayout Layout : Layouts)
+			{
+				if (!PixelRepack::IsSupported(Layout, Size))
+					continue;
+				Measure(Options, TEXT("repack"), FString::Printf(TEXT("%s %s"), PixelRepack::GetLayoutName(Layout), PixelRepack::GetVectorKernelName()), Size, FrameBytes, OutResults, [&] {
+					PixelRepack::Repack(Frame.View, Layout, Out.GetData());
+				});
+			}
+
+			TArray64<uint8> Resized;
+			FImageView ResizedView;
+			Measure(Options, TEXT("resize"), TEXT("halve"), Size, FrameBytes, OutResults, [&] {
+				ImageResize::Resize(Frame.View, Size / 2, Resized, ResizedView);
+			});
+			Measure(Options, TEXT("resize"), TEXT("bilinear 2/3"), Size, FrameBytes, OutResults, [&] {
+				ImageResize::Resize(Frame.View, Size * 2 / 3, Resized, ResizedView);
+			});
+
+			// Segmentation labels, checked to round-trip through the runs.
+			TArray64<uint8> Labels;
+			MakeSyntheticLabels(Size, Labels);
+			FImageView LabelView;
+			LabelView.Data = Labels.GetData();
+			LabelView.RowStride = Size.X;
+			LabelView.BytesPerPixel = 1;
+			LabelView.Size = Size;
+			TArray64<uint8> Runs;
+			Runs.SetNumUninitialized(LabelRLE::GetMaxEncodedBytes(Size));
+			int64 RunBytes = 0;
+			const int32 FirstRleResult = OutResults.Num();
+			Measure(Options, TEXT("rle"), TEXT("encode"), Size, NumPixels, OutResults, [&] {
+				RunBytes = LabelRLE::Encode(LabelView, Runs.GetData());
+			});
+			TArray64<uint8> DecodedLabels;
+			DecodedLabels.SetNumUninitialized(NumPixels);
+			bool bDecoded = false;
+			Measure(Options, TEXT("rle"), TEXT("decode"), Size, NumPixels, OutResults, [&] {
+				bDecoded = LabelRLE::Decode(Runs.GetData(), RunBytes, DecodedLabels.GetData(), NumPixels);
+			});
+			if (RunBytes > 0)
+			{
+				SetCheck(OutResults, FirstRleResult, bDecoded && DecodedLabels == Labels);
+			}
+			if (RunBytes > 0 && (!bDecoded || DecodedLabels != Labels))
+			{
+				UE_LOG(LogAerosimConnector, Error, TEXT("ImageUtil benchmark rle: %dx%d labels did not round-trip"), Size.X, Size.Y);
+			}
+			else if (RunBytes > 0)
+			{
+				UE_LOG(LogAerosimConnector, Display, TEXT("ImageUtil benchmark rle: %dx%d labels compressed %.1fx"), Size.X, Size.Y, (double)NumPixels / RunBytes);
+			}
+
+			// Loopback publishing of the packed frame and of the same frame with
+			// padded rows, checked to publish the same pixels either way.
+			ImageUtil::StripRowPitch(Frame.View.Data, Frame.View.RowStride, Size, 4, Out.GetData());
+			const uint32 ExpectedChecksum = FCrc::MemCrc32(Out.GetData(), (int32)FrameBytes);
+			FImageView PackedView = Frame.View;
+			PackedView.Data = Out.GetData();
+			PackedView.RowStride = PackedView.GetRowBytes();
+			TArray64<uint8> PaddedPixels;
+			FImageView PaddedView = PackedView;
+			PaddedView.RowStride = Align(PackedView.GetRowBytes() + 1, RowAlignment);
+			PaddedPixels.SetNumZeroed((int64)PaddedView.RowStride * Size.Y);
+			for (int32 Y = 0; Y < Size.Y; ++Y)
+			{
+				FMemory::Memcpy(PaddedPixels.GetData() + (int64)Y * PaddedView.RowStride, PackedView.GetRow(Y), PackedView.GetRowBytes());
+			}
+			PaddedView.Data = PaddedPixels.GetData();
+
+			struct FPublishCase
+			{
+				const TCHAR* Name;
+				const FImageView* View;
+				bool bGatherRows;
+			};
+			const FPublishCase PublishCases[] = {
+				{ TEXT("loopback packed"), &PackedView, true },
+				{ TEXT("loopback padded in place"), &PaddedView, false },
+				{ TEXT("loopback padded gather"), &PaddedView, true },
+			};
+			for (const FPublishCase& Case : PublishCases)
+			{
+				FLoopbackImageTransport Transport(Case.bGatherRows);
+				Measure(Options, TEXT("publish"), Case.Name, Size, FrameBytes, OutResults, [&] {
+					Transport.Publish("aerosim.benchmark", *Case.View);
+				});
+				if (Transport.GetFramesPublished() == 0)
+					continue;
+				OutResults.Last().BytesCopied = (int64)(Transport.GetBytesCopied() / Transport.GetFramesPublished());
+				SetCheck(OutResults, OutResults.Num() - 1, Transport.GetLastChecksum() == ExpectedChecksum);
+				if (Transport.GetLastChecksum() != ExpectedChecksum)
+				{
+					UE_LOG(LogAerosimConnector, Error, TEXT("ImageUtil benchmark publish %s %dx%d: published pixels differ from the packed frame"), Case.Name, Size.X, Size.Y);
+				}
+				else
+				{
+					UE_LOG(LogAerosimConnector, Display, TEXT("ImageUtil benchmark publish %s %dx%d: %lld bytes copied per frame"), Case.Name, Size.X, Size.Y, OutResults.Last().BytesCopied);
+				}
+			}
+
+			struct FCodecCase
+			{
+				const TCHAR* Name;
+				FImageEncodeSettings Settings;
+			};
+			const FCodecCase Codecs[] = {
+				{ TEXT("lz4"), { EImageCodec::LZ4, 0, 0 } },
+				{ TEXT("jpeg q85"), { EImageCodec::JPEG, 85, 0 } },
+			};
+			TArray64<uint8> Encoded;
+			for (const FCodecCase& Codec : Codecs)
+			{
+				Measure(Options, TEXT("encode"), Codec.Name, Size, FrameBytes, OutResults, [&] {
+					ImageEncoder::Encode(Frame.View, EPixelLayout::BGRA8, Codec.Settings, Encoded);
+				});
+			}
+		}
+	}
+
+	bool WriteResults(const TArray<FBenchmarkResult>& Results, const FString& Path)
+	{
+		TSharedPtr<FJsonObject> Root = MakeShared<FJsonObject>();
+		Root->SetStringField(TEXT("suite"), TEXT("ImageUtil"));
+		Root->SetStringField(TEXT("timestamp"), FDateTime::UtcNow().ToIso8601());
+		Root->SetStringField(TEXT("engine_version"), FEngineVersion::Current().ToString());
+		Root->SetStringField(TEXT("platform"), ANSI_TO_TCHAR(FPlatformProperties::IniPlatformName()));
+		Root->SetStringField(TEXT("cpu"), FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+		Root->SetNumberField(TEXT("cores"), FPlatformMisc::NumberOfCoresIncludingHyperthreads());
+		Root->SetNumberField(TEXT("worker_threads"), FTaskGraphInterface::Get().GetNumWorkerThreads());
+		Root->SetStringField(TEXT("vector_kernels"), PixelRepack::GetVectorKernelName());
+
+		TArray<TSharedPtr<FJsonValue>> ResultValues;
+		for (const FBenchmarkResult& Result : Results)
+		{
+			TSharedPtr<FJsonObject> ResultObject = MakeShared<FJsonObject>();
+			ResultObject->SetStringField(TEXT("stage"), Result.Stage);
+			ResultObject->SetStringField(TEXT("variant"), Result.Variant);
+			ResultObject->SetNumberField(TEXT("width"), Result.Size.X);
+			ResultObject->SetNumberField(TEXT("height"), Result.Size.Y);
+			ResultObject->SetNumberField(TEXT("iterations"), Result.Iterations);
+			ResultObject->SetNumberField(TEXT("ms_per_iteration"), Result.SecondsPerIteration * 1000.0);
+			ResultObject->SetNumberField(TEXT("gb_per_second"), Result.GetGigabytesPerSecond());
+			ResultObject->SetNumberField(TEXT("ns_per_pixel"), Result.GetNanosecondsPerPixel());
+			if (Result.Stage == TEXT("publish"))
+			{
+				ResultObject->SetNumberField(TEXT("bytes_copied"), Result.BytesCopied);
+			}
+			if (Result.bChecked)
+			{
+				ResultObject->SetBoolField(TEXT("check_passed"), Result.bCheckPassed);
+			}
+			ResultValues.Add(MakeShared<FJsonValueObject>(ResultObject));
+		}
+		Root->SetArrayField(TEXT("results"), ResultValues);
+
+		FString Json;
+		TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+		if (!FJsonSerializer::Serialize(Root.ToSharedRef(), Writer))
+			return false;
+		if (!FFileHelper::SaveStringToFile(Json, *Path))
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("Could not write the benchmark results to %s"), *Path);
+			return false;
+		}
+		const FString TablePath = FPaths::ChangeExtension(Path, TEXT("md"));
+		if (!FFileHelper::SaveStringToFile(FormatTable(Results), *TablePath))
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("Could not write the benchmark table to %s"), *TablePath);
+			return false;
+		}
+		UE_LOG(LogAerosimConnector, Display, TEXT("Wrote %d benchmark results to %s and %s"), Results.Num(), *Path, *TablePath);
+		return true;
+	}
+
+	FString FormatTable(const TArray<FBenchmarkResult>& Results)
+	{
+		FString Table = FString::Printf(TEXT("ImageUtil benchmark, %s, %s, %d worker threads, %s kernels\n\n"),
+			*FEngineVersion::Current().ToString(), *FPlatformMisc::GetCPUBrand().TrimStartAndEnd(),
+			FTaskGraphInterface::Get().GetNumWorkerThreads(), PixelRepack::GetVectorKernelName());
+		Table += TEXT("| stage | variant | resolution | ms | GB/s | ns/pixel | check |\n");
+		Table += TEXT("|---|---|---|---:|---:|---:|---|\n");
+		for (const FBenchmarkResult& Result : Results)
+		{
+			const TCHAR* Check = !Result.bChecked ? TEXT("") : Result.bCheckPassed ? TEXT("passed") : TEXT("FAILED");
+			Table += FString::Printf(TEXT("| %s | %s | %dx%d | %.3f | %.2f | %.2f | %s |\n"),
+				*Result.Stage, *Result.Variant, Result.Size.X, Result.Size.Y, Result.SecondsPerIteration * 1000.0,
+				Result.GetGigabytesPerSecond(), Result.GetNanosecondsPerPixel(), Check);
+		}
+		return Table;
+	}
+
+	int32 CountFailedChecks(const TArray<FBenchmarkResult>& Results)
+	{
+		int32 Failed = 0;
+		for (const FBenchmarkResult& Result : Results)
+		{
+			if (Result.bChecked && !Result.bCheckPassed)
+				++Failed;
+		}
+		return Failed;
+	}
+
+	FString GetDefaultResultsPath()
+	{
+		return FPaths::ProjectSavedDir() / TEXT("Benchmarks") / FString::Printf(TEXT("ImageUtil-%s.json"), *FDateTime::Now().ToString());
+	}
+
+	static void RunSuiteCommand(const TArray<FString>& Args)
+	{
+		FBenchmarkOptions Options;
+		Options.Filter = Args.Num() > 0 ? Args[0] : FString();
+		const FString Path = Args.Num() > 1 ? Args[1] : GetDefaultResultsPath();
+		TArray<FBenchmarkResult> Results;
+		RunSuite(Options, Results);
+		WriteResults(Results, Path);
+		if (const int32 Failed = CountFailedChecks(Results))
+		{
+			UE_LOG(LogAerosimConnector, Error, TEXT("%d benchmark cases failed their check"), Failed);
+		}
+	}
+
+	static FAutoConsoleCommand SuiteBenchmarkCommand(
+		TEXT("aerosim.Benchmark.ImageUtil"),
+		TEXT("Runs the image path microbenchmarks and writes them as JSON. Args: [Filter] [OutputFile]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunSuiteCommand));
+
+	static FAutoConsoleCommand DecodeBenchmarkCommand(
+		TEXT("aerosim.Benchmark.DecodePixels"),
+		TEXT("Checks DecodePixelsByFormat against the reference converters for every format and logs its throughput. Args: [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunDecodeBenchmark));
+
+	static FAutoConsoleCommand ResizeBenchmarkCommand(
+		TEXT("aerosim.Benchmark.ImageResize"),
+		TEXT("Checks the image downscaling kernels against the scalar reference and measures them. Args: [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunResizeBenchmark));
+
+	static FAutoConsoleCommand RepackBenchmarkCommand(
+		TEXT("aerosim.Benchmark.PixelRepack"),
+		TEXT("Checks the pixel repacking kernels against the scalar reference and measures them. Args: [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunRepackBenchmark));
+
+	static FAutoConsoleCommand EncodeBenchmarkCommand(
+		TEXT("aerosim.Benchmark.ImageEncode"),
+		TEXT("Measures camera frame encoding throughput and compression ratio. Args: [SampleFramesDir] [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunEncodeBenchmark));
+} // namespace ImageBenchmark
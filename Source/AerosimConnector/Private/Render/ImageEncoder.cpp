@@ -0,0 +1,248 @@
+#include "Render/ImageEncoder.h"
+#include "Render/ImagePublisher.h"
+#include "Render/LabelRLE.h"
+#include "AerosimConnector.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Misc/Compression.h"
+#include "Modules/ModuleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Image Encode"), STAT_AerosimImageEncode, STATGROUP_AerosimConnector);
+
+namespace ImageEncoder
+{
+	// Set once on the game thread, the module stays loaded until engine shutdown.
+	static IImageWrapperModule* ImageWrapperModule = nullptr;
+
+	void Startup()
+	{
+		check(IsInGameThread());
+		ImageWrapperModule = &FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+	}
+
+	const TCHAR* GetCodecName(EImageCodec Codec)
+	{
+		switch (Codec)
+		{
+			case EImageCodec::LZ4:
+				return TEXT("lz4");
+			case EImageCodec::JPEG:
+				return TEXT("jpeg");
+			case EImageCodec::RLE:
+				return TEXT("rle");
+			default:
+				return TEXT("none");
+		}
+	}
+
+	static int32 GetBandRows(const FImageView& Image, const FImageEncodeSettings& Settings)
+	{
+		if (Settings.BandRows > 0)
+			return Settings.BandRows;
+		// One band per worker plus the calling thread, but never thinner than
+		// 16 rows, below that the per-band overhead dominates.
+		const int32 NumWorkers = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+		return FMath::Max(16, FMath::DivideAndRoundUp(Image.Size.Y, NumWorkers));
+	}
+
+	static bool EncodeBandLZ4(const FImageView& Band, TArray64<uint8>& Out, int64& OutBytes)
+	{
+		const uint8* In = Band.Data;
+		const int64 InBytes = Band.GetPackedBytes();
+		if (!Band.IsContiguous())
+		{
+			// LZ4 needs one contiguous block, gather the band rows first.
+			static thread_local TArray64<uint8> Scratch;
+			if (Scratch.Num() < InBytes)
+				Scratch.SetNumUninitialized(InBytes);
+			for (int32 Y = 0; Y < Band.Size.Y; ++Y)
+			{
+				FMemory::Memcpy(Scratch.GetData() + (int64)Y * Band.GetRowBytes(), Band.GetRow(Y), Band.GetRowBytes());
+			}
+			In = Scratch.GetData();
+		}
+
+		const int32 Bound = FCompression::CompressMemoryBound(NAME_LZ4, (int32)InBytes);
+		if (Out.Num() < Bound)
+			Out.SetNumUninitialized(Bound);
+		int32 CompressedBytes = Bound;
+		if (!FCompression::CompressMemory(NAME_LZ4, Out.GetData(), CompressedBytes, In, (int32)InBytes))
+			return false;
+		OutBytes = CompressedBytes;
+		return true;
+	}
+
+	static bool EncodeBandRaw(const FImageView& Band, TArray64<uint8>& Out, int64& OutBytes)
+	{
+		OutBytes = Band.GetPackedBytes();
+		if (Out.Num() < OutBytes)
+			Out.SetNumUninitialized(OutBytes);
+		for (int32 Y = 0; Y < Band.Size.Y; ++Y)
+		{
+			FMemory::Memcpy(Out.GetData() + (int64)Y * Band.GetRowBytes(), Band.GetRow(Y), Band.GetRowBytes());
+		}
+		return true;
+	}
+
+	static bool EncodeBandJPEG(const FImageView& Band, int32 Quality, TArray64<uint8>& Out, int64& OutBytes)
+	{
+		if (ImageWrapperModule == nullptr || (Band.BytesPerPixel != 4 && Band.BytesPerPixel != 1))
+			return false;
+		TSharedPtr<IImageWrapper> Wrapper = ImageWrapperModule->CreateImageWrapper(EImageFormat::JPEG);
+		if (!Wrapper.IsValid())
+			return false;
+		// The wrapper reads the rows with their stride, no gather needed.
+		if (!Wrapper->SetRaw(Band.Data, (int64)Band.RowStride * Band.Size.Y, Band.Size.X, Band.Size.Y, Band.BytesPerPixel == 4 ? ERGBFormat::BGRA : ERGBFormat::Gray, 8, Band.RowStride))
+			return false;
+		const TArray64<uint8>& Compressed = Wrapper->GetCompressed(FMath::Clamp(Quality, 1, 100));
+		if (Compressed.IsEmpty())
+			return false;
+		if (Out.Num() < Compressed.Num())
+			Out.SetNumUninitialized(Compressed.Num());
+		FMemory::Memcpy(Out.GetData(), Compressed.GetData(), Compressed.Num());
+		OutBytes = Compressed.Num();
+		return true;
+	}
+
+	static bool EncodeBandRLE(const FImageView& Band, TArray64<uint8>& Out, int64& OutBytes)
+	{
+		const int64 Bound = LabelRLE::GetMaxEncodedBytes(Band.Size);
+		if (Out.Num() < Bound)
+			Out.SetNumUninitialized(Bound);
+		OutBytes = LabelRLE::Encode(Band, Out.GetData());
+		return true;
+	}
+
+	template <typename T>
+	static void Write(uint8*& Cursor, T Value)
+	{
+		FMemory::Memcpy(Cursor, &Value, sizeof(T));
+		Cursor += sizeof(T);
+	}
+
+	static void WriteHeader(uint8*& Cursor, FIntPoint Size, EPixelLayout Layout, int32 BytesPerPixel, EImageCodec Codec, int32 Quality, int32 NumBands)
+	{
+		Write<uint32>(Cursor, HeaderMagic);
+		Write<uint16>(Cursor, HeaderVersion);
+		Write<uint8>(Cursor, (uint8)Codec);
+		Write<uint8>(Cursor, (uint8)FMath::Clamp(Quality, 0, 100));
+		Write<uint32>(Cursor, (uint32)Size.X);
+		Write<uint32>(Cursor, (uint32)Size.Y);
+		Write<uint8>(Cursor, (uint8)Layout);
+		Write<uint8>(Cursor, (uint8)BytesPerPixel);
+		Write<uint16>(Cursor, (uint16)NumBands);
+	}
+
+	void WriteRawHeader(
+		FIntPoint Size,
+		EPixelLayout Layout,
+		uint8* Out)
+	{
+		const FImageView Packed = PixelRepack::GetPackedView(Layout, Size, nullptr);
+		WriteHeader(Out, Size, Layout, Packed.BytesPerPixel, EImageCodec::None, 0, 1);
+		Write<uint32>(Out, (uint32)Packed.Size.Y);
+		Write<uint32>(Out, (uint32)Packed.GetPackedBytes());
+	}
+
+	bool IsSupported(EImageCodec Codec, EPixelLayout Layout)
+	{
+		// JPEG through ImageWrapper only takes BGRA or grayscale input.
+		if (Codec == EImageCodec::JPEG)
+			return Layout == EPixelLayout::BGRA8 || Layout == EPixelLayout::Y8;
+		if (Codec == EImageCodec::RLE)
+			return Layout == EPixelLayout::Y8;
+		return true;
+	}
+
+	bool Encode(
+		const FImageView& Image,
+		EPixelLayout Layout,
+		const FImageEncodeSettings& Settings,
+		TArray64<uint8>& Out)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(ImageEncoder::Encode);
+		SCOPE_CYCLE_COUNTER(STAT_AerosimImageEncode);
+
+		if (Image.Data == nullptr || !IsSupported(Settings.Codec, Layout))
+			return false;
+
+		const int32 BandRows = GetBandRows(Image, Settings);
+		const int32 NumBands = FMath::DivideAndRoundUp(Image.Size.Y, BandRows);
+
+		// Band buffers only grow, so steady-state encoding does not allocate.
+		// Encode is called from the publisher thread, the bands are filled by
+		// task graph workers.
+		static thread_local TArray<TArray64<uint8>> ThreadBandBuffers;
+		static thread_local TArray<int64> ThreadBandBytes;
+		// Thread locals named inside the lambda would resolve to the worker's copy.
+		TArray<TArray64<uint8>>& BandBuffers = ThreadBandBuffers;
+		TArray<int64>& BandBytes = ThreadBandBytes;
+		if (BandBuffers.Num() < NumBands)
+			BandBuffers.SetNum(NumBands);
+		BandBytes.SetNumZeroed(NumBands);
+
+		std::atomic<bool> bFailed{ false };
+		ParallelFor(NumBands, [&](int32 BandIndex) {
+			TRACE_CPUPROFILER_EVENT_SCOPE(ImageEncoder::EncodeBand);
+			const int32 FirstRow = BandIndex * BandRows;
+			FImageView Band = Image;
+			Band.Data = Image.GetRow(FirstRow);
+			Band.Size.Y = FMath::Min(BandRows, Image.Size.Y - FirstRow);
+
+			bool bEncoded = false;
+			switch (Settings.Codec)
+			{
+				case EImageCodec::None:
+					bEncoded = EncodeBandRaw(Band, BandBuffers[BandIndex], BandBytes[BandIndex]);
+					break;
+				case EImageCodec::LZ4:
+					bEncoded = EncodeBandLZ4(Band, BandBuffers[BandIndex], BandBytes[BandIndex]);
+					break;
+				case EImageCodec::JPEG:
+					bEncoded = EncodeBandJPEG(Band, Settings.Quality, BandBuffers[BandIndex], BandBytes[BandIndex]);
+					break;
+				case EImageCodec::RLE:
+					bEncoded = EncodeBandRLE(Band, BandBuffers[BandIndex], BandBytes[BandIndex]);
+					break;
+			}
+			if (!bEncoded)
+				bFailed = true;
+		});
+
+		if (bFailed)
+		{
+			UE_LOG(LogAerosimConnector, Warning, TEXT("Failed to encode %dx%d image with codec %s"), Image.Size.X, Image.Size.Y, GetCodecName(Settings.Codec));
+			return false;
+		}
+
+		constexpr int64 HeaderBytes = 4 + 2 + 1 + 1 + 4 + 4 + 2 + 2;
+		int64 TotalBytes = HeaderBytes + (int64)NumBands * 8;
+		for (int32 BandIndex = 0; BandIndex < NumBands; ++BandIndex)
+		{
+			TotalBytes += BandBytes[BandIndex];
+		}
+		if (Out.Num() != TotalBytes)
+			Out.SetNumUninitialized(TotalBytes);
+
+		// The 4:2:0 layouts are encoded as one plane 1.5 times as tall as the image.
+		FIntPoint ImageSize = Image.Size;
+		if (Layout == EPixelLayout::NV12 || Layout == EPixelLayout::I420)
+			ImageSize.Y = Image.Size.Y * 2 / 3;
+
+		uint8* Cursor = Out.GetData();
+		WriteHeader(Cursor, ImageSize, Layout, Image.BytesPerPixel, Settings.Codec, Settings.Quality, NumBands);
+		for (int32 BandIndex = 0; BandIndex < NumBands; ++BandIndex)
+		{
+			Write<uint32>(Cursor, (uint32)FMath::Min(BandRows, Image.Size.Y - BandIndex * BandRows));
+			Write<uint32>(Cursor, (uint32)BandBytes[BandIndex]);
+		}
+		for (int32 BandIndex = 0; BandIndex < NumBands; ++BandIndex)
+		{
+			FMemory::Memcpy(Cursor, BandBuffers[BandIndex].GetData(), BandBytes[BandIndex]);
+			Cursor += BandBytes[BandIndex];
+		}
+		return true;
+	}
+} // namespace ImageEncoder
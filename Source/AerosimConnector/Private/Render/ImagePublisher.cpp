@@ -0,0 +1,565 @@
+#include "Render/ImagePublisher.h"
+#include "Render/ImageResize.h"
+#include "AerosimConnector.h"
+#include "Algo/BinarySearch.h"
+#include "Async/ParallelFor.h"
+#include "Dom/JsonObject.h"
+#include "HAL/Event.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/Crc.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "Util/MessageHandler.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Image Bytes Copied"), STAT_AerosimImageBytesCopied, STATGROUP_AerosimConnector);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Images Published"), STAT_AerosimImagesPublished, STATGROUP_AerosimConnector);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Images Dropped"), STAT_AerosimImagesDropped, STATGROUP_AerosimConnector);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Images Queued"), STAT_AerosimImagesQueued, STATGROUP_AerosimConnector);
+
+static TAutoConsoleVariable<bool> CVarImagePublishLoopback(
+	TEXT("aerosim.ImagePublish.Loopback"),
+	false,
+	TEXT("Publish camera frames to a local loopback transport instead of aerosim-world-link."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarImagePublishStatsInterval(
+	TEXT("aerosim.ImagePublish.StatsInterval"),
+	1.0f,
+	TEXT("Seconds between image publisher stream counter reports, 0 disables them."),
+	ECVF_Default);
+
+const uint8* IImageTransport::GatherRows(const FImageView& Image)
+{
+	if (Image.IsContiguous())
+		return Image.Data;
+
+	TRACE_CPUPROFILER_EVENT_SCOPE(IImageTransport::GatherRows);
+	const int64 PackedBytes = Image.GetPackedBytes();
+	static thread_local TArray64<uint8> Scratch;
+	if (Scratch.Num() < PackedBytes)
+		Scratch.SetNumUninitialized(PackedBytes);
+	uint8* Out = Scratch.GetData();
+	const int32 RowBytes = Image.GetRowBytes();
+	ParallelFor(Image.Size.Y, [&](int32 Y) {
+		FMemory::Memcpy(Out + (int64)Y * RowBytes, Image.GetRow(Y), RowBytes);
+	});
+	BytesCopied += PackedBytes;
+	INC_DWORD_STAT_BY(STAT_AerosimImageBytesCopied, (uint32)PackedBytes);
+	return Out;
+}
+
+bool FWorldLinkImageTransport::Publish(const char* Topic, const FImageView& Image)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWorldLinkImageTransport::Publish);
+
+	// world-link takes a single buffer
+	const int64 PackedBytes = Image.GetPackedBytes();
+	const uint8* Packed = GatherRows(Image);
+
+	publish_image_to_topic(Topic, Image.Size.X, Image.Size.Y, 1, Packed, PackedBytes);
+	++FramesPublished;
+	BytesPublished += PackedBytes;
+	INC_DWORD_STAT(STAT_AerosimImagesPublished);
+	return true;
+}
+
+bool FWorldLinkImageTransport::PublishEncoded(const char* Topic, FIntPoint Size, const uint8* Data, int64 Bytes)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWorldLinkImageTransport::PublishEncoded);
+	publish_image_to_topic(Topic, Size.X, Size.Y, 1, Data, Bytes);
+	++FramesPublished;
+	BytesPublished += Bytes;
+	INC_DWORD_STAT(STAT_AerosimImagesPublished);
+	return true;
+}
+
+bool FLoopbackImageTransport::Publish(const char* Topic, const FImageView& Image)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FLoopbackImageTransport::Publish);
+
+	uint32 Checksum = 0;
+	if (bGatherRows)
+	{
+		Checksum = FCrc::MemCrc32(GatherRows(Image), (int32)Image.GetPackedBytes());
+	}
+	else
+	{
+		for (int32 Y = 0; Y < Image.Size.Y; ++Y)
+		{
+			Checksum = FCrc::MemCrc32(Image.GetRow(Y), Image.GetRowBytes(), Checksum);
+		}
+	}
+	LastChecksum = Checksum;
+	++FramesPublished;
+	BytesPublished += Image.GetPackedBytes();
+	INC_DWORD_STAT(STAT_AerosimImagesPublished);
+	return true;
+}
+
+bool FLoopbackImageTransport::PublishEncoded(const char* Topic, FIntPoint Size, const uint8* Data, int64 Bytes)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FLoopbackImageTransport::PublishEncoded);
+	LastChecksum = FCrc::MemCrc32(Data, (int32)Bytes);
+	++FramesPublished;
+	BytesPublished += Bytes;
+	INC_DWORD_STAT(STAT_AerosimImagesPublished);
+	return true;
+}
+
+namespace ImagePublisher
+{
+	IImageTransport& GetTransport()
+	{
+		static FWorldLinkImageTransport WorldLinkTransport;
+		static FLoopbackImageTransport LoopbackTransport;
+		if (CVarImagePublishLoopback.GetValueOnAnyThread())
+			return LoopbackTransport;
+		return WorldLinkTransport;
+	}
+
+	bool PublishImage(
+		const char* Topic,
+		const FImageView& Image)
+	{
+		if (Image.Data == nullptr || Image.Size.X <= 0 || Image.Size.Y <= 0)
+			return false;
+		return GetTransport().Publish(Topic, Image);
+	}
+
+	bool PublishEncodedImage(
+		const char* Topic,
+		FIntPoint Size,
+		const TArray64<uint8>& Data)
+	{
+		if (Data.IsEmpty())
+			return false;
+		return GetTransport().PublishEncoded(Topic, Size, Data.GetData(), Data.Num());
+	}
+} // namespace ImagePublisher
+
+static void ValidateSettings(const FString& Label, FImageStreamSettings& Settings)
+{
+	if (!ImageEncoder::IsSupported(Settings.Encode.Codec, Settings.Layout))
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("Sensor %s: codec %s does not support layout %s, using lz4 instead"),
+			*Label, ImageEncoder::GetCodecName(Settings.Encode.Codec), PixelRepack::GetLayoutName(Settings.Layout));
+		Settings.Encode.Codec = EImageCodec::LZ4;
+	}
+}
+
+TUniquePtr<FImageFrame> FImageFrame::MakeOwning(TArray64<uint8>&& Pixels, FIntPoint Size, int32 BytesPerPixel, EPixelLayout Layout)
+{
+	check(Pixels.Num() >= (int64)Size.X * Size.Y * BytesPerPixel);
+	TUniquePtr<FImageFrame> Frame = MakeUnique<FImageFrame>();
+	Frame->View.Data = Pixels.GetData();
+	Frame->View.RowStride = Size.X * BytesPerPixel;
+	Frame->View.BytesPerPixel = BytesPerPixel;
+	Frame->View.Size = Size;
+	Frame->Layout = Layout;
+	// Moving the array keeps its allocation, the view stays valid until the frame is released.
+	Frame->Release = [Pixels = MoveTemp(Pixels)]() {};
+	return Frame;
+}
+
+FIntPoint FImageStreamSettings::GetOutputSize(FIntPoint Size) const
+{
+	// Same clamping as ImageResize::Crop, a region outside the frame is ignored.
+	const FIntPoint RoiSize = FIntPoint::ComponentMin(Roi.Max, Size) - FIntPoint::ComponentMax(Roi.Min, FIntPoint::ZeroValue);
+	if (Roi.Area() > 0 && RoiSize.X > 0 && RoiSize.Y > 0)
+	{
+		Size = RoiSize;
+	}
+	if (OutputSize.X > 0 && OutputSize.Y > 0)
+		return OutputSize;
+	return FIntPoint::ComponentMax(Size / FMath::Max(1, Downscale), FIntPoint(1, 1));
+}
+
+FImagePublisher& FImagePublisher::Get()
+{
+	static FImagePublisher Instance;
+	return Instance;
+}
+
+int32 FImagePublisher::RegisterStream(
+	const FString& Label,
+	const FString& Topic,
+	const FImageStreamSettings& Settings)
+{
+	FScopeLock Lock(&Mutex);
+	if (Thread == nullptr)
+	{
+		bStopping = false;
+		WorkEvent = FPlatformProcess::GetSynchEventFromPool();
+		Thread = FRunnableThread::Create(this, TEXT("AerosimImagePublisher"), 0, TPri_AboveNormal);
+	}
+
+	TSharedPtr<FStream> Stream = MakeShared<FStream>();
+	Stream->Label = Label;
+	Stream->Topic = Topic;
+	Stream->Settings = Settings;
+	Stream->RequestedSettings = Settings;
+	Stream->Settings.QueueDepth = FMath::Max(1, Settings.QueueDepth);
+	ValidateSettings(Label, Stream->Settings);
+	const int32 StreamId = NextStreamId++;
+	Streams.Add(StreamId, Stream);
+	// Ids only grow, so appending keeps the order sorted.
+	StreamOrder.Add(StreamId);
+	return StreamId;
+}
+
+void FImagePublisher::UpdateStream(int32 StreamId, const FString& Label, const FImageStreamSettings& Settings)
+{
+	TArray<TUniquePtr<FImageFrame>> Trimmed;
+	{
+		FScopeLock Lock(&Mutex);
+		TSharedPtr<FStream>* Stream = Streams.Find(StreamId);
+		if (Stream == nullptr)
+			return;
+		// The scene graph resends the same settings with every update.
+		if ((*Stream)->Label == Label && (*Stream)->RequestedSettings == Settings)
+			return;
+		(*Stream)->Label = Label;
+		(*Stream)->RequestedSettings = Settings;
+		(*Stream)->Settings = Settings;
+		(*Stream)->Settings.QueueDepth = FMath::Max(1, Settings.QueueDepth);
+		ValidateSettings(Label, (*Stream)->Settings);
+
+		// Keep the newest frames if the queue shrank.
+		TArray<TUniquePtr<FImageFrame>>& Queue = (*Stream)->Queue;
+		while (Queue.Num() > (*Stream)->Settings.QueueDepth)
+		{
+			Trimmed.Add(MoveTemp(Queue[0]));
+			Queue.RemoveAt(0);
+			++(*Stream)->Dropped;
+		}
+		// A blocked producer rechecks the new depth and policy.
+		(*Stream)->SpaceEvent->Trigger();
+	}
+	// The trimmed frames are released outside the lock.
+}
+
+void FImagePublisher::UnregisterStream(int32 StreamId)
+{
+	TSharedPtr<FStream> Stream;
+	{
+		FScopeLock Lock(&Mutex);
+		Streams.RemoveAndCopyValue(StreamId, Stream);
+		StreamOrder.Remove(StreamId);
+	}
+	if (Stream.IsValid())
+	{
+		// A frame of this stream may still be in flight on the publisher thread,
+		// which keeps the stream alive until it is done. The queued frames are
+		// released outside the lock.
+		TArray<TUniquePtr<FImageFrame>> Queue;
+		{
+			FScopeLock Lock(&Mutex);
+			Queue = MoveTemp(Stream->Queue);
+		}
+		// A producer blocked on the stream finds it gone and drops its frame.
+		Stream->SpaceEvent->Trigger();
+	}
+}
+
+bool FImagePublisher::Submit(int32 StreamId, TUniquePtr<FImageFrame>&& Frame)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FImagePublisher::Submit);
+
+	// Frames that do not make it into a queue are released after the lock.
+	TUniquePtr<FImageFrame> Discarded;
+	bool bCounted = false;
+	TSharedPtr<FStream> Blocked;
+	for (;;)
+	{
+		FScopeLock Lock(&Mutex);
+		TSharedPtr<FStream>* StreamPtr = Streams.Find(StreamId);
+		if (StreamPtr == nullptr)
+		{
+			// Pass the wake up on to the next producer blocked on the removed stream.
+			if (Blocked.IsValid())
+				Blocked->SpaceEvent->Trigger();
+			Discarded = MoveTemp(Frame);
+			return false;
+		}
+
+		FStream& Stream = **StreamPtr;
+		if (!bCounted)
+		{
+			++Stream.Captured;
+			bCounted = true;
+		}
+
+		if (Stream.Queue.Num() < Stream.Settings.QueueDepth)
+		{
+			Stream.Queue.Add(MoveTemp(Frame));
+			break;
+		}
+
+		if (Stream.Settings.Policy == EImageQueuePolicy::DropOldest)
+		{
+			Discarded = MoveTemp(Stream.Queue[0]);
+			Stream.Queue.RemoveAt(0);
+			Stream.Queue.Add(MoveTemp(Frame));
+			++Stream.Dropped;
+			INC_DWORD_STAT(STAT_AerosimImagesDropped);
+			break;
+		}
+
+		if (Stream.Settings.Policy == EImageQueuePolicy::DropNewest || bStopping)
+		{
+			if (Blocked.IsValid())
+				Stream.SpaceEvent->Trigger();
+			Discarded = MoveTemp(Frame);
+			++Stream.Dropped;
+			INC_DWORD_STAT(STAT_AerosimImagesDropped);
+			return false;
+		}
+
+		// EImageQueuePolicy::Block, wait for the publisher thread to pop a frame.
+		// The stream is kept alive by the reference while the lock is released.
+		Blocked = *StreamPtr;
+		Lock.Unlock();
+		TRACE_CPUPROFILER_EVENT_SCOPE(FImagePublisher::Submit::Block);
+		Blocked->SpaceEvent->Wait();
+	}
+
+	WorkEvent->Trigger();
+	return true;
+}
+
+TSharedPtr<FImagePublisher::FStream> FImagePublisher::PopNextFrame(TUniquePtr<FImageFrame>& OutFrame, FImageStreamSettings& OutSettings)
+{
+	FScopeLock Lock(&Mutex);
+	if (Streams.IsEmpty())
+		return nullptr;
+
+	// Visit the streams in id order, starting right after the last served one.
+	const int32 Start = Algo::UpperBound(StreamOrder, LastServedStreamId);
+	int32 Queued = 0;
+	TSharedPtr<FStream> Served;
+	for (int32 Offset = 0; Offset < StreamOrder.Num(); ++Offset)
+	{
+		const int32 StreamId = StreamOrder[(Start + Offset) % StreamOrder.Num()];
+		const TSharedPtr<FStream>& Stream = Streams.FindChecked(StreamId);
+		if (!Served.IsValid() && Stream->Queue.Num() > 0)
+		{
+			OutFrame = MoveTemp(Stream->Queue[0]);
+			Stream->Queue.RemoveAt(0);
+			LastServedStreamId = StreamId;
+			OutSettings = Stream->Settings;
+			Served = Stream;
+			// Room was made in the queue, unblock its producer.
+			Stream->SpaceEvent->Trigger();
+		}
+		Queued += Stream->Queue.Num();
+	}
+	SET_DWORD_STAT(STAT_AerosimImagesQueued, Queued);
+	return Served;
+}
+
+uint32 FImagePublisher::Run()
+{
+	while (!bStopping)
+	{
+		TUniquePtr<FImageFrame> Frame;
+		FImageStreamSettings Settings;
+		TSharedPtr<FStream> Stream = PopNextFrame(Frame, Settings);
+		if (!Stream.IsValid())
+		{
+			WorkEvent->Wait(FTimespan::FromMilliseconds(100));
+		}
+		else
+		{
+			const int64 RawBytes = Frame->View.GetPackedBytes();
+			const int64 PublishedBytes = PublishFrame(Stream->Topic, MoveTemp(Frame), Settings);
+			if (PublishedBytes >= 0)
+			{
+				FScopeLock Lock(&Mutex);
+				++Stream->Published;
+				Stream->RawBytes += RawBytes;
+				Stream->EncodedBytes += PublishedBytes;
+			}
+			else
+			{
+				// The frame never reached the transport
+				FScopeLock Lock(&Mutex);
+				++Stream->Dropped;
+				INC_DWORD_STAT(STAT_AerosimImagesDropped);
+			}
+		}
+
+		const float StatsInterval = CVarImagePublishStatsInterval.GetValueOnAnyThread();
+		const double Now = FPlatformTime::Seconds();
+		if (StatsInterval > 0.0f && Now - LastStatsTime >= StatsInterval)
+		{
+			LastStatsTime = Now;
+			PublishStats();
+		}
+	}
+	return 0;
+}
+
+int64 FImagePublisher::PublishFrame(const FString& Topic, TUniquePtr<FImageFrame>&& Frame, const FImageStreamSettings& Settings)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FImagePublisher::PublishFrame);
+
+	FImageView View = Frame->View;
+	const EPixelLayout FrameLayout = Frame->Layout;
+	const bool bColor = FrameLayout == EPixelLayout::BGRA8;
+	if (Settings.Roi.Area() > 0)
+	{
+		View = ImageResize::Crop(View, Settings.Roi);
+	}
+	const FIntPoint OutputSize = Settings.GetOutputSize(Frame->View.Size);
+	FImageView Resized;
+	if (OutputSize != View.Size && bColor && View.BytesPerPixel == 4 && ImageResize::Resize(View, OutputSize, ResizeBuffer, Resized))
+	{
+		View = Resized;
+		Frame.Reset();
+	}
+
+	const FIntPoint Size = View.Size;
+	// Single-channel frames (e.g. segmentation labels) are published as Y8.
+	EPixelLayout Layout = !bColor ? FrameLayout : View.BytesPerPixel == 1 ? EPixelLayout::Y8 : EPixelLayout::BGRA8;
+	if (Settings.Layout != EPixelLayout::BGRA8 && bColor && View.BytesPerPixel == 4 && PixelRepack::IsSupported(Settings.Layout, Size))
+	{
+		Layout = Settings.Layout;
+		const int64 PackedBytes = PixelRepack::GetPackedView(Layout, Size, nullptr).GetPackedBytes();
+		if (Settings.Encode.Codec == EImageCodec::None)
+		{
+			// Repack right behind the header, so the pixels are copied only once.
+			EncodeBuffer.SetNumUninitialized(ImageEncoder::RawHeaderBytes + PackedBytes);
+			ImageEncoder::WriteRawHeader(Size, Layout, EncodeBuffer.GetData());
+			PixelRepack::Repack(View, Layout, EncodeBuffer.GetData() + ImageEncoder::RawHeaderBytes);
+			// The pixels are no longer needed, unlock the readback before publishing.
+			Frame.Reset();
+			return ImagePublisher::PublishEncodedImage(TCHAR_TO_UTF8(*Topic), Size, EncodeBuffer) ? EncodeBuffer.Num() : -1;
+		}
+
+		if (RepackBuffer.Num() < PackedBytes)
+			RepackBuffer.SetNumUninitialized(PackedBytes);
+		PixelRepack::Repack(View, Layout, RepackBuffer.GetData());
+		View = PixelRepack::GetPackedView(Layout, Size, RepackBuffer.GetData());
+		Frame.Reset();
+	}
+
+	if (Settings.Encode.Codec != EImageCodec::None && ImageEncoder::Encode(View, Layout, Settings.Encode, EncodeBuffer))
+	{
+		Frame.Reset();
+		return ImagePublisher::PublishEncodedImage(TCHAR_TO_UTF8(*Topic), Size, EncodeBuffer) ? EncodeBuffer.Num() : -1;
+	}
+
+	if (Layout != EPixelLayout::BGRA8 || Settings.Encode.Codec != EImageCodec::None)
+	{
+		// Repacked, not color or failed to encode, publish the pixels with a raw
+		// header so clients can tell what they got.
+		const int64 RowBytes = View.GetRowBytes();
+		EncodeBuffer.SetNumUninitialized(ImageEncoder::RawHeaderBytes + View.GetPackedBytes());
+		ImageEncoder::WriteRawHeader(Size, Layout, EncodeBuffer.GetData());
+		uint8* Out = EncodeBuffer.GetData() + ImageEncoder::RawHeaderBytes;
+		for (int32 Y = 0; Y < View.Size.Y; ++Y)
+		{
+			FMemory::Memcpy(Out + Y * RowBytes, View.GetRow(Y), RowBytes);
+		}
+		Frame.Reset();
+		return ImagePublisher::PublishEncodedImage(TCHAR_TO_UTF8(*Topic), Size, EncodeBuffer) ? EncodeBuffer.Num() : -1;
+	}
+
+	return ImagePublisher::PublishImage(TCHAR_TO_UTF8(*Topic), View) ? View.GetPackedBytes() : -1;
+}
+
+void FImagePublisher::Stop()
+{
+	bStopping = true;
+	if (WorkEvent != nullptr)
+		WorkEvent->Trigger();
+
+	// Blocked producers drop their frame once they see bStopping.
+	FScopeLock Lock(&Mutex);
+	for (auto& Pair : Streams)
+	{
+		Pair.Value->SpaceEvent->Trigger();
+	}
+}
+
+void FImagePublisher::Shutdown()
+{
+	if (Thread != nullptr)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	FScopeLock Lock(&Mutex);
+	// As with the readback poller, the RHI is gone by now, so the queued frames
+	// are discarded without unlocking their readbacks.
+	for (auto& Pair : Streams)
+	{
+		for (TUniquePtr<FImageFrame>& Frame : Pair.Value->Queue)
+		{
+			Frame->Release = TUniqueFunction<void()>();
+		}
+	}
+	Streams.Empty();
+	StreamOrder.Empty();
+
+	if (WorkEvent != nullptr)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+		WorkEvent = nullptr;
+	}
+}
+
+TArray<FImageStreamStats> FImagePublisher::GetStreamStats() const
+{
+	FScopeLock Lock(&Mutex);
+	TArray<FImageStreamStats> Result;
+	for (const auto& Pair : Streams)
+	{
+		FImageStreamStats& Stats = Result.AddDefaulted_GetRef();
+		Stats.Label = Pair.Value->Label;
+		Stats.Captured = Pair.Value->Captured;
+		Stats.Published = Pair.Value->Published;
+		Stats.Dropped = Pair.Value->Dropped;
+		Stats.Queued = Pair.Value->Queue.Num();
+		Stats.RawBytes = Pair.Value->RawBytes;
+		Stats.EncodedBytes = Pair.Value->EncodedBytes;
+	}
+	return Result;
+}
+
+void FImagePublisher::PublishStats()
+{
+	TArray<FImageStreamStats> StreamStats = GetStreamStats();
+	if (StreamStats.IsEmpty())
+		return;
+
+	TArray<TSharedPtr<FJsonValue>> StreamArray;
+	for (const FImageStreamStats& Stats : StreamStats)
+	{
+		TSharedPtr<FJsonObject> StreamObject = MakeShareable(new FJsonObject);
+		StreamObject->SetStringField(TEXT("sensor"), Stats.Label);
+		StreamObject->SetNumberField(TEXT("captured"), Stats.Captured);
+		StreamObject->SetNumberField(TEXT("published"), Stats.Published);
+		StreamObject->SetNumberField(TEXT("dropped"), Stats.Dropped);
+		StreamObject->SetNumberField(TEXT("queued"), Stats.Queued);
+		StreamObject->SetNumberField(TEXT("raw_bytes"), Stats.RawBytes);
+		StreamObject->SetNumberField(TEXT("encoded_bytes"), Stats.EncodedBytes);
+		StreamArray.Add(MakeShareable(new FJsonValueObject(StreamObject)));
+	}
+
+	TSharedPtr<FJsonObject> ResponsePayload = MakeShareable(new FJsonObject);
+	ResponsePayload->SetStringField(TEXT("response_type"), TEXT("image_publisher_stats"));
+	TSharedPtr<FJsonObject> ResponseParameters = MakeShareable(new FJsonObject);
+	ResponseParameters->SetArrayField(TEXT("streams"), StreamArray);
+	ResponsePayload->SetObjectField(TEXT("parameters"), ResponseParameters);
+
+	FString ResponseString;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ResponseString);
+	FJsonSerializer::Serialize(ResponsePayload.ToSharedRef(), Writer);
+
+	publish_to_topic("aerosim.renderer.responses", TCHAR_TO_UTF8(*ResponseString));
+}
@@ -0,0 +1,301 @@
+#include "Render/ImageResize.h"
+#include "Render/ImagePublisher.h"
+#include "AerosimConnector.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+	#define AEROSIM_RESIZE_NEON 1
+	#include <arm_neon.h>
+#elif PLATFORM_ENABLE_VECTORINTRINSICS && PLATFORM_ALWAYS_HAS_SSE4_1
+	#define AEROSIM_RESIZE_SSE 1
+	#include <immintrin.h>
+#endif
+
+#ifndef AEROSIM_RESIZE_NEON
+	#define AEROSIM_RESIZE_NEON 0
+#endif
+#ifndef AEROSIM_RESIZE_SSE
+	#define AEROSIM_RESIZE_SSE 0
+#endif
+
+DECLARE_CYCLE_STAT(TEXT("Image Resize"), STAT_AerosimImageResize, STATGROUP_AerosimConnector);
+
+namespace ImageResize
+{
+	// Source column/row and weight of the second one, in 1/256 units.
+	struct FBilinearTap
+	{
+		int32 Index = 0;
+		int32 Weight = 0;
+	};
+
+	static void ComputeTaps(int32 SourceSize, int32 OutputSize, int32 First, int32 Num, TArray<FBilinearTap>& OutTaps)
+	{
+		OutTaps.SetNumUninitialized(Num);
+		const double Scale = (double)SourceSize / OutputSize;
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			FBilinearTap& Tap = OutTaps[Index];
+			const double Position = FMath::Max(0.0, (First + Index + 0.5) * Scale - 0.5);
+			Tap.Index = FMath::FloorToInt32(Position);
+			Tap.Weight = FMath::RoundToInt32((Position - Tap.Index) * 256.0);
+			if (Tap.Weight == 256)
+			{
+				++Tap.Index;
+				Tap.Weight = 0;
+			}
+			// Keep both taps inside the image, so the pair can be loaded at once.
+			if (Tap.Index >= SourceSize - 1)
+			{
+				Tap.Index = FMath::Max(0, SourceSize - 2);
+				Tap.Weight = SourceSize > 1 ? 256 : 0;
+			}
+		}
+	}
+
+	namespace Scalar
+	{
+		static void HalveRow(const uint8* In0, const uint8* In1, uint8* Out, int32 OutWidth)
+		{
+			for (int32 X = 0; X < OutWidth; ++X)
+			{
+				for (int32 Channel = 0; Channel < 4; ++Channel)
+				{
+					Out[4 * X + Channel] = (uint8)((In0[8 * X + Channel] + In0[8 * X + 4 + Channel] + In1[8 * X + Channel] + In1[8 * X + 4 + Channel] + 2) >> 2);
+				}
+			}
+		}
+
+		static void BilinearRow(const uint8* In0, const uint8* In1, int32 WeightY, const FBilinearTap* Taps, uint8* Out, int32 OutWidth, int32 SourceWidth)
+		{
+			const int32 NextPixel = SourceWidth > 1 ? 4 : 0;
+			for (int32 X = 0; X < OutWidth; ++X)
+			{
+				const uint8* P0 = In0 + 4 * Taps[X].Index;
+				const uint8* P1 = In1 + 4 * Taps[X].Index;
+				const int32 WeightX = Taps[X].Weight;
+				for (int32 Channel = 0; Channel < 4; ++Channel)
+				{
+					const int32 Top = P0[Channel] * (256 - WeightX) + P0[NextPixel + Channel] * WeightX;
+					const int32 Bottom = P1[Channel] * (256 - WeightX) + P1[NextPixel + Channel] * WeightX;
+					Out[4 * X + Channel] = (uint8)((Top * (256 - WeightY) + Bottom * WeightY + 32768) >> 16);
+				}
+			}
+		}
+	} // namespace Scalar
+
+	// Vector kernels return the number of output pixels they produced, the
+	// scalar kernels take care of the rest of the row.
+	namespace Vector
+	{
+		static int32 HalveRow(const uint8* In0, const uint8* In1, uint8* Out, int32 OutWidth)
+		{
+			int32 X = 0;
+#if AEROSIM_RESIZE_SSE
+			const __m128i Zero = _mm_setzero_si128();
+			const __m128i Two = _mm_set1_epi16(2);
+			for (; X + 4 <= OutWidth; X += 4)
+			{
+				__m128i Halves[2];
+				for (int32 Half = 0; Half < 2; ++Half)
+				{
+					const __m128i Row0 = _mm_loadu_si128((const __m128i*)(In0 + 8 * X + 16 * Half));
+					const __m128i Row1 = _mm_loadu_si128((const __m128i*)(In1 + 8 * X + 16 * Half));
+					// Vertical sums of pixels 0 1 and 2 3, then the horizontal pairs.
+					const __m128i Lo = _mm_add_epi16(_mm_unpacklo_epi8(Row0, Zero), _mm_unpacklo_epi8(Row1, Zero));
+					const __m128i Hi = _mm_add_epi16(_mm_unpackhi_epi8(Row0, Zero), _mm_unpackhi_epi8(Row1, Zero));
+					const __m128i Sum = _mm_unpacklo_epi64(
+						_mm_add_epi16(Lo, _mm_srli_si128(Lo, 8)),
+						_mm_add_epi16(Hi, _mm_srli_si128(Hi, 8)));
+					Halves[Half] = _mm_srli_epi16(_mm_add_epi16(Sum, Two), 2);
+				}
+				_mm_storeu_si128((__m128i*)(Out + 4 * X), _mm_packus_epi16(Halves[0], Halves[1]));
+			}
+#elif AEROSIM_RESIZE_NEON
+			for (; X + 8 <= OutWidth; X += 8)
+			{
+				const uint8x16x4_t Row0 = vld4q_u8(In0 + 8 * X);
+				const uint8x16x4_t Row1 = vld4q_u8(In1 + 8 * X);
+				uint8x8x4_t Result;
+				for (int32 Channel = 0; Channel < 4; ++Channel)
+				{
+					const uint16x8_t Sum = vaddq_u16(vpaddlq_u8(Row0.val[Channel]), vpaddlq_u8(Row1.val[Channel]));
+					// vrshrn adds 2 before shifting by 2.
+					Result.val[Channel] = vrshrn_n_u16(Sum, 2);
+				}
+				vst4_u8(Out + 4 * X, Result);
+			}
+#endif
+			return X;
+		}
+
+		static int32 BilinearRow(const uint8* In0, const uint8* In1, int32 WeightY, const FBilinearTap* Taps, uint8* Out, int32 OutWidth, int32 SourceWidth)
+		{
+			int32 X = 0;
+#if AEROSIM_RESIZE_SSE
+			if (SourceWidth < 2)
+				return 0;
+			const __m128i Zero = _mm_setzero_si128();
+			const __m128i WeightsY = _mm_setr_epi32(256 - WeightY, WeightY, 0, 0);
+			const __m128i Rounding = _mm_set1_epi32(32768);
+			for (; X + 2 <= OutWidth; X += 2)
+			{
+				__m128i Pixels[2];
+				for (int32 Pixel = 0; Pixel < 2; ++Pixel)
+				{
+					const FBilinearTap& Tap = Taps[X + Pixel];
+					const __m128i WeightsX = _mm_set1_epi32(((uint32)Tap.Weight << 16) | (uint32)(256 - Tap.Weight));
+					// Both taps of a row are adjacent, interleave their channels so
+					// madd blends them: B0 B1 G0 G1 R0 R1 A0 A1.
+					const __m128i Pair0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(In0 + 4 * Tap.Index)), Zero);
+					const __m128i Pair1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(In1 + 4 * Tap.Index)), Zero);
+					const __m128i Top = _mm_madd_epi16(_mm_unpacklo_epi16(Pair0, _mm_srli_si128(Pair0, 8)), WeightsX);
+					const __m128i Bottom = _mm_madd_epi16(_mm_unpacklo_epi16(Pair1, _mm_srli_si128(Pair1, 8)), WeightsX);
+					const __m128i Blend = _mm_add_epi32(
+						_mm_mullo_epi32(Top, _mm_shuffle_epi32(WeightsY, _MM_SHUFFLE(0, 0, 0, 0))),
+						_mm_mullo_epi32(Bottom, _mm_shuffle_epi32(WeightsY, _MM_SHUFFLE(1, 1, 1, 1))));
+					Pixels[Pixel] = _mm_srli_epi32(_mm_add_epi32(Blend, Rounding), 16);
+				}
+				const __m128i Packed = _mm_packus_epi16(_mm_packs_epi32(Pixels[0], Pixels[1]), Zero);
+				_mm_storel_epi64((__m128i*)(Out + 4 * X), Packed);
+			}
+#endif
+			return X;
+		}
+	} // namespace Vector
+
+	FImageView Crop(const FImageView& Source, const FIntRect& Roi)
+	{
+		const FIntRect Clamped(
+			FIntPoint::ComponentMax(Roi.Min, FIntPoint::ZeroValue),
+			FIntPoint::ComponentMin(Roi.Max, Source.Size));
+		if (Clamped.Width() <= 0 || Clamped.Height() <= 0)
+			return Source;
+
+		FImageView Cropped = Source;
+		Cropped.Data = Source.GetRow(Clamped.Min.Y) + (int64)Clamped.Min.X * Source.BytesPerPixel;
+		Cropped.Size = Clamped.Size();
+		return Cropped;
+	}
+
+	void HalveRows(
+		const FImageView& Source,
+		int32 FirstRow,
+		int32 NumRows,
+		uint8* Out,
+		bool bUseVectorKernels)
+	{
+		check(Source.BytesPerPixel == 4);
+		const int32 OutWidth = Source.Size.X / 2;
+		for (int32 Y = FirstRow; Y < FirstRow + NumRows; ++Y)
+		{
+			const uint8* In0 = Source.GetRow(2 * Y);
+			const uint8* In1 = Source.GetRow(2 * Y + 1);
+			uint8* OutRow = Out + (int64)Y * OutWidth * 4;
+			const int32 X = bUseVectorKernels ? Vector::HalveRow(In0, In1, OutRow, OutWidth) : 0;
+			Scalar::HalveRow(In0 + 8 * X, In1 + 8 * X, OutRow + 4 * X, OutWidth - X);
+		}
+	}
+
+	void BilinearRows(
+		const FImageView& Source,
+		FIntPoint OutputSize,
+		int32 FirstRow,
+		int32 NumRows,
+		uint8* Out,
+		bool bUseVectorKernels)
+	{
+		check(Source.BytesPerPixel == 4);
+		TArray<FBilinearTap> ColumnTaps;
+		TArray<FBilinearTap> RowTaps;
+		ComputeTaps(Source.Size.X, OutputSize.X, 0, OutputSize.X, ColumnTaps);
+		ComputeTaps(Source.Size.Y, OutputSize.Y, FirstRow, NumRows, RowTaps);
+		for (int32 Row = 0; Row < NumRows; ++Row)
+		{
+			const FBilinearTap& RowTap = RowTaps[Row];
+			const uint8* In0 = Source.GetRow(RowTap.Index);
+			const uint8* In1 = Source.GetRow(FMath::Min(RowTap.Index + 1, Source.Size.Y - 1));
+			uint8* OutRow = Out + (int64)(FirstRow + Row) * OutputSize.X * 4;
+			const int32 X = bUseVectorKernels
+				? Vector::BilinearRow(In0, In1, RowTap.Weight, ColumnTaps.GetData(), OutRow, OutputSize.X, Source.Size.X)
+				: 0;
+			Scalar::BilinearRow(In0, In1, RowTap.Weight, ColumnTaps.GetData() + X, OutRow + 4 * X, OutputSize.X - X, Source.Size.X);
+		}
+	}
+
+	template <typename FRowsFunction>
+	static void ParallelRows(int32 NumRows, FRowsFunction&& RowsFunction)
+	{
+		const int32 NumWorkers = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+		const int32 BandRows = FMath::Max(8, FMath::DivideAndRoundUp(NumRows, NumWorkers));
+		const int32 NumBands = FMath::DivideAndRoundUp(NumRows, BandRows);
+		ParallelFor(NumBands, [&](int32 BandIndex) {
+			const int32 FirstRow = BandIndex * BandRows;
+			RowsFunction(FirstRow, FMath::Min(BandRows, NumRows - FirstRow));
+		});
+	}
+
+	bool Resize(
+		const FImageView& Source,
+		FIntPoint OutputSize,
+		TArray64<uint8>& Out,
+		FImageView& OutView)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(ImageResize::Resize);
+		SCOPE_CYCLE_COUNTER(STAT_AerosimImageResize);
+
+		if (Source.Data == nullptr || Source.BytesPerPixel != 4 || OutputSize.X <= 0 || OutputSize.Y <= 0)
+			return false;
+
+		// Number of halvings if OutputSize is Source.Size divided by a power of two.
+		int32 NumHalvings = 0;
+		FIntPoint HalvedSize = Source.Size;
+		while (HalvedSize.X > OutputSize.X && HalvedSize.Y > OutputSize.Y && HalvedSize.X % 2 == 0 && HalvedSize.Y % 2 == 0)
+		{
+			HalvedSize /= 2;
+			++NumHalvings;
+		}
+
+		// Intermediate mip levels, ping-ponged between the two buffers.
+		static thread_local TArray64<uint8> ThreadMipBuffer;
+		TArray64<uint8>& MipBuffer = ThreadMipBuffer;
+
+		const int64 OutBytes = (int64)OutputSize.X * OutputSize.Y * 4;
+		if (HalvedSize == OutputSize && NumHalvings > 0)
+		{
+			FImageView Level = Source;
+			for (int32 Halving = 0; Halving < NumHalvings; ++Halving)
+			{
+				// The last level goes to Out, the ones before alternate so that
+				// a level never reads the buffer it writes.
+				TArray64<uint8>& Target = ((NumHalvings - 1 - Halving) % 2 == 0) ? Out : MipBuffer;
+				const FIntPoint LevelSize = Level.Size / 2;
+				const int64 LevelBytes = (int64)LevelSize.X * LevelSize.Y * 4;
+				if (Target.Num() < LevelBytes)
+					Target.SetNumUninitialized(LevelBytes);
+				uint8* TargetData = Target.GetData();
+				ParallelRows(LevelSize.Y, [&](int32 FirstRow, int32 NumRows) {
+					HalveRows(Level, FirstRow, NumRows, TargetData);
+				});
+				Level.Data = TargetData;
+				Level.Size = LevelSize;
+				Level.RowStride = LevelSize.X * 4;
+			}
+			OutView = Level;
+			return true;
+		}
+
+		if (Out.Num() < OutBytes)
+			Out.SetNumUninitialized(OutBytes);
+		uint8* OutData = Out.GetData();
+		ParallelRows(OutputSize.Y, [&](int32 FirstRow, int32 NumRows) {
+			BilinearRows(Source, OutputSize, FirstRow, NumRows, OutData);
+		});
+		OutView.Data = OutData;
+		OutView.Size = OutputSize;
+		OutView.BytesPerPixel = 4;
+		OutView.RowStride = OutputSize.X * 4;
+		return true;
+	}
+} // namespace ImageResize
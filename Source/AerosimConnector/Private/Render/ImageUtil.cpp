@@ -4,6 +4,25 @@
 #include "ImageWriteQueue.h"
 #include "HighResScreenshot.h"
 #include "RHIGPUReadback.h"
+#include "Render/ReadbackPoller.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+	#define AEROSIM_DECODE_NEON 1
+	#include <arm_neon.h>
+#elif PLATFORM_ENABLE_VECTORINTRINSICS
+	// Only SSE2 is used, so the kernels are available on every x64 target.
+	#define AEROSIM_DECODE_SSE 1
+	#include <emmintrin.h>
+#endif
+
+#ifndef AEROSIM_DECODE_NEON
+	#define AEROSIM_DECODE_NEON 0
+#endif
+#ifndef AEROSIM_DECODE_SSE
+	#define AEROSIM_DECODE_SSE 0
+#endif
 
 template <typename F>
 class ScopedCallback
@@ -19,59 +38,315 @@ public:
 
 namespace ImageUtil
 {
+	// Row kernels of DecodePixelsByFormat. Each one produces exactly what the
+	// engine converter (or the scalar loop it replaces) does for the same row.
+	namespace DecodeKernels
+	{
+		// FLinearColor(Value, 0, 0, 1).QuantizeRound() for every pixel.
+		static void R32FToFColorRow(const float* In, FColor* Out, int32 Width)
+		{
+			int32 X = 0;
+#if AEROSIM_DECODE_SSE
+			const __m128 Scale = _mm_set1_ps(255.f);
+			const __m128 Half = _mm_set1_ps(0.5f);
+			const __m128i Zero = _mm_setzero_si128();
+			const __m128i Alpha = _mm_set1_epi32((int32)0xFF000000);
+			for (; X + 4 <= Width; X += 4)
+			{
+				// Truncation like the scalar int32 cast, NaN and out of range
+				// values become INT_MIN in both. The two saturating packs clamp
+				// to [0, 255].
+				const __m128i Truncated = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(In + X), Scale), Half));
+				const __m128i Clamped = _mm_packus_epi16(_mm_packs_epi32(Truncated, Truncated), Zero);
+				// R is the third byte of an FColor.
+				const __m128i Red = _mm_unpacklo_epi16(Zero, _mm_unpacklo_epi8(Clamped, Zero));
+				_mm_storeu_si128((__m128i*)(Out + X), _mm_or_si128(Red, Alpha));
+			}
+#elif AEROSIM_DECODE_NEON
+			const float32x4_t Scale = vdupq_n_f32(255.f);
+			const float32x4_t Half = vdupq_n_f32(0.5f);
+			const int32x4_t Zero = vdupq_n_s32(0);
+			const int32x4_t Max = vdupq_n_s32(255);
+			const uint32x4_t Alpha = vdupq_n_u32(0xFF000000);
+			for (; X + 4 <= Width; X += 4)
+			{
+				// Saturating truncation with NaN as 0, as the scalar int32 cast on ARM.
+				const int32x4_t Truncated = vcvtq_s32_f32(vaddq_f32(vmulq_f32(vld1q_f32(In + X), Scale), Half));
+				const uint32x4_t Clamped = vreinterpretq_u32_s32(vminq_s32(vmaxq_s32(Truncated, Zero), Max));
+				vst1q_u32((uint32*)(Out + X), vorrq_u32(vshlq_n_u32(Clamped, 16), Alpha));
+			}
+#endif
+			for (; X < Width; ++X)
+			{
+				Out[X] = FLinearColor(In[X], 0.f, 0.f, 1.f).QuantizeRound();
+			}
+		}
+
+#if AEROSIM_DECODE_SSE
+		// Exact half to float conversion of the low 16 bits of each lane,
+		// including denormals, infinities and NaNs, without requiring F16C.
+		static FORCEINLINE __m128 HalfToFloat(__m128i Halves)
+		{
+			const __m128i ExponentMantissa = _mm_and_si128(Halves, _mm_set1_epi32(0x7FFF));
+			const __m128i Sign = _mm_slli_epi32(_mm_xor_si128(Halves, ExponentMantissa), 16);
+			// Rebias the exponent with a multiply, which also normalizes denormals.
+			const __m128 Scaled = _mm_mul_ps(
+				_mm_castsi128_ps(_mm_slli_epi32(ExponentMantissa, 13)),
+				_mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+			const __m128i bInfNan = _mm_cmpgt_epi32(ExponentMantissa, _mm_set1_epi32(0x7BFF));
+			const __m128 InfNanExponent = _mm_and_ps(_mm_castsi128_ps(bInfNan), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+			return _mm_or_ps(Scaled, _mm_or_ps(_mm_castsi128_ps(Sign), InfNanExponent));
+		}
+#endif
+
+		// Converts a row of RGBA half floats to FLinearColor.
+		static void HalfRGBAToLinearRow(const FFloat16* In, FLinearColor* Out, int32 Width)
+		{
+			int32 X = 0;
+#if AEROSIM_DECODE_SSE
+			const __m128i Zero = _mm_setzero_si128();
+			for (; X + 2 <= Width; X += 2)
+			{
+				const __m128i Halves = _mm_loadu_si128((const __m128i*)(In + 4 * X));
+				_mm_storeu_ps((float*)(Out + X), HalfToFloat(_mm_unpacklo_epi16(Halves, Zero)));
+				_mm_storeu_ps((float*)(Out + X + 1), HalfToFloat(_mm_unpackhi_epi16(Halves, Zero)));
+			}
+#elif AEROSIM_DECODE_NEON
+			const uint16x8_t ExponentMantissaMask = vdupq_n_u16(0x7FFF);
+			const uint16x8_t Infinity = vdupq_n_u16(0x7C00);
+			for (; X + 2 <= Width; X += 2)
+			{
+				const uint16x8_t Halves = vld1q_u16((const uint16*)(In + 4 * X));
+				// The hardware conversion quiets signaling NaNs, the scalar one
+				// keeps their bits, so pixels holding a NaN are left to it.
+				if (vmaxvq_u16(vcgtq_u16(vandq_u16(Halves, ExponentMantissaMask), Infinity)) != 0)
+				{
+					for (int32 Pixel = X; Pixel < X + 2; ++Pixel)
+					{
+						Out[Pixel] = FLinearColor(In[4 * Pixel + 0].GetFloat(), In[4 * Pixel + 1].GetFloat(), In[4 * Pixel + 2].GetFloat(), In[4 * Pixel + 3].GetFloat());
+					}
+					continue;
+				}
+				vst1q_f32((float*)(Out + X), vcvt_f32_f16(vreinterpret_f16_u16(vget_low_u16(Halves))));
+				vst1q_f32((float*)(Out + X + 1), vcvt_f32_f16(vreinterpret_f16_u16(vget_high_u16(Halves))));
+			}
+#endif
+			for (; X < Width; ++X)
+			{
+				Out[X] = FLinearColor(In[4 * X + 0].GetFloat(), In[4 * X + 1].GetFloat(), In[4 * X + 2].GetFloat(), In[4 * X + 3].GetFloat());
+			}
+		}
+
+		// Converts a row of R11G11B10 floats to FLinearColor. Groups holding an
+		// infinity or NaN go through the engine converter, so their payload bits
+		// match too.
+		static void R11G11B10ToLinearRow(const uint32* In, FLinearColor* Out, int32 Width)
+		{
+			int32 X = 0;
+#if AEROSIM_DECODE_SSE
+			const __m128i Mask11 = _mm_set1_epi32(0x7FF);
+			const __m128i Mask10 = _mm_set1_epi32(0x3FF);
+			const __m128i ExponentR = _mm_set1_epi32(0x7C0);
+			const __m128i ExponentG = _mm_set1_epi32(0x3E0000);
+			const __m128i ExponentB = _mm_set1_epi32((int32)0xF8000000);
+			const __m128 One = _mm_set1_ps(1.f);
+			for (; X + 4 <= Width; X += 4)
+			{
+				const __m128i Packed = _mm_loadu_si128((const __m128i*)(In + X));
+				const __m128i bInfNan = _mm_or_si128(_mm_or_si128(
+					_mm_cmpeq_epi32(_mm_and_si128(Packed, ExponentR), ExponentR),
+					_mm_cmpeq_epi32(_mm_and_si128(Packed, ExponentG), ExponentG)),
+					_mm_cmpeq_epi32(_mm_and_si128(Packed, ExponentB), ExponentB));
+				if (_mm_movemask_epi8(bInfNan) != 0)
+				{
+					ConvertRawRR11G11B10DataToFLinearColor(4, 1, (uint8*)(In + X), 4 * sizeof(uint32), Out + X);
+					continue;
+				}
+				// The 6/5-bit mantissas line up with the top of a half mantissa.
+				__m128 R = HalfToFloat(_mm_slli_epi32(_mm_and_si128(Packed, Mask11), 4));
+				__m128 G = HalfToFloat(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(Packed, 11), Mask11), 4));
+				__m128 B = HalfToFloat(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(Packed, 22), Mask10), 5));
+				__m128 A = One;
+				_MM_TRANSPOSE4_PS(R, G, B, A);
+				_mm_storeu_ps((float*)(Out + X + 0), R);
+				_mm_storeu_ps((float*)(Out + X + 1), G);
+				_mm_storeu_ps((float*)(Out + X + 2), B);
+				_mm_storeu_ps((float*)(Out + X + 3), A);
+			}
+#elif AEROSIM_DECODE_NEON
+			const uint32x4_t Mask11 = vdupq_n_u32(0x7FF);
+			const uint32x4_t Mask10 = vdupq_n_u32(0x3FF);
+			const uint32x4_t ExponentR = vdupq_n_u32(0x7C0);
+			const uint32x4_t ExponentG = vdupq_n_u32(0x3E0000);
+			const uint32x4_t ExponentB = vdupq_n_u32(0xF8000000);
+			for (; X + 4 <= Width; X += 4)
+			{
+				const uint32x4_t Packed = vld1q_u32(In + X);
+				const uint32x4_t bInfNan = vorrq_u32(vorrq_u32(
+					vceqq_u32(vandq_u32(Packed, ExponentR), ExponentR),
+					vceqq_u32(vandq_u32(Packed, ExponentG), ExponentG)),
+					vceqq_u32(vandq_u32(Packed, ExponentB), ExponentB));
+				if (vmaxvq_u32(bInfNan) != 0)
+				{
+					ConvertRawRR11G11B10DataToFLinearColor(4, 1, (uint8*)(In + X), 4 * sizeof(uint32), Out + X);
+					continue;
+				}
+				const uint16x4_t R = vmovn_u32(vshlq_n_u32(vandq_u32(Packed, Mask11), 4));
+				const uint16x4_t G = vmovn_u32(vshlq_n_u32(vandq_u32(vshrq_n_u32(Packed, 11), Mask11), 4));
+				const uint16x4_t B = vmovn_u32(vshlq_n_u32(vandq_u32(vshrq_n_u32(Packed, 22), Mask10), 5));
+				float32x4x4_t Pixels;
+				Pixels.val[0] = vcvt_f32_f16(vreinterpret_f16_u16(R));
+				Pixels.val[1] = vcvt_f32_f16(vreinterpret_f16_u16(G));
+				Pixels.val[2] = vcvt_f32_f16(vreinterpret_f16_u16(B));
+				Pixels.val[3] = vdupq_n_f32(1.f);
+				vst4q_f32((float*)(Out + X), Pixels);
+			}
+#endif
+			if (X < Width)
+			{
+				ConvertRawRR11G11B10DataToFLinearColor(Width - X, 1, (uint8*)(In + X), (Width - X) * sizeof(uint32), Out + X);
+			}
+		}
+
+		// Quantizes a row of linear colors the way the engine FColor converters do.
+		static void LinearToFColorRow(const FLinearColor* In, FColor* Out, int32 Width, bool bLinearToGamma)
+		{
+			for (int32 X = 0; X < Width; ++X)
+			{
+				Out[X] = In[X].ToFColor(bLinearToGamma);
+			}
+		}
+	} // namespace DecodeKernels
+
+	// Runs Function over bands of rows on the task graph. Images too small to
+	// be worth splitting are decoded on the calling thread.
+	template <typename FBandFunction>
+	static void ForEachRowBand(FIntPoint Extent, bool bParallel, FBandFunction&& Function)
+	{
+		constexpr int64 MinBandPixels = 32 * 1024;
+		int32 BandRows = Extent.Y;
+		if (bParallel)
+		{
+			const int32 NumWorkers = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+			const int32 MinBandRows = (int32)FMath::Max<int64>(1, MinBandPixels / FMath::Max(1, Extent.X));
+			BandRows = FMath::Max(MinBandRows, FMath::DivideAndRoundUp(Extent.Y, NumWorkers));
+		}
+		const int32 NumBands = FMath::DivideAndRoundUp(Extent.Y, FMath::Max(1, BandRows));
+		ParallelFor(NumBands, [&](int32 BandIndex) {
+			const int32 FirstRow = BandIndex * BandRows;
+			Function(FirstRow, FMath::Min(BandRows, Extent.Y - FirstRow));
+		}, NumBands > 1 ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+	}
+
+	// Runs an engine converter, Converter(NumRows, In, Out), over bands of rows.
+	template <typename FOutColor, typename FConverter>
+	static void ConvertRowBands(const void* PixelData, int32 SourcePitch, FIntPoint Extent, FOutColor* Out, bool bParallel, FConverter&& Converter)
+	{
+		ForEachRowBand(Extent, bParallel, [&](int32 FirstRow, int32 NumRows) {
+			Converter((uint32)NumRows, (uint8*)PixelData + (int64)FirstRow * SourcePitch, Out + (int64)FirstRow * Extent.X);
+		});
+	}
+
 	bool DecodePixelsByFormat(
 		const void* PixelData,
 		int32 SourcePitch,
 		FIntPoint Extent,
 		EPixelFormat Format,
 		FReadSurfaceDataFlags Flags,
-		TArrayView<FLinearColor> Out)
+		TArrayView<FLinearColor> Out,
+		bool bUseFastPath)
 	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(ImageUtil::DecodePixelsByFormat);
 		SourcePitch *= GPixelFormats[Format].BlockBytes;
-		auto OutPixelCount = Extent.X * Extent.Y;
+		const uint32 Width = Extent.X;
+		const bool bParallel = bUseFastPath;
+		// The engine keeps float values as they are under min/max compression and
+		// normalizes them over the whole image otherwise, which can't be split in
+		// bands. Float formats only take the fast path in the first case.
+		const bool bFloatParallel = bUseFastPath && Flags.GetCompressionMode() == RCM_MinMax;
 		switch (Format)
 		{
 			case PF_G16:
 			case PF_R16_UINT:
 			case PF_R16_SINT:
 				// Shadow maps
-				ConvertRawR16DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR16DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_R8G8B8A8:
-				ConvertRawR8G8B8A8DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR8G8B8A8DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_B8G8R8A8:
-				ConvertRawB8G8R8A8DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawB8G8R8A8DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_A2B10G10R10:
-				ConvertRawA2B10G10R10DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawA2B10G10R10DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_FloatRGBA:
 			case PF_R16G16B16A16_UNORM:
 			case PF_R16G16B16A16_SNORM:
-				ConvertRawR16G16B16A16FDataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags);
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bFloatParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					if (!bFloatParallel)
+					{
+						ConvertRawR16G16B16A16FDataToFLinearColor(Width, NumRows, In, SourcePitch, Dest, Flags);
+						return;
+					}
+					for (uint32 Y = 0; Y < NumRows; ++Y)
+					{
+						DecodeKernels::HalfRGBAToLinearRow((const FFloat16*)(In + (int64)Y * SourcePitch), Dest + (int64)Y * Width, Width);
+					}
+				});
 				break;
 			case PF_FloatR11G11B10:
-				ConvertRawRR11G11B10DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					if (!bUseFastPath)
+					{
+						ConvertRawRR11G11B10DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+						return;
+					}
+					for (uint32 Y = 0; Y < NumRows; ++Y)
+					{
+						DecodeKernels::R11G11B10ToLinearRow((const uint32*)(In + (int64)Y * SourcePitch), Dest + (int64)Y * Width, Width);
+					}
+				});
 				break;
 			case PF_A32B32G32R32F:
-				ConvertRawR32G32B32A32DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags);
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bFloatParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR32G32B32A32DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest, Flags);
+				});
 				break;
 			case PF_A16B16G16R16:
-				ConvertRawR16G16B16A16DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR16G16B16A16DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_G16R16:
-				ConvertRawR16G16DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR16G16DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_X24_G8: // Depth Stencil
-				ConvertRawR24G8DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags);
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR24G8DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest, Flags);
+				});
 				break;
 			case PF_R32_FLOAT: // Depth Stencil
-				ConvertRawR32DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags);
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bFloatParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR32DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest, Flags);
+				});
 				break;
 			case PF_R16G16B16A16_UINT:
 			case PF_R16G16B16A16_SINT:
-				ConvertRawR16G16B16A16DataToFLinearColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FLinearColor* Dest) {
+					ConvertRawR16G16B16A16DataToFLinearColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			default:
 				UE_LOG(LogAerosimConnector, Warning, TEXT("Unsupported format %llu"), (unsigned long long)Format);
@@ -86,70 +361,130 @@ namespace ImageUtil
 		FIntPoint Extent,
 		EPixelFormat Format,
 		FReadSurfaceDataFlags Flags,
-		TArrayView<FColor> Out)
+		TArrayView<FColor> Out,
+		bool bUseFastPath)
 	{
 		TRACE_CPUPROFILER_EVENT_SCOPE(ImageUtil::DecodePixelsByFormat);
 		SourcePitch *= GPixelFormats[Format].BlockBytes;
-		auto OutPixelCount = Extent.X * Extent.Y;
+		const uint32 Width = Extent.X;
+		const bool bParallel = bUseFastPath;
+		const bool bLinearToGamma = Flags.GetLinearToGamma();
 		switch (Format)
 		{
 			case PF_G16:
 			case PF_R16_UINT:
 			case PF_R16_SINT:
 				// Shadow maps
-				ConvertRawR16DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR16DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_R8G8B8A8:
-				ConvertRawR8G8B8A8DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR8G8B8A8DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_B8G8R8A8:
-				ConvertRawB8G8R8A8DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				// Row copies, splitting them in bands is all there is to speed up.
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawB8G8R8A8DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_A2B10G10R10:
-				ConvertRawR10G10B10A2DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR10G10B10A2DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_FloatRGBA:
 			case PF_R16G16B16A16_UNORM:
 			case PF_R16G16B16A16_SNORM:
-				ConvertRawR16G16B16A16FDataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags.GetLinearToGamma());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					if (!bUseFastPath)
+					{
+						ConvertRawR16G16B16A16FDataToFColor(Width, NumRows, In, SourcePitch, Dest, bLinearToGamma);
+						return;
+					}
+					// Per worker thread, this lambda runs on the band's worker.
+					static thread_local TArray<FLinearColor> RowBuffer;
+					RowBuffer.SetNumUninitialized(Width, EAllowShrinking::No);
+					for (uint32 Y = 0; Y < NumRows; ++Y)
+					{
+						DecodeKernels::HalfRGBAToLinearRow((const FFloat16*)(In + (int64)Y * SourcePitch), RowBuffer.GetData(), Width);
+						DecodeKernels::LinearToFColorRow(RowBuffer.GetData(), Dest + (int64)Y * Width, Width, bLinearToGamma);
+					}
+				});
 				break;
 			case PF_FloatR11G11B10:
-				ConvertRawR11G11B10DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags.GetLinearToGamma());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					if (!bUseFastPath)
+					{
+						ConvertRawR11G11B10DataToFColor(Width, NumRows, In, SourcePitch, Dest, bLinearToGamma);
+						return;
+					}
+					static thread_local TArray<FLinearColor> RowBuffer;
+					RowBuffer.SetNumUninitialized(Width, EAllowShrinking::No);
+					for (uint32 Y = 0; Y < NumRows; ++Y)
+					{
+						DecodeKernels::R11G11B10ToLinearRow((const uint32*)(In + (int64)Y * SourcePitch), RowBuffer.GetData(), Width);
+						DecodeKernels::LinearToFColorRow(RowBuffer.GetData(), Dest + (int64)Y * Width, Width, bLinearToGamma);
+					}
+				});
 				break;
 			case PF_A32B32G32R32F:
-				ConvertRawR32G32B32A32DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags.GetLinearToGamma());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR32G32B32A32DataToFColor(Width, NumRows, In, SourcePitch, Dest, bLinearToGamma);
+				});
 				break;
 			case PF_A16B16G16R16:
-				ConvertRawR16G16B16A16DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR16G16B16A16DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_G16R16:
-				ConvertRawR16G16DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR16G16DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_DepthStencil: // Depth / Stencil
-				ConvertRawD32S8DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags);
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawD32S8DataToFColor(Width, NumRows, In, SourcePitch, Dest, Flags);
+				});
 				break;
 			case PF_X24_G8: // Depth / Stencil
-				ConvertRawR24G8DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData(), Flags);
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR24G8DataToFColor(Width, NumRows, In, SourcePitch, Dest, Flags);
+				});
 				break;
 			case PF_R32_FLOAT: // Depth
-				for (uint32 Y = 0; Y < (uint32)Extent.Y; Y++)
-				{
-					auto SrcPtr = (float*)((uint8*)PixelData + Y * SourcePitch);
-					auto DestPtr = Out.GetData() + Y * Extent.X;
-					for (uint32 X = 0; X < (uint32)Extent.X; X++)
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					for (uint32 Y = 0; Y < NumRows; ++Y)
 					{
-						*DestPtr = FLinearColor(SrcPtr[0], 0.f, 0.f, 1.f).QuantizeRound();
-						++SrcPtr;
-						++DestPtr;
+						const float* SrcPtr = (const float*)(In + (int64)Y * SourcePitch);
+						FColor* DestPtr = Dest + (int64)Y * Width;
+						if (bUseFastPath)
+						{
+							DecodeKernels::R32FToFColorRow(SrcPtr, DestPtr, Width);
+							continue;
+						}
+						for (uint32 X = 0; X < Width; X++)
+						{
+							*DestPtr = FLinearColor(SrcPtr[0], 0.f, 0.f, 1.f).QuantizeRound();
+							++SrcPtr;
+							++DestPtr;
+						}
 					}
-				}
+				});
 				break;
 			case PF_R16G16B16A16_UINT:
 			case PF_R16G16B16A16_SINT:
-				ConvertRawR16G16B16A16DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR16G16B16A16DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			case PF_G8:
-				ConvertRawR8DataToFColor(Extent.X, Extent.Y, (uint8*)PixelData, SourcePitch, Out.GetData());
+				ConvertRowBands(PixelData, SourcePitch, Extent, Out.GetData(), bParallel, [&](uint32 NumRows, uint8* In, FColor* Dest) {
+					ConvertRawR8DataToFColor(Width, NumRows, In, SourcePitch, Dest);
+				});
 				break;
 			default:
 				UE_LOG(LogAerosimConnector, Warning, TEXT("Unsupported format %llu"), (unsigned long long)Format);
@@ -158,6 +493,23 @@ namespace ImageUtil
 		return true;
 	}
 
+	void StripRowPitch(
+		const void* PixelData,
+		int32 SourcePitch,
+		FIntPoint Extent,
+		int32 BytesPerPixel,
+		void* Out)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(ImageUtil::StripRowPitch);
+		const int64 RowBytes = (int64)Extent.X * BytesPerPixel;
+		ForEachRowBand(Extent, true, [&](int32 FirstRow, int32 NumRows) {
+			for (int32 Y = FirstRow; Y < FirstRow + NumRows; ++Y)
+			{
+				FMemory::Memcpy((uint8*)Out + Y * RowBytes, (const uint8*)PixelData + (int64)Y * SourcePitch, RowBytes);
+			}
+		});
+	}
+
 	bool ReadImageData(
 		UTextureRenderTarget2D& RenderTarget,
 		TArray<FColor>& Out)
@@ -187,8 +539,11 @@ namespace ImageUtil
 			RenderTarget.GetSurfaceWidth(),
 			RenderTarget.GetSurfaceHeight());
 		auto PixelData = MakeUnique<TImagePixelData<FColor>>(Size);
-		ReadImageData(RenderTarget, PixelData->Pixels);
-		return TUniquePtr<TImagePixelData<FColor>>();
+		if (!ReadImageData(RenderTarget, PixelData->Pixels))
+		{
+			return nullptr;
+		}
+		return PixelData;
 	}
 
 	TFuture<bool> SaveImageData(
@@ -202,6 +557,11 @@ namespace ImageUtil
 		TUniquePtr<TImagePixelData<FColor>> Data,
 		const FStringView& Path)
 	{
+		// A failed read has no pixels, the write task would dereference them.
+		if (!Data.IsValid())
+		{
+			return MakeFulfilledPromise<bool>(false).GetFuture();
+		}
 		auto& HighResScreenshotConfig = GetHighResScreenshotConfig();
 		auto ImageTask = MakeUnique<FImageWriteTask>();
 		ImageTask->PixelData = MoveTemp(Data);
@@ -218,37 +578,39 @@ namespace ImageUtil
 		EPixelFormat Format;
 		FIntPoint Size;
 		ReadImageDataAsyncCallback Callback;
+		ReadImageDataAsyncCallbackLease LeaseCallback;
 		TUniquePtr<FRHIGPUTextureReadback> Readback;
 	};
 
-	static void ReadImageDataBegin(
+	static bool ReadImageDataBegin(
 		ReadImageDataContext& Self,
-		UTextureRenderTarget2D& RenderTarget,
-		ReadImageDataAsyncCallback&& Callback)
+		UTextureRenderTarget2D& RenderTarget)
 	{
-		static thread_local auto RenderQueryPool =
-			RHICreateRenderQueryPool(RQT_AbsoluteTime);
-
 		auto& CmdList = FRHICommandListImmediate::Get();
 		auto Resource = static_cast<FTextureRenderTarget2DResource*>(
 			RenderTarget.GetResource());
+		if (Resource == nullptr)
+			return false;
 		auto Texture = Resource->GetRenderTargetTexture();
 		if (Texture == nullptr)
-			return;
-		Self.Callback = std::move(Callback);
+			return false;
 		Self.Readback = MakeUnique<FRHIGPUTextureReadback>(
 			TEXT("ReadImageData-Readback"));
 		Self.Size = Texture->GetSizeXY();
 		Self.Format = Texture->GetFormat();
 		auto ResolveRect = FResolveRect();
+		// The copy is only enqueued here, completion is detected by the
+		// FReadbackPoller at the end of a later render frame.
 		Self.Readback->EnqueueCopy(CmdList, Texture, ResolveRect);
+		return true;
+	}
 
-		auto Query = RenderQueryPool->AllocateQuery();
-		CmdList.EndRenderQuery(Query.GetQuery());
-		CmdList.ImmediateFlush(EImmediateFlushType::FlushRHIThread);
-		uint64 DeltaTime;
-		RHIGetRenderQueryResult(Query.GetQuery(), DeltaTime, true);
-		Query.ReleaseQuery();
+	// Tells a lease callee that its read failed, so it doesn't wait for it.
+	static void ReadImageDataFailed(
+		ReadImageDataContext& Self)
+	{
+		if (Self.LeaseCallback)
+			Self.LeaseCallback(nullptr, 0, FIntPoint::ZeroValue, PF_Unknown, [] {});
 	}
 
 	static void ReadImageDataEnd(
@@ -256,7 +618,25 @@ namespace ImageUtil
 	{
 		int32 RowPitch, BufferHeight;
 		auto MappedPtr = Self.Readback->Lock(RowPitch, &BufferHeight);
-		if (MappedPtr != nullptr)
+		if (MappedPtr == nullptr)
+		{
+			ReadImageDataFailed(Self);
+			return;
+		}
+		if (Self.LeaseCallback)
+		{
+			// The readback stays locked until the callee releases it. It is held
+			// by raw pointer so that discarding the release function without
+			// calling it (e.g. on shutdown, once the RHI is gone) leaks it instead.
+			FRHIGPUTextureReadback* Readback = Self.Readback.Release();
+			TUniqueFunction<void()> Release = [Readback] {
+				Readback->Unlock();
+				delete Readback;
+			};
+			const int32 RowStride = RowPitch * GPixelFormats[Self.Format].BlockBytes;
+			Self.LeaseCallback(MappedPtr, RowStride, Self.Size, Self.Format, MoveTemp(Release));
+		}
+		else
 		{
 			ScopedCallback Unlock = [&] { Self.Readback->Unlock(); };
 			Self.Callback(MappedPtr, RowPitch, BufferHeight, Self.Format, Self.Size);
@@ -266,10 +646,11 @@ namespace ImageUtil
 	static void ReadImageDataEndAsync(
 		ReadImageDataContext&& Self)
 	{
-		AsyncTask(
-			ENamedThreads::HighTaskPriority, [Self = std::move(Self)]() mutable {
-				while (!Self.Readback->IsReady())
-					std::this_thread::yield();
+		auto PendingReadback = MoveTemp(Self.Readback);
+		FReadbackPoller::Get().Enqueue(
+			MoveTemp(PendingReadback),
+			[Self = std::move(Self)](TUniquePtr<FRHIGPUTextureReadback>&& Readback) mutable {
+				Self.Readback = MoveTemp(Readback);
 				ReadImageDataEnd(Self);
 			});
 	}
@@ -279,8 +660,21 @@ namespace ImageUtil
 		ReadImageDataAsyncCallback&& Callback)
 	{
 		ReadImageDataContext Context = {};
-		ReadImageDataBegin(Context, RenderTarget, std::move(Callback));
-		ReadImageDataEndAsync(std::move(Context));
+		Context.Callback = std::move(Callback);
+		if (ReadImageDataBegin(Context, RenderTarget))
+			ReadImageDataEndAsync(std::move(Context));
+	}
+
+	static void ReadImageDataAsyncLeaseCommand(
+		UTextureRenderTarget2D& RenderTarget,
+		ReadImageDataAsyncCallbackLease&& Callback)
+	{
+		ReadImageDataContext Context = {};
+		Context.LeaseCallback = std::move(Callback);
+		if (ReadImageDataBegin(Context, RenderTarget))
+			ReadImageDataEndAsync(std::move(Context));
+		else
+			ReadImageDataFailed(Context);
 	}
 
 	bool ReadImageDataAsync(
@@ -296,9 +690,7 @@ namespace ImageUtil
 		else
 		{
 			ENQUEUE_RENDER_COMMAND(ReadImageDataAsyncCmd)([&RenderTarget, Callback = std::move(Callback)](auto& CmdList) mutable {
-				ReadImageDataContext Context = {};
-				ReadImageDataBegin(Context, RenderTarget, std::move(Callback));
-				ReadImageDataEnd(Context);
+				ReadImageDataAsyncCommand(RenderTarget, std::move(Callback));
 			});
 		}
 		return true;
@@ -385,7 +777,6 @@ namespace ImageUtil
 		return ReadImageDataAsync(RenderTarget, [Callback = std::move(Callback)](const void* Mapping, size_t RowPitch, size_t BufferHeight, EPixelFormat Format, FIntPoint Size) -> bool {
 			TRACE_CPUPROFILER_EVENT_SCOPE(ImageUtils::ReadImageDataAsync);
 			
-			uint32 Height = Size.Y;
 			uint32 Width = Size.X;
 			const uint32 DstPitch = Width * sizeof(FColor);
 			const uint32 SourcePitch = RowPitch * GPixelFormats[Format].BlockBytes;
@@ -402,22 +793,68 @@ namespace ImageUtil
 				// Pitch --> Number of bytes per image row.
 				TArray<FColor> Pixels;
 				Pixels.SetNumUninitialized(Size.X * Size.Y);
-				uint8* In = (uint8*)Mapping;
 				FColor* Out = Pixels.GetData();
 				// Check if Source pitch is bigger than Dst Pitch to avoid rise conditions while copying. Source Pitch should be equal or less than DestPitch. 
 				// Pitch means number of bytes per image row according to Unreal, this code is based on ConvertRawB8G8R8A8DataToFColor function from engine can be found on RHISurfaceDataConversion.h
 				check(SourcePitch > DstPitch);
 
-				ParallelFor(Height, [&](int32 Y)
-				{
-					FColor* SrcPtr = (FColor*)(In + Y * SourcePitch);
-					FColor* DestPtr = Out + Y * Width;
-					FMemory::Memcpy(DestPtr, SrcPtr, DstPitch);
-				});
+				StripRowPitch(Mapping, SourcePitch, Size, sizeof(FColor), Out);
 
 				return Callback((void*)Out, Size);
 			}
 		});
 	}
 
+	bool ReadSensorDataAsyncStrided(
+		ACameraSensor* Sensor,
+		ReadImageDataAsyncCallbackStrided&& Callback)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(ImageUtil::ReadSensorDataAsyncStrided);
+		auto RenderTarget = Sensor->GetRenderTarget();
+		if (RenderTarget == nullptr)
+			return false;
+		return ReadImageDataAsyncStrided(*RenderTarget, std::move(Callback));
+	}
+
+	bool ReadImageDataAsyncStrided(
+		UTextureRenderTarget2D& RenderTarget,
+		ReadImageDataAsyncCallbackStrided&& Callback)
+	{
+		return ReadImageDataAsync(RenderTarget, [Callback = std::move(Callback)](const void* Mapping, size_t RowPitch, size_t BufferHeight, EPixelFormat Format, FIntPoint Size) -> bool {
+			// RowPitch is given in pixels (blocks), consumers want bytes.
+			const int32 RowStride = (int32)RowPitch * GPixelFormats[Format].BlockBytes;
+			return Callback(Mapping, RowStride, Size, Format);
+		});
+	}
+
+	bool ReadSensorDataAsyncLease(
+		ACameraSensor* Sensor,
+		ReadImageDataAsyncCallbackLease&& Callback)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(ImageUtil::ReadSensorDataAsyncLease);
+		auto RenderTarget = Sensor->GetRenderTarget();
+		if (RenderTarget == nullptr)
+			return false;
+		return ReadImageDataAsyncLease(*RenderTarget, std::move(Callback));
+	}
+
+	bool ReadImageDataAsyncLease(
+		UTextureRenderTarget2D& RenderTarget,
+		ReadImageDataAsyncCallbackLease&& Callback)
+	{
+		if (IsInRenderingThread())
+		{
+			ReadImageDataAsyncLeaseCommand(
+				RenderTarget,
+				std::move(Callback));
+		}
+		else
+		{
+			ENQUEUE_RENDER_COMMAND(ReadImageDataAsyncLeaseCmd)([&RenderTarget, Callback = std::move(Callback)](auto& CmdList) mutable {
+				ReadImageDataAsyncLeaseCommand(RenderTarget, std::move(Callback));
+			});
+		}
+		return true;
+	}
+
 } // namespace ImageUtil
@@ -0,0 +1,108 @@
+#include "Render/LabelRLE.h"
+#include "Render/ImagePublisher.h"
+
+namespace LabelRLE
+{
+	static uint8* WriteRun(uint8* Cursor, uint8 Label, uint64 Length)
+	{
+		*Cursor++ = Label;
+		while (Length >= 0x80)
+		{
+			*Cursor++ = (uint8)(Length | 0x80);
+			Length >>= 7;
+		}
+		*Cursor++ = (uint8)Length;
+		return Cursor;
+	}
+
+	int64 GetMaxEncodedBytes(FIntPoint Size)
+	{
+		// A run of N pixels takes 1 + ceil(bits(N) / 7) <= 1 + N bytes.
+		return 2 * (int64)Size.X * Size.Y;
+	}
+
+	int32 GetRunLength(const uint8* Data, int32 Count)
+	{
+		// Compare 8 labels at a time, the first differing byte of a
+		// little-endian word is its lowest non-zero byte.
+		const uint64 Pattern = 0x0101010101010101ull * Data[0];
+		int32 Length = 0;
+		for (; Length + 8 <= Count; Length += 8)
+		{
+			uint64 Word;
+			FMemory::Memcpy(&Word, Data + Length, sizeof(Word));
+			const uint64 Diff = Word ^ Pattern;
+			if (Diff != 0)
+				return Length + (int32)(FMath::CountTrailingZeros64(Diff) >> 3);
+		}
+		while (Length < Count && Data[Length] == Data[0])
+		{
+			++Length;
+		}
+		return Length;
+	}
+
+	int64 Encode(const FImageView& Labels, uint8* Out)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(LabelRLE::Encode);
+		check(Labels.BytesPerPixel == 1);
+
+		uint8* Cursor = Out;
+		uint8 Label = 0;
+		uint64 Length = 0;
+		for (int32 Y = 0; Y < Labels.Size.Y; ++Y)
+		{
+			const uint8* Row = Labels.GetRow(Y);
+			int32 X = 0;
+			while (X < Labels.Size.X)
+			{
+				const int32 RunLength = GetRunLength(Row + X, Labels.Size.X - X);
+				if (Length > 0 && Row[X] == Label)
+				{
+					// The run goes on from the previous row.
+					Length += RunLength;
+				}
+				else
+				{
+					if (Length > 0)
+						Cursor = WriteRun(Cursor, Label, Length);
+					Label = Row[X];
+					Length = RunLength;
+				}
+				X += RunLength;
+			}
+		}
+		if (Length > 0)
+			Cursor = WriteRun(Cursor, Label, Length);
+		return Cursor - Out;
+	}
+
+	bool Decode(const uint8* Runs, int64 Bytes, uint8* Out, int64 NumPixels)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(LabelRLE::Decode);
+
+		const uint8* End = Runs + Bytes;
+		int64 Decoded = 0;
+		while (Runs < End)
+		{
+			const uint8 Label = *Runs++;
+			uint64 Length = 0;
+			uint8 Byte = 0;
+			int32 Shift = 0;
+			do
+			{
+				if (Runs == End || Shift > 56)
+					return false;
+				Byte = *Runs++;
+				Length |= (uint64)(Byte & 0x7F) << Shift;
+				Shift += 7;
+			} while (Byte & 0x80);
+
+			if (Length == 0 || Length > (uint64)(NumPixels - Decoded))
+				return false;
+			FMemory::Memset(Out + Decoded, Label, Length);
+			Decoded += Length;
+		}
+		return Decoded == NumPixels;
+	}
+} // namespace LabelRLE
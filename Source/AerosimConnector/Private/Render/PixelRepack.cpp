@@ -0,0 +1,459 @@
+#include "Render/PixelRepack.h"
+#include "Render/ImagePublisher.h"
+#include "AerosimConnector.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+	#define AEROSIM_REPACK_NEON 1
+	#include <arm_neon.h>
+#elif PLATFORM_ENABLE_VECTORINTRINSICS && PLATFORM_ALWAYS_HAS_SSE4_1
+	#define AEROSIM_REPACK_SSE 1
+	#include <immintrin.h>
+	#if defined(__AVX2__)
+		#define AEROSIM_REPACK_AVX2 1
+	#endif
+#endif
+
+#ifndef AEROSIM_REPACK_NEON
+	#define AEROSIM_REPACK_NEON 0
+#endif
+#ifndef AEROSIM_REPACK_SSE
+	#define AEROSIM_REPACK_SSE 0
+#endif
+#ifndef AEROSIM_REPACK_AVX2
+	#define AEROSIM_REPACK_AVX2 0
+#endif
+
+DECLARE_CYCLE_STAT(TEXT("Pixel Repack"), STAT_AerosimPixelRepack, STATGROUP_AerosimConnector);
+
+// BT.601 limited range, 8-bit fixed point. Every kernel below produces the
+// exact same bytes as the scalar reference ones.
+//   Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16
+//   U = ((-38 R - 74 G + 112 B + 256) >> 9) + 128
+//   V = ((112 R - 94 G - 18 B + 256) >> 9) + 128
+// where the chroma R, G, B are the sum of the two rounded vertical averages
+// of a 2x2 block, hence the extra bit of shift.
+namespace PixelRepack
+{
+	namespace Scalar
+	{
+		static FORCEINLINE uint8 Luma(int32 B, int32 G, int32 R)
+		{
+			return (uint8)(((66 * R + 129 * G + 25 * B + 128) >> 8) + 16);
+		}
+
+		static void RowToRGB(const uint8* In, uint8* Out, int32 Width)
+		{
+			for (int32 X = 0; X < Width; ++X)
+			{
+				Out[3 * X + 0] = In[4 * X + 2];
+				Out[3 * X + 1] = In[4 * X + 1];
+				Out[3 * X + 2] = In[4 * X + 0];
+			}
+		}
+
+		static void RowToY(const uint8* In, uint8* Out, int32 Width)
+		{
+			for (int32 X = 0; X < Width; ++X)
+			{
+				Out[X] = Luma(In[4 * X + 0], In[4 * X + 1], In[4 * X + 2]);
+			}
+		}
+
+		static void RowsToUV(const uint8* In0, const uint8* In1, uint8* OutU, uint8* OutV, int32 Step, int32 NumChroma)
+		{
+			for (int32 C = 0; C < NumChroma; ++C)
+			{
+				const uint8* A = In0 + 8 * C;
+				const uint8* B = In1 + 8 * C;
+				int32 Sum[3];
+				for (int32 Channel = 0; Channel < 3; ++Channel)
+				{
+					Sum[Channel] = ((A[Channel] + B[Channel] + 1) >> 1) + ((A[4 + Channel] + B[4 + Channel] + 1) >> 1);
+				}
+				OutU[C * Step] = (uint8)FMath::Clamp(((112 * Sum[0] - 74 * Sum[1] - 38 * Sum[2] + 256) >> 9) + 128, 0, 255);
+				OutV[C * Step] = (uint8)FMath::Clamp(((-18 * Sum[0] - 94 * Sum[1] + 112 * Sum[2] + 256) >> 9) + 128, 0, 255);
+			}
+		}
+	} // namespace Scalar
+
+	// Vector kernels return the number of pixels (or chroma samples) they
+	// converted, the scalar kernels take care of the rest of the row.
+	namespace Vector
+	{
+#if AEROSIM_REPACK_SSE
+		static FORCEINLINE __m128i Luma4(__m128i Pixels, __m128i Coeffs)
+		{
+			const __m128i Zero = _mm_setzero_si128();
+			const __m128i Lo = _mm_madd_epi16(_mm_unpacklo_epi8(Pixels, Zero), Coeffs);
+			const __m128i Hi = _mm_madd_epi16(_mm_unpackhi_epi8(Pixels, Zero), Coeffs);
+			const __m128i Sum = _mm_hadd_epi32(Lo, Hi);
+			return _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(Sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+		}
+
+		// Sums the rounded vertical averages of two horizontal pixel pairs,
+		// as [B G R A] of pair 0 followed by [B G R A] of pair 1 in 16 bits.
+		static FORCEINLINE __m128i ChromaSums(const uint8* In0, const uint8* In1)
+		{
+			const __m128i Zero = _mm_setzero_si128();
+			const __m128i Avg = _mm_avg_epu8(
+				_mm_loadu_si128((const __m128i*)In0),
+				_mm_loadu_si128((const __m128i*)In1));
+			const __m128i Lo = _mm_unpacklo_epi8(Avg, Zero);
+			const __m128i Hi = _mm_unpackhi_epi8(Avg, Zero);
+			return _mm_unpacklo_epi64(
+				_mm_add_epi16(Lo, _mm_srli_si128(Lo, 8)),
+				_mm_add_epi16(Hi, _mm_srli_si128(Hi, 8)));
+		}
+
+		static FORCEINLINE __m128i Chroma4(__m128i Sums0, __m128i Sums1, __m128i Coeffs)
+		{
+			const __m128i Sum = _mm_hadd_epi32(_mm_madd_epi16(Sums0, Coeffs), _mm_madd_epi16(Sums1, Coeffs));
+			return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(Sum, _mm_set1_epi32(256)), 9), _mm_set1_epi32(128));
+		}
+#endif
+
+#if AEROSIM_REPACK_AVX2
+		static FORCEINLINE __m256i Luma8(const uint8* In, __m256i Coeffs)
+		{
+			const __m256i Lo = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)In)), Coeffs);
+			const __m256i Hi = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(In + 16))), Coeffs);
+			// hadd works within 128-bit lanes, which leaves the pixels as 0 1 4 5 2 3 6 7.
+			const __m256i Sum = _mm256_permute4x64_epi64(_mm256_hadd_epi32(Lo, Hi), _MM_SHUFFLE(3, 1, 2, 0));
+			return _mm256_add_epi32(_mm256_srli_epi32(_mm256_add_epi32(Sum, _mm256_set1_epi32(128)), 8), _mm256_set1_epi32(16));
+		}
+#endif
+
+		static int32 RowToRGB(const uint8* In, uint8* Out, int32 Width)
+		{
+			int32 X = 0;
+#if AEROSIM_REPACK_AVX2
+			{
+				const __m256i Shuffle = _mm256_setr_epi8(
+					2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+					2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+				// Each 16-byte store spills 4 bytes past its 12 valid ones, keep
+				// those inside the row so the next iteration overwrites them.
+				for (; X + 10 <= Width; X += 8)
+				{
+					const __m256i Packed = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(In + 4 * X)), Shuffle);
+					_mm_storeu_si128((__m128i*)(Out + 3 * X), _mm256_castsi256_si128(Packed));
+					_mm_storeu_si128((__m128i*)(Out + 3 * X + 12), _mm256_extracti128_si256(Packed, 1));
+				}
+			}
+#endif
+#if AEROSIM_REPACK_SSE
+			{
+				const __m128i Shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+				for (; X + 6 <= Width; X += 4)
+				{
+					const __m128i Pixels = _mm_loadu_si128((const __m128i*)(In + 4 * X));
+					_mm_storeu_si128((__m128i*)(Out + 3 * X), _mm_shuffle_epi8(Pixels, Shuffle));
+				}
+			}
+#elif AEROSIM_REPACK_NEON
+			for (; X + 16 <= Width; X += 16)
+			{
+				const uint8x16x4_t Pixels = vld4q_u8(In + 4 * X);
+				uint8x16x3_t Packed;
+				Packed.val[0] = Pixels.val[2];
+				Packed.val[1] = Pixels.val[1];
+				Packed.val[2] = Pixels.val[0];
+				vst3q_u8(Out + 3 * X, Packed);
+			}
+#endif
+			return X;
+		}
+
+		static int32 RowToY(const uint8* In, uint8* Out, int32 Width)
+		{
+			int32 X = 0;
+#if AEROSIM_REPACK_AVX2
+			{
+				const __m256i Coeffs = _mm256_setr_epi16(
+					25, 129, 66, 0, 25, 129, 66, 0,
+					25, 129, 66, 0, 25, 129, 66, 0);
+				for (; X + 16 <= Width; X += 16)
+				{
+					const __m256i Luma0 = Luma8(In + 4 * X, Coeffs);
+					const __m256i Luma1 = Luma8(In + 4 * X + 32, Coeffs);
+					const __m256i Luma16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(Luma0, Luma1), _MM_SHUFFLE(3, 1, 2, 0));
+					_mm_storeu_si128((__m128i*)(Out + X), _mm_packus_epi16(_mm256_castsi256_si128(Luma16), _mm256_extracti128_si256(Luma16, 1)));
+				}
+			}
+#endif
+#if AEROSIM_REPACK_SSE
+			{
+				const __m128i Coeffs = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+				for (; X + 16 <= Width; X += 16)
+				{
+					const __m128i* Pixels = (const __m128i*)(In + 4 * X);
+					const __m128i Luma0 = Luma4(_mm_loadu_si128(Pixels + 0), Coeffs);
+					const __m128i Luma1 = Luma4(_mm_loadu_si128(Pixels + 1), Coeffs);
+					const __m128i Luma2 = Luma4(_mm_loadu_si128(Pixels + 2), Coeffs);
+					const __m128i Luma3 = Luma4(_mm_loadu_si128(Pixels + 3), Coeffs);
+					_mm_storeu_si128((__m128i*)(Out + X), _mm_packus_epi16(
+						_mm_packs_epi32(Luma0, Luma1),
+						_mm_packs_epi32(Luma2, Luma3)));
+				}
+			}
+#elif AEROSIM_REPACK_NEON
+			for (; X + 16 <= Width; X += 16)
+			{
+				const uint8x16x4_t Pixels = vld4q_u8(In + 4 * X);
+				uint16x8_t Lo = vmull_u8(vget_low_u8(Pixels.val[2]), vdup_n_u8(66));
+				Lo = vmlal_u8(Lo, vget_low_u8(Pixels.val[1]), vdup_n_u8(129));
+				Lo = vmlal_u8(Lo, vget_low_u8(Pixels.val[0]), vdup_n_u8(25));
+				uint16x8_t Hi = vmull_u8(vget_high_u8(Pixels.val[2]), vdup_n_u8(66));
+				Hi = vmlal_u8(Hi, vget_high_u8(Pixels.val[1]), vdup_n_u8(129));
+				Hi = vmlal_u8(Hi, vget_high_u8(Pixels.val[0]), vdup_n_u8(25));
+				// vrshrn adds 128 before shifting by 8.
+				const uint8x16_t Luma = vcombine_u8(vrshrn_n_u16(Lo, 8), vrshrn_n_u16(Hi, 8));
+				vst1q_u8(Out + X, vaddq_u8(Luma, vdupq_n_u8(16)));
+			}
+#endif
+			return X;
+		}
+
+		static int32 RowsToUV(const uint8* In0, const uint8* In1, uint8* OutU, uint8* OutV, bool bInterleaved, int32 NumChroma)
+		{
+			int32 C = 0;
+#if AEROSIM_REPACK_SSE
+			const __m128i UCoeffs = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+			const __m128i VCoeffs = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+			const __m128i Interleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+			for (; C + 4 <= NumChroma; C += 4)
+			{
+				const __m128i Sums0 = ChromaSums(In0 + 8 * C, In1 + 8 * C);
+				const __m128i Sums1 = ChromaSums(In0 + 8 * C + 16, In1 + 8 * C + 16);
+				const __m128i U = Chroma4(Sums0, Sums1, UCoeffs);
+				const __m128i V = Chroma4(Sums0, Sums1, VCoeffs);
+				// U0 U1 U2 U3 V0 V1 V2 V3 in the low 8 bytes.
+				const __m128i UV = _mm_packus_epi16(_mm_packs_epi32(U, V), _mm_setzero_si128());
+				if (bInterleaved)
+				{
+					_mm_storel_epi64((__m128i*)(OutU + 2 * C), _mm_shuffle_epi8(UV, Interleave));
+				}
+				else
+				{
+					const int32 U4 = _mm_cvtsi128_si32(UV);
+					const int32 V4 = _mm_extract_epi32(UV, 1);
+					FMemory::Memcpy(OutU + C, &U4, 4);
+					FMemory::Memcpy(OutV + C, &V4, 4);
+				}
+			}
+#elif AEROSIM_REPACK_NEON
+			for (; C + 4 <= NumChroma; C += 4)
+			{
+				const uint8x8x4_t Row0 = vld4_u8(In0 + 8 * C);
+				const uint8x8x4_t Row1 = vld4_u8(In1 + 8 * C);
+				const int16x4_t B = vreinterpret_s16_u16(vpaddl_u8(vrhadd_u8(Row0.val[0], Row1.val[0])));
+				const int16x4_t G = vreinterpret_s16_u16(vpaddl_u8(vrhadd_u8(Row0.val[1], Row1.val[1])));
+				const int16x4_t R = vreinterpret_s16_u16(vpaddl_u8(vrhadd_u8(Row0.val[2], Row1.val[2])));
+				int32x4_t U = vmull_n_s16(B, 112);
+				U = vmlsl_n_s16(U, G, 74);
+				U = vmlsl_n_s16(U, R, 38);
+				int32x4_t V = vmull_n_s16(R, 112);
+				V = vmlsl_n_s16(V, G, 94);
+				V = vmlsl_n_s16(V, B, 18);
+				// vrshrq adds 256 before shifting by 9.
+				const int32x4_t Offset = vdupq_n_s32(128);
+				const uint16x4_t U16 = vqmovun_s32(vaddq_s32(vrshrq_n_s32(U, 9), Offset));
+				const uint16x4_t V16 = vqmovun_s32(vaddq_s32(vrshrq_n_s32(V, 9), Offset));
+				const uint8x8_t U8 = vqmovn_u16(vcombine_u16(U16, U16));
+				const uint8x8_t V8 = vqmovn_u16(vcombine_u16(V16, V16));
+				if (bInterleaved)
+				{
+					vst1_u8(OutU + 2 * C, vzip_u8(U8, V8).val[0]);
+				}
+				else
+				{
+					vst1_lane_u32((uint32_t*)(OutU + C), vreinterpret_u32_u8(U8), 0);
+					vst1_lane_u32((uint32_t*)(OutV + C), vreinterpret_u32_u8(V8), 0);
+				}
+			}
+#endif
+			return C;
+		}
+	} // namespace Vector
+
+	static void RowToRGB(const uint8* In, uint8* Out, int32 Width, bool bUseVectorKernels)
+	{
+		const int32 X = bUseVectorKernels ? Vector::RowToRGB(In, Out, Width) : 0;
+		Scalar::RowToRGB(In + 4 * X, Out + 3 * X, Width - X);
+	}
+
+	static void RowToY(const uint8* In, uint8* Out, int32 Width, bool bUseVectorKernels)
+	{
+		const int32 X = bUseVectorKernels ? Vector::RowToY(In, Out, Width) : 0;
+		Scalar::RowToY(In + 4 * X, Out + X, Width - X);
+	}
+
+	static void RowsToUV(const uint8* In0, const uint8* In1, uint8* OutU, uint8* OutV, bool bInterleaved, int32 NumChroma, bool bUseVectorKernels)
+	{
+		const int32 C = bUseVectorKernels ? Vector::RowsToUV(In0, In1, OutU, OutV, bInterleaved, NumChroma) : 0;
+		const int32 Step = bInterleaved ? 2 : 1;
+		Scalar::RowsToUV(In0 + 8 * C, In1 + 8 * C, OutU + C * Step, OutV + C * Step, Step, NumChroma - C);
+	}
+
+	const TCHAR* GetLayoutName(EPixelLayout Layout)
+	{
+		switch (Layout)
+		{
+			case EPixelLayout::RGB8:
+				return TEXT("rgb8");
+			case EPixelLayout::NV12:
+				return TEXT("nv12");
+			case EPixelLayout::I420:
+				return TEXT("i420");
+			case EPixelLayout::Y8:
+				return TEXT("y8");
+			case EPixelLayout::R32F:
+				return TEXT("r32f");
+			case EPixelLayout::R16:
+				return TEXT("r16");
+			case EPixelLayout::XYZI32F:
+				return TEXT("xyzi32f");
+			default:
+				return TEXT("bgra8");
+		}
+	}
+
+	const TCHAR* GetVectorKernelName()
+	{
+#if AEROSIM_REPACK_AVX2
+		return TEXT("AVX2");
+#elif AEROSIM_REPACK_SSE
+		return TEXT("SSE4.1");
+#elif AEROSIM_REPACK_NEON
+		return TEXT("NEON");
+#else
+		return TEXT("Scalar");
+#endif
+	}
+
+	bool IsSupported(EPixelLayout Layout, FIntPoint Size)
+	{
+		if (Layout == EPixelLayout::NV12 || Layout == EPixelLayout::I420)
+			return Size.X % 2 == 0 && Size.Y % 2 == 0;
+		return Layout != EPixelLayout::R32F && Layout != EPixelLayout::R16 && Layout != EPixelLayout::XYZI32F;
+	}
+
+	FImageView GetPackedView(EPixelLayout Layout, FIntPoint Size, const uint8* Data)
+	{
+		FImageView View;
+		View.Data = Data;
+		View.Size = Size;
+		switch (Layout)
+		{
+			case EPixelLayout::RGB8:
+				View.BytesPerPixel = 3;
+				break;
+			case EPixelLayout::Y8:
+				View.BytesPerPixel = 1;
+				break;
+			case EPixelLayout::R16:
+				View.BytesPerPixel = 2;
+				break;
+			case EPixelLayout::XYZI32F:
+				View.BytesPerPixel = 16;
+				break;
+			case EPixelLayout::NV12:
+			case EPixelLayout::I420:
+				View.BytesPerPixel = 1;
+				View.Size.Y = Size.Y * 3 / 2;
+				break;
+			default:
+				View.BytesPerPixel = 4;
+				break;
+		}
+		View.RowStride = View.GetRowBytes();
+		return View;
+	}
+
+	void RepackRows(
+		const FImageView& Source,
+		EPixelLayout Layout,
+		int32 FirstRow,
+		int32 NumRows,
+		uint8* Out,
+		bool bUseVectorKernels)
+	{
+		check(Source.BytesPerPixel == 4);
+		const int32 Width = Source.Size.X;
+		const int32 Height = Source.Size.Y;
+		const int32 LastRow = FirstRow + NumRows;
+		switch (Layout)
+		{
+			case EPixelLayout::BGRA8:
+				for (int32 Y = FirstRow; Y < LastRow; ++Y)
+				{
+					FMemory::Memcpy(Out + (int64)Y * Width * 4, Source.GetRow(Y), Width * 4);
+				}
+				break;
+			case EPixelLayout::RGB8:
+				for (int32 Y = FirstRow; Y < LastRow; ++Y)
+				{
+					RowToRGB(Source.GetRow(Y), Out + (int64)Y * Width * 3, Width, bUseVectorKernels);
+				}
+				break;
+			case EPixelLayout::Y8:
+				for (int32 Y = FirstRow; Y < LastRow; ++Y)
+				{
+					RowToY(Source.GetRow(Y), Out + (int64)Y * Width, Width, bUseVectorKernels);
+				}
+				break;
+			case EPixelLayout::NV12:
+			case EPixelLayout::I420:
+			{
+				check(FirstRow % 2 == 0 && NumRows % 2 == 0);
+				const int32 ChromaWidth = Width / 2;
+				uint8* ChromaPlane = Out + (int64)Width * Height;
+				for (int32 Y = FirstRow; Y < LastRow; Y += 2)
+				{
+					const uint8* Row0 = Source.GetRow(Y);
+					const uint8* Row1 = Source.GetRow(Y + 1);
+					RowToY(Row0, Out + (int64)Y * Width, Width, bUseVectorKernels);
+					RowToY(Row1, Out + (int64)(Y + 1) * Width, Width, bUseVectorKernels);
+					const int64 ChromaRow = Y / 2;
+					if (Layout == EPixelLayout::NV12)
+					{
+						uint8* UV = ChromaPlane + ChromaRow * Width;
+						RowsToUV(Row0, Row1, UV, UV + 1, true, ChromaWidth, bUseVectorKernels);
+					}
+					else
+					{
+						uint8* U = ChromaPlane + ChromaRow * ChromaWidth;
+						uint8* V = ChromaPlane + (int64)ChromaWidth * (Height / 2) + ChromaRow * ChromaWidth;
+						RowsToUV(Row0, Row1, U, V, false, ChromaWidth, bUseVectorKernels);
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	bool Repack(
+		const FImageView& Source,
+		EPixelLayout Layout,
+		uint8* Out)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(PixelRepack::Repack);
+		SCOPE_CYCLE_COUNTER(STAT_AerosimPixelRepack);
+
+		if (Source.Data == nullptr || Source.BytesPerPixel != 4 || !IsSupported(Layout, Source.Size))
+			return false;
+
+		// Even bands, so the 4:2:0 layouts always get whole row pairs.
+		const int32 NumWorkers = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+		const int32 BandRows = Align(FMath::Max(16, FMath::DivideAndRoundUp(Source.Size.Y, NumWorkers)), 2);
+		const int32 NumBands = FMath::DivideAndRoundUp(Source.Size.Y, BandRows);
+		ParallelFor(NumBands, [&](int32 BandIndex) {
+			TRACE_CPUPROFILER_EVENT_SCOPE(PixelRepack::RepackBand);
+			const int32 FirstRow = BandIndex * BandRows;
+			RepackRows(Source, Layout, FirstRow, FMath::Min(BandRows, Source.Size.Y - FirstRow), Out);
+		});
+		return true;
+	}
+} // namespace PixelRepack
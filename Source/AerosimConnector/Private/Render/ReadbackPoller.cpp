@@ -0,0 +1,128 @@
+#include "Render/ReadbackPoller.h"
+#include "AerosimConnector.h"
+#include "Async/Async.h"
+#include "Misc/CoreDelegates.h"
+#include "RenderingThread.h"
+#include "RHIGPUReadback.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Readbacks In Flight"), STAT_AerosimReadbacksInFlight, STATGROUP_AerosimConnector);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Readbacks Dispatched"), STAT_AerosimReadbacksDispatched, STATGROUP_AerosimConnector);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Readback Latency (ms)"), STAT_AerosimReadbackLatency, STATGROUP_AerosimConnector);
+
+FReadbackPoller& FReadbackPoller::Get()
+{
+	static FReadbackPoller Instance;
+	return Instance;
+}
+
+void FReadbackPoller::Enqueue(
+	TUniquePtr<FRHIGPUTextureReadback>&& Readback,
+	FOnReadbackReady&& OnReady)
+{
+	check(IsInRenderingThread());
+	if (!PollHandle.IsValid())
+	{
+		PollHandle = FCoreDelegates::OnEndFrameRT.AddRaw(this, &FReadbackPoller::Poll);
+	}
+
+	FPendingReadback& Entry = Pending.AddDefaulted_GetRef();
+	Entry.Readback = MoveTemp(Readback);
+	Entry.OnReady = MoveTemp(OnReady);
+	Entry.EnqueueCycles = FPlatformTime::Cycles64();
+	++InFlight;
+}
+
+void FReadbackPoller::Poll()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FReadbackPoller::Poll);
+	check(IsInRenderingThread());
+
+	const uint64 NowCycles = FPlatformTime::Cycles64();
+	for (int32 Index = 0; Index < Pending.Num();)
+	{
+		FPendingReadback& Entry = Pending[Index];
+		if (!Entry.Readback->IsReady())
+		{
+			++Index;
+			continue;
+		}
+
+		RecordLatency(FPlatformTime::ToMilliseconds64(NowCycles - Entry.EnqueueCycles));
+		--InFlight;
+		++Dispatched;
+		AsyncTask(
+			ENamedThreads::AnyHiPriThreadNormalTask,
+			[this, Readback = MoveTemp(Entry.Readback), OnReady = MoveTemp(Entry.OnReady)]() mutable {
+				OnReady(MoveTemp(Readback));
+				--Dispatched;
+				++Completed;
+			});
+		// Keep the remaining readbacks in submission order.
+		Pending.RemoveAt(Index);
+	}
+
+	SET_DWORD_STAT(STAT_AerosimReadbacksInFlight, InFlight.load());
+	SET_DWORD_STAT(STAT_AerosimReadbacksDispatched, Dispatched.load());
+	SET_FLOAT_STAT(STAT_AerosimReadbackLatency, AverageLatencyMs.load());
+}
+
+void FReadbackPoller::RecordLatency(double LatencyMs)
+{
+	// Exponential moving average, roughly the last 16 readbacks.
+	constexpr double Alpha = 1.0 / 16.0;
+	const double PreviousAverage = AverageLatencyMs.load();
+	AverageLatencyMs = bHasLatencySample
+		? PreviousAverage + Alpha * (LatencyMs - PreviousAverage)
+		: LatencyMs;
+	bHasLatencySample = true;
+	LastLatencyMs = LatencyMs;
+	if (LatencyMs > MaxLatencyMs.load())
+	{
+		MaxLatencyMs = LatencyMs;
+	}
+}
+
+void FReadbackPoller::Flush()
+{
+	if (IsInRenderingThread())
+	{
+		InFlight -= Pending.Num();
+		Pending.Empty();
+		return;
+	}
+
+	ENQUEUE_RENDER_COMMAND(FlushReadbackPollerCmd)([this](FRHICommandListImmediate& CmdList) {
+		InFlight -= Pending.Num();
+		Pending.Empty();
+	});
+}
+
+void FReadbackPoller::Shutdown()
+{
+	if (PollHandle.IsValid())
+	{
+		FCoreDelegates::OnEndFrameRT.Remove(PollHandle);
+		PollHandle.Reset();
+	}
+
+	// The RHI is already gone when modules shut down, so the pending readbacks
+	// are leaked on purpose instead of being released after it.
+	for (FPendingReadback& Entry : Pending)
+	{
+		Entry.Readback.Release();
+	}
+	Pending.Empty();
+	InFlight = 0;
+}
+
+FReadbackPollerStats FReadbackPoller::GetStats() const
+{
+	FReadbackPollerStats Stats;
+	Stats.InFlight = InFlight.load();
+	Stats.Dispatched = Dispatched.load();
+	Stats.Completed = Completed.load();
+	Stats.LastLatencyMs = LastLatencyMs.load();
+	Stats.AverageLatencyMs = AverageLatencyMs.load();
+	Stats.MaxLatencyMs = MaxLatencyMs.load();
+	return Stats;
+}
@@ -0,0 +1,355 @@
+#include "Render/SensorRecorder.h"
+#include "Render/ImagePublisher.h"
+#include "Render/ImageUtil.h"
+#include "AerosimConnector.h"
+#include "HAL/Event.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "ImagePixelData.h"
+#include "ImageWriteQueue.h"
+#include "ImageWriteTask.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Frames Recorded"), STAT_AerosimFramesRecorded, STATGROUP_AerosimConnector);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Recorded Frames Dropped"), STAT_AerosimRecordedFramesDropped, STATGROUP_AerosimConnector);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Recorded Frames In Flight"), STAT_AerosimRecordedFramesInFlight, STATGROUP_AerosimConnector);
+
+static const TCHAR* GetRecordingExtension(ERecordingFormat Format)
+{
+	switch (Format)
+	{
+		case ERecordingFormat::EXR:
+			return TEXT("exr");
+		case ERecordingFormat::Raw:
+			return TEXT("raw");
+		default:
+			return TEXT("png");
+	}
+}
+
+// Converts the packed pixels of a frame and writes them, on the image write
+// queue thread pool so several frames are encoded at once.
+class FSensorRecorder::FWriteTask final : public IImageWriteTaskBase
+{
+public:
+	TSharedPtr<FRecording> Recording;
+	int64 FrameNumber = 0;
+	FString FileName; // Relative to the recording directory.
+	FIntPoint Size = FIntPoint::ZeroValue;
+	EPixelFormat Format = PF_Unknown;
+	FRecordedFrameMetadata Metadata;
+	TArray64<uint8> Pixels; // Without row padding.
+
+	virtual bool RunTask() override
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FSensorRecorder::WriteFrame);
+
+		const FString Path = Recording->Directory / FileName;
+		bool bSuccess = false;
+		if (Recording->Settings.Format == ERecordingFormat::Raw)
+		{
+			bSuccess = FFileHelper::SaveArrayToFile(Pixels, *Path);
+		}
+		else
+		{
+			FImageWriteTask ImageTask;
+			ImageTask.Filename = Path;
+			ImageTask.bOverwriteFile = true;
+			ImageTask.CompressionQuality = (int32)EImageCompressionQuality::Default;
+			bSuccess = MakePixelData(ImageTask) && ImageTask.RunTask();
+		}
+		Pixels.Empty();
+
+		const int64 Bytes = bSuccess ? IFileManager::Get().FileSize(*Path) : 0;
+		Recording->OnFrameWritten(FrameNumber, FileName, Size, Format, Metadata, bSuccess, Bytes);
+		return bSuccess;
+	}
+
+	virtual void OnAbandoned() override
+	{
+		Recording->OnFrameWritten(FrameNumber, FileName, Size, Format, Metadata, false, 0);
+	}
+
+private:
+	bool MakePixelData(FImageWriteTask& ImageTask)
+	{
+		const int64 NumPixels = (int64)Size.X * Size.Y;
+		// The pixels are packed, so the pitch is the width (in pixels).
+		const int32 Pitch = Size.X;
+		if (Recording->Settings.Format == ERecordingFormat::EXR)
+		{
+			// Float formats keep their values, e.g. depth in meters. 16-bit
+			// depth is normalized to [0, 1] over its quantization range.
+			TArray64<FLinearColor> Colors;
+			Colors.SetNumUninitialized(NumPixels);
+			if (!ImageUtil::DecodePixelsByFormat(Pixels.GetData(), Pitch, Size, Format, FReadSurfaceDataFlags(RCM_MinMax), MakeArrayView(Colors.GetData(), (int32)NumPixels)))
+			{
+				return false;
+			}
+			ImageTask.Format = EImageFormat::EXR;
+			ImageTask.PixelData = MakeUnique<TImagePixelData<FLinearColor>>(Size, MoveTemp(Colors));
+			return true;
+		}
+
+		TArray64<FColor> Colors;
+		Colors.SetNumUninitialized(NumPixels);
+		if (Format == PF_B8G8R8A8)
+		{
+			FMemory::Memcpy(Colors.GetData(), Pixels.GetData(), NumPixels * sizeof(FColor));
+		}
+		else if (!ImageUtil::DecodePixelsByFormat(Pixels.GetData(), Pitch, Size, Format, FReadSurfaceDataFlags(RCM_UNorm), MakeArrayView(Colors.GetData(), (int32)NumPixels)))
+		{
+			return false;
+		}
+		ImageTask.Format = EImageFormat::PNG;
+		ImageTask.PixelData = MakeUnique<TImagePixelData<FColor>>(Size, MoveTemp(Colors));
+		// Scene captures leave arbitrary values in alpha.
+		ImageTask.PixelPreProcessors.Add(TAsyncAlphaWrite<FColor>(255));
+		return true;
+	}
+};
+
+FSensorRecorder::FRecording::~FRecording()
+{
+	if (SpaceEvent != nullptr)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(SpaceEvent);
+	}
+	if (!IndexWriter.IsValid())
+	{
+		return;
+	}
+	IndexWriter->Close();
+
+	UE_LOG(LogAerosimConnector, Log, TEXT("FSensorRecorder: stopped recording %s to %s, %llu frames written, %llu dropped, %llu failed"),
+		*SensorId, *Directory, Written.load(), Dropped.load(), Failed.load());
+}
+
+void FSensorRecorder::FRecording::OnFrameWritten(
+	int64 FrameNumber,
+	const FString& FileName,
+	FIntPoint Size,
+	EPixelFormat Format,
+	const FRecordedFrameMetadata& Metadata,
+	bool bSuccess,
+	int64 Bytes)
+{
+	if (bSuccess)
+	{
+		const FVector Location = Metadata.Pose.GetLocation();
+		const FQuat Rotation = Metadata.Pose.GetRotation();
+		const FString Line = FString::Printf(
+			TEXT("{\"frame\":%lld,\"file\":\"%s\",\"sensor\":\"%s\",\"sim_time\":%.9f,")
+				TEXT("\"position\":[%.3f,%.3f,%.3f],\"rotation\":[%.9f,%.9f,%.9f,%.9f],")
+				TEXT("\"width\":%d,\"height\":%d,\"pixel_format\":\"%s\"}\n"),
+			FrameNumber, *FileName, *SensorId, Metadata.SimTime,
+			Location.X, Location.Y, Location.Z, Rotation.X, Rotation.Y, Rotation.Z, Rotation.W,
+			Size.X, Size.Y, GPixelFormats[Format].Name);
+		const FTCHARToUTF8 Utf8(*Line);
+		{
+			FScopeLock Lock(&IndexMutex);
+			IndexWriter->Serialize((void*)Utf8.Get(), Utf8.Length());
+		}
+		++Written;
+		BytesWritten += Bytes;
+		INC_DWORD_STAT(STAT_AerosimFramesRecorded);
+	}
+	else if (Failed++ == 0)
+	{
+		UE_LOG(LogAerosimConnector, Warning, TEXT("FSensorRecorder: failed to write %s"), *(Directory / FileName));
+	}
+
+	--InFlight;
+	DEC_DWORD_STAT(STAT_AerosimRecordedFramesInFlight);
+	SpaceEvent->Trigger();
+}
+
+FSensorRecorder& FSensorRecorder::Get()
+{
+	static FSensorRecorder Instance;
+	return Instance;
+}
+
+int32 FSensorRecorder::StartRecording(const FString& SensorId, const FSensorRecordingSettings& Settings)
+{
+	check(IsInGameThread());
+
+	if (WriteQueue == nullptr)
+	{
+		WriteQueue = &FModuleManager::LoadModuleChecked<IImageWriteQueueModule>("ImageWriteQueue").GetWriteQueue();
+	}
+
+	TSharedPtr<FRecording> Recording = MakeShared<FRecording>();
+	Recording->SensorId = SensorId;
+	Recording->Settings = Settings;
+	Recording->Settings.MaxInFlight = FMath::Max(1, Settings.MaxInFlight);
+	// Every recording gets a directory of its own, so restarting a recording
+	// never overwrites the frames or index of a previous one.
+	const FString Root = !Settings.Directory.IsEmpty() ? Settings.Directory : FPaths::ProjectSavedDir() / TEXT("Recordings");
+	const FString SessionName = FString::Printf(TEXT("%s-%s"), *SensorId, *FDateTime::Now().ToString(TEXT("%Y.%m.%d-%H.%M.%S.%s")));
+	Recording->Directory = Root / SessionName;
+	for (int32 Suffix = 1; IFileManager::Get().DirectoryExists(*Recording->Directory); ++Suffix)
+	{
+		Recording->Directory = Root / FString::Printf(TEXT("%s-%d"), *SessionName, Suffix);
+	}
+
+	if (!IFileManager::Get().MakeDirectory(*Recording->Directory, true))
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("FSensorRecorder: could not create %s"), *Recording->Directory);
+		return INDEX_NONE;
+	}
+	Recording->IndexWriter.Reset(IFileManager::Get().CreateFileWriter(*(Recording->Directory / TEXT("index.jsonl"))));
+	if (!Recording->IndexWriter.IsValid())
+	{
+		UE_LOG(LogAerosimConnector, Error, TEXT("FSensorRecorder: could not create the index in %s"), *Recording->Directory);
+		return INDEX_NONE;
+	}
+	Recording->SpaceEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Recording->StartTime = FPlatformTime::Seconds();
+
+	UE_LOG(LogAerosimConnector, Log, TEXT("FSensorRecorder: recording %s to %s as %s"),
+		*SensorId, *Recording->Directory, GetRecordingExtension(Settings.Format));
+
+	FScopeLock Lock(&Mutex);
+	const int32 RecordingId = NextRecordingId++;
+	Recordings.Add(RecordingId, MoveTemp(Recording));
+	return RecordingId;
+}
+
+void FSensorRecorder::StopRecording(int32 RecordingId)
+{
+	TSharedPtr<FRecording> Recording;
+	{
+		FScopeLock Lock(&Mutex);
+		Recordings.RemoveAndCopyValue(RecordingId, Recording);
+	}
+	if (Recording.IsValid())
+	{
+		// The index is closed once the last frame in flight has been written.
+		Recording->bStopped = true;
+		Recording->SpaceEvent->Trigger();
+	}
+}
+
+bool FSensorRecorder::RecordFrame(int32 RecordingId, const FImageView& View, EPixelFormat Format, const FRecordedFrameMetadata& Metadata)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FSensorRecorder::RecordFrame);
+
+	TSharedPtr<FRecording> Recording;
+	{
+		FScopeLock Lock(&Mutex);
+		Recording = Recordings.FindRef(RecordingId);
+	}
+	if (!Recording.IsValid())
+	{
+		return false;
+	}
+
+	// Reserve a slot, waiting for one to free up unless frames are dropped.
+	while (Recording->InFlight.fetch_add(1) >= Recording->Settings.MaxInFlight)
+	{
+		--Recording->InFlight;
+		if (Recording->Settings.bDropWhenFull || Recording->bStopped)
+		{
+			++Recording->Dropped;
+			INC_DWORD_STAT(STAT_AerosimRecordedFramesDropped);
+			return false;
+		}
+		TRACE_CPUPROFILER_EVENT_SCOPE(FSensorRecorder::WaitForSpace);
+		Recording->SpaceEvent->Wait(10);
+	}
+	INC_DWORD_STAT(STAT_AerosimRecordedFramesInFlight);
+
+	TUniquePtr<FWriteTask> Task = MakeUnique<FWriteTask>();
+	Task->Recording = Recording;
+	Task->FrameNumber = Recording->NextFrame++;
+	Task->FileName = FString::Printf(TEXT("%08lld.%s"), Task->FrameNumber, GetRecordingExtension(Recording->Settings.Format));
+	Task->Size = View.Size;
+	Task->Format = Format;
+	Task->Metadata = Metadata;
+	// Only the copy happens here, the readback buffer is released right after.
+	Task->Pixels.SetNumUninitialized(View.GetPackedBytes());
+	ImageUtil::StripRowPitch(View.Data, View.RowStride, View.Size, View.BytesPerPixel, Task->Pixels.GetData());
+
+	WriteQueue->Enqueue(MoveTemp(Task));
+	return true;
+}
+
+ERecordingFormat FSensorRecorder::ParseFormat(const FString& Name)
+{
+	if (Name.Equals(TEXT("exr")))
+	{
+		return ERecordingFormat::EXR;
+	}
+	if (Name.Equals(TEXT("raw")))
+	{
+		return ERecordingFormat::Raw;
+	}
+	return ERecordingFormat::PNG;
+}
+
+TArray<FSensorRecordingStats> FSensorRecorder::GetStats() const
+{
+	const double Now = FPlatformTime::Seconds();
+	TArray<FSensorRecordingStats> Stats;
+	FScopeLock Lock(&Mutex);
+	for (const TPair<int32, TSharedPtr<FRecording>>& Pair : Recordings)
+	{
+		const FRecording& Recording = *Pair.Value;
+		FSensorRecordingStats& Entry = Stats.AddDefaulted_GetRef();
+		Entry.SensorId = Recording.SensorId;
+		Entry.Directory = Recording.Directory;
+		Entry.Written = Recording.Written;
+		Entry.Dropped = Recording.Dropped;
+		Entry.Failed = Recording.Failed;
+		Entry.InFlight = Recording.InFlight;
+		Entry.BytesWritten = Recording.BytesWritten;
+		Entry.Seconds = Now - Recording.StartTime;
+	}
+	return Stats;
+}
+
+void FSensorRecorder::Shutdown()
+{
+	TArray<TSharedPtr<FRecording>> Stopped;
+	{
+		FScopeLock Lock(&Mutex);
+		Recordings.GenerateValueArray(Stopped);
+		Recordings.Empty();
+	}
+	for (const TSharedPtr<FRecording>& Recording : Stopped)
+	{
+		Recording->bStopped = true;
+		Recording->SpaceEvent->Trigger();
+	}
+
+	// Give the frames in flight a chance to reach the disk.
+	const double Deadline = FPlatformTime::Seconds() + 10.0;
+	for (const TSharedPtr<FRecording>& Recording : Stopped)
+	{
+		while (Recording->InFlight > 0 && FPlatformTime::Seconds() < Deadline)
+		{
+			FPlatformProcess::Sleep(0.01f);
+		}
+	}
+}
+
+static FAutoConsoleCommand RecorderStatsCommand(
+	TEXT("aerosim.Recorder.Stats"),
+	TEXT("Logs the throughput of the sensor recordings in progress."),
+	FConsoleCommandDelegate::CreateLambda([]() {
+		const TArray<FSensorRecordingStats> Stats = FSensorRecorder::Get().GetStats();
+		if (Stats.IsEmpty())
+		{
+			UE_LOG(LogAerosimConnector, Display, TEXT("Recorder: nothing is being recorded"));
+		}
+		for (const FSensorRecordingStats& Entry : Stats)
+		{
+			const double Seconds = FMath::Max(Entry.Seconds, 1e-3);
+			UE_LOG(LogAerosimConnector, Display, TEXT("Recorder: %s -> %s, %llu written (%.1f fps, %.1f MB/s), %llu dropped, %llu failed, %d in flight"),
+				*Entry.SensorId, *Entry.Directory, Entry.Written, Entry.Written / Seconds, Entry.BytesWritten / Seconds / (1024.0 * 1024.0),
+				Entry.Dropped, Entry.Failed, Entry.InFlight);
+		}
+	}));
@@ -9,6 +9,7 @@
 #include "AerosimActor.generated.h"
 
 class UTrajectoryVisualizerComponent;
+struct FTrajectoryVisualizationSettingsData;
 class UPFDWidget;
 
 UCLASS(Blueprintable)
@@ -47,6 +48,10 @@ public:
 	virtual void Tick(float DeltaTime) override;
 	inline const TArray<ObjectLabel>& GetSemanticTags() const { return SemanticTags; };
 	inline TArray<ObjectLabel>& GetSemanticTags() { return SemanticTags; };
+
+	// Writes the first semantic tag to the custom depth stencil of every
+	// primitive of the actor, where the segmentation camera reads it.
+	void ApplySemanticStencil();
 	USceneComponent* GetChildrenActorByChildName(const FString& UsdNameToSearch);
 
 	void AddRelativeTransformToChild(const FString& UsdNameToSearch, const FTransform& DeltaTransform);
@@ -64,7 +69,8 @@ public:
 	void UpdateTrajectoryVisualizer(FVector Position);
 	void UpdateTrajectoryVisualizerUserDefinedWaypoints(const TArray<FVector>& Waypoints);
 	void UpdateTrajectoryVisualizerFutureTrajectory(const TArray<FVector>& Waypoints);
-	void UpdateTrajectoryVisualizerSettings(bool bDisplayFutureTrajectory, bool bDisplayPastWaypoints, bool bHighlightUserDefinedWaypoints, uint32 NumberOfFutureWaypoints);
+	void UpdateTrajectoryVisualizerSettings(const FTrajectoryVisualizationSettingsData& Settings);
+	void RebaseTrajectoryVisualizer(const FTransform& OldToNew);
 
 	UFUNCTION(BlueprintCallable, Category = "Identification")
 	void SetWidgetID(int Id);
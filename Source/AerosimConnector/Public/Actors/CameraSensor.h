@@ -5,10 +5,13 @@
 #include "CoreMinimal.h"
 #include "Sensor.h"
 #include "IntVectorTypes.h"
+#include "Render/SensorRecorder.h"
 
 #include "CameraSensor.generated.h"
 
 class ASceneCapture2D;
+class URenderTargetPool;
+struct FImageStreamSettings;
 
 UCLASS(Blueprintable)
 class AEROSIMCONNECTOR_API ACameraSensor : public ASensor
@@ -20,6 +23,7 @@ public:
 
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:
 	virtual void Tick(float DeltaTime) override;
@@ -32,8 +36,20 @@ public:
 
 	void SetCaptureEnabled(bool bCaptureEnabledIn);
 
+	// Borrows a render target of the given size in the format of this sensor
+	// from the render target pool, returning the current one. Does nothing if
+	// the size is unchanged.
+	void InitRenderTarget(FIntPoint Size);
+
+	// Configures the publisher stream of this sensor, Label names it in the stream counters.
+	virtual void SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings);
+
+	// Starts or stops writing the frames of this sensor to disk, a change of
+	// settings starts a new recording. SensorId names it in the index.
+	void SetRecording(bool bEnable, const FString& SensorId, const FSensorRecordingSettings& Settings);
+
 protected:
-	void GetCurrentFrame();
+	virtual void GetCurrentFrame();
 
 	UPROPERTY(VisibleAnywhere, Category = "Components")
 	ASceneCapture2D* SceneCaptureActor;
@@ -41,7 +57,20 @@ protected:
 	UPROPERTY(VisibleAnywhere, Category = "Components")
 	UTextureRenderTarget2D* RenderTarget;
 
+	UPROPERTY()
+	URenderTargetPool* RenderTargetPool;
+
 	bool bCaptureEnabled = true;
 
+	// Format of the render target, set by the sensors capturing something else than color.
+	EPixelFormat RenderTargetFormat = PF_B8G8R8A8;
+
+	int32 PublishStreamId = INDEX_NONE;
+
+	int32 RecordingId = INDEX_NONE;
+	bool bRecordingStartFailed = false;
+
+	FSensorRecordingSettings RecordingSettings;
+
 	FVector2D Resolution = { 1920, 1080 };
 };
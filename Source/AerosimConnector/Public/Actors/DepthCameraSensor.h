@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Actors/CameraSensor.h"
+
+#include "DepthCameraSensor.generated.h"
+
+// Encoding of published depth frames.
+UENUM(BlueprintType)
+enum class EDepthEncoding : uint8
+{
+	Float32, // Distance to the image plane in meters.
+	UInt16	 // Distance quantized over the depth range, 0 at its near end and 65535 at its far end or beyond.
+};
+
+// Depth camera for the "sensors/depth_sensor" asset type. Captures scene depth
+// into an R32F render target and publishes it through the same asynchronous
+// readback and publisher stream as the RGB camera, as R32F or R16 frames with
+// the encoded frame header. The actor registry of the game mode (its
+// SpawnableActorTypes, set in the asset library) must map "sensors/depth_sensor"
+// to this class or a Blueprint of it.
+UCLASS(Blueprintable)
+class AEROSIMCONNECTOR_API ADepthCameraSensor : public ACameraSensor
+{
+	GENERATED_BODY()
+
+public:
+	ADepthCameraSensor();
+
+protected:
+	virtual void BeginPlay() override;
+
+public:
+	// Only the queue, region and lossless codec settings apply to depth frames.
+	virtual void SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings) override;
+
+	// Clip planes of the capture in meters.
+	void SetClipPlanes(float NearClipIn, float FarClipIn);
+
+	// Range quantized to 16 bits in meters. An empty range uses the clip planes,
+	// up to 1000 m when the far clip is off.
+	void SetDepthEncoding(EDepthEncoding EncodingIn, FVector2D RangeIn = FVector2D::ZeroVector);
+
+protected:
+	virtual void GetCurrentFrame() override;
+
+	FVector2D GetQuantizedRange() const;
+
+	EDepthEncoding Encoding = EDepthEncoding::Float32;
+
+	FVector2D Range = FVector2D::ZeroVector;
+
+	float NearClip = 0.1f;
+
+	float FarClip = 1000.0f;
+};
@@ -5,6 +5,32 @@
 #include "GameFramework/Actor.h"
 #include "DepthCaptureSensor.generated.h"
 
+// Robust statistics of the depth samples of a measurement, in centimeters.
+USTRUCT(BlueprintType)
+struct FDepthSampleStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Depth Capture")
+	float Median = -1.0f;
+
+	// Mean of the valid samples without the lowest and highest TrimFraction of them.
+	UPROPERTY(BlueprintReadOnly, Category = "Depth Capture")
+	float TrimmedMean = -1.0f;
+
+	// Share of the samples with a depth in range, e.g. not looking at the sky.
+	UPROPERTY(BlueprintReadOnly, Category = "Depth Capture")
+	float ValidRatio = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Depth Capture")
+	int32 NumSamples = 0;
+
+	// Same acceptance rule as before: more than half of the samples valid.
+	bool IsValid() const { return ValidRatio > 0.5f; }
+};
+
+// Downward looking depth probe used to measure the terrain height. The depth
+// buffer is read back once into a CPU copy and every sample is taken from it.
 UCLASS(Blueprintable)
 class AEROSIMCONNECTOR_API ADepthCaptureSensor : public AActor
 {
@@ -13,24 +39,63 @@ class AEROSIMCONNECTOR_API ADepthCaptureSensor : public AActor
 public:
     ADepthCaptureSensor();
 
+	using FOnHeightSampled = TFunction<void(const FDepthSampleStats&)>;
+
 protected:
     virtual void BeginPlay() override;
 
 public:
     virtual void Tick(float DeltaTime) override;
 
+	// Reads the depth buffer synchronously if the copy is not from this frame.
     UFUNCTION(BlueprintCallable, Category = "Depth Capture")
     float GetDistanceAtPixel(int X, int Y);
 
+	// Trimmed mean of NumSamples depths around the center, -1 if too few are
+	// valid. Reads the depth buffer synchronously if the copy is not from this frame.
     UFUNCTION(BlueprintCallable, Category = "Depth Capture")
     float SampleHeight(int NumSamples);
 
+	// Reads the depth buffer back asynchronously and calls OnSampled on the game
+	// thread with the statistics of NumSamples depths.
+	void SampleHeightAsync(int32 NumSamples, FOnHeightSampled&& OnSampled);
+
+	// Reads the depth buffer back asynchronously and calls OnRead on the game
+	// thread once the CPU copy is updated. Requests made while a readback is in
+	// flight wait for the next one, so they never see a frame captured before
+	// they were made.
+	void ReadDepthAsync(TUniqueFunction<void()>&& OnRead);
+
+	// Statistics of NumSamples depths from the last readback, weighted towards the center.
+	FDepthSampleStats ComputeHeightStats(int32 NumSamples) const;
+
+	// Median of the valid depths of the last readback in the (2 * Radius + 1)^2
+	// pixels around UV, -1 if there are none. UV (0, 0) is the top left corner.
+	float GetDepthAt(FVector2D UV, int32 Radius = 1) const;
+
+	// Position of a world location in the probe image, false outside of it.
+	bool ProjectToUV(const FVector& Location, FVector2D& OutUV) const;
+
+	// Width of the captured area in centimeters, the probe is orthographic.
+	void SetOrthoWidth(float OrthoWidth);
+	float GetOrthoWidth() const;
+
+	// Share of the valid samples dropped at each end for the trimmed mean.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Depth Capture")
+	float TrimFraction = 0.1f;
+
 protected:
     TArray<FColor> GetCurrentFrame();
 
+	// Blocking readback into the CPU copy, only used when no async one is available.
+	bool ReadDepthSync();
+
+	void IssueReadback();
+	void OnDepthReadback(TArray<float>&& Depth, FIntPoint Size);
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Components")
 	USceneComponent* SceneRootComponent;
-	
+
     UPROPERTY(VisibleAnywhere, Category="Depth Capture")
     USceneCaptureComponent2D* SceneCaptureComponent;
 
@@ -38,4 +103,14 @@ protected:
     UTextureRenderTarget2D* DepthRenderTarget;
 
 	FVector2D Resolution = {480, 480};
+
+	// Scene depth in centimeters, row-major, from frame CachedDepthFrame.
+	TArray<float> CachedDepth;
+	FIntPoint CachedDepthSize = FIntPoint::ZeroValue;
+	uint64 CachedDepthFrame = MAX_uint64;
+
+	// Callbacks of the readback in flight, and of the one issued after it.
+	TArray<TUniqueFunction<void()>> InFlightReads;
+	TArray<TUniqueFunction<void()>> QueuedReads;
+	bool bReadbackInFlight = false;
 };
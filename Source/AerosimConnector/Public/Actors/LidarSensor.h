@@ -0,0 +1,135 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Actors/Sensor.h"
+#include "Engine/EngineTypes.h"
+#include "WorldCollision.h"
+
+#include "LidarSensor.generated.h"
+
+struct FImageStreamSettings;
+
+// Scan pattern of a spinning lidar.
+USTRUCT(BlueprintType)
+struct FLidarSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar")
+	int32 Channels = 32;
+
+	// Elevation of the top and bottom channels in degrees, the channels are evenly spaced in between.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar")
+	float UpperFov = 10.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar")
+	float LowerFov = -30.0f;
+
+	// Degrees between consecutive columns of a revolution.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar")
+	float HorizontalResolution = 0.2f;
+
+	// Revolutions per second, every revolution is published as one point cloud.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar")
+	float RotationRate = 10.0f;
+
+	// Meters.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar")
+	float Range = 120.0f;
+
+	// Rays issued per frame at most, 0 for no limit. Columns over the limit are issued on the next frames.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar")
+	int32 MaxRaysPerFrame = 0;
+
+	int32 GetColumns() const { return FMath::Max(1, FMath::RoundToInt(360.0f / FMath::Max(HorizontalResolution, 0.01f))); }
+
+	bool operator==(const FLidarSettings& Other) const
+	{
+		return Channels == Other.Channels && UpperFov == Other.UpperFov && LowerFov == Other.LowerFov && HorizontalResolution == Other.HorizontalResolution
+			&& RotationRate == Other.RotationRate && Range == Other.Range && MaxRaysPerFrame == Other.MaxRaysPerFrame;
+	}
+};
+
+// Lidar for the "sensors/lidar" asset type. The revolution is swept as the
+// sensor ticks: every frame issues the columns the beam went past as a batch
+// of asynchronous line traces, which the physics scene runs on the task graph
+// and hands back on the next frame. Only collision is involved, so it works
+// with a null renderer. Complete revolutions are published through the image
+// publisher on aerosim.renderer.lidar.<sensor name> as packed float32
+// (x, y, z, intensity) points in the sensor frame, in meters, intensity derived
+// from the ObjectLabel of the surface hit. Every scan starts with the encoded
+// frame header (see ImageEncoder.h) of an XYZI32F image one row high, one
+// pixel per point.
+UCLASS(Blueprintable)
+class AEROSIMCONNECTOR_API ALidarSensor : public ASensor
+{
+	GENERATED_BODY()
+
+public:
+	ALidarSensor();
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+	virtual void Tick(float DeltaTime) override;
+
+	void SetCaptureEnabled(bool bCaptureEnabledIn) { bCaptureEnabled = bCaptureEnabledIn; }
+
+	// Restarts the revolution if the pattern changed.
+	void SetLidarSettings(const FLidarSettings& Settings);
+
+	const FLidarSettings& GetLidarSettings() const { return LidarSettings; }
+
+	// Configures the publisher stream, the pixel layout and resize options do not
+	// apply. Label is the sensor name, which the topic is derived from.
+	void SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings);
+
+	static FString GetPointCloudTopic(const FString& SensorName);
+
+	uint64 GetRaysIssued() const { return RaysIssued; }
+	uint64 GetRaysCompleted() const { return RaysCompleted; }
+	uint64 GetScansPublished() const { return ScansPublished; }
+
+protected:
+	// Revolution whose traces are in flight. Two of them alternate, so one can
+	// wait for its last traces while the next one is swept.
+	struct FScan
+	{
+		TArray<FVector4f> Points; // Per ray, W < 0 for misses.
+		int32 PendingTraces = 0;
+		bool bSwept = false;
+		uint8 Generation = 0; // Bumped on reset, results of abandoned traces are ignored.
+	};
+
+	void UpdatePattern();
+	void IssueColumns(int32 FirstColumn, int32 NumColumns);
+	void OnTraceCompleted(const FTraceHandle& Handle, FTraceDatum& Datum);
+	void PublishScan(FScan& Scan);
+	void ResetScan(FScan& Scan);
+
+	UPROPERTY(EditAnywhere, Category = "Lidar")
+	FLidarSettings LidarSettings;
+
+	bool bCaptureEnabled = true;
+
+	int32 PublishStreamId = INDEX_NONE;
+	FString PublishTopic;
+
+	// Unit ray directions in the sensor frame, per channel and per column.
+	TArray<FVector2f> ChannelSinCos;
+	TArray<FVector2f> ColumnSinCos;
+
+	FScan Scans[2];
+	int32 CurrentScan = 0;
+	int32 NextColumn = 0;
+	double ColumnBudget = 0.0;
+
+	FTraceDelegate TraceDelegate;
+	FCollisionQueryParams QueryParams;
+
+	uint64 RaysIssued = 0;
+	uint64 RaysCompleted = 0;
+	uint64 ScansPublished = 0;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Actors/CameraSensor.h"
+
+#include "SegmentationCameraSensor.generated.h"
+
+class UMaterialInterface;
+
+// Semantic segmentation camera for the "sensors/cameras/segmentation_camera"
+// asset type. The semantic tags of every AAerosimActor are written to the
+// custom depth stencil, a post process material copies the stencil to the red
+// channel and the sensor publishes that channel as one ObjectLabel per pixel,
+// run-length encoded (see LabelRLE.h). Needs r.CustomDepth 3, which
+// AAerosimGameMode sets on BeginPlay.
+UCLASS(Blueprintable)
+class AEROSIMCONNECTOR_API ASegmentationCameraSensor : public ACameraSensor
+{
+	GENERATED_BODY()
+
+public:
+	ASegmentationCameraSensor();
+
+protected:
+	virtual void BeginPlay() override;
+
+public:
+	virtual void Tick(float DeltaTime) override;
+
+	// Labels are always published as Y8, RLE unless another lossless codec is set.
+	virtual void SetPublishSettings(const FString& Label, const FImageStreamSettings& Settings) override;
+
+	// Post process material writing CustomStencil / 255 to the red channel and 0
+	// to green and blue. It must replace the tonemapper so the values reach the
+	// linear render target unaltered: the red byte of each pixel is its label.
+	// The default one is created by Content/Python/create_semantic_stencil_material.py.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Segmentation")
+	TSoftObjectPtr<UMaterialInterface> StencilMaterial;
+
+protected:
+	virtual void GetCurrentFrame() override;
+
+	// Tags can change and USD parts can load after spawning, the stencils are refreshed periodically.
+	void ApplySemanticStencils();
+
+	double LastStencilUpdateTime = -1.0;
+};
@@ -4,8 +4,10 @@
 
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
+#include "Stats/Stats.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(LogAerosimConnector, Log, All);
+DECLARE_STATS_GROUP(TEXT("AerosimConnector"), STATGROUP_AerosimConnector, STATCAT_Advanced);
 
 class FAerosimConnectorModule : public IModuleInterface
 {
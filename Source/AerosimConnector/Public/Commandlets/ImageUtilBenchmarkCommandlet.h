@@ -0,0 +1,21 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "ImageUtilBenchmarkCommandlet.generated.h"
+
+// Runs the image path microbenchmarks (see ImageBenchmark.h) and writes the
+// results as JSON, so they can be tracked on machines without a GPU:
+//   UnrealEditor-Cmd <Project>.uproject -run=ImageUtilBenchmark -nullrhi
+//     [-filter=<stage or variant>] [-output=<file>] [-minseconds=<seconds per case>]
+UCLASS()
+class AEROSIMCONNECTOR_API UImageUtilBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UImageUtilBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
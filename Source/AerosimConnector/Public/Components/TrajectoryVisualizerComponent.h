@@ -2,10 +2,11 @@
 
 #include "CoreMinimal.h"
 #include "Components/SceneComponent.h"
-#include "Components/SplineComponent.h"
-#include "Components/SplineMeshComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
 #include "TrajectoryVisualizerComponent.generated.h"
 
+struct FTrajectoryVisualizationSettingsData;
+
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
 class AEROSIMCONNECTOR_API UTrajectoryVisualizerComponent : public USceneComponent
 {
@@ -15,10 +16,14 @@ public:
 	UTrajectoryVisualizerComponent();
 
 	inline bool IsEnabled() const { return bEnabled; }
+	// Adds Position to the past trajectory when it passes the decimation of the settings.
 	void Update(FVector Position);
 	void UpdateUserDefinedWaypoints(const TArray<FVector>& Waypoints);
 	void UpdateFutureTrajectory(const TArray<FVector>& Waypoints);
-	void UpdateSettings(bool bDisplayFutureTrajectory, bool bDisplayPastWaypoints, bool bHighlightUserDefinedWaypoints, uint32 FutureWaypoints);
+	void UpdateSettings(const FTrajectoryVisualizationSettingsData& Settings);
+
+	// Moves everything drawn so far into the Unreal coordinates of a new origin.
+	void Rebase(const FTransform& OldToNew);
 
 protected:
 	virtual void BeginPlay() override;
@@ -34,17 +39,38 @@ private:
 	bool bHighlightUserDefinedWaypoints{ false };
 	UPROPERTY()
 	uint32 NumberOfFutureWaypoints{ 1 };
+	UPROPERTY(VisibleAnywhere)
+	float UpdateInterval{ 0.1f };
+	UPROPERTY(VisibleAnywhere)
+	float MinPointDistance{ 100.0f };
+	UPROPERTY(VisibleAnywhere)
+	float MaxHeadingChange{ 5.0f };
+	UPROPERTY(VisibleAnywhere)
+	float SimplifyTolerance{ 0.0f };
 
 private:
-	int32 LastSplinePointIndex{ 0 };
-	UPROPERTY()
-	USplineComponent* SplineComponent{ nullptr };
+	// The past trajectory is one instance per segment in a ring of
+	// aerosim.Trajectory.MaxPastSegments instances, the oldest segment is
+	// overwritten once it is full. Instances are relative to the component.
 	UPROPERTY()
-	TArray<USplineMeshComponent*> SplineMeshes{};
+	UInstancedStaticMeshComponent* PastTrajectoryMesh{ nullptr };
+	int32 PastSegmentCapacity{ 0 };
+	int32 NextPastSegment{ 0 };
+	FVector LastPastPoint{ FVector::ZeroVector };
+	FVector LastPastDirection{ FVector::ZeroVector };
+	double LastPastPointSeconds{ 0.0 };
+	bool bHasPastPoint{ false };
+	// Instance of the newest segment and the points it stands for, from its
+	// start, while SimplifyTolerance lets it be stretched over new points.
+	int32 LastPastSegment{ INDEX_NONE };
+	TArray<FVector> SimplifiedPoints;
+	// The future trajectory is one instance per segment, updated in place:
+	// a new path only touches the segments whose waypoints moved.
 	UPROPERTY()
-	USplineComponent* FutureSplineComponent{ nullptr };
-	UPROPERTY()
-	TArray<USplineMeshComponent*> FutureSplineMeshes{};
+	UInstancedStaticMeshComponent* FutureTrajectoryMesh{ nullptr };
+	TArray<FVector> FutureWaypoints;
+	TBitArray<> ChangedFutureWaypoints;
+	int32 NumFutureSegments{ 0 };
 	UPROPERTY()
 	TArray<UStaticMeshComponent*> UserDefinedWaypoints{};
 
@@ -63,6 +89,13 @@ private:
 
 private:
 	void DrawUserDefinedWaypoints(const TArray<FVector>& Waypoints);
-	void DrawSpline();
-	void DrawFutureSpline();
+	UInstancedStaticMeshComponent* CreateTrajectoryMesh(const TCHAR* Name);
+	bool CreatePastTrajectoryMesh();
+	void AddPastPoint(const FVector& Point);
+	int32 DrawPastSegment(const FVector& Start, const FVector& End);
+	static UStaticMesh* GetCubeMesh();
+
+	// Instance transform stretching the cube mesh from Start to End.
+	static FTransform GetSegmentTransform(const FVector& Start, const FVector& End);
+	void DrawFutureSegments();
 };
@@ -20,6 +20,8 @@ class ACesium3DTileset;
 class ACesiumCameraManager;
 class ACesiumSunSky;
 class UAerosimDataTracker;
+class URenderTargetPool;
+class UAltitudeMeasurementService;
 class AAerosimHUD;
 class AAerosimWeather;
 
@@ -46,6 +48,10 @@ public:
 
 	UFUNCTION(BlueprintCallable)
 	UCesiumTileManager* GetCesiumTileManager() { return CesiumTileManager; }
+
+	URenderTargetPool* GetRenderTargetPool() { return RenderTargetPool; }
+
+	UAltitudeMeasurementService* GetAltitudeMeasurementService() { return AltitudeMeasurementService; }
 protected:
 	virtual void BeginPlay() override;
 	virtual void Tick(float DeltaSeconds) override;
@@ -73,6 +79,12 @@ private:
 	UPROPERTY()
 	UCommandConsumer* CommandConsumer;
 
+	UPROPERTY()
+	URenderTargetPool* RenderTargetPool;
+
+	UPROPERTY()
+	UAltitudeMeasurementService* AltitudeMeasurementService;
+
 	UPROPERTY()
 	UCesiumTileManager* CesiumTileManager;
 
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "Game/Subsystems/TerrainHeightCache.h"
+
+#include "AltitudeMeasurementService.generated.h"
+
+class UCesiumTileManager;
+class APawn;
+class USceneComponent;
+
+USTRUCT(BlueprintType)
+struct FMeasureAltitudeOffsetCommandParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString UUID;
+
+	UPROPERTY()
+	double Lat = 0.0;
+
+	UPROPERTY()
+	double Lon = 0.0;
+
+	UPROPERTY()
+	double ExpectedAltitude = 0.0;
+
+	// Seconds the measurement may take once started, 0 uses aerosim.AltitudeMeasurement.TimeoutSeconds.
+	UPROPERTY()
+	double Timeout = 0.0;
+};
+
+// Where the height of a queried point came from.
+enum class ETerrainHeightSource : uint8
+{
+	Missing,
+	Cache,
+	Measured,
+};
+
+// A query_terrain_heights request, answered once all its clusters are measured.
+struct FTerrainHeightQuery
+{
+	FString UUID;
+	TArray<FVector2D> Points; // (Lat, Lon)
+	TArray<double> Heights;
+	TArray<ETerrainHeightSource> Sources;
+	int32 PendingClusters = 0;
+	bool bTimedOut = false;
+};
+
+// Unit of work of the probe: an altitude offset measurement, or the points of
+// a query close enough to be measured from a single tileset load.
+struct FAltitudeMeasurementJob
+{
+	// For clusters: the query uuid, the center and the probe altitude guess.
+	FMeasureAltitudeOffsetCommandParams Params;
+	bool bCluster = false;
+	TArray<int32> PointIndices;
+};
+
+// Stages of the measurement in progress.
+enum class EAltitudeMeasurementStage : uint8
+{
+	Idle,
+	SettleCoarse,  // Origin raised by the initial offset, waiting for the tiles.
+	MeasureCoarse, // Depth readback in flight.
+	SettleFine,	   // Origin moved close above the terrain, waiting for the finer LODs.
+	MeasureFine,   // Depth readback in flight.
+};
+
+// Serves measure_altitude_offset and query_terrain_heights commands. Jobs are
+// queued and measured one after the other, since each one moves the
+// georeference origin. A measurement raises the origin above the expected
+// altitude, waits for the tileset to settle, measures the terrain with the
+// depth probe, moves the origin close above the terrain for the finer LODs,
+// waits again and measures the final offset. Settling is decided from the
+// tileset load progress staying complete for
+// aerosim.AltitudeMeasurement.SettleFrames frames, not from fixed delays.
+//
+// Terrain height queries are answered from a cache of the heights measured so
+// far. The points it cannot answer are grouped by locality, every group is
+// measured from one tileset load and one readback of the orthographic probe
+// widened to cover it. Responses are published as each request completes.
+//
+// With aerosim.TerrainHeights.Persist the cache is kept in a file per tileset
+// source under Saved/Aerosim/TerrainHeights, so the heights measured by a
+// previous run answer both kinds of requests without loading any tile.
+UCLASS()
+class AEROSIMCONNECTOR_API UAltitudeMeasurementService : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	void SetCesiumTileManager(UCesiumTileManager* NewCesiumTileManager) { CesiumTileManager = NewCesiumTileManager; }
+	void SetSpectatorPawn(APawn* NewSpectatorPawn) { SpectatorPawn = NewSpectatorPawn; }
+
+	// Queues a measurement, a pending request with the same uuid is replaced.
+	void Enqueue(const FMeasureAltitudeOffsetCommandParams& Params);
+
+	// Answers the points found in the cache and queues measurements for the
+	// others. Heights within MaxDistance meters of measured samples are
+	// interpolated, 0 uses aerosim.TerrainHeights.InterpolationMeters.
+	void EnqueueTerrainQuery(const FString& UUID, TArray<FVector2D>&& Points, double MaxDistance, double Timeout);
+
+	void Tick(float DeltaSeconds);
+
+	// Writes the heights measured since the cache file was last saved.
+	void Shutdown();
+
+	int32 GetNumPending() const { return PendingJobs.Num() + (Stage != EAltitudeMeasurementStage::Idle ? 1 : 0); }
+
+	FTerrainHeightCache& GetHeightCache() { return HeightCache; }
+
+private:
+	void StartNext();
+	// The probe moves the origin and the spectator. They are saved before the
+	// first job and put back once the queue is drained.
+	void SaveView();
+	void RestoreView();
+	void StartProbe(double ExpectedAltitude);
+	// Moves the origin, where the probe is, above the active job at ProbeAltitude.
+	void MoveProbe(double ProbeAltitude);
+	void UpdateSettling(EAltitudeMeasurementStage NextStage);
+	void Measure();
+	void OnMeasured(uint32 Serial, double MeasuredDistance);
+	void OnClusterRead(uint32 Serial);
+	void Finish(const TCHAR* Status, double AltitudeOffset);
+	void FinishCluster();
+	void PublishQuery(FTerrainHeightQuery& Query);
+	void PublishOffset(const FMeasureAltitudeOffsetCommandParams& Params, const TCHAR* Status, double AltitudeOffset);
+
+	// Maps the cache file of the current tileset source, saving the cache of
+	// the previous source first if the tileset changed.
+	void UpdateHeightCacheFile();
+
+	// Terrain height under each point of the active cluster from the last
+	// readback, unset when unknown. Returns the number of points measured.
+	int32 ReadClusterHeights(TArray<TOptional<double>>& OutHeights) const;
+
+	UPROPERTY()
+	UCesiumTileManager* CesiumTileManager;
+
+	UPROPERTY()
+	APawn* SpectatorPawn;
+
+	TArray<FAltitudeMeasurementJob> PendingJobs;
+	TMap<FString, FTerrainHeightQuery> Queries;
+	FTerrainHeightCache HeightCache;
+	FString HeightCacheSourceKey;
+
+	FAltitudeMeasurementJob Active;
+	EAltitudeMeasurementStage Stage = EAltitudeMeasurementStage::Idle;
+	double ActiveStartTime = 0.0;
+	double ActiveTimeout = 0.0;
+	int32 SettledFrames = 0;
+	// Meters the origin is raised above the expected altitude, so the probe
+	// never starts below the terrain.
+	double DepthSensorOffset = 0.0;
+	// Heights of the active cluster after the coarse readback, kept as a
+	// fallback for the points the fine readback misses.
+	TArray<TOptional<double>> CoarseHeights;
+	// Points of the active cluster measured by the fine readback.
+	TBitArray<> FinePoints;
+	// Bumped per readback, results of an abandoned measurement are ignored.
+	uint32 MeasurementSerial = 0;
+	bool bSensorSpawned = false;
+	float DefaultOrthoWidth = 0.0f;
+
+	// Origin (Lon, Lat, Height) and spectator placement before the first job.
+	bool bViewSaved = false;
+	FVector SavedOrigin = FVector::ZeroVector;
+	TWeakObjectPtr<USceneComponent> SavedSpectatorParent;
+	FName SavedSpectatorSocket;
+	FTransform SavedSpectatorTransform;
+};
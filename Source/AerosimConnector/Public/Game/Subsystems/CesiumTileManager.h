@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Game/Subsystems/TileGovernor.h"
+#include "Game/Subsystems/TileMetrics.h"
+#include "Game/Subsystems/TilePrefetcher.h"
 
 #include "CesiumTileManager.generated.h"
 
@@ -14,6 +17,9 @@ class ACesiumSunSky;
 class ADepthCaptureSensor;
 class UWorld;
 
+// Old to new Unreal coordinates of a rebase of the origin.
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnOriginRebased, const FTransform&);
+
 UCLASS()
 class AEROSIMCONNECTOR_API UCesiumTileManager : public UObject
 {
@@ -26,9 +32,36 @@ public:
 	UFUNCTION()
 	void EndPlay();
 
+	void Tick(float DeltaSeconds);
+
+	// Tile manager of the game mode of World, null if there is none.
+	static UCesiumTileManager* Get(const UWorld* World);
+
+	// Prefetches the tiles ahead of Actor from its velocity.
+	void TrackPrefetchActor(AActor* Actor) { Prefetcher.Track(Actor); }
+
+	// Prefetches the tiles along the future trajectory of Actor, in world coordinates.
+	void SetPrefetchWaypoints(AActor* Actor, const TArray<FVector>& Waypoints) { Prefetcher.SetWaypoints(Actor, Waypoints); }
+
+	FTilePrefetcher& GetPrefetcher() { return Prefetcher; }
+
+	// Sets the tileset budget directly, fields left unset keep their value.
+	// The governor carries on from it unless bGovernorEnabled turns it off.
+	void SetTileBudget(TOptional<double> MaximumScreenSpaceError, TOptional<int64> MaximumCachedBytes,
+		TOptional<int32> MaximumSimultaneousTileLoads, TOptional<bool> bGovernorEnabled);
+
 	UFUNCTION()
 	bool LoadTileSet(double Lat, double Long, double Height);
 
+	// Moves the origin to the given coordinates. Within aerosim.Origin.RebaseMeters
+	// of the current origin the world is rebased in place: the free spectator and
+	// the listeners of OnOriginRebased keep their location on the globe, so the
+	// tiles in view stay valid. Larger jumps reset the view with LoadTileSet.
+	// Returns whether the origin was rebased in place.
+	bool MoveOrigin(double Lat, double Lon, double Height);
+
+	FOnOriginRebased& OnOriginRebased() { return OriginRebased; }
+
 	UFUNCTION()
 	bool SpawnAltitudeOffsetSensor();
 
@@ -38,6 +71,33 @@ public:
 	UFUNCTION()
 	double MeasureAltitudeOffset();
 
+	// Calls OnMeasured on the game thread with the terrain distance under the
+	// sensor in centimeters, -1 if the measurement failed, after one depth readback.
+	void MeasureAltitudeOffsetAsync(TFunction<void(double)>&& OnMeasured);
+
+	// Streams the tileset from JsonPath, a tileset directory, tileset.json or
+	// url, or from the Cesium ion asset IonId when JsonPath is empty. Applied to
+	// the live tileset, which reloads.
+	void SetTilesetSource(const FString& JsonPath, int32 IonId);
+
+	// Same from a single string: an ion asset id if numeric, else a path or url.
+	void SetTilesetSourceFromString(const FString& Source);
+
+	// Resources/SampleTileset of the plugin, a 200 m ground square at latitude
+	// and longitude 0 stored as a local tileset.json.
+	static FString GetSampleTilesetPath();
+
+	// Streams the local tileset at JsonPath, or the sample one with the origin
+	// moved onto it when empty, and logs how long it took to load its content
+	// or why it failed. Urls are refused, so it runs without network access.
+	// The previous source, origin and spectator are restored once it is done.
+	void CheckLocalTileset(const FString& JsonPath, double TimeoutSeconds);
+
+	// Limits of the persistent cache of tile requests, evicting the least
+	// recently used ones. 0 keeps the current value. Cesium reads them once per
+	// process, they are saved and apply from the next start.
+	static void ConfigureRequestCache(int32 MaxItems, int32 RequestsPerPrune);
+
 	UFUNCTION()
 	void SetCesiumJsonPath(FString CesiumPath) { CesiumJsonPath = CesiumPath; }
 
@@ -87,6 +147,16 @@ public:
 	UFUNCTION()
 	ACesium3DTileset* GetCesiumTileset() { return CesiumTileset; }
 
+	UFUNCTION()
+	ACesiumGeoreference* GetGeoReference() { return GeoReference; }
+
+	// Identifies the data the tileset streams, e.g. "ion:2275207" or "url:file:///...",
+	// empty without a tileset. Terrain measurements are only valid for the same source.
+	FString GetTilesetSourceKey() const;
+
+	// Depth probe spawned by SpawnAltitudeOffsetSensor, null when there is none.
+	ADepthCaptureSensor* GetAltitudeOffsetSensor() { return DepthCaptureActor; }
+
 	UFUNCTION(BlueprintCallable)
 	void SetCesiumEnabled(bool bEnabled);
 
@@ -108,7 +178,22 @@ private:
 	UPROPERTY()
 	UWorld* CurrentWorldReference;
 
-	UPROPERTY(EditDefaultsOnly, Category = "Cesium Tile Loader", meta = (ToolTip = "Formatted to include cesium's file:/// starter in the path. Must end with .json"))
+	FTilePrefetcher Prefetcher;
+	FTileGovernor Governor;
+	FTileMetrics Metrics;
+
+	FOnOriginRebased OriginRebased;
+
+	// A CheckLocalTileset is running, it restores the tileset when done.
+	bool bCheckingTileset = false;
+
+	// Applies CesiumJsonPath, or CesiumIonID when it is empty, to the tileset.
+	void ApplyTilesetSource();
+
+	// file:/// url of a local tileset directory or json, urls are kept as is.
+	FString ResolveTilesetUrl(const FString& JsonPath);
+
+	UPROPERTY(EditDefaultsOnly, Category = "Cesium Tile Loader", meta = (ToolTip = "Local tileset directory or tileset.json, or url. Takes precedence over the ion asset when set"))
 	FString CesiumJsonPath = "";
 
 	UPROPERTY(EditDefaultsOnly, Category = "Cesium Tile Loader", meta = (ToolTip = "Cesium id asset"))
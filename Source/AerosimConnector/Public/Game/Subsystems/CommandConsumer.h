@@ -3,30 +3,13 @@
 #include "CoreMinimal.h"
 #include "UObject/NoExportTypes.h"
 #include "Game/Subsystems/SceneGraph.h"
+#include "Game/Subsystems/AltitudeMeasurementService.h"
 #include "CommandConsumer.generated.h"
 
 class UCesiumTileManager;
 class UActorRegistry;
 class AAerosimGameMode;
 
-USTRUCT(BlueprintType)
-struct FMeasureAltitudeOffsetCommandParams
-{
-	GENERATED_BODY()
-
-	UPROPERTY()
-	FString UUID;
-
-	UPROPERTY()
-	double Lat = 0.0;
-
-	UPROPERTY()
-	double Lon = 0.0;
-
-	UPROPERTY()
-	double ExpectedAltitude = 0.0;
-};
-
 UCLASS()
 class AEROSIMCONNECTOR_API UCommandConsumer : public UObject
 {
@@ -38,6 +21,7 @@ public:
 
 	void SetActorRegistry(UActorRegistry* ActorRegistry);
 	void SetCesiumTileManager(UCesiumTileManager* NewCesiumTileManager);
+	void SetAltitudeMeasurementService(UAltitudeMeasurementService* NewAltitudeMeasurementService);
 
 	void ProcessCommandsFromQueue(float DeltaSeconds);
 
@@ -58,11 +42,13 @@ private:
 	void DeleteSensorCommand(TSharedPtr<FJsonObject> JsonObject);
 	void AttachSensorCommand(TSharedPtr<FJsonObject> JsonObject);
 	void PossessSensorCommand(TSharedPtr<FJsonObject> JsonObject);
+	void SetSensorRecordingCommand(TSharedPtr<FJsonObject> JsonObject);
 	void LoadCoordinatesCommand(TSharedPtr<FJsonObject> JsonObject);
 	void AttachSpectatorToSocketCommand(TSharedPtr<FJsonObject> JsonObject);
 	void LoadUSDInActorCommand(TSharedPtr<FJsonObject> JsonObject);
 	void AttachActorToActorWithSocketCommand(TSharedPtr<FJsonObject> JsonObject);
 	void MeasureAltitudeOffsetCommand(TSharedPtr<FJsonObject> JsonObject);
+	void QueryTerrainHeightsCommand(TSharedPtr<FJsonObject> JsonObject);
 	void VisualizeTrajectoryCommand(TSharedPtr<FJsonObject> JsonObject);
 	void VisualizeTrajectorySettingsCommand(TSharedPtr<FJsonObject> JsonObject);
 	void SetUserDefinedWaypointsCommand(TSharedPtr<FJsonObject> JsonObject);
@@ -70,11 +56,13 @@ private:
 	void LoadWeatherPreset(TSharedPtr<FJsonObject> JsonObject);
 	void SetCesiumEnabled(TSharedPtr<FJsonObject> JsonObject);
 	void SetCesiumWeatherEnabled(TSharedPtr<FJsonObject> JsonObject);
+	void SetTilesetBudgetCommand(TSharedPtr<FJsonObject> JsonObject);
 
 	// Scene graph functions
 
 	void SpawnActorsIfNeeded(FSceneGraph& SceneGraph);
 	void UpdateResourcesFromSceneGraph(const FSceneGraph& SceneGraph);
+	void UpdateSensorsFromSceneGraph(const FSceneGraph& SceneGraph);
 	void UpdateActorTransformsFromSceneGraph(const FSceneGraph& SceneGraph);
 	void UpdateEffectorsFromSceneGraph(FSceneGraph& SceneGraph);
 	void UpdatePFDsFromSceneGraph(const FSceneGraph& SceneGraph);
@@ -82,18 +70,8 @@ private:
 	void UpdateTrajectoryVisualizationUserDefinedWaypointsFromSceneGraph(const FSceneGraph& SceneGraph);
 	void UpdateTrajectoryVisualizationFutureTrajectoryWaypointsFromSceneGraph(const FSceneGraph& SceneGraph);
 
-	UFUNCTION()
-	void OnTilesetLoaded();
-
-	UFUNCTION()
-	void AdjustDepthSensorOffset();
-
-	UFUNCTION()
-	void MeasureAltitudeOffsetResponse();
-
-	FTimerHandle DepthSensorDelayTimerHandle;
-	double InitialDepthSensorOffset = 500.0;
-	double CurrentDepthSensorOffset = 0.0;
+	// Keeps the actors in the world frame in place on the globe when the origin moves.
+	void OnOriginRebased(const FTransform& OldToNew);
 
 	UPROPERTY()
 	UActorRegistry* Registry;
@@ -120,7 +98,7 @@ private:
 	double COMMAND_BUFFER_MAX_SEC = 0.05;
 
 	UPROPERTY()
-	FMeasureAltitudeOffsetCommandParams CachedMeasureAltitudeOffsetCommandParams;
+	UAltitudeMeasurementService* AltitudeMeasurementService;
 
 	FVector CachedOrigin;
 
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+
+#include "RenderTargetPool.generated.h"
+
+class UTextureRenderTarget2D;
+
+// Description of the render targets that can be handed out interchangeably.
+struct FRenderTargetKey
+{
+	FIntPoint Size = FIntPoint::ZeroValue;
+	EPixelFormat Format = PF_Unknown;
+	bool bForceLinearGamma = true;
+
+	bool operator==(const FRenderTargetKey& Other) const
+	{
+		return Size == Other.Size && Format == Other.Format && bForceLinearGamma == Other.bForceLinearGamma;
+	}
+
+	friend uint32 GetTypeHash(const FRenderTargetKey& Key)
+	{
+		return HashCombine(GetTypeHash(Key.Size), HashCombine(GetTypeHash((uint8)Key.Format), GetTypeHash(Key.bForceLinearGamma)));
+	}
+
+	// Approximate GPU memory of a target with this description.
+	int64 GetSizeBytes() const;
+};
+
+// Snapshot of the pool counters.
+struct FRenderTargetPoolStats
+{
+	int32 InUse = 0;		 // Targets borrowed by sensors.
+	int32 Idle = 0;			 // Targets waiting to be reused or trimmed.
+	int64 InUseBytes = 0;	 // Approximate GPU memory of the borrowed targets.
+	int64 IdleBytes = 0;	 // Approximate GPU memory of the idle targets.
+	uint64 Allocated = 0;	 // Targets created since the pool was created.
+	uint64 Reused = 0;		 // Acquisitions served from an idle target.
+	uint64 Trimmed = 0;		 // Idle targets released after the idle timeout.
+};
+
+USTRUCT()
+struct FPooledRenderTarget
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UTextureRenderTarget2D* Target = nullptr;
+
+	FRenderTargetKey Key;
+	double IdleSince = 0.0;
+};
+
+// Render targets shared by the sensors, keyed by resolution, pixel format and
+// gamma. Sensors borrow a target when they know their resolution and return it
+// when they are destroyed or resized, so respawning cameras reuses the GPU
+// memory instead of allocating it again. Targets that stay idle longer than
+// aerosim.RenderTargetPool.IdleSeconds are released.
+UCLASS()
+class AEROSIMCONNECTOR_API URenderTargetPool : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// Returns an idle target matching the description, or creates one.
+	UTextureRenderTarget2D* Acquire(FIntPoint Size, EPixelFormat Format, bool bForceLinearGamma = true);
+
+	// Hands a target obtained from Acquire back to the pool.
+	void Release(UTextureRenderTarget2D* Target);
+
+	// Releases the targets that have been idle for too long. Called every game frame.
+	void Tick();
+
+	// Releases every idle target.
+	void Trim();
+
+	FRenderTargetPoolStats GetStats() const;
+
+	// Finds the pool of the game mode of World, if any.
+	static URenderTargetPool* Get(const UWorld* World);
+
+private:
+	void ReleaseIdle(int32 Index);
+	void UpdateStats() const;
+
+	UPROPERTY()
+	TArray<FPooledRenderTarget> InUse;
+
+	UPROPERTY()
+	TArray<FPooledRenderTarget> Idle;
+
+	uint64 Allocated = 0;
+	uint64 Reused = 0;
+	uint64 Trimmed = 0;
+};
@@ -2,6 +2,10 @@
 
 #include "CoreMinimal.h"
 #include "UObject/NoExportTypes.h"
+#include "Render/ImagePublisher.h"
+#include "Render/SensorRecorder.h"
+#include "Actors/DepthCameraSensor.h"
+#include "Actors/LidarSensor.h"
 
 #include "SceneGraph.generated.h"
 
@@ -78,6 +82,66 @@ struct FSensorData
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
 	bool bCaptureEnabled = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	int32 PublishQueueDepth = 2;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	EImageQueuePolicy PublishQueuePolicy = EImageQueuePolicy::DropOldest;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	EPixelLayout OutputLayout = EPixelLayout::BGRA8;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	EImageCodec Codec = EImageCodec::None;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	int32 CodecQuality = 85;
+
+	// Region of the rendered frame to publish, a zero size publishes the whole frame.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	FIntPoint RoiOffset = FIntPoint::ZeroValue;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	FIntPoint RoiSize = FIntPoint::ZeroValue;
+
+	// Published extent after cropping, a zero size keeps the region size divided by Downscale.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	FIntPoint OutputResolution = FIntPoint::ZeroValue;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	int32 Downscale = 1;
+
+	// Depth sensors only, see ADepthCameraSensor.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	EDepthEncoding DepthEncoding = EDepthEncoding::Float32;
+
+	// Range in meters quantized to 16 bits, an empty range uses the clip planes.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	FVector2D DepthRange = FVector2D::ZeroVector;
+
+	// Lidars only, the camera parameters above do not apply to them.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	FLidarSettings Lidar;
+
+	// Recording is left as it is (e.g. started by a command) unless the sensor sets "record".
+	bool bRecordSet = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	bool bRecord = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	ERecordingFormat RecordFormat = ERecordingFormat::PNG;
+
+	// Empty records to Saved/Recordings.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	FString RecordDirectory;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	int32 RecordQueueDepth = 16;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor")
+	bool bRecordDropWhenFull = false;
 };
 
 USTRUCT(BlueprintType)
@@ -185,6 +249,22 @@ struct FTrajectoryVisualizationSettingsData
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Trajectory Visualization")
 	int NumberOfFutureWaypoints = 1;
+
+	// Past trajectory decimation, done per actor: a point is kept once it is
+	// MinPointDistance (m) from the previous one or turns by MaxHeadingChange
+	// (degrees), at most every UpdateInterval (s). With a SimplifyTolerance (m)
+	// the last segment is stretched over points within it of the straight line.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Trajectory Visualization")
+	float UpdateInterval = 0.1f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Trajectory Visualization")
+	float MinPointDistance = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Trajectory Visualization")
+	float MaxHeadingChange = 5.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Trajectory Visualization")
+	float SimplifyTolerance = 0.0f;
 };
 
 USTRUCT(BlueprintType)
@@ -259,6 +339,10 @@ struct FResources
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Resources")
 	FViewportConfig ViewportConfig;
+
+	// Seconds, -1 if the update carried no sim time.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Resources")
+	double SimTime = -1.0;
 	
 	bool bResourcesSet = false;
 };
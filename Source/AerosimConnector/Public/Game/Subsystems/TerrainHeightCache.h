@@ -0,0 +1,138 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+// Terrain height measured at a point, height above the ellipsoid in meters.
+struct FTerrainHeightSample
+{
+	double Lat = 0.0;
+	double Lon = 0.0;
+	double Height = 0.0;
+	// Detail of the tiles the height was measured on, higher is finer. A sample
+	// only replaces a nearby one of the same or a coarser level.
+	uint8 Lod = 0;
+};
+
+// Measured terrain heights, indexed by a grid of latitude / longitude cells so
+// a query only looks at the cells around the point. Heights between samples are
+// interpolated by inverse distance weighting of the samples in range.
+//
+// The cache can be backed by a file, see Open. The samples of the file are
+// memory mapped and searched in place, the samples added since are kept in
+// memory until Save merges them into a new file.
+class AEROSIMCONNECTOR_API FTerrainHeightCache
+{
+public:
+	// Cells of CellDegrees on a side, about 110 m of latitude for the default.
+	explicit FTerrainHeightCache(double CellDegrees = 0.001);
+	~FTerrainHeightCache();
+
+	FTerrainHeightCache(const FTerrainHeightCache&) = delete;
+	FTerrainHeightCache& operator=(const FTerrainHeightCache&) = delete;
+
+	// Adds a sample, replacing the closest sample within MergeDistance meters if
+	// it is of the same or a lower Lod, in whichever cell it lies.
+	void Add(double Lat, double Lon, double Height, uint8 Lod = 0, double MergeDistance = 0.5);
+
+	// Interpolated height from the samples within MaxDistance meters, false if
+	// there are none. A sample closer than half a meter is returned as is.
+	bool Query(double Lat, double Lon, double MaxDistance, double& OutHeight) const;
+
+	// Height of the closest sample of at least MinLod within MaxDistance meters.
+	bool FindNearest(double Lat, double Lon, double MaxDistance, double& OutHeight, uint8 MinLod = 0) const;
+
+	// Samples in memory and in the file, a sample replaced since the file was
+	// written counts twice until the next Save.
+	int32 Num() const { return NumSamples + FileSamples.Num(); }
+
+	// Drops the samples in memory and closes the file, without saving.
+	void Reset();
+
+	// Calls Visitor for every sample.
+	void ForEachSample(TFunctionRef<void(const FTerrainHeightSample&)> Visitor) const;
+
+	// Backs the cache with the file at Path, replacing the samples in memory.
+	// The file is mapped if it was written for the same SourceHash, cell size
+	// and Precision, otherwise it is replaced on the next Save. Positions are
+	// stored on a grid of Precision degrees. Returns whether samples were mapped.
+	bool Open(const FString& Path, uint64 SourceHash, double Precision);
+
+	// Writes the samples of the file and the ones in memory to a new file and
+	// maps it. The samples in memory are dropped once the new file is mapped.
+	bool Save();
+
+	bool IsOpen() const { return !FilePath.IsEmpty(); }
+
+	// Samples added since the file was written.
+	bool IsDirty() const { return NumSamples > 0; }
+
+	// Local east / north distance in meters between two nearby points.
+	static FVector2D GetOffsetMeters(double FromLat, double FromLon, double ToLat, double ToLon);
+
+private:
+	using FCell = TArray<FTerrainHeightSample, TInlineAllocator<4>>;
+
+	// On disk layout: a header, the cells sorted by key, then the samples of
+	// every cell in a row. Cells point into the samples by index.
+	struct FFileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint64 SourceHash;
+		double CellDegrees;
+		double Precision;
+		uint32 NumCells;
+		uint32 NumSamples;
+	};
+
+	struct FFileCell
+	{
+		uint64 Key;
+		uint32 First;
+		uint32 Count;
+	};
+
+	// Position in units of Precision degrees.
+	struct FFileSample
+	{
+		int32 Lat;
+		int32 Lon;
+		float Height;
+		uint8 Lod;
+		uint8 Padding[3];
+	};
+
+	// Maps the file at FilePath if it matches the source hash, cell size and precision.
+	bool MapFile();
+	const FFileCell* FindFileCell(uint64 Key) const;
+	FTerrainHeightSample ToSample(const FFileSample& Sample) const;
+	void CloseFile();
+
+	// Cell of a point, longitudes are wrapped to [-180, 180).
+	FIntPoint GetCell(double Lat, double Lon) const;
+	int32 GetNumLonCells() const;
+	int32 WrapCellX(int32 CellX) const;
+
+	static uint64 MakeKey(FIntPoint Cell) { return ((uint64)(uint32)Cell.Y << 32) | (uint32)Cell.X; }
+
+	// Visits the keys of the cells overlapping the MaxDistance radius around the point.
+	void ForEachCellInRange(double Lat, double Lon, double MaxDistance, TFunctionRef<void(uint64)> Visitor) const;
+
+	// Visits the samples of the cells overlapping the MaxDistance radius around the point.
+	void ForEachSampleInRange(double Lat, double Lon, double MaxDistance, TFunctionRef<void(const FTerrainHeightSample&, double)> Visitor) const;
+
+	double CellDegrees;
+	TMap<uint64, FCell> Cells;
+	int32 NumSamples = 0;
+
+	FString FilePath;
+	uint64 FileSourceHash = 0;
+	double Precision = 1e-6;
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	TArrayView<const FFileCell> FileCells;
+	TArrayView<const FFileSample> FileSamples;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ACesium3DTileset;
+
+// Knobs of the tileset that trade terrain detail for frame time and memory.
+struct FTileBudget
+{
+	double MaximumScreenSpaceError = 16.0;
+	int64 MaximumCachedBytes = 0;
+	int32 MaximumSimultaneousTileLoads = 0;
+
+	bool operator==(const FTileBudget& Other) const
+	{
+		return MaximumScreenSpaceError == Other.MaximumScreenSpaceError && MaximumCachedBytes == Other.MaximumCachedBytes
+			&& MaximumSimultaneousTileLoads == Other.MaximumSimultaneousTileLoads;
+	}
+	bool operator!=(const FTileBudget& Other) const { return !(*this == Other); }
+};
+
+// Adjusts the tileset budget to hold aerosim.TileGovernor.TargetFrameMs and
+// aerosim.TileGovernor.MaxMemoryMB. The frame time is the slowest of the game,
+// render and GPU threads, smoothed over about a second, so waiting for vsync
+// or a frame rate cap does not count. Over the memory ceiling or the frame
+// target the screen-space error is raised and the loads throttled; well under
+// the target detail is given back step by step, down to the finer of the
+// cvar limits and the budget the user set. Each adjustment is logged with the
+// metric that triggered it.
+class AEROSIMCONNECTOR_API FTileGovernor
+{
+public:
+	void Tick(ACesium3DTileset* Tileset, float DeltaSeconds);
+
+	static FTileBudget GetBudget(const ACesium3DTileset* Tileset);
+
+	// Sets the budget directly, the governor carries on from it when enabled.
+	static void ApplyBudget(ACesium3DTileset* Tileset, const FTileBudget& Budget);
+
+	// Same, and the governor may give detail back up to it, beyond its own limits.
+	void SetUserBudget(ACesium3DTileset* Tileset, const FTileBudget& Budget);
+
+	static void SetEnabled(bool bEnabled);
+
+private:
+	double SmoothedFrameMs = 0.0;
+	double SecondsSinceAdjustment = 0.0;
+	// Budget set by the user, or the one of the tileset when first ticked.
+	TOptional<FTileBudget> UserBudget;
+};
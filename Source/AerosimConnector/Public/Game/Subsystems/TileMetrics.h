@@ -0,0 +1,88 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+
+class ACesium3DTileset;
+
+// Tile streaming figures of one publishing window.
+struct FTileMetricsWindow
+{
+	double Seconds = 0.0;
+	// Tileset ticks timed in the window and their total and longest duration.
+	int32 Ticks = 0;
+	double TickSeconds = 0.0;
+	double MaxTickSeconds = 0.0;
+	// Tiles that finished loading and were unloaded in the window.
+	int32 TilesLoaded = 0;
+	int32 TilesEvicted = 0;
+	// Load latencies in milliseconds, a uniform sample of the loads of the window.
+	TArray<float> LoadLatenciesMs;
+	int32 LoadsSeen = 0;
+};
+
+// Measures the tile streaming of the tileset and reports it as stat counters
+// and, every aerosim.TileMetrics.PublishSeconds, as a tile_metrics message on
+// the renderer responses topic. aerosim.TileMetrics.Level tiers the overhead:
+//   0 measures nothing.
+//   1 costs a few reads per frame: resident tiles and bytes, pending requests
+//     derived from the load progress, and the tileset tick time. The actor tick
+//     of the tileset is left in place and timed by two tick functions of its
+//     group around it, one its prerequisite and one depending on it, all three
+//     run first in the group. Loads and evictions are the net changes of the
+//     resident tiles.
+//   2 also walks the tile tree every frame to count each load and eviction and
+//     time the loads from their start to completion, for diagnosis.
+class AEROSIMCONNECTOR_API FTileMetrics
+{
+public:
+	FTileMetrics();
+
+	FTileMetrics(const FTileMetrics&) = delete;
+	FTileMetrics& operator=(const FTileMetrics&) = delete;
+
+	void Tick(ACesium3DTileset* Tileset, float DeltaSeconds);
+
+	// Stops timing the tileset tick and clears the window.
+	void Reset(ACesium3DTileset* Tileset);
+
+private:
+	// Start or end of the timed tileset tick.
+	struct FTilesetTickBracket : public FTickFunction
+	{
+		FTileMetrics* Metrics = nullptr;
+		bool bEnd = false;
+
+		virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+		virtual FString DiagnosticMessage() override { return bEnd ? TEXT("FTileMetrics::TilesetTickEnd") : TEXT("FTileMetrics::TilesetTickStart"); }
+	};
+
+	// Per tile state of the level 2 walk.
+	struct FTrackedTile
+	{
+		// When the tile was first seen loading, negative if it was first seen loaded.
+		double LoadStartSeconds = -1.0;
+		bool bLoaded = false;
+		uint32 Walk = 0;
+	};
+
+	void TimeTilesetTick(bool bEnabled, ACesium3DTileset* Tileset);
+	void WalkTiles(const ACesium3DTileset* Tileset);
+	void AddLoadLatency(double Milliseconds);
+	void Publish(const ACesium3DTileset* Tileset, int32 Level);
+
+	FTilesetTickBracket TilesetTickStart;
+	FTilesetTickBracket TilesetTickEnd;
+	TWeakObjectPtr<ACesium3DTileset> TimedTileset;
+	bool bTimingTilesetTick = false;
+	// Priority of the actor tick before it was timed, restored after.
+	bool bTimedTickHighPriority = false;
+	uint64 TilesetTickStartFrame = MAX_uint64;
+	uint64 TilesetTickStartCycles = 0;
+
+	TMap<const void*, FTrackedTile> TrackedTiles;
+	uint32 WalkSerial = 0;
+	int32 LastResidentTiles = -1;
+
+	FTileMetricsWindow Window;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+class ACesium3DTileset;
+
+struct FTilePrefetchStats
+{
+	// Virtual cameras registered with the tileset this frame.
+	int32 Views = 0;
+	int32 Targets = 0;
+	// Frames the tileset was checked with the prefetch views removed, and how
+	// many of them it still had tiles to load for the real cameras.
+	uint64 SampledFrames = 0;
+	uint64 MissedFrames = 0;
+	// Frames prefetching was suspended because the resident tiles exceeded the budget.
+	uint64 OverBudgetFrames = 0;
+
+	double GetMissRatio() const { return SampledFrames > 0 ? (double)MissedFrames / SampledFrames : 0.0; }
+};
+
+// Loads tiles ahead of moving actors. Every tracked actor gets virtual cameras
+// registered with the tileset camera manager along its predicted corridor:
+// the future trajectory waypoints when there are some, its smoothed velocity
+// otherwise, up to aerosim.TilePrefetch.LookaheadSeconds ahead. Cesium then
+// selects and loads the tiles of these views like those of a real camera.
+//
+// aerosim.TilePrefetch.MaxViews limits the number of views, not the tile
+// requests they cause. They are shared between the actors, the remainder going
+// to different actors every frame. The views are withdrawn while the tile data resident in memory exceeds
+// aerosim.TilePrefetch.MaxMegabytes so prefetching never evicts what the
+// cameras need. Every aerosim.TilePrefetch.SampleFrames frames the views are
+// removed for a frame and the tileset load progress tells whether the real
+// cameras are looking at tiles not loaded yet.
+class AEROSIMCONNECTOR_API FTilePrefetcher
+{
+public:
+	// Starts predicting the motion of Actor, if not already tracked.
+	void Track(AActor* Actor);
+
+	// Upcoming waypoints of Actor in world coordinates, an empty array falls back to its velocity.
+	void SetWaypoints(AActor* Actor, const TArray<FVector>& Waypoints);
+
+	void Tick(ACesium3DTileset* Tileset, float DeltaSeconds);
+
+	// Moves the predictions into the Unreal coordinates of a new origin.
+	void Rebase(const FTransform& OldToNew);
+
+	// Removes the views from the tileset and forgets the tracked actors.
+	void Reset(ACesium3DTileset* Tileset);
+
+	const FTilePrefetchStats& GetStats() const { return Stats; }
+	void ResetStats();
+
+private:
+	struct FTarget
+	{
+		TWeakObjectPtr<AActor> Actor;
+		TArray<FVector> Waypoints;
+		FVector LastLocation = FVector::ZeroVector;
+		FVector Velocity = FVector::ZeroVector;
+		bool bHasLocation = false;
+		TArray<int32> ViewIds;
+	};
+
+	void UpdateVelocity(FTarget& Target, float DeltaSeconds) const;
+
+	// Points along the predicted corridor of Target, each with its direction of travel.
+	void PredictViews(const FTarget& Target, int32 NumViews, TArray<TPair<FVector, FVector>>& OutViews) const;
+
+	void RemoveViews(ACesium3DTileset* Tileset, FTarget& Target) const;
+
+	TArray<FTarget> Targets;
+	FTilePrefetchStats Stats;
+	uint64 FrameCounter = 0;
+	// The views were removed last frame to sample the load progress of the real cameras.
+	bool bSampling = false;
+};
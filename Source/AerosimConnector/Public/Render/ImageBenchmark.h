@@ -0,0 +1,52 @@
+#pragma once
+
+#include <CoreMinimal.h>
+
+// CPU-only microbenchmarks of the camera image path: pixel decoding, pitch
+// stripping, repacking, resizing, label run-length coding (checked to
+// round-trip), encoding and loopback publishing (checked to see the packed
+// frame, with the bytes the transport copies), run over synthetic pitched
+// buffers so they work without a GPU (e.g. in a -nullrhi commandlet).
+namespace ImageBenchmark
+{
+	struct FBenchmarkResult
+	{
+		FString Stage;	 // decode, pitch_strip, repack, resize, rle, encode or publish.
+		FString Variant; // Format, layout or codec being measured, and the path used.
+		FIntPoint Size = FIntPoint::ZeroValue;
+		int32 Iterations = 0;
+		double SecondsPerIteration = 0.0;
+		int64 InputBytes = 0; // Bytes of pixels read per iteration, row padding excluded.
+		int64 BytesCopied = 0; // Bytes copied per iteration by the transport, publish stage only.
+		// Whether the case has a correctness check (decode paths agree, labels
+		// round-trip, published pixels match) and whether it passed.
+		bool bChecked = false;
+		bool bCheckPassed = false;
+
+		double GetGigabytesPerSecond() const { return SecondsPerIteration > 0.0 ? InputBytes / SecondsPerIteration / 1e9 : 0.0; }
+		double GetNanosecondsPerPixel() const { return SecondsPerIteration * 1e9 / FMath::Max<int64>(1, (int64)Size.X * Size.Y); }
+	};
+
+	struct FBenchmarkOptions
+	{
+		double MinSeconds = 0.2; // Minimum measured time of each case.
+		int32 MinIterations = 3;
+		FString Filter;			 // Only stages or variants containing this are run, empty runs everything.
+	};
+
+	// Runs every case of the suite at resolutions from 320x240 to 3840x2160.
+	void RunSuite(const FBenchmarkOptions& Options, TArray<FBenchmarkResult>& OutResults);
+
+	// Writes the results and a description of the machine as JSON, and the
+	// throughput table next to it as Markdown.
+	bool WriteResults(const TArray<FBenchmarkResult>& Results, const FString& Path);
+
+	// Markdown throughput table of the results, one row per case.
+	FString FormatTable(const TArray<FBenchmarkResult>& Results);
+
+	// Number of results whose correctness check failed.
+	int32 CountFailedChecks(const TArray<FBenchmarkResult>& Results);
+
+	// Saved/Benchmarks/ImageUtil-<timestamp>.json
+	FString GetDefaultResultsPath();
+} // namespace ImageBenchmark
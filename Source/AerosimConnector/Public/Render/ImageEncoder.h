@@ -0,0 +1,73 @@
+#pragma once
+
+#include <CoreMinimal.h>
+
+#include "Render/PixelRepack.h"
+
+#include "ImageEncoder.generated.h"
+
+struct FImageView;
+
+// Codec applied to camera frames before they are published.
+UENUM(BlueprintType)
+enum class EImageCodec : uint8
+{
+	None, // Raw pixels, published as before unless the layout is repacked.
+	LZ4,  // Lossless and fast.
+	JPEG, // Lossy, BGRA8 and Y8 layouts only.
+	RLE	  // Label runs (see LabelRLE.h), Y8 layout only.
+};
+
+struct FImageEncodeSettings
+{
+	EImageCodec Codec = EImageCodec::None;
+	int32 Quality = 85; // JPEG quality, 1-100.
+	int32 BandRows = 0; // Rows per independently encoded band, 0 picks one from the worker count.
+
+	bool operator==(const FImageEncodeSettings& Other) const
+	{
+		return Codec == Other.Codec && Quality == Other.Quality && BandRows == Other.BandRows;
+	}
+};
+
+// Encoded frames start with a little-endian header:
+//   uint32 Magic ('AIMG'), uint16 Version, uint8 Codec, uint8 Quality,
+//   uint32 Width, uint32 Height, uint8 Layout, uint8 BytesPerPixel, uint16 NumBands,
+// followed by NumBands (uint32 Rows, uint32 EncodedBytes) entries and then the
+// encoded bands, top to bottom. Each band is an independent LZ4 block, JPEG
+// image, set of label runs or run of raw bytes, so clients can decode them in
+// parallel as well.
+// Width and Height are the image extent, band rows count rows of the packed
+// layout (see PixelRepack::GetPackedView).
+namespace ImageEncoder
+{
+	constexpr uint32 HeaderMagic = 0x474D4941; // 'AIMG'
+	constexpr uint16 HeaderVersion = 2;
+
+	// Size of the header of a frame stored as a single raw band.
+	constexpr int64 RawHeaderBytes = 20 + 8;
+
+	// Loads the codec modules. Must be called from the game thread.
+	void Startup();
+
+	// Encodes Image into Out, splitting it in row bands encoded on the task graph.
+	bool Encode(
+		const FImageView& Image,			   // Packed view of the image to encode, may have padded rows.
+		EPixelLayout Layout,				   // Layout of the image.
+		const FImageEncodeSettings& Settings, // Codec and its parameters.
+		TArray64<uint8>& Out				   // Receives the header and the encoded bands.
+	);
+
+	// Writes the RawHeaderBytes header of an uncompressed frame, so its pixels
+	// can be repacked right after it without an extra copy.
+	void WriteRawHeader(
+		FIntPoint Size,		 // Image extent.
+		EPixelLayout Layout, // Layout of the pixels following the header.
+		uint8* Out			 // Receives RawHeaderBytes bytes.
+	);
+
+	// Whether Codec can encode images of the given layout.
+	bool IsSupported(EImageCodec Codec, EPixelLayout Layout);
+
+	const TCHAR* GetCodecName(EImageCodec Codec);
+} // namespace ImageEncoder
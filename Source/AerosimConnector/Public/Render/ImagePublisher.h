@@ -0,0 +1,248 @@
+#pragma once
+
+#include <CoreMinimal.h>
+#include <HAL/Event.h>
+#include <HAL/Runnable.h>
+#include <Templates/Function.h>
+
+#include "Render/ImageEncoder.h"
+
+#include <atomic>
+
+#include "ImagePublisher.generated.h"
+
+class FRunnableThread;
+
+// What a stream does with a new frame when its queue is already full.
+UENUM(BlueprintType)
+enum class EImageQueuePolicy : uint8
+{
+	DropOldest, // Discard the oldest queued frame to make room.
+	DropNewest, // Discard the incoming frame.
+	Block		// Wait on the producer thread until the queue has room.
+};
+
+// Non-owning view of an image, typically pointing straight into a mapped
+// readback buffer whose rows are padded up to the GPU row pitch.
+struct FImageView
+{
+	const uint8* Data = nullptr;
+	int32 RowStride = 0;	 // Number of bytes between the start of consecutive rows.
+	int32 BytesPerPixel = 4; // Number of bytes per pixel.
+	FIntPoint Size = FIntPoint::ZeroValue;
+
+	int32 GetRowBytes() const { return Size.X * BytesPerPixel; }
+	int64 GetPackedBytes() const { return (int64)GetRowBytes() * Size.Y; }
+	bool IsContiguous() const { return RowStride == GetRowBytes(); }
+	const uint8* GetRow(int32 Y) const { return Data + (int64)Y * RowStride; }
+};
+
+// Destination for published images. Transports receive the image with its row
+// stride, so padded rows are gathered once by the transport itself instead of
+// being repacked into a temporary array beforehand.
+class AEROSIMCONNECTOR_API IImageTransport
+{
+public:
+	virtual ~IImageTransport() = default;
+
+	// Publishes Image on Topic. Called from task-graph worker threads.
+	virtual bool Publish(const char* Topic, const FImageView& Image) = 0;
+
+	// Publishes an encoded frame (see ImageEncoder.h) of the given extent on Topic.
+	virtual bool PublishEncoded(const char* Topic, FIntPoint Size, const uint8* Data, int64 Bytes) = 0;
+
+	uint64 GetFramesPublished() const { return FramesPublished.load(); }
+	uint64 GetBytesPublished() const { return BytesPublished.load(); }
+	// Bytes copied by the transport to gather padded rows.
+	uint64 GetBytesCopied() const { return BytesCopied.load(); }
+
+protected:
+	// Copies the padded rows of Image into a per-thread scratch buffer that is
+	// reused across frames, and returns it. Contiguous images are returned as is.
+	const uint8* GatherRows(const FImageView& Image);
+
+	std::atomic<uint64> FramesPublished{ 0 };
+	std::atomic<uint64> BytesPublished{ 0 };
+	std::atomic<uint64> BytesCopied{ 0 };
+};
+
+// Publishes images through aerosim-world-link. The library expects a single
+// contiguous buffer, so padded images are gathered into a per-thread scratch
+// buffer that is reused across frames.
+class AEROSIMCONNECTOR_API FWorldLinkImageTransport : public IImageTransport
+{
+public:
+	virtual bool Publish(const char* Topic, const FImageView& Image) override;
+	virtual bool PublishEncoded(const char* Topic, FIntPoint Size, const uint8* Data, int64 Bytes) override;
+};
+
+// Local stand-in for the world-link transport. It consumes every row in place
+// and drops the frame, which allows measuring the capture pipeline (and the
+// bytes it copies) without a message broker. With bGatherRows it gathers
+// padded rows into one buffer first, as world-link requires.
+class AEROSIMCONNECTOR_API FLoopbackImageTransport : public IImageTransport
+{
+public:
+	explicit FLoopbackImageTransport(bool bInGatherRows = false)
+		: bGatherRows(bInGatherRows) {}
+
+	virtual bool Publish(const char* Topic, const FImageView& Image) override;
+	virtual bool PublishEncoded(const char* Topic, FIntPoint Size, const uint8* Data, int64 Bytes) override;
+
+	// Checksum of the last published frame, so the rows are actually read.
+	uint32 GetLastChecksum() const { return LastChecksum.load(); }
+
+private:
+	const bool bGatherRows;
+	std::atomic<uint32> LastChecksum{ 0 };
+};
+
+namespace ImagePublisher
+{
+	// Returns the transport selected by the aerosim.ImagePublish.Loopback console variable.
+	IImageTransport& GetTransport();
+
+	// Publishes Image on Topic through the current transport.
+	bool PublishImage(
+		const char* Topic,		// Topic to publish to.
+		const FImageView& Image // Image to publish, may have padded rows.
+	);
+
+	// Publishes an encoded frame on Topic through the current transport.
+	bool PublishEncodedImage(
+		const char* Topic,			 // Topic to publish to.
+		FIntPoint Size,				 // Extent of the encoded image.
+		const TArray64<uint8>& Data	 // Output of ImageEncoder::Encode.
+	);
+} // namespace ImagePublisher
+
+// Frame waiting in a publisher queue. The pixels stay in the locked readback
+// buffer; the frame unlocks it when destroyed, i.e. once it has been published
+// or dropped.
+struct FImageFrame
+{
+	FImageView View;
+	// Layout of View. BGRA8 frames may be resized and repacked as their stream
+	// requests, the others (e.g. depth) are published as they are.
+	EPixelLayout Layout = EPixelLayout::BGRA8;
+	TUniqueFunction<void()> Release;
+
+	FImageFrame() = default;
+	~FImageFrame()
+	{
+		if (Release)
+			Release();
+	}
+	UE_NONCOPYABLE(FImageFrame);
+
+	// Frame of packed rows holding Pixels until it is released.
+	static TUniquePtr<FImageFrame> MakeOwning(TArray64<uint8>&& Pixels, FIntPoint Size, int32 BytesPerPixel, EPixelLayout Layout);
+};
+
+struct FImageStreamSettings
+{
+	int32 QueueDepth = 2;
+	EImageQueuePolicy Policy = EImageQueuePolicy::DropOldest;
+	EPixelLayout Layout = EPixelLayout::BGRA8;
+	FImageEncodeSettings Encode;
+	FIntRect Roi;								 // Region of the frame to publish, empty for the whole frame.
+	FIntPoint OutputSize = FIntPoint::ZeroValue; // Published extent, zero keeps the size of the region.
+	int32 Downscale = 1;						 // Divides the region size when OutputSize is zero.
+
+	bool operator==(const FImageStreamSettings& Other) const
+	{
+		return QueueDepth == Other.QueueDepth && Policy == Other.Policy && Layout == Other.Layout && Encode == Other.Encode
+			&& Roi == Other.Roi && OutputSize == Other.OutputSize && Downscale == Other.Downscale;
+	}
+	bool operator!=(const FImageStreamSettings& Other) const { return !(*this == Other); }
+
+	// Extent of the published image for a Size frame, before any repacking.
+	FIntPoint GetOutputSize(FIntPoint Size) const;
+};
+
+// Snapshot of the counters of a single publisher stream.
+struct FImageStreamStats
+{
+	FString Label;
+	uint64 Captured = 0;  // Frames handed to the stream.
+	uint64 Published = 0; // Frames sent through the transport.
+	uint64 Dropped = 0;	  // Frames discarded because the queue was full.
+	int32 Queued = 0;	  // Frames currently waiting in the queue.
+	uint64 RawBytes = 0;	  // Size of the published frames before encoding.
+	uint64 EncodedBytes = 0; // Size of the published frames after encoding.
+};
+
+// Publishes images on a dedicated thread, so a slow transport never holds the
+// readback workers or the renderer. Each sensor owns a stream with a bounded
+// queue; streams are served round-robin.
+class AEROSIMCONNECTOR_API FImagePublisher : public FRunnable
+{
+public:
+	static FImagePublisher& Get();
+
+	// Creates a stream and returns its id. Starts the publisher thread if needed.
+	int32 RegisterStream(
+		const FString& Label,				 // Name reported in the stream counters.
+		const FString& Topic,				 // Topic the frames are published on.
+		const FImageStreamSettings& Settings // Queue depth and overflow policy.
+	);
+
+	void UpdateStream(int32 StreamId, const FString& Label, const FImageStreamSettings& Settings);
+
+	// Removes a stream and drops its queued frames.
+	void UnregisterStream(int32 StreamId);
+
+	// Queues Frame on the stream. Returns false if the frame was dropped.
+	// Called from the readback workers.
+	bool Submit(int32 StreamId, TUniquePtr<FImageFrame>&& Frame);
+
+	TArray<FImageStreamStats> GetStreamStats() const;
+
+	// Stops the publisher thread. Called on module shutdown.
+	void Shutdown();
+
+	//~ Begin FRunnable Interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	//~ End FRunnable Interface
+
+private:
+	struct FStream
+	{
+		FString Label;
+		FString Topic;
+		FImageStreamSettings Settings;
+		FImageStreamSettings RequestedSettings; // As passed in, before validation.
+		TArray<TUniquePtr<FImageFrame>> Queue;
+		// Signalled when a frame leaves the queue, wakes a producer blocked on it.
+		FEventRef SpaceEvent;
+		uint64 Captured = 0;
+		uint64 Published = 0;
+		uint64 Dropped = 0;
+		uint64 RawBytes = 0;
+		uint64 EncodedBytes = 0;
+	};
+
+	// Pops the next frame to publish, visiting the streams round-robin.
+	TSharedPtr<FStream> PopNextFrame(TUniquePtr<FImageFrame>& OutFrame, FImageStreamSettings& OutSettings);
+	// Repacks and encodes Frame as configured, returns the number of bytes published or -1.
+	int64 PublishFrame(const FString& Topic, TUniquePtr<FImageFrame>&& Frame, const FImageStreamSettings& Settings);
+	void PublishStats();
+
+	mutable FCriticalSection Mutex;
+	TMap<int32, TSharedPtr<FStream>> Streams;
+	// Ids of Streams in ascending order, the round-robin order of PopNextFrame.
+	TArray<int32> StreamOrder;
+	int32 NextStreamId = 0;
+	int32 LastServedStreamId = INDEX_NONE;
+
+	FRunnableThread* Thread = nullptr;
+	FEvent* WorkEvent = nullptr;
+	std::atomic<bool> bStopping{ false };
+	double LastStatsTime = 0.0;
+
+	// Only accessed from the publisher thread.
+	TArray64<uint8> EncodeBuffer;
+	TArray64<uint8> RepackBuffer;
+	TArray64<uint8> ResizeBuffer;
+};
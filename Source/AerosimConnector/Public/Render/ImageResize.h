@@ -0,0 +1,45 @@
+#pragma once
+
+#include <CoreMinimal.h>
+
+struct FImageView;
+
+// Cropping and downscaling of 4-byte-per-pixel frames on the CPU, applied on
+// the way from the readback buffer to the publisher so sensors can ship a
+// region or a lower resolution without re-rendering.
+namespace ImageResize
+{
+	// Returns the part of Source inside Roi, clamped to the image. The result
+	// points into Source, nothing is copied.
+	FImageView Crop(const FImageView& Source, const FIntRect& Roi);
+
+	// Resizes Source to OutputSize into Out. Sizes that are Source divided by a
+	// power of two go through repeated 2x2 box filtering (like a mip chain),
+	// any other size uses a bilinear filter.
+	bool Resize(
+		const FImageView& Source, // 4-byte-per-pixel image, may have padded rows.
+		FIntPoint OutputSize,	  // Extent of the resized image.
+		TArray64<uint8>& Out,	  // Receives the resized, packed image.
+		FImageView& OutView		  // Receives a view of Out.
+	);
+
+	// Halves Source with a 2x2 box filter into Out, which has Source.Size / 2
+	// packed pixels. Odd trailing rows and columns are dropped.
+	void HalveRows(
+		const FImageView& Source, // 4-byte-per-pixel image, may have padded rows.
+		int32 FirstRow,			  // First output row to compute.
+		int32 NumRows,			  // Number of output rows to compute.
+		uint8* Out,				  // Start of the packed output image.
+		bool bUseVectorKernels = true // False forces the scalar reference kernels.
+	);
+
+	// Bilinearly resamples Source to OutputSize into Out (packed pixels).
+	void BilinearRows(
+		const FImageView& Source, // 4-byte-per-pixel image, may have padded rows.
+		FIntPoint OutputSize,	  // Extent of the resized image.
+		int32 FirstRow,			  // First output row to compute.
+		int32 NumRows,			  // Number of output rows to compute.
+		uint8* Out,				  // Start of the packed output image.
+		bool bUseVectorKernels = true // False forces the scalar reference kernels.
+	);
+} // namespace ImageResize
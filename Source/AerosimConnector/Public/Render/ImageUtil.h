@@ -43,26 +43,62 @@ namespace ImageUtil
 			FIntPoint	 // Image extent.
 			)>;
 
+	// Callback for the strided async image reading functions below.
+	// The data points straight into the mapped readback buffer, so rows may be
+	// padded up to the GPU row pitch.
+	using ReadImageDataAsyncCallbackStrided = std::function<
+		bool(
+			const void*,  // Source image data as raw pixels array.
+			int32,		  // Number of bytes between the start of consecutive rows.
+			FIntPoint,	  // Image extent.
+			EPixelFormat  // Image pixel format.
+			)>;
+
+	// Callback for the leased async image reading functions below.
+	// The readback buffer stays mapped after the callback returns, until the
+	// provided release function is invoked (from any thread). A read that fails
+	// once issued still calls back, with null data, a zero extent and PF_Unknown.
+	using ReadImageDataAsyncCallbackLease = std::function<
+		void(
+			const void*,			// Source image data as raw pixels array.
+			int32,					// Number of bytes between the start of consecutive rows.
+			FIntPoint,				// Image extent.
+			EPixelFormat,			// Image pixel format.
+			TUniqueFunction<void()>&& // Unmaps and frees the readback buffer.
+			)>;
+
 	// Reads pixels in the specified format from a region of memory
 	// into an FColor array.
 	bool DecodePixelsByFormat(
 		const void* PixelData,		 // Image data to read from.
-		int32 SourcePitch,			 // Number of bytes per image row.
+		int32 SourcePitch,			 // Number of pixels between the start of consecutive rows.
 		FIntPoint Extent,			 // Image extent.
 		EPixelFormat Format,		 // Image pixel format.
 		FReadSurfaceDataFlags Flags, // Read image flags.
-		TArrayView<FColor> Out		 // Output array view.
+		TArrayView<FColor> Out,		 // Output array view.
+		bool bUseFastPath = true // False runs the single-threaded reference converters.
 	);
 
 	// Reads pixels in the specified format from a region of memory.
 	// into an FLinearColor array.
 	bool DecodePixelsByFormat(
 		const void* PixelData,		 // Image data to read from.
-		int32 SourcePitch,			 // Number of bytes per image row.
+		int32 SourcePitch,			 // Number of pixels between the start of consecutive rows.
 		FIntPoint Extent,			 // Image extent.
 		EPixelFormat Format,		 // Image pixel format.
 		FReadSurfaceDataFlags Flags, // Read image flags.
-		TArrayView<FLinearColor> Out // Output array view.
+		TArrayView<FLinearColor> Out, // Output array view.
+		bool bUseFastPath = true // False runs the single-threaded reference converters.
+	);
+
+	// Copies the rows of a pitched image, e.g. a mapped readback buffer, into a
+	// packed buffer, in row bands on the task graph.
+	void StripRowPitch(
+		const void* PixelData, // Image data to read from.
+		int32 SourcePitch,	   // Number of bytes per source row.
+		FIntPoint Extent,	   // Image extent.
+		int32 BytesPerPixel,   // Size of a pixel in bytes.
+		void* Out			   // Receives Extent.X * Extent.Y * BytesPerPixel bytes.
 	);
 
 	// Reads image data from a UTextureRenderTarget2D using its ReadPixels method.
@@ -86,7 +122,7 @@ namespace ImageUtil
 	);
 
 	// Reads and outputs the contents of a render target to a PNG file.
-	// Currently uses ReadImageData under the hood.
+	// Currently uses ReadImageData under the hood, the future is false if it fails.
 	TFuture<bool> SaveImageData(
 		UTextureRenderTarget2D& RenderTarget, // Render target to read from.
 		const FStringView& Path				  // Output image file path.
@@ -166,4 +202,36 @@ namespace ImageUtil
 		UTextureRenderTarget2D& RenderTarget,	 // Render target to read from.
 		ReadImageDataAsyncCallbackRaw&& Callback // Callback to invoke when the image is available.
 	);
+
+	// Asynchronously reads the contents of the specified ACameraSensor
+	// and calls the provided Callback. Uses ReadImageDataAsync underneath.
+	// This variant hands out the mapped pixels and their row stride without copying.
+	bool ReadSensorDataAsyncStrided(
+		ACameraSensor* Sensor,						 // CameraSensor to read from.
+		ReadImageDataAsyncCallbackStrided&& Callback // Callback to invoke when the image is available.
+	);
+
+	// Asynchronously reads the contents of the specified RenderTarget
+	// and calls the provided Callback. Uses ReadImageDataAsync underneath.
+	// This variant hands out the mapped pixels and their row stride without copying.
+	bool ReadImageDataAsyncStrided(
+		UTextureRenderTarget2D& RenderTarget,		 // Render target to read from.
+		ReadImageDataAsyncCallbackStrided&& Callback // Callback to invoke when the image is available.
+	);
+
+	// Asynchronously reads the contents of the specified ACameraSensor
+	// and calls the provided Callback. The mapped pixels are leased to the
+	// callee, which must invoke the release function once it is done with them.
+	bool ReadSensorDataAsyncLease(
+		ACameraSensor* Sensor,					   // CameraSensor to read from.
+		ReadImageDataAsyncCallbackLease&& Callback // Callback to invoke when the image is available.
+	);
+
+	// Asynchronously reads the contents of the specified RenderTarget
+	// and calls the provided Callback. The mapped pixels are leased to the
+	// callee, which must invoke the release function once it is done with them.
+	bool ReadImageDataAsyncLease(
+		UTextureRenderTarget2D& RenderTarget,	   // Render target to read from.
+		ReadImageDataAsyncCallbackLease&& Callback // Callback to invoke when the image is available.
+	);
 } // namespace ImageUtil
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <CoreMinimal.h>
+
+struct FImageView;
+
+// Run-length coding of label images (one byte per pixel), used for the
+// segmentation camera. Pixels are visited row-major and every run of equal
+// labels is stored as its label byte followed by its length as an unsigned
+// LEB128 varint; runs continue across rows. Aerial views are dominated by a
+// few large regions, so they shrink 20-100x.
+namespace LabelRLE
+{
+	// Upper bound of the encoded size of a Size image, every run takes at most one byte per pixel plus its label.
+	int64 GetMaxEncodedBytes(FIntPoint Size);
+
+	// Encodes Labels into Out, which must hold GetMaxEncodedBytes bytes.
+	// Returns the number of bytes written.
+	int64 Encode(
+		const FImageView& Labels, // One byte per pixel, may have padded rows.
+		uint8* Out				  // Receives the runs.
+	);
+
+	// Expands runs into NumPixels labels. Returns false if the runs are
+	// malformed or do not cover exactly NumPixels pixels.
+	bool Decode(
+		const uint8* Runs, // Output of Encode.
+		int64 Bytes,	   // Size of Runs.
+		uint8* Out,		   // Receives NumPixels labels.
+		int64 NumPixels	   // Number of pixels of the image.
+	);
+
+	// Number of bytes equal to Data[0] at the start of Data, at most Count.
+	int32 GetRunLength(const uint8* Data, int32 Count);
+} // namespace LabelRLE
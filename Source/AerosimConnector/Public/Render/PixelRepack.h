@@ -0,0 +1,59 @@
+#pragma once
+
+#include <CoreMinimal.h>
+
+#include "PixelRepack.generated.h"
+
+struct FImageView;
+
+// Pixel layout of published camera frames. RGB8 to Y8 are produced on the
+// CPU from the BGRA8 readback while the row padding is stripped. The others
+// describe frames of the depth camera and lidar as they convert them.
+UENUM(BlueprintType)
+enum class EPixelLayout : uint8
+{
+	BGRA8, // As rendered, 4 bytes per pixel.
+	RGB8,  // Alpha dropped, 3 bytes per pixel.
+	NV12,  // BT.601 Y plane followed by an interleaved half-resolution UV plane.
+	I420,  // BT.601 Y plane followed by half-resolution U and V planes.
+	Y8,	   // BT.601 luma only.
+	R32F,  // Depth in meters, one 32-bit float per pixel.
+	R16,   // Depth quantized over the depth range, one uint16 per pixel.
+	XYZI32F // Lidar points, float32 x, y, z in meters in the sensor frame and intensity, one row.
+};
+
+namespace PixelRepack
+{
+	const TCHAR* GetLayoutName(EPixelLayout Layout);
+
+	// Name of the vector kernels compiled in (AVX2, SSE4.1, NEON or Scalar).
+	const TCHAR* GetVectorKernelName();
+
+	// Whether a Size image can be repacked into Layout. The YUV 4:2:0 layouts
+	// need an even extent, the depth and point layouts are never repacked into.
+	bool IsSupported(EPixelLayout Layout, FIntPoint Size);
+
+	// Describes the repacked image as rows of bytes: RGB8 and Y8 keep the image
+	// extent, the 4:2:0 layouts are viewed as a single Width x (Height * 3 / 2)
+	// plane of 1-byte pixels.
+	FImageView GetPackedView(EPixelLayout Layout, FIntPoint Size, const uint8* Data);
+
+	// Repacks rows [FirstRow, FirstRow + NumRows) of a BGRA8 image into Out,
+	// which holds the whole packed image. FirstRow and NumRows must be even for
+	// the 4:2:0 layouts.
+	void RepackRows(
+		const FImageView& Source, // BGRA8 image, may have padded rows.
+		EPixelLayout Layout,	  // Output layout.
+		int32 FirstRow,			  // First source row to convert.
+		int32 NumRows,			  // Number of source rows to convert.
+		uint8* Out,				  // Start of the packed output image.
+		bool bUseVectorKernels = true // False forces the scalar reference kernels.
+	);
+
+	// Repacks a whole BGRA8 image into Layout, in row bands on the task graph.
+	bool Repack(
+		const FImageView& Source, // BGRA8 image, may have padded rows.
+		EPixelLayout Layout,	  // Output layout.
+		uint8* Out				  // Receives the packed image, GetPackedView(...).GetPackedBytes() bytes.
+	);
+} // namespace PixelRepack
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <CoreMinimal.h>
+#include <Templates/Function.h>
+
+#include <atomic>
+
+class FRHIGPUTextureReadback;
+
+// Snapshot of the readback poller counters.
+struct FReadbackPollerStats
+{
+	int32 InFlight = 0;			   // Readbacks still waiting for the GPU.
+	int32 Dispatched = 0;		   // Ready readbacks whose callback has not finished yet.
+	uint64 Completed = 0;		   // Readbacks completed since startup.
+	double LastLatencyMs = 0.0;	   // Enqueue-to-ready time of the most recent readback.
+	double AverageLatencyMs = 0.0; // Moving average of the enqueue-to-ready time.
+	double MaxLatencyMs = 0.0;	   // Worst enqueue-to-ready time seen so far.
+};
+
+// Owns every pending GPU texture readback of the plugin. Pending readbacks are
+// checked once per render frame (at the end of the render thread frame), and
+// each one that is ready is handed to a background worker, so no thread ever
+// spins waiting on the GPU.
+class AEROSIMCONNECTOR_API FReadbackPoller
+{
+public:
+	// Invoked on a background worker once the readback data can be mapped.
+	// Ownership of the readback is transferred to the callee.
+	using FOnReadbackReady = TUniqueFunction<void(TUniquePtr<FRHIGPUTextureReadback>&&)>;
+
+	static FReadbackPoller& Get();
+
+	// Registers a readback whose copy has already been enqueued.
+	// Must be called from the rendering thread.
+	void Enqueue(
+		TUniquePtr<FRHIGPUTextureReadback>&& Readback, // Readback with a copy in flight.
+		FOnReadbackReady&& OnReady					   // Callback to invoke when the data is available.
+	);
+
+	// Drops every pending readback without invoking its callback, e.g. when the
+	// sensors that issued them are going away.
+	void Flush();
+
+	// Unhooks the poller from the render loop. Called on module shutdown.
+	void Shutdown();
+
+	FReadbackPollerStats GetStats() const;
+
+private:
+	struct FPendingReadback
+	{
+		TUniquePtr<FRHIGPUTextureReadback> Readback;
+		FOnReadbackReady OnReady;
+		uint64 EnqueueCycles = 0;
+	};
+
+	void Poll();
+	void RecordLatency(double LatencyMs);
+
+	// Only accessed from the rendering thread.
+	TArray<FPendingReadback> Pending;
+	FDelegateHandle PollHandle;
+	bool bHasLatencySample = false;
+
+	std::atomic<int32> InFlight{ 0 };
+	std::atomic<int32> Dispatched{ 0 };
+	std::atomic<uint64> Completed{ 0 };
+	std::atomic<double> LastLatencyMs{ 0.0 };
+	std::atomic<double> AverageLatencyMs{ 0.0 };
+	std::atomic<double> MaxLatencyMs{ 0.0 };
+};
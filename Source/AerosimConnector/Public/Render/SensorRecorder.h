@@ -0,0 +1,125 @@
+#pragma once
+
+#include <CoreMinimal.h>
+
+#include <atomic>
+
+#include "SensorRecorder.generated.h"
+
+class FEvent;
+class FArchive;
+class IImageWriteQueue;
+struct FImageView;
+
+// File format of recorded frames.
+UENUM(BlueprintType)
+enum class ERecordingFormat : uint8
+{
+	PNG, // 8-bit BGRA, lossless.
+	EXR, // Linear float RGBA, for depth and HDR data.
+	Raw	 // Pixels as read back with the row padding removed, see the index for the format.
+};
+
+struct FSensorRecordingSettings
+{
+	FString Directory;							 // Each recording goes to <Directory>/<sensor>-<time>, empty is Saved/Recordings.
+	ERecordingFormat Format = ERecordingFormat::PNG;
+	int32 MaxInFlight = 16;						 // Frames copied but not yet on disk.
+	bool bDropWhenFull = false;					 // Drop new frames instead of blocking the readback worker.
+
+	bool operator==(const FSensorRecordingSettings& Other) const
+	{
+		return Directory == Other.Directory && Format == Other.Format && MaxInFlight == Other.MaxInFlight && bDropWhenFull == Other.bDropWhenFull;
+	}
+};
+
+// Where and when a frame was captured, written to the index next to it.
+struct FRecordedFrameMetadata
+{
+	double SimTime = -1.0; // Simulation time of the last scene graph update, -1 if unknown.
+	FTransform Pose;	   // Sensor pose in world space at capture time.
+};
+
+// Snapshot of the counters of a single recording.
+struct FSensorRecordingStats
+{
+	FString SensorId;
+	FString Directory;
+	uint64 Written = 0;		 // Frames on disk.
+	uint64 Dropped = 0;		 // Frames skipped because the queue was full.
+	uint64 Failed = 0;		 // Frames that could not be written.
+	int32 InFlight = 0;		 // Frames waiting to be encoded or written.
+	uint64 BytesWritten = 0; // Size of the files on disk.
+	double Seconds = 0.0;	 // Time since the recording started.
+};
+
+// Streams sensor frames to disk as numbered PNG, EXR or raw files through the
+// engine image write queue, which encodes them in parallel on the thread
+// pool. Every recording keeps an index.jsonl next to its frames with the sim
+// time, pose and sensor id of each frame written. The number of frames in
+// flight is bounded, once it is reached frames are dropped or the caller is
+// blocked until one has been written.
+class AEROSIMCONNECTOR_API FSensorRecorder
+{
+public:
+	static FSensorRecorder& Get();
+
+	// Starts a recording, returns its id. Must be called from the game thread.
+	int32 StartRecording(const FString& SensorId, const FSensorRecordingSettings& Settings);
+
+	// Stops accepting frames, the ones in flight are still written.
+	void StopRecording(int32 RecordingId);
+
+	// Copies the frame and queues it for writing. Returns false if it was
+	// dropped. Called from the readback workers.
+	bool RecordFrame(
+		int32 RecordingId,					   // Id returned by StartRecording.
+		const FImageView& View,				   // Pixels of the frame, may have padded rows.
+		EPixelFormat Format,				   // Pixel format of View.
+		const FRecordedFrameMetadata& Metadata // Capture time and pose.
+	);
+
+	TArray<FSensorRecordingStats> GetStats() const;
+
+	// "png", "exr" or "raw", anything else is PNG.
+	static ERecordingFormat ParseFormat(const FString& Name);
+
+	// Simulation time stamped on the frames recorded from now on.
+	void SetSimTime(double SimTime) { CurrentSimTime = SimTime; }
+	double GetSimTime() const { return CurrentSimTime; }
+
+	// Stops every recording and waits for the frames in flight. Called on module shutdown.
+	void Shutdown();
+
+private:
+	struct FRecording
+	{
+		~FRecording();
+
+		void OnFrameWritten(int64 FrameNumber, const FString& FileName, FIntPoint Size, EPixelFormat Format, const FRecordedFrameMetadata& Metadata, bool bSuccess, int64 Bytes);
+
+		FString SensorId;
+		FString Directory;
+		FSensorRecordingSettings Settings;
+		double StartTime = 0.0;
+		FEvent* SpaceEvent = nullptr;
+		std::atomic<bool> bStopped{ false };
+		std::atomic<int64> NextFrame{ 0 };
+		std::atomic<int32> InFlight{ 0 };
+		std::atomic<uint64> Written{ 0 };
+		std::atomic<uint64> Dropped{ 0 };
+		std::atomic<uint64> Failed{ 0 };
+		std::atomic<uint64> BytesWritten{ 0 };
+
+		FCriticalSection IndexMutex;
+		TUniquePtr<FArchive> IndexWriter;
+	};
+
+	class FWriteTask;
+
+	mutable FCriticalSection Mutex;
+	TMap<int32, TSharedPtr<FRecording>> Recordings;
+	int32 NextRecordingId = 0;
+	IImageWriteQueue* WriteQueue = nullptr;
+	std::atomic<double> CurrentSimTime{ -1.0 };
+};